@@ -39,6 +39,7 @@
 #include "m64p_debugger.h"
 #include "m64p_types.h"
 #include "main/main.h"
+#include "main/ram_search.h"
 
 unsigned int op;
 
@@ -221,12 +222,91 @@ EXPORT void * CALL DebugMemGetPointer(m64p_dbg_memptr_type mem_ptr_type)
             return g_dev.ri.regs;
         case M64P_DBG_PTR_AI_REG:
             return g_dev.ai.regs;
+        case M64P_DBG_PTR_SP_MEM:
+            return g_dev.sp.mem;
+        case M64P_DBG_PTR_ROM:
+            return g_dev.pi.cart_rom.rom;
         default:
             DebugMessage(M64MSG_ERROR, "Bug: DebugMemGetPointer() called with invalid m64p_dbg_memptr_type");
             return NULL;
     }
 }
 
+EXPORT m64p_error CALL DebugMemGetRegion(m64p_dbg_memptr_type mem_ptr_type, m64p_dbg_mem_region *region)
+{
+    if (region == NULL)
+        return M64ERR_INPUT_ASSERT;
+
+    switch (mem_ptr_type)
+    {
+        case M64P_DBG_PTR_RDRAM:
+            region->host_ptr = g_dev.ri.rdram.dram;
+            region->address = 0x80000000;
+            region->size = (unsigned int) g_dev.ri.rdram.dram_size;
+            region->writable = 1;
+            break;
+        case M64P_DBG_PTR_SP_MEM:
+            region->host_ptr = g_dev.sp.mem;
+            region->address = 0xa4000000;
+            region->size = SP_MEM_SIZE;
+            region->writable = 1;
+            break;
+        case M64P_DBG_PTR_ROM:
+            region->host_ptr = g_dev.pi.cart_rom.rom;
+            region->address = 0xb0000000;
+            region->size = (unsigned int) g_dev.pi.cart_rom.rom_size;
+            region->writable = 0;
+            break;
+        default:
+            return M64ERR_INPUT_INVALID;
+    }
+
+    if (region->host_ptr == NULL)
+        return M64ERR_INVALID_STATE;
+
+    /* stored as host endian 32-bit words */
+    region->byte_xor = S8;
+    return M64ERR_SUCCESS;
+}
+
+EXPORT m64p_error CALL DebugMemReadBlock(unsigned int address, void *buffer, unsigned int length)
+{
+#ifdef DBG
+    if (buffer == NULL)
+        return M64ERR_INPUT_ASSERT;
+    read_memory_block(address, (uint8 *) buffer, length);
+    return M64ERR_SUCCESS;
+#else
+    DebugMessage(M64MSG_ERROR, "Bug: DebugMemReadBlock() called, but Debugger not supported in Core library");
+    return M64ERR_UNSUPPORTED;
+#endif
+}
+
+EXPORT m64p_error CALL DebugMemWriteBlock(unsigned int address, const void *buffer, unsigned int length)
+{
+#ifdef DBG
+    if (buffer == NULL)
+        return M64ERR_INPUT_ASSERT;
+    write_memory_block(address, (const uint8 *) buffer, length);
+    return M64ERR_SUCCESS;
+#else
+    DebugMessage(M64MSG_ERROR, "Bug: DebugMemWriteBlock() called, but Debugger not supported in Core library");
+    return M64ERR_UNSUPPORTED;
+#endif
+}
+
+EXPORT int CALL DebugMemDiff(unsigned int address, void *snapshot, unsigned int length, m64p_dbg_mem_span *spans, int max_spans)
+{
+#ifdef DBG
+    if (snapshot == NULL || (spans == NULL && max_spans > 0))
+        return -1;
+    return (int) diff_memory_block(address, (uint8 *) snapshot, length, spans, (max_spans > 0) ? (unsigned int) max_spans : 0);
+#else
+    DebugMessage(M64MSG_ERROR, "Bug: DebugMemDiff() called, but Debugger not supported in Core library");
+    return -1;
+#endif
+}
+
 EXPORT unsigned long long CALL DebugMemRead64(unsigned int address)
 {
 #ifdef DBG
@@ -315,6 +395,37 @@ EXPORT void CALL DebugMemWrite8(unsigned int address, unsigned char value)
 #endif
 }
 
+EXPORT m64p_error CALL DebugRamSearchStart(m64p_ram_search_type type)
+{
+    return ram_search_start(type);
+}
+
+EXPORT int CALL DebugRamSearchFilter(m64p_ram_search_op op, double value)
+{
+    if (op < M64P_RAM_SEARCH_EQUAL || op > M64P_RAM_SEARCH_DECREASED)
+        return -1;
+    return (int) ram_search_filter(op, value);
+}
+
+EXPORT int CALL DebugRamSearchGetResults(int first, m64p_ram_search_result *results, int max_results)
+{
+    if (results == NULL || first < 0 || max_results < 0)
+        return -1;
+    return (int) ram_search_results((size_t) first, results, (size_t) max_results);
+}
+
+EXPORT int CALL DebugRamSearchGetCheat(unsigned int address, double value, m64p_cheat_code *codes)
+{
+    if (codes == NULL)
+        return 0;
+    return ram_search_cheat_codes(address, value, codes);
+}
+
+EXPORT void CALL DebugRamSearchStop(void)
+{
+    ram_search_stop();
+}
+
 EXPORT void * CALL DebugGetCPUDataPtr(m64p_dbg_cpu_data cpu_data_type)
 {
     switch (cpu_data_type)
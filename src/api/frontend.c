@@ -86,6 +86,7 @@ EXPORT m64p_error CALL CoreStartup(int APIVersion, const char *ConfigPath, const
     plugin_connect(M64PLUGIN_CORE, NULL);
 
     savestates_init();
+    main_pause_init();
 
     /* next, start up the configuration handling code by loading and parsing the config file */
     if (ConfigInit(ConfigPath, DataPath) != M64ERR_SUCCESS)
@@ -126,6 +127,7 @@ EXPORT m64p_error CALL CoreShutdown(void)
     ConfigShutdown();
     workqueue_shutdown();
     savestates_deinit();
+    main_pause_deinit();
 
     /* tell SDL to shut down */
     SDL_Quit();
@@ -289,6 +291,9 @@ EXPORT m64p_error CALL CoreDoCommand(m64p_command Command, int ParamInt, void *P
         case M64CMD_SET_FRAME_CALLBACK:
             g_FrameCallback = (m64p_frame_callback) ParamPtr;
             return M64ERR_SUCCESS;
+        case M64CMD_SET_VI_CALLBACK:
+            g_ViCallback = (m64p_frame_callback) ParamPtr;
+            return M64ERR_SUCCESS;
         case M64CMD_TAKE_NEXT_SCREENSHOT:
             if (!g_EmulatorRunning)
                 return M64ERR_INVALID_STATE;
@@ -313,6 +318,36 @@ EXPORT m64p_error CALL CoreDoCommand(m64p_command Command, int ParamInt, void *P
                 return M64ERR_INVALID_STATE;
             main_advance_one();
             return M64ERR_SUCCESS;
+        case M64CMD_SET_INPUT_SNAPSHOT:
+            if (ParamInt < 0 || ParamInt > 0xf)
+                return M64ERR_INPUT_INVALID;
+            if (ParamInt != 0 && ParamPtr == NULL)
+                return M64ERR_INPUT_ASSERT;
+            main_set_input_snapshot(ParamInt, (const uint32_t*)ParamPtr);
+            return M64ERR_SUCCESS;
+        case M64CMD_LOCKSTEP_COMPARE:
+            if (g_EmulatorRunning || !l_ROMOpen)
+                return M64ERR_INVALID_STATE;
+            if (ParamPtr == NULL)
+                return M64ERR_INPUT_ASSERT;
+            if (((m64p_lockstep_params*)ParamPtr)->state_path == NULL || ((m64p_lockstep_params*)ParamPtr)->steps == 0)
+                return M64ERR_INPUT_INVALID;
+            /* main_lockstep() runs the emulator two or three times and returns when done */
+            return main_lockstep((m64p_lockstep_params*)ParamPtr);
+        case M64CMD_GET_RUN_STATS:
+            if (!g_EmulatorRunning)
+                return M64ERR_INVALID_STATE;
+            if (ParamPtr == NULL)
+                return M64ERR_INPUT_ASSERT;
+            main_get_run_stats((m64p_run_stats*)ParamPtr);
+            return M64ERR_SUCCESS;
+        case M64CMD_ADVANCE_FRAMES:
+            if (!g_EmulatorRunning)
+                return M64ERR_INVALID_STATE;
+            if (ParamInt < 1)
+                return M64ERR_INPUT_INVALID;
+            /* returns once the frames have run and the emulator is paused again */
+            return main_advance_frames((unsigned int) ParamInt, 1);
         default:
             return M64ERR_INPUT_INVALID;
     }
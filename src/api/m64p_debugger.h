@@ -161,6 +161,63 @@ EXPORT void CALL DebugMemWrite16(unsigned int, unsigned short);
 EXPORT void CALL DebugMemWrite8(unsigned int, unsigned char);
 #endif
 
+/* DebugMemGetRegion()
+ *
+ * This function describes a block of emulated N64 memory stored as such in
+ * host memory (RDRAM, SP memory or cartridge ROM), so that the front-end can
+ * inspect it in place. The description includes the byte order of the storage.
+ */
+typedef m64p_error (*ptr_DebugMemGetRegion)(m64p_dbg_memptr_type, m64p_dbg_mem_region *);
+#if defined(M64P_CORE_PROTOTYPES)
+EXPORT m64p_error CALL DebugMemGetRegion(m64p_dbg_memptr_type, m64p_dbg_mem_region *);
+#endif
+
+/* DebugMemReadBlock(), DebugMemWriteBlock()
+ *
+ * These functions copy a range of the emulated N64 memory from or to a buffer
+ * of the front-end, in N64 (big-endian) byte order.
+ */
+typedef m64p_error (*ptr_DebugMemReadBlock)(unsigned int, void *, unsigned int);
+typedef m64p_error (*ptr_DebugMemWriteBlock)(unsigned int, const void *, unsigned int);
+#if defined(M64P_CORE_PROTOTYPES)
+EXPORT m64p_error CALL DebugMemReadBlock(unsigned int, void *, unsigned int);
+EXPORT m64p_error CALL DebugMemWriteBlock(unsigned int, const void *, unsigned int);
+#endif
+
+/* DebugMemDiff()
+ *
+ * This function compares a range of the emulated N64 memory with a snapshot
+ * previously taken with DebugMemReadBlock(), returns the number of runs of
+ * changed bytes and fills in as many of them as fit in the spans array. The
+ * snapshot is updated with the current memory contents.
+ */
+typedef int (*ptr_DebugMemDiff)(unsigned int, void *, unsigned int, m64p_dbg_mem_span *, int);
+#if defined(M64P_CORE_PROTOTYPES)
+EXPORT int CALL DebugMemDiff(unsigned int, void *, unsigned int, m64p_dbg_mem_span *, int);
+#endif
+
+/* DebugRamSearch*()
+ *
+ * These functions search RDRAM for values of a given type, by successive
+ * filtering: DebugRamSearchStart() takes every aligned value as a candidate,
+ * and each DebugRamSearchFilter() keeps those passing a test, returning how
+ * many are left. DebugRamSearchGetResults() retrieves candidates with their
+ * current value, and DebugRamSearchGetCheat() turns a candidate and the value
+ * to force into codes for CoreAddCheat().
+ */
+typedef m64p_error (*ptr_DebugRamSearchStart)(m64p_ram_search_type);
+typedef int        (*ptr_DebugRamSearchFilter)(m64p_ram_search_op, double);
+typedef int        (*ptr_DebugRamSearchGetResults)(int, m64p_ram_search_result *, int);
+typedef int        (*ptr_DebugRamSearchGetCheat)(unsigned int, double, m64p_cheat_code *);
+typedef void       (*ptr_DebugRamSearchStop)(void);
+#if defined(M64P_CORE_PROTOTYPES)
+EXPORT m64p_error CALL DebugRamSearchStart(m64p_ram_search_type);
+EXPORT int        CALL DebugRamSearchFilter(m64p_ram_search_op, double);
+EXPORT int        CALL DebugRamSearchGetResults(int, m64p_ram_search_result *, int);
+EXPORT int        CALL DebugRamSearchGetCheat(unsigned int, double, m64p_cheat_code *);
+EXPORT void       CALL DebugRamSearchStop(void);
+#endif
+
 /* DebugGetCPUDataPtr()
  *
  * This function returns a memory pointer (in x86 memory space) to a specific
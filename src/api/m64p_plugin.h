@@ -212,6 +212,9 @@ EXPORT void CALL FBWrite(unsigned int addr, unsigned int size);
 EXPORT void CALL FBGetFrameBufferInfo(void *p);
 #endif
 
+/* audio plugin capabilities, returned by PluginGetVersion */
+#define M64P_AUDIO_CAPS_THREADED    1 /* AiDacrateChanged and AiLenChanged may run on their own thread */
+
 /* audio plugin function pointers */
 typedef void (*ptr_AiDacrateChanged)(int SystemType);
 typedef void (*ptr_AiLenChanged)(void);
@@ -156,7 +156,12 @@ typedef enum {
   M64CMD_CORE_STATE_SET,
   M64CMD_READ_SCREEN,
   M64CMD_RESET,
-  M64CMD_ADVANCE_FRAME
+  M64CMD_ADVANCE_FRAME,
+  M64CMD_SET_INPUT_SNAPSHOT,
+  M64CMD_LOCKSTEP_COMPARE,
+  M64CMD_SET_VI_CALLBACK,
+  M64CMD_GET_RUN_STATS,
+  M64CMD_ADVANCE_FRAMES
 } m64p_command;
 
 typedef struct {
@@ -164,6 +169,34 @@ typedef struct {
   int      value;
 } m64p_cheat_code;
 
+typedef struct {
+  const char  *state_path;     /* savestate both runs start from */
+  int          reference_mode; /* R4300Emulator value of the reference run */
+  int          test_mode;      /* R4300Emulator value of the run under test */
+  unsigned int steps;          /* number of instructions to compare */
+  unsigned int ram_interval;   /* block boundaries between two RDRAM compares, 0 to disable */
+  /* filled in by the core */
+  int          diverged;
+  unsigned int divergence_step;
+  uint32_t     divergence_pc;
+} m64p_lockstep_params;
+
+typedef struct {
+  unsigned int       vi_count;            /* VIs since the emulator was started */
+  unsigned int       count_per_op;        /* CP0 Count cycles per instruction */
+  unsigned long long idle_skipped_cycles; /* Count cycles skipped over polling loops */
+  long long          compile_ns;          /* time spent compiling guest code, 0 under the pure interpreter */
+  unsigned int       frame_jitter[8];     /* paced frames by deviation from their period: below 0.1, 0.25, 0.5, 1, 2, 4, 8 ms, and above or late enough to resync */
+  /* new dynarec translation cache, all 0 under the other emulators */
+  unsigned int       dynarec_cache_size;  /* bytes reserved for generated code */
+  unsigned int       dynarec_cache_used;  /* current output offset within the cache */
+  unsigned int       dynarec_lookups;     /* C dispatcher lookups finding compiled code */
+  unsigned int       dynarec_misses;      /* C dispatcher lookups which had to compile */
+  unsigned int       dynarec_samples;     /* PCs sampled at interrupts to find hot code */
+  unsigned int       dynarec_evictions;   /* entry points expired to make room */
+  unsigned int       dynarec_kept;        /* times a hot eighth of the cache was spared by expiry */
+} m64p_run_stats;
+
 /* ----------------------------------------- */
 /* Structures to hold ROM image information  */
 /* ----------------------------------------- */
@@ -267,9 +300,50 @@ typedef enum {
   M64P_DBG_PTR_SI_REG,
   M64P_DBG_PTR_VI_REG,
   M64P_DBG_PTR_RI_REG,
-  M64P_DBG_PTR_AI_REG
+  M64P_DBG_PTR_AI_REG,
+  M64P_DBG_PTR_SP_MEM,
+  M64P_DBG_PTR_ROM
 } m64p_dbg_memptr_type;
 
+typedef struct {
+  void         *host_ptr;  /* storage of the region, valid while the ROM is open */
+  unsigned int  address;   /* N64 address of the first byte */
+  unsigned int  size;      /* in bytes */
+  unsigned int  byte_xor;  /* N64 byte i of the region is ((unsigned char *) host_ptr)[i ^ byte_xor] */
+  int           writable;  /* whether the front-end may write to host_ptr */
+} m64p_dbg_mem_region;
+
+typedef struct {
+  unsigned int address;    /* first changed byte */
+  unsigned int length;     /* number of consecutive changed bytes */
+} m64p_dbg_mem_span;
+
+typedef enum {
+  M64P_RAM_SEARCH_U8 = 0,
+  M64P_RAM_SEARCH_S8,
+  M64P_RAM_SEARCH_U16,
+  M64P_RAM_SEARCH_S16,
+  M64P_RAM_SEARCH_U32,
+  M64P_RAM_SEARCH_S32,
+  M64P_RAM_SEARCH_FLOAT
+} m64p_ram_search_type;
+
+typedef enum {
+  M64P_RAM_SEARCH_EQUAL = 0,   /* compared with the given value */
+  M64P_RAM_SEARCH_NOT_EQUAL,
+  M64P_RAM_SEARCH_LESS,
+  M64P_RAM_SEARCH_GREATER,
+  M64P_RAM_SEARCH_CHANGED,     /* compared with the value at the previous filter */
+  M64P_RAM_SEARCH_UNCHANGED,
+  M64P_RAM_SEARCH_INCREASED,
+  M64P_RAM_SEARCH_DECREASED
+} m64p_ram_search_op;
+
+typedef struct {
+  unsigned int address;        /* KSEG0 address of the value */
+  double       value;          /* current value */
+} m64p_ram_search_result;
+
 typedef enum {
   M64P_CPU_PC = 1,
   M64P_CPU_REG_REG,
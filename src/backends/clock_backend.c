@@ -26,3 +26,8 @@ time_t clock_get_time(struct clock_backend* clock)
 {
     return clock->get_time(clock->user_data);
 }
+
+uint64_t clock_get_monotonic_ns(struct clock_backend* clock)
+{
+    return clock->get_monotonic_ns(clock->user_data);
+}
@@ -22,14 +22,18 @@
 #ifndef M64P_BACKENDS_CLOCK_BACKEND_H
 #define M64P_BACKENDS_CLOCK_BACKEND_H
 
+#include <stdint.h>
 #include <time.h>
 
 struct clock_backend
 {
     void* user_data;
     time_t (*get_time)(void*);
+    /* nanoseconds from an arbitrary origin, never going backward */
+    uint64_t (*get_monotonic_ns)(void*);
 };
 
 time_t clock_get_time(struct clock_backend* clock);
+uint64_t clock_get_monotonic_ns(struct clock_backend* clock);
 
 #endif
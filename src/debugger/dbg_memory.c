@@ -503,4 +503,204 @@ uint32 get_memory_flags(uint32 addr)
   return flags;
 }
 
+/* Host storage of the N64 bytes at addr, for RDRAM, SP memory and cartridge ROM.
+ * N64 byte i of the region is at base[i ^ S8]; *offset is set to the index of addr
+ * and *avail to the number of bytes left before the next region. Returns NULL for
+ * registers and unmapped areas. TLB mapped addresses are only followed for reads. */
+static uint8* direct_memory(uint32 addr, uint32* offset, uint32* avail, int write)
+{
+    uint8* base;
+    uint32 page_left = 0x10000 - (addr & 0xffff);
+    size_t size;
+
+    switch(get_memory_type(&g_dev.mem, addr))
+    {
+    case M64P_MEM_NOMEM:
+        if (write || !g_dev.r4300.cp0.tlb.LUT_r[addr>>12])
+            return NULL;
+        base = direct_memory((g_dev.r4300.cp0.tlb.LUT_r[addr>>12]&0xFFFFF000)|(addr&0xFFF), offset, avail, 0);
+        if (base != NULL && *avail > 0x1000 - (addr & 0xfff))
+            *avail = 0x1000 - (addr & 0xfff);
+        return base;
+    case M64P_MEM_RDRAM:
+        base = (uint8*)g_dev.ri.rdram.dram;
+        size = g_dev.ri.rdram.dram_size;
+        *offset = addr & 0xffffff;
+        break;
+    case M64P_MEM_RSPMEM:
+        if (write || (addr & 0xffff) >= SP_MEM_SIZE)
+            return NULL;
+        base = (uint8*)g_dev.sp.mem;
+        size = SP_MEM_SIZE;
+        *offset = addr & 0xffff;
+        break;
+    case M64P_MEM_ROM:
+        if (write)
+            return NULL;
+        base = g_dev.pi.cart_rom.rom;
+        size = g_dev.pi.cart_rom.rom_size;
+        *offset = addr & 0x03ffffff;
+        break;
+    default:
+        return NULL;
+    }
+
+    if (*offset >= size)
+        return NULL;
+
+    *avail = (size - *offset < page_left) ? (uint32)(size - *offset) : page_left;
+    return base;
+}
+
+static void copy_from_host(uint8* dst, const uint8* base, uint32 offset, uint32 length)
+{
+    for (; length != 0 && (offset & 3) != 0; --length)
+        *dst++ = base[offset++ ^ S8];
+
+    for (; length >= 4; length -= 4, offset += 4, dst += 4)
+    {
+        uint32 word = *(const uint32*)(base + offset);
+        dst[0] = (uint8)(word >> 24);
+        dst[1] = (uint8)(word >> 16);
+        dst[2] = (uint8)(word >> 8);
+        dst[3] = (uint8)word;
+    }
+
+    for (; length != 0; --length)
+        *dst++ = base[offset++ ^ S8];
+}
+
+static void copy_to_host(uint8* base, uint32 offset, const uint8* src, uint32 length)
+{
+    for (; length != 0 && (offset & 3) != 0; --length)
+        base[offset++ ^ S8] = *src++;
+
+    for (; length >= 4; length -= 4, offset += 4, src += 4)
+    {
+        *(uint32*)(base + offset) = ((uint32)src[0] << 24) | ((uint32)src[1] << 16)
+                                  | ((uint32)src[2] << 8) | (uint32)src[3];
+    }
+
+    for (; length != 0; --length)
+        base[offset++ ^ S8] = *src++;
+}
+
+void read_memory_block(uint32 addr, uint8* buffer, uint32 length)
+{
+    while (length != 0)
+    {
+        uint32 offset, n;
+        const uint8* base = direct_memory(addr, &offset, &n, 0);
+
+        if (base != NULL)
+        {
+            if (n > length)
+                n = length;
+            copy_from_host(buffer, base, offset, n);
+        }
+        else if ((addr & 3) == 0 && length >= 4)
+        {
+            /* registers and unmapped areas */
+            uint32 word = read_memory_32(addr);
+            buffer[0] = (uint8)(word >> 24);
+            buffer[1] = (uint8)(word >> 16);
+            buffer[2] = (uint8)(word >> 8);
+            buffer[3] = (uint8)word;
+            n = 4;
+        }
+        else
+        {
+            *buffer = read_memory_8(addr);
+            n = 1;
+        }
+
+        addr += n;
+        buffer += n;
+        length -= n;
+    }
+}
+
+void write_memory_block(uint32 addr, const uint8* buffer, uint32 length)
+{
+    while (length != 0)
+    {
+        uint32 offset, n;
+        uint8* base = direct_memory(addr, &offset, &n, 1);
+
+        if (base != NULL)
+        {
+            if (n > length)
+                n = length;
+            copy_to_host(base, offset, buffer, n);
+            invalidate_r4300_cached_code(&g_dev.r4300, addr, n);
+        }
+        else
+        {
+            write_memory_8(addr, *buffer);
+            n = 1;
+        }
+
+        addr += n;
+        buffer += n;
+        length -= n;
+    }
+}
+
+static void add_span(m64p_dbg_mem_span* spans, unsigned int max_spans, unsigned int count, uint32 start, uint32 end)
+{
+    if (count < max_spans)
+    {
+        spans[count].address = start;
+        spans[count].length = end - start;
+    }
+}
+
+unsigned int diff_memory_block(uint32 addr, uint8* snapshot, uint32 length,
+                               m64p_dbg_mem_span* spans, unsigned int max_spans)
+{
+    uint8 current[0x1000];
+    unsigned int count = 0;
+    uint32 start = 0, end = 0;
+    int open = 0;
+
+    while (length != 0)
+    {
+        uint32 i, n = (length < sizeof(current)) ? length : (uint32)sizeof(current);
+
+        read_memory_block(addr, current, n);
+
+        /* most of the range is expected to be unchanged */
+        if (memcmp(current, snapshot, n) != 0)
+        {
+            for (i = 0; i < n; ++i)
+            {
+                if (current[i] == snapshot[i])
+                    continue;
+
+                if (open && end == addr + i)
+                {
+                    ++end;
+                    continue;
+                }
+
+                if (open)
+                    add_span(spans, max_spans, count++, start, end);
+                start = addr + i;
+                end = start + 1;
+                open = 1;
+            }
+            memcpy(snapshot, current, n);
+        }
+
+        addr += n;
+        snapshot += n;
+        length -= n;
+    }
+
+    if (open)
+        add_span(spans, max_spans, count++, start, end);
+
+    return count;
+}
+
 #endif
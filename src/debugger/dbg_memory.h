@@ -23,6 +23,9 @@
 #ifndef __DEBUGGER_MEMORY_H__
 #define __DEBUGGER_MEMORY_H__
 
+#include "api/m64p_types.h"
+#include "dbg_types.h"
+
 #define MAX_DISASSEMBLY 64
 
 void init_host_disassembler(void);
@@ -47,5 +50,16 @@ uint8 read_memory_8(uint32 addr);
 void write_memory_8(uint32 addr, uint8 value);
 uint32 get_memory_flags(uint32);
 
+/* Bulk accesses, in N64 byte order. RDRAM, SP memory and ROM are copied
+ * directly, other areas go through the word accessors above. */
+void read_memory_block(uint32 addr, uint8* buffer, uint32 length);
+void write_memory_block(uint32 addr, const uint8* buffer, uint32 length);
+
+/* Compare a range with a previous read_memory_block of it, refresh the
+ * snapshot, and fill up to max_spans runs of changed bytes. Returns the
+ * number of runs, which may be more than max_spans. */
+unsigned int diff_memory_block(uint32 addr, uint8* snapshot, uint32 length,
+                               m64p_dbg_mem_span* spans, unsigned int max_spans);
+
 #endif /* __DEBUGGER_MEMORY_H__ */
 
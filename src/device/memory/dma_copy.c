@@ -0,0 +1,96 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - dma_copy.c                                              *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "dma_copy.h"
+
+#include <string.h>
+
+#ifndef M64P_BIG_ENDIAN
+#define DMA_S8 3
+#else
+#define DMA_S8 0
+#endif
+
+static void dma_copy_bytes(uint8_t* dst, uint32_t dst_addr,
+                           const uint8_t* src, uint32_t src_addr,
+                           size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length; ++i)
+    {
+        dst[(dst_addr+i)^DMA_S8] = src[(src_addr+i)^DMA_S8];
+    }
+}
+
+void dma_copy(uint8_t* dst, uint32_t dst_addr,
+              const uint8_t* src, uint32_t src_addr,
+              size_t length)
+{
+    size_t i;
+    size_t head;
+    size_t words;
+    unsigned int shift;
+    uint32_t* d;
+    const uint32_t* s;
+
+    /* bring destination to a word boundary */
+    head = (4 - (dst_addr & 3)) & 3;
+    if (head > length)
+        head = length;
+
+    dma_copy_bytes(dst, dst_addr, src, src_addr, head);
+    dst_addr += head;
+    src_addr += head;
+    length -= head;
+
+    words = length / 4;
+
+    if (words != 0)
+    {
+        d = (uint32_t*)(dst + dst_addr);
+        shift = (src_addr & 3) * 8;
+
+        if (shift == 0)
+        {
+            /* same alignment: swizzled words can be copied as is */
+            memcpy(d, src + src_addr, words * 4);
+        }
+        else
+        {
+            /* words hold big endian values (on any host), so realigning
+             * the stream is a funnel shift of two neighbouring words */
+            s = (const uint32_t*)(src + (src_addr & ~3));
+
+            for (i = 0; i < words; ++i)
+            {
+                d[i] = (s[i] << shift) | (s[i+1] >> (32 - shift));
+            }
+        }
+
+        dst_addr += (uint32_t)(words * 4);
+        src_addr += (uint32_t)(words * 4);
+        length -= words * 4;
+    }
+
+    /* tail */
+    dma_copy_bytes(dst, dst_addr, src, src_addr, length);
+}
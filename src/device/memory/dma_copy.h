@@ -0,0 +1,39 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - dma_copy.h                                              *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_DEVICE_MEMORY_DMA_COPY_H
+#define M64P_DEVICE_MEMORY_DMA_COPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Copy length bytes between two buffers which both use the S8 byte
+ * swizzle of RDRAM / cart ROM (32-bit words stored in host order).
+ * dst_addr and src_addr are byte offsets into dst and src.
+ *
+ * Runs whose offsets share the same word alignment are moved with memcpy,
+ * other runs are realigned a word at a time; only the unaligned head
+ * and tail are copied byte by byte. Buffers must not overlap. */
+void dma_copy(uint8_t* dst, uint32_t dst_addr,
+              const uint8_t* src, uint32_t src_addr,
+              size_t length);
+
+#endif
@@ -27,6 +27,7 @@
 
 #include "api/callbacks.h"
 #include "api/m64p_types.h"
+#include "device/memory/dma_copy.h"
 #include "device/memory/memory.h"
 #include "device/r4300/r4300_core.h"
 #include "device/ri/rdram_detection_hack.h"
@@ -80,8 +81,6 @@ static void dma_pi_write(struct pi_controller* pi)
     unsigned int longueur, i;
     uint32_t dram_address;
     uint32_t rom_address;
-    uint8_t* dram;
-    const uint8_t* rom;
 
     if (pi->regs[PI_CART_ADDR_REG] < 0x10000000)
     {
@@ -151,16 +150,12 @@ static void dma_pi_write(struct pi_controller* pi)
 
     dram_address = pi->regs[PI_DRAM_ADDR_REG];
     rom_address = (pi->regs[PI_CART_ADDR_REG] - 0x10000000) & 0x3ffffff;
-    dram = (uint8_t*)pi->ri->rdram.dram;
-    rom = pi->cart_rom.rom;
 
-    for(i = 0; i < longueur; ++i)
-    {
-        dram[(dram_address+i)^S8] = rom[(rom_address+i)^S8];
-    }
+    dma_copy((uint8_t*)pi->ri->rdram.dram, dram_address,
+             pi->cart_rom.rom, rom_address,
+             longueur);
 
-    invalidate_r4300_cached_code(pi->r4300, 0x80000000 + dram_address, longueur);
-    invalidate_r4300_cached_code(pi->r4300, 0xa0000000 + dram_address, longueur);
+    invalidate_r4300_cached_rdram(pi->r4300, dram_address, longueur);
 
     /* HACK: monitor PI DMA to trigger RDRAM size detection
      * hack just before initial cart ROM loading. */
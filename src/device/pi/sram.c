@@ -26,6 +26,7 @@
 #include <string.h>
 
 #include "backends/storage_backend.h"
+#include "device/memory/dma_copy.h"
 #include "device/memory/memory.h"
 #include "device/pi/pi_controller.h"
 #include "device/ri/ri_controller.h"
@@ -43,7 +44,6 @@ void init_sram(struct sram* sram, struct storage_backend* storage)
 
 void dma_write_sram(struct pi_controller* pi)
 {
-    size_t i;
     size_t length = (pi->regs[PI_RD_LEN_REG] & 0xffffff) + 1;
 
     uint8_t* sram = pi->sram.storage->data;
@@ -51,15 +51,13 @@ void dma_write_sram(struct pi_controller* pi)
     uint32_t cart_addr = pi->regs[PI_CART_ADDR_REG] - 0x08000000;
     uint32_t dram_addr = pi->regs[PI_DRAM_ADDR_REG];
 
-    for(i = 0; i < length; ++i)
-        sram[(cart_addr+i)^S8] = dram[(dram_addr+i)^S8];
+    dma_copy(sram, cart_addr, dram, dram_addr, length);
 
     storage_save(pi->sram.storage);
 }
 
 void dma_read_sram(struct pi_controller* pi)
 {
-    size_t i;
     size_t length = (pi->regs[PI_WR_LEN_REG] & 0xffffff) + 1;
 
     uint8_t* sram = pi->sram.storage->data;
@@ -67,7 +65,6 @@ void dma_read_sram(struct pi_controller* pi)
     uint32_t cart_addr = (pi->regs[PI_CART_ADDR_REG] - 0x08000000) & 0xffff;
     uint32_t dram_addr = pi->regs[PI_DRAM_ADDR_REG];
 
-    for(i = 0; i < length; ++i)
-        dram[(dram_addr+i)^S8] = sram[(cart_addr+i)^S8];
+    dma_copy(dram, dram_addr, sram, cart_addr, length);
 }
 
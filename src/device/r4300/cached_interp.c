@@ -32,11 +32,13 @@
 #include "device/memory/memory.h"
 #include "device/r4300/cached_interp.h"
 #include "device/r4300/exception.h"
+#include "device/r4300/idle_loop.h"
 #include "device/r4300/interrupt.h"
 #include "device/r4300/macros.h"
 #include "device/r4300/ops.h"
 #include "device/r4300/recomp.h"
 #include "device/r4300/tlb.h"
+#include "fuzzer/fuzzer_coverage.h"
 #include "main/main.h"
 
 #ifdef DBG
@@ -53,6 +55,23 @@
 #define UPDATE_DEBUGGER() do { } while(0)
 #endif
 
+/* Self-loops and static polling loops were proven idle when the block was
+ * built, dynamic polling loops are checked again with the registers their
+ * loads are based on. */
+static int idle_loop_can_skip(uint32_t target)
+{
+   const struct precomp_instr* inst = *r4300_pc_struct();
+   const uint32_t pc = inst->addr;
+   const uint32_t* code;
+
+   if (target == pc || inst->idle_loop_kind == IDLE_LOOP_STATIC)
+      return 1;
+
+   code = fast_mem_access(target);
+   return code != NULL
+       && r4300_idle_loop_can_skip(code, (pc - target) / 4 + 2, r4300_regs());
+}
+
 #define PCADDR *r4300_pc()
 #define ADD_TO_PC(x) (*r4300_pc_struct()) += x;
 #define DECLARE_INSTRUCTION(name) static void name(void)
@@ -62,6 +81,7 @@
    { \
       const int take_jump = (condition); \
       const uint32_t jump_target = (destination); \
+      const uint32_t branch_pc = *r4300_pc(); \
       int64_t *link_register = (link); \
       if (cop1 && check_cop1_unusable(&g_dev.r4300)) return; \
       if (link_register != &r4300_regs()[0]) \
@@ -86,6 +106,7 @@
          (*r4300_pc_struct()) += 2; \
          cp0_update_count(); \
       } \
+      fuzzer_coverage_edge(branch_pc, *r4300_pc()); \
       g_dev.r4300.cp0.last_addr = *r4300_pc(); \
       if (*r4300_cp0_next_interrupt() <= r4300_cp0_regs()[CP0_COUNT_REG]) gen_interrupt(); \
    } \
@@ -93,6 +114,7 @@
    { \
       const int take_jump = (condition); \
       const uint32_t jump_target = (destination); \
+      const uint32_t branch_pc = *r4300_pc(); \
       int64_t *link_register = (link); \
       if (cop1 && check_cop1_unusable(&g_dev.r4300)) return; \
       if (link_register != &r4300_regs()[0]) \
@@ -117,6 +139,7 @@
          (*r4300_pc_struct()) += 2; \
          cp0_update_count(); \
       } \
+      fuzzer_coverage_edge(branch_pc, *r4300_pc()); \
       g_dev.r4300.cp0.last_addr = *r4300_pc(); \
       if (*r4300_cp0_next_interrupt() <= r4300_cp0_regs()[CP0_COUNT_REG]) gen_interrupt(); \
    } \
@@ -126,11 +149,15 @@
       const int take_jump = (condition); \
       int skip; \
       if (cop1 && check_cop1_unusable(&g_dev.r4300)) return; \
-      if (take_jump) \
+      if (take_jump && idle_loop_can_skip(destination)) \
       { \
          cp0_update_count(); \
          skip = *r4300_cp0_next_interrupt() - cp0_regs[CP0_COUNT_REG]; \
-         if (skip > 3) cp0_regs[CP0_COUNT_REG] += (skip & UINT32_C(0xFFFFFFFC)); \
+         if (skip > 3) \
+         { \
+            cp0_regs[CP0_COUNT_REG] += (skip & UINT32_C(0xFFFFFFFC)); \
+            g_dev.r4300.idle_skipped_cycles += (skip & UINT32_C(0xFFFFFFFC)); \
+         } \
          else name(); \
       } \
       else name(); \
@@ -613,11 +640,36 @@ void free_blocks(struct r4300_core* r4300)
     }
 }
 
+/* invalidate page i if it holds compiled code in [begin, end) (page offsets) */
+static void invalidate_page_hacktarux(struct r4300_core* r4300, size_t i, uint32_t begin, uint32_t end)
+{
+    uint32_t k;
+    struct cached_interp* cinterp = &r4300->cached_interp;
+
+    if (cinterp->invalid_code[i] != 0)
+        return;
+
+    if (cinterp->blocks[i] == NULL)
+    {
+        cinterp->invalid_code[i] = 1;
+        return;
+    }
+
+    for (k = begin / 4; k <= (end - 1) / 4; ++k)
+    {
+        if (cinterp->blocks[i]->block[k].ops != r4300->current_instruction_table.NOTCOMPILED)
+        {
+            cinterp->invalid_code[i] = 1;
+            return;
+        }
+    }
+}
+
 void invalidate_cached_code_hacktarux(struct r4300_core* r4300, uint32_t address, size_t size)
 {
-    size_t i;
-    uint32_t addr;
-    uint32_t addr_max;
+    uint32_t page;
+    uint32_t first;
+    uint32_t last;
 
     if (size == 0)
     {
@@ -627,33 +679,47 @@ void invalidate_cached_code_hacktarux(struct r4300_core* r4300, uint32_t address
     else
     {
         /* invalidate blocks (if necessary) */
-        addr_max = address+size;
+        first = address >> 12;
+        last = (uint32_t)(address + size - 1) >> 12;
 
-        for(addr = address; addr < addr_max; addr += 4)
+        for (page = first; page <= last; ++page)
         {
-            i = (addr >> 12);
-
-            if (r4300->cached_interp.invalid_code[i] == 0)
-            {
-                if (r4300->cached_interp.blocks[i] == NULL
-                || r4300->cached_interp.blocks[i]->block[(addr & 0xfff) / 4].ops != r4300->current_instruction_table.NOTCOMPILED)
-                {
-                    r4300->cached_interp.invalid_code[i] = 1;
-                    /* go directly to next i */
-                    addr &= ~0xfff;
-                    addr |= 0xffc;
-                }
-            }
-            else
-            {
-                /* go directly to next i */
-                addr &= ~0xfff;
-                addr |= 0xffc;
-            }
+            invalidate_page_hacktarux(r4300, page,
+                (page == first) ? (address & 0xfff) : 0,
+                (page == last) ? ((uint32_t)(address + size - 1) & 0xfff) + 1 : 0x1000);
         }
     }
 }
 
+void invalidate_rdram_cached_code_hacktarux(struct r4300_core* r4300, uint32_t address, size_t size)
+{
+    uint32_t page;
+    uint32_t first;
+    uint32_t last;
+    uint32_t begin;
+    uint32_t end;
+
+    if (size == 0)
+    {
+        memset(r4300->cached_interp.invalid_code, 1, 0x100000);
+        return;
+    }
+
+    /* walk the physical range once and check both cached (kseg0)
+     * and uncached (kseg1) mirrors of each page */
+    first = (address & 0x1fffffff) >> 12;
+    last = (uint32_t)((address & 0x1fffffff) + size - 1) >> 12;
+
+    for (page = first; page <= last; ++page)
+    {
+        begin = (page == first) ? (address & 0xfff) : 0;
+        end = (page == last) ? ((uint32_t)(address + size - 1) & 0xfff) + 1 : 0x1000;
+
+        invalidate_page_hacktarux(r4300, 0x80000 + page, begin, end);
+        invalidate_page_hacktarux(r4300, 0xa0000 + page, begin, end);
+    }
+}
+
 void run_cached_interpreter(struct r4300_core* r4300)
 {
     while (!*r4300_stop())
@@ -35,6 +35,7 @@ void init_blocks(struct r4300_core* r4300);
 void free_blocks(struct r4300_core* r4300);
 
 void invalidate_cached_code_hacktarux(struct r4300_core* r4300, uint32_t address, size_t size);
+void invalidate_rdram_cached_code_hacktarux(struct r4300_core* r4300, uint32_t address, size_t size);
 
 void run_cached_interpreter(struct r4300_core* r4300);
 
@@ -22,6 +22,10 @@
 #include <stdint.h>
 #include <string.h>
 
+#if defined(__x86_64__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
 #include "cp0.h"
 #include "cp1.h"
 
@@ -90,6 +94,11 @@ uint32_t* r4300_cp1_fcr31(void)
 #endif
 }
 
+int* r4300_cp1_host_rounding_mode(void)
+{
+    return &g_dev.r4300.cp1.host_rounding_mode;
+}
+
 
 
 /* Refer to Figure 6-2 on page 155 and explanation on page B-11
@@ -185,15 +194,40 @@ void update_x86_rounding_mode(uint32_t fcr31)
     {
     case 0: /* Round to nearest, or to even if equidistant */
         g_dev.r4300.cp1.rounding_mode = UINT32_C(0x33F);
+        g_dev.r4300.cp1.sse_rounding_mode = UINT32_C(0x1F80);
         break;
     case 1: /* Truncate (toward 0) */
         g_dev.r4300.cp1.rounding_mode = UINT32_C(0xF3F);
+        g_dev.r4300.cp1.sse_rounding_mode = UINT32_C(0x7F80);
         break;
     case 2: /* Round up (toward +Inf) */
         g_dev.r4300.cp1.rounding_mode = UINT32_C(0xB3F);
+        g_dev.r4300.cp1.sse_rounding_mode = UINT32_C(0x5F80);
         break;
     case 3: /* Round down (toward -Inf) */
         g_dev.r4300.cp1.rounding_mode = UINT32_C(0x73F);
+        g_dev.r4300.cp1.sse_rounding_mode = UINT32_C(0x3F80);
         break;
     }
+
+    apply_sse_rounding_mode();
+    invalidate_host_rounding_mode();
+}
+
+/* Load sse_rounding_mode into MXCSR. The x86-64 JIT only does this on
+ * CTC1, so FCR31 writes made anywhere else (savestate load, poweron, the
+ * interpreters) have to go through here to reach the SSE2 COP1 code. */
+void apply_sse_rounding_mode(void)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    _mm_setcsr(g_dev.r4300.cp1.sse_rounding_mode);
+#endif
+}
+
+/* Make the next set_rounding apply FCR31 to the host FPU again. Needed
+ * whenever FCR31 is written, and after running code (plugins, frontend
+ * callbacks) which may have changed the host rounding mode. */
+void invalidate_host_rounding_mode(void)
+{
+    g_dev.r4300.cp1.host_rounding_mode = -1;
 }
@@ -44,6 +44,15 @@ struct cp1
      * words. However, x86/gcop1.c and x86-64/gcop1.c update this variable
      * using 32-bit stores. */
     uint32_t rounding_mode;
+
+    /* The same rounding mode as an MXCSR value, for the x86-64 JIT which
+     * does its COP1 arithmetic with SSE2. Loaded by LDMXCSR on CTC1 and by
+     * apply_sse_rounding_mode() everywhere else FCR31 changes. */
+    uint32_t sse_rounding_mode;
+
+    /* FCR31 rounding mode last applied to the host FPU by set_rounding,
+     * or -1 when the host state may have been changed behind our back. */
+    int host_rounding_mode;
 };
 
 void poweron_cp1(struct cp1* cp1);
@@ -54,11 +63,14 @@ double** r4300_cp1_regs_double(void);
 
 uint32_t* r4300_cp1_fcr0(void);
 uint32_t* r4300_cp1_fcr31(void);
+int* r4300_cp1_host_rounding_mode(void);
 
 void shuffle_fpr_data(uint32_t oldStatus, uint32_t newStatus);
 void set_fpr_pointers(uint32_t newStatus);
 
 void update_x86_rounding_mode(uint32_t fcr31);
+void apply_sse_rounding_mode(void);
+void invalidate_host_rounding_mode(void);
 
 #endif /* M64P_DEVICE_R4300_CP1_H */
 
@@ -446,6 +446,10 @@ void genni()
 {
 }
 
+void genidle_loop()
+{
+}
+
 void genreserved()
 {
 }
@@ -53,9 +53,18 @@
 #define FCR31_CMP_BIT UINT32_C(0x800000)
 
 
+/* Writing the host control word is slow and games rarely change the rounding
+ * mode, so only do it when FCR31 no longer matches what was last applied. */
 M64P_FPU_INLINE void set_rounding(void)
 {
-  switch((*r4300_cp1_fcr31()) & 3) {
+  int* host_rounding_mode = r4300_cp1_host_rounding_mode();
+  int mode = (*r4300_cp1_fcr31()) & 3;
+
+  if (*host_rounding_mode == mode)
+    return;
+  *host_rounding_mode = mode;
+
+  switch(mode) {
   case 0: /* Round to nearest, or to even if equidistant */
     fesetround(FE_TONEAREST);
     break;
@@ -0,0 +1,236 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - device/r4300/idle_loop.c                                *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "idle_loop.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OP(w)    ((w) >> 26)
+#define RS(w)    (((w) >> 21) & 0x1f)
+#define RT(w)    (((w) >> 16) & 0x1f)
+#define RD(w)    (((w) >> 11) & 0x1f)
+#define FUNCT(w) ((w) & 0x3f)
+#define SIMM(w)  ((uint32_t)(int16_t)((w) & 0xffff))
+
+#define BIT(r)   (UINT32_C(1) << (r))
+
+static int is_polled_address(uint32_t address)
+{
+    uint32_t phys;
+
+    /* only unmapped segments, TLB lookups could fault */
+    if (address < UINT32_C(0x80000000) || address >= UINT32_C(0xc0000000))
+        return 0;
+
+    phys = address & UINT32_C(0x1fffffff);
+
+    if (phys < UINT32_C(0x00800000))
+        return 1;
+
+    switch (phys >> 20)
+    {
+    case 0x040: /* SP */
+    case 0x041: /* DPC */
+    case 0x043: /* MI */
+    case 0x046: /* PI */
+    case 0x047: /* RI */
+    case 0x048: /* SI */
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int is_loop_branch(uint32_t w)
+{
+    switch (OP(w))
+    {
+    case 0x01: /* REGIMM */
+        return RT(w) <= 0x03; /* BLTZ, BGEZ, BLTZL, BGEZL */
+    case 0x02: /* J */
+    case 0x04: /* BEQ */
+    case 0x05: /* BNE */
+    case 0x06: /* BLEZ */
+    case 0x07: /* BGTZ */
+    case 0x14: /* BEQL */
+    case 0x15: /* BNEL */
+    case 0x16: /* BLEZL */
+    case 0x17: /* BGTZL */
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Registers read and written by an instruction allowed in a polling loop.
+ * Returns 0 for anything else. */
+static int decode(uint32_t w, int is_branch, uint32_t* reads, uint32_t* writes, int* is_load)
+{
+    *reads = 0;
+    *writes = 0;
+    *is_load = 0;
+
+    if (is_branch)
+    {
+        if (!is_loop_branch(w))
+            return 0;
+
+        switch (OP(w))
+        {
+        case 0x02: break;
+        case 0x04: case 0x05: case 0x14: case 0x15:
+            *reads = BIT(RS(w)) | BIT(RT(w)); break;
+        default:
+            *reads = BIT(RS(w)); break;
+        }
+        return 1;
+    }
+
+    switch (OP(w))
+    {
+    case 0x00: /* SPECIAL */
+        switch (FUNCT(w))
+        {
+        case 0x00: case 0x02: case 0x03: /* SLL, SRL, SRA */
+            *reads = BIT(RT(w)); *writes = BIT(RD(w)); break;
+        case 0x04: case 0x06: case 0x07: /* SLLV, SRLV, SRAV */
+        case 0x21: case 0x23: /* ADDU, SUBU */
+        case 0x24: case 0x25: case 0x26: case 0x27: /* AND, OR, XOR, NOR */
+        case 0x2a: case 0x2b: /* SLT, SLTU */
+            *reads = BIT(RS(w)) | BIT(RT(w)); *writes = BIT(RD(w)); break;
+        case 0x0f: /* SYNC */
+            break;
+        default:
+            return 0;
+        }
+        break;
+    case 0x09: case 0x0a: case 0x0b: /* ADDIU, SLTI, SLTIU */
+    case 0x0c: case 0x0d: case 0x0e: /* ANDI, ORI, XORI */
+        *reads = BIT(RS(w)); *writes = BIT(RT(w)); break;
+    case 0x0f: /* LUI */
+        *writes = BIT(RT(w)); break;
+    case 0x20: case 0x21: case 0x23: /* LB, LH, LW */
+    case 0x24: case 0x25: case 0x27: /* LBU, LHU, LWU */
+    case 0x37: /* LD */
+        *reads = BIT(RS(w)); *writes = BIT(RT(w)); *is_load = 1; break;
+    default:
+        return 0;
+    }
+
+    *writes &= ~BIT(0);
+    return 1;
+}
+
+/* With regs == NULL, loads from registers without a known value make the
+ * loop IDLE_LOOP_DYNAMIC; otherwise their addresses are checked. */
+static enum idle_loop_kind analyze(const uint32_t* code, size_t count, const int64_t* regs)
+{
+    uint32_t reads, writes;
+    uint32_t written = 0, loop_writes = 0;
+    uint32_t known = BIT(0);
+    uint32_t value[32];
+    enum idle_loop_kind kind = IDLE_LOOP_STATIC;
+    int is_load;
+    size_t i, j;
+
+    if (count < 2 || count > IDLE_LOOP_MAX_LENGTH)
+        return IDLE_LOOP_NONE;
+
+    for (i = 0; i < count; ++i)
+    {
+        if (!decode(code[i], i == count - 2, &reads, &writes, &is_load))
+            return IDLE_LOOP_NONE;
+        loop_writes |= writes;
+    }
+
+    value[0] = 0;
+
+    for (i = 0; i < count; ++i)
+    {
+        uint32_t w = code[i];
+        decode(w, i == count - 2, &reads, &writes, &is_load);
+
+        /* a value computed by a previous iteration */
+        if (reads & loop_writes & ~written)
+            return IDLE_LOOP_NONE;
+
+        if (is_load)
+        {
+            unsigned int base = RS(w);
+
+            if (known & BIT(base))
+            {
+                if (!is_polled_address(value[base] + SIMM(w)))
+                    return IDLE_LOOP_NONE;
+            }
+            else
+            {
+                /* the base must still hold the same value at the branch */
+                for (j = i + 1; j < count; ++j)
+                {
+                    uint32_t r, wr;
+                    int l;
+                    decode(code[j], j == count - 2, &r, &wr, &l);
+                    if (wr & BIT(base))
+                        return IDLE_LOOP_NONE;
+                }
+
+                if (regs == NULL)
+                    kind = IDLE_LOOP_DYNAMIC;
+                else if (!is_polled_address((uint32_t)regs[base] + SIMM(w)))
+                    return IDLE_LOOP_NONE;
+            }
+        }
+
+        /* track constants built by LUI/ORI/ADDIU for load addresses */
+        if (writes)
+        {
+            unsigned int rt = RT(w);
+            known &= ~writes;
+            switch (OP(w))
+            {
+            case 0x0f:
+                value[rt] = (w & 0xffff) << 16; known |= BIT(rt); break;
+            case 0x09:
+                if (known & BIT(RS(w))) { value[rt] = value[RS(w)] + SIMM(w); known |= BIT(rt); }
+                break;
+            case 0x0d:
+                if (known & BIT(RS(w))) { value[rt] = value[RS(w)] | (w & 0xffff); known |= BIT(rt); }
+                break;
+            }
+        }
+
+        written |= writes;
+    }
+
+    return kind;
+}
+
+enum idle_loop_kind r4300_idle_loop_kind(const uint32_t* code, size_t count)
+{
+    return analyze(code, count, NULL);
+}
+
+int r4300_idle_loop_can_skip(const uint32_t* code, size_t count, const int64_t* regs)
+{
+    return analyze(code, count, regs) != IDLE_LOOP_NONE;
+}
@@ -0,0 +1,53 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - device/r4300/idle_loop.h                                *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_DEVICE_R4300_IDLE_LOOP_H
+#define M64P_DEVICE_R4300_IDLE_LOOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A polling loop is a short backward branch whose body only loads from
+ * memory or registers which change at interrupt events (RDRAM, MI, SP, DP,
+ * PI, RI and SI, but not the count driven VI and AI registers) and does
+ * pure register arithmetic with no value carried over to the next iteration.
+ * Every iteration computes the same thing until an event fires, so Count can
+ * jump straight to the next interrupt.
+ *
+ * code points to the loop's first instruction and count includes the
+ * closing branch and its delay slot. */
+
+#define IDLE_LOOP_MAX_LENGTH 16
+
+enum idle_loop_kind
+{
+    IDLE_LOOP_NONE,
+    IDLE_LOOP_STATIC,   /* all load addresses are checked at analysis time */
+    IDLE_LOOP_DYNAMIC   /* some load addresses depend on register values */
+};
+
+enum idle_loop_kind r4300_idle_loop_kind(const uint32_t* code, size_t count);
+
+/* Check the loop against the current register values, needed before
+ * skipping an IDLE_LOOP_DYNAMIC loop. */
+int r4300_idle_loop_can_skip(const uint32_t* code, size_t count, const int64_t* regs);
+
+#endif /* M64P_DEVICE_R4300_IDLE_LOOP_H */
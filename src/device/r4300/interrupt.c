@@ -539,6 +539,14 @@ void gen_interrupt(void)
         dyna_stop();
     }
 
+#ifdef NEW_DYNAREC
+    /* pcaddr is where the dynarec resumes, see do_ccstub */
+    if (r4300->emumode == EMUMODE_DYNAREC) {
+        new_dynarec_sample_pc(pcaddr);
+        new_dynarec_count_polling_skip();
+    }
+#endif
+
     if (!r4300->cp0.interrupt_unsafe_state)
     {
         if (savestates_get_job() == savestates_job_load)
@@ -636,6 +644,14 @@ void gen_interrupt(void)
             savestates_save();
             return;
         }
+
+        /* A load requested while handling the event (e.g. by the fuzzer on
+           VI) is applied before any more of the discarded timeline runs. */
+        if (savestates_get_job() == savestates_job_load)
+        {
+            savestates_load();
+            return;
+        }
     }
 }
 
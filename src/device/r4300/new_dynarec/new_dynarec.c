@@ -41,6 +41,8 @@
 #include "device/r4300/recomp.h"
 #include "device/r4300/tlb.h"
 #include "device/r4300/fpu.h"
+#include "device/r4300/idle_loop.h"
+#include "plugin/get_monotonic_time.h"
 
 #if !defined(WIN32)
 #include <sys/mman.h>
@@ -271,6 +273,9 @@ static char *copy;
 static int expirep;
 unsigned int using_tlb;
 unsigned int stop_after_jal;
+unsigned int translation_cache_mb;
+static int cache_size_2;
+static struct new_dynarec_cache_stats cache_stats;
 static u_int dirty_entry_count;
 static u_int copy_size;
 static u_int hash_table[65536][4];
@@ -278,6 +283,20 @@ static struct ll_entry *jump_in[4096];
 static struct ll_entry *jump_dirty[4096];
 static struct ll_entry *jump_out[4096];
 
+// Smallest translation cache; the largest is TARGET_SIZE_2
+#define MIN_CACHE_SIZE_2 22
+// Expiry works through the cache in eighths. An eighth which got at least
+// HOT_CHUNK_SAMPLES PC samples, and a quarter of all samples, since expiry
+// last passed it is skipped once (second chance) and the output pointer
+// jumps over it. At most MAX_KEPT_CHUNKS eighths are kept at a time.
+#define CACHE_CHUNKS 8
+#define HOT_CHUNK_SAMPLES 16
+#define MAX_KEPT_CHUNKS 3
+static u_int chunk_samples[CACHE_CHUNKS];
+static char chunk_kept[CACHE_CHUNKS];
+// Cycle count as it was before the last polling loop skip, see do_cc
+static int polling_cycle_count;
+
 #if COUNT_NOTCOMPILEDS
 static int notcompiledCount = 0;
 #endif
@@ -1737,6 +1756,29 @@ static void tlb_hacks()
   }
 }
 
+// Linked blocks and the hash table dispatch never reach C code, so cache
+// heat is sampled instead: at each interrupt the block the dynarec resumes
+// at is looked up in the hash table, and its eighth of the cache charged.
+void new_dynarec_sample_pc(u_int vaddr)
+{
+  u_int *ht_bin=hash_table[((vaddr>>16)^vaddr)&0xFFFF];
+  u_int addr;
+  cache_stats.samples++;
+  if(ht_bin[0]==vaddr) addr=ht_bin[1];
+  else if(ht_bin[2]==vaddr) addr=ht_bin[3];
+  else return;
+  chunk_samples[((addr-(u_int)base_addr)>>(cache_size_2-3))&(CACHE_CHUNKS-1)]++;
+}
+
+// The interrupt following a polling loop skip adds the skipped cycles
+void new_dynarec_count_polling_skip(void)
+{
+  int cc=polling_cycle_count;
+  polling_cycle_count=0;
+  // Count went from next_interrupt+cc to next_interrupt+(cc&3)
+  if(cc<0) g_dev.r4300.idle_skipped_cycles+=(u_int)((cc&3)-cc);
+}
+
 // Add virtual address mapping to linked list
 static void ll_add(struct ll_entry **head,int vaddr,void *addr)
 {
@@ -1763,13 +1805,15 @@ static void ll_add_32(struct ll_entry **head,int vaddr,u_int reg32,void *addr)
   *head=new_entry;
 }
 
-static void ll_remove_matching_addrs(struct ll_entry **head,int addr,int shift)
+// Remove the entries in the given block of the cache, and unless head_too is
+// 0, in the first MAX_OUTPUT_BLOCK_SIZE bytes of the following one
+static void ll_remove_matching_addrs(struct ll_entry **head,int addr,int shift,int head_too)
 {
   struct ll_entry **cur=head;
   struct ll_entry *next;
   while(*cur) {
     if((((u_int)((*cur)->addr)-(u_int)base_addr)>>shift)==((addr-(u_int)base_addr)>>shift) ||
-       (((u_int)((*cur)->addr)-(u_int)base_addr-MAX_OUTPUT_BLOCK_SIZE)>>shift)==((addr-(u_int)base_addr)>>shift))
+       (head_too&&(((u_int)((*cur)->addr)-(u_int)base_addr-MAX_OUTPUT_BLOCK_SIZE)>>shift)==((addr-(u_int)base_addr)>>shift)))
     {
       if(head>=jump_dirty&&head<(jump_dirty+4096)){
         u_int copy,length;
@@ -1781,6 +1825,8 @@ static void ll_remove_matching_addrs(struct ll_entry **head,int addr,int shift)
           copy_size-=length+4;
         }
       }
+      if(head>=jump_in&&head<(jump_in+4096))
+        cache_stats.evictions++;
       inv_debug("EXP: Remove pointer to %x (%x)\n",(int)(*cur)->addr,(*cur)->vaddr);
       remove_hash((*cur)->vaddr);
       next=(*cur)->next;
@@ -1841,6 +1887,100 @@ static void ll_kill_pointers(struct ll_entry *head,int addr,int shift)
   }
 }
 
+// Remove the hash table entries pointing in the given block of the cache,
+// or in the first MAX_OUTPUT_BLOCK_SIZE bytes of the following one
+static void ht_remove_matching_addrs(u_int *ht_bin,int addr,int shift)
+{
+  if(((ht_bin[3]-(u_int)base_addr)>>shift)==((addr-(u_int)base_addr)>>shift) ||
+     ((ht_bin[3]-(u_int)base_addr-MAX_OUTPUT_BLOCK_SIZE)>>shift)==((addr-(u_int)base_addr)>>shift)) {
+    inv_debug("EXP: Remove hash %x -> %x\n",ht_bin[2],ht_bin[3]);
+    ht_bin[2]=ht_bin[3]=-1;
+  }
+  if(((ht_bin[1]-(u_int)base_addr)>>shift)==((addr-(u_int)base_addr)>>shift) ||
+     ((ht_bin[1]-(u_int)base_addr-MAX_OUTPUT_BLOCK_SIZE)>>shift)==((addr-(u_int)base_addr)>>shift)) {
+    inv_debug("EXP: Remove hash %x -> %x\n",ht_bin[0],ht_bin[1]);
+    ht_bin[0]=ht_bin[2];
+    ht_bin[1]=ht_bin[3];
+    ht_bin[2]=ht_bin[3]=-1;
+  }
+}
+
+// Decide whether expiry will skip an eighth of the cache on this pass.
+// Its samples are cleared either way, so it has to stay hot to be kept
+// on the next pass. The eighth being written to is never kept.
+static void choose_kept_chunk(int chunk)
+{
+  u_int total=0;
+  int kept=0;
+  int n;
+  for(n=0;n<CACHE_CHUNKS;n++) {
+    total+=chunk_samples[n];
+    if(n!=chunk) kept+=chunk_kept[n];
+  }
+  chunk_kept[chunk]=chunk_samples[chunk]>=HOT_CHUNK_SAMPLES&&
+                    chunk_samples[chunk]*4>=total&&
+                    kept<MAX_KEPT_CHUNKS&&
+                    chunk!=(int)(((u_int)out-(u_int)base_addr)>>(cache_size_2-3));
+  chunk_samples[chunk]=0;
+  if(chunk_kept[chunk]) cache_stats.kept++;
+}
+
+// A kept eighth is followed by one which gets overwritten. The blocks in
+// its last MAX_OUTPUT_BLOCK_SIZE bytes may run into the next eighth, so
+// their entry points are dropped. The code itself stays, and so do the
+// jump_out entries of its branches, which may still be reached from
+// the blocks before.
+static void expire_chunk_tail(int chunk)
+{
+  int shift=18; // log2(MAX_OUTPUT_BLOCK_SIZE)
+  int tail=(int)base_addr+((chunk+1)<<(cache_size_2-3))-MAX_OUTPUT_BLOCK_SIZE;
+  int n;
+  assert((1<<shift)==MAX_OUTPUT_BLOCK_SIZE);
+  for(n=0;n<4096;n++) {
+    ll_remove_matching_addrs(jump_in+n,tail,shift,1);
+    ll_remove_matching_addrs(jump_dirty+n,tail,shift,1);
+  }
+  for(n=0;n<4096;n++)
+    ll_kill_pointers(jump_out[n],tail,shift);
+  for(n=0;n<65536;n++)
+    ht_remove_matching_addrs(hash_table[n],tail,shift);
+  #if NEW_DYNAREC == NEW_DYNAREC_ARM
+  do_clear_cache();
+  #endif
+}
+
+// Called when expiry reaches the start of an eighth of the cache. Returns
+// the expiry pointer, past the eighths which are kept on this pass.
+static int enter_chunk(int chunk)
+{
+  while(1) {
+    choose_kept_chunk((chunk+1)&(CACHE_CHUNKS-1));
+    if(!chunk_kept[chunk]) break;
+    // Blocks at the end of the cache never run on into the first eighth
+    if(chunk<CACHE_CHUNKS-1&&!chunk_kept[chunk+1]) expire_chunk_tail(chunk);
+    chunk=(chunk+1)&(CACHE_CHUNKS-1);
+  }
+  chunk_samples[chunk]=0;
+  return chunk<<13;
+}
+
+// Move the output pointer past the kept eighths of the cache, so that no
+// block is written into one of them
+static void skip_kept_chunks(void)
+{
+  int shift=cache_size_2-3;
+  int n;
+  for(n=0;n<CACHE_CHUNKS;n++) {
+    int chunk=((u_int)out-(u_int)base_addr)>>shift;
+    if(chunk_kept[chunk])
+      out=(u_char *)base_addr+(((chunk+1)&(CACHE_CHUNKS-1))<<shift);
+    else if(chunk<CACHE_CHUNKS-1&&chunk_kept[chunk+1]&&
+            out>(u_char *)base_addr+((chunk+1)<<shift)-MAX_OUTPUT_BLOCK_SIZE)
+      out=(u_char *)base_addr+((chunk+1)<<shift);
+    else break;
+  }
+}
+
 // Add an entry to jump_out after making a link
 static void add_link(u_int vaddr,void *src)
 {
@@ -1866,6 +2006,7 @@ static void *dynamic_linker(void * src, u_int vaddr)
 
   while(head!=NULL) {
     if(head->vaddr==vaddr&&head->reg32==0) {
+      cache_stats.lookups++;
       add_link(vaddr, add_pointer(src,head->addr));
       return head->addr;
     }
@@ -1881,7 +2022,7 @@ static void *dynamic_linker(void * src, u_int vaddr)
     if(head->vaddr==vaddr&&head->reg32==0) {
       //DebugMessage(M64MSG_VERBOSE, "TRACE: count=%d next=%d (get_addr match dirty %x: %x)",r4300_cp0_regs()[CP0_COUNT_REG],*r4300_cp0_next_interrupt(),vaddr,(int)head->addr);
       // Don't restore blocks which are about to expire from the cache
-      if((((u_int)head->addr-(u_int)out)<<(32-TARGET_SIZE_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-TARGET_SIZE_2))) {
+      if((((u_int)head->addr-(u_int)out)<<(32-cache_size_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-cache_size_2))) {
         if(verify_dirty(head->addr)) {
           //DebugMessage(M64MSG_VERBOSE, "restore candidate: %x (%d) d=%d",vaddr,page,g_dev.r4300.cached_interp.invalid_code[vaddr>>12]);
           g_dev.r4300.cached_interp.invalid_code[vaddr>>12]=0;
@@ -1920,6 +2061,7 @@ static void *dyna_linker(void * src, u_int vaddr)
   void *addr=dynamic_linker(src,vaddr);
   if(addr==NULL)
   {
+    cache_stats.misses++;
     if(new_recompile_block(vaddr)==0)
     {
       addr=dynamic_linker(src,vaddr);
@@ -1936,6 +2078,7 @@ static void *dyna_linker_ds(void * src, u_int vaddr)
   void *addr=dynamic_linker(src,vaddr);
   if(addr==NULL)
   {
+    cache_stats.misses++;
     if(new_recompile_block((vaddr&0xFFFFFFF8)+1)==0)
     {
       addr=dynamic_linker(src,vaddr);
@@ -1963,6 +2106,7 @@ void *get_addr(u_int vaddr)
   while(head!=NULL) {
     if(head->vaddr==vaddr&&head->reg32==0) {
   //DebugMessage(M64MSG_VERBOSE, "TRACE: count=%d next=%d (get_addr match %x: %x)",r4300_cp0_regs()[CP0_COUNT_REG],g_dev.r4300.cp0.next_interrupt,vaddr,(int)head->addr);
+      cache_stats.lookups++;
       u_int *ht_bin=hash_table[((vaddr>>16)^vaddr)&0xFFFF];
       ht_bin[3]=ht_bin[1];
       ht_bin[2]=ht_bin[0];
@@ -1977,7 +2121,7 @@ void *get_addr(u_int vaddr)
     if(head->vaddr==vaddr&&head->reg32==0) {
       //DebugMessage(M64MSG_VERBOSE, "TRACE: count=%d next=%d (get_addr match dirty %x: %x)",r4300_cp0_regs()[CP0_COUNT_REG],g_dev.r4300.cp0.next_interrupt,vaddr,(int)head->addr);
       // Don't restore blocks which are about to expire from the cache
-      if((((u_int)head->addr-(u_int)out)<<(32-TARGET_SIZE_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-TARGET_SIZE_2))) {
+      if((((u_int)head->addr-(u_int)out)<<(32-cache_size_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-cache_size_2))) {
         if(verify_dirty(head->addr)) {
           //DebugMessage(M64MSG_VERBOSE, "restore candidate: %x (%d) d=%d",vaddr,page,g_dev.r4300.cached_interp.invalid_code[vaddr>>12]);
           g_dev.r4300.cached_interp.invalid_code[vaddr>>12]=0;
@@ -2008,6 +2152,7 @@ void *get_addr(u_int vaddr)
     head=head->next;
   }
   //DebugMessage(M64MSG_VERBOSE, "TRACE: count=%d next=%d (get_addr no-match %x)",r4300_cp0_regs()[CP0_COUNT_REG],g_dev.r4300.cp0.next_interrupt,vaddr);
+  cache_stats.misses++;
   int r=new_recompile_block(vaddr);
   if(r==0) return get_addr(vaddr);
   // Execute in unmapped page, generate pagefault execption
@@ -2040,6 +2185,7 @@ void *get_addr_32(u_int vaddr,u_int flags)
   while(head!=NULL) {
     if(head->vaddr==vaddr&&(head->reg32&flags)==0) {
       //DebugMessage(M64MSG_VERBOSE, "TRACE: count=%d next=%d (get_addr_32 match %x: %x)",r4300_cp0_regs()[CP0_COUNT_REG],g_dev.r4300.cp0.next_interrupt,vaddr,(int)head->addr);
+      cache_stats.lookups++;
       if(head->reg32==0) {
         u_int *ht_bin=hash_table[((vaddr>>16)^vaddr)&0xFFFF];
         if(ht_bin[0]==-1) {
@@ -2063,7 +2209,7 @@ void *get_addr_32(u_int vaddr,u_int flags)
     if(head->vaddr==vaddr&&(head->reg32&flags)==0) {
       //DebugMessage(M64MSG_VERBOSE, "TRACE: count=%d next=%d (get_addr_32 match dirty %x: %x)",r4300_cp0_regs()[CP0_COUNT_REG],g_dev.r4300.cp0.next_interrupt,vaddr,(int)head->addr);
       // Don't restore blocks which are about to expire from the cache
-      if((((u_int)head->addr-(u_int)out)<<(32-TARGET_SIZE_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-TARGET_SIZE_2))) {
+      if((((u_int)head->addr-(u_int)out)<<(32-cache_size_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-cache_size_2))) {
         if(verify_dirty(head->addr)) {
           //DebugMessage(M64MSG_VERBOSE, "restore candidate: %x (%d) d=%d",vaddr,page,g_dev.r4300.cached_interp.invalid_code[vaddr>>12]);
           g_dev.r4300.cached_interp.invalid_code[vaddr>>12]=0;
@@ -2097,6 +2243,7 @@ void *get_addr_32(u_int vaddr,u_int flags)
     head=head->next;
   }
   //DebugMessage(M64MSG_VERBOSE, "TRACE: count=%d next=%d (get_addr_32 no-match %x,flags %x)",r4300_cp0_regs()[CP0_COUNT_REG],g_dev.r4300.cp0.next_interrupt,vaddr,flags);
+  cache_stats.misses++;
   int r=new_recompile_block(vaddr);
   if(r==0) return get_addr(vaddr);
   // Execute in unmapped page, generate pagefault execption
@@ -2139,11 +2286,11 @@ static void *check_addr(u_int vaddr)
 {
   u_int *ht_bin=hash_table[((vaddr>>16)^vaddr)&0xFFFF];
   if(ht_bin[0]==vaddr) {
-    if(((ht_bin[1]-MAX_OUTPUT_BLOCK_SIZE-(u_int)out)<<(32-TARGET_SIZE_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-TARGET_SIZE_2)))
+    if(((ht_bin[1]-MAX_OUTPUT_BLOCK_SIZE-(u_int)out)<<(32-cache_size_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-cache_size_2)))
       if(isclean(ht_bin[1])) return (void *)ht_bin[1];
   }
   if(ht_bin[2]==vaddr) {
-    if(((ht_bin[3]-MAX_OUTPUT_BLOCK_SIZE-(u_int)out)<<(32-TARGET_SIZE_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-TARGET_SIZE_2)))
+    if(((ht_bin[3]-MAX_OUTPUT_BLOCK_SIZE-(u_int)out)<<(32-cache_size_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-cache_size_2)))
       if(isclean(ht_bin[3])) return (void *)ht_bin[3];
   }
   u_int page=(vaddr^0x80000000)>>12;
@@ -2153,7 +2300,7 @@ static void *check_addr(u_int vaddr)
   head=jump_in[page];
   while(head!=NULL) {
     if(head->vaddr==vaddr&&head->reg32==0) {
-      if((((u_int)head->addr-(u_int)out)<<(32-TARGET_SIZE_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-TARGET_SIZE_2))) {
+      if((((u_int)head->addr-(u_int)out)<<(32-cache_size_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-cache_size_2))) {
         // Update existing entry with current address
         if(ht_bin[0]==vaddr) {
           ht_bin[1]=(int)head->addr;
@@ -2181,6 +2328,13 @@ static void *check_addr(u_int vaddr)
   return 0;
 }
 
+void new_dynarec_get_cache_stats(struct new_dynarec_cache_stats* stats)
+{
+  *stats=cache_stats;
+  stats->size=1u<<cache_size_2;
+  stats->used=(u_int)(out-(u_char *)base_addr);
+}
+
 // This is called when we write to a compiled block (see do_invstub)
 static void invalidate_page(u_int page)
 {
@@ -2294,6 +2448,29 @@ void invalidate_cached_code_new_dynarec(struct r4300_core* r4300, uint32_t addre
         invalidate_block(i);
 }
 
+void invalidate_rdram_cached_code_new_dynarec(struct r4300_core* r4300, uint32_t address, size_t size)
+{
+    size_t i;
+    size_t begin;
+    size_t end;
+
+    if (size == 0)
+    {
+        invalidate_cached_code_new_dynarec(r4300, 0, 0);
+        return;
+    }
+
+    /* both kseg0 and kseg1 mirrors in a single pass */
+    begin = (address & 0x1fffffff) >> 12;
+    end = ((address & 0x1fffffff)+size-1) >> 12;
+
+    for(i = begin; i <= end; ++i)
+    {
+        invalidate_block(0x80000 + i);
+        invalidate_block(0xa0000 + i);
+    }
+}
+
 // This is called when loading a save state.
 // Anything could have changed, so invalidate everything.
 void invalidate_all_pages(void)
@@ -2309,8 +2486,8 @@ void invalidate_all_pages(void)
     }
   }
   #if NEW_DYNAREC == NEW_DYNAREC_ARM
-  __clear_cache((void *)base_addr,(void *)base_addr+(1<<TARGET_SIZE_2));
-  //cacheflush((void *)base_addr,(void *)base_addr+(1<<TARGET_SIZE_2),0);
+  __clear_cache((void *)base_addr,(void *)base_addr+(1<<cache_size_2));
+  //cacheflush((void *)base_addr,(void *)base_addr+(1<<cache_size_2),0);
   #endif
   #ifdef USE_MINI_HT
   memset(mini_ht,-1,sizeof(mini_ht));
@@ -2340,7 +2517,7 @@ void clean_blocks(u_int page)
   while(head!=NULL) {
     if(!g_dev.r4300.cached_interp.invalid_code[head->vaddr>>12]) {
       // Don't restore blocks which are about to expire from the cache
-      if((((u_int)head->addr-(u_int)out)<<(32-TARGET_SIZE_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-TARGET_SIZE_2))) {
+      if((((u_int)head->addr-(u_int)out)<<(32-cache_size_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-cache_size_2))) {
         u_int start,end;
         if(verify_dirty(head->addr)) {
           //DebugMessage(M64MSG_VERBOSE, "Possibly Restore %x (%x)",head->vaddr, (int)head->addr);
@@ -2362,7 +2539,7 @@ void clean_blocks(u_int page)
           }
           if(!inv) {
             void * clean_addr=(void *)get_clean_addr((int)head->addr);
-            if((((u_int)clean_addr-(u_int)out)<<(32-TARGET_SIZE_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-TARGET_SIZE_2))) {
+            if((((u_int)clean_addr-(u_int)out)<<(32-cache_size_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-cache_size_2))) {
               u_int ppage=page;
               if(page<2048&&g_dev.r4300.cp0.tlb.LUT_r[head->vaddr>>12]) ppage=(g_dev.r4300.cp0.tlb.LUT_r[head->vaddr>>12]^0x80000000)>>12;
               inv_debug("INV: Restored %x (%x/%x)\n",head->vaddr, (int)head->addr, (int)clean_addr);
@@ -5700,6 +5877,15 @@ static void ds_assemble_entry(int i)
   emit_jmp(0);
 }
 
+// Backward branch within the block closing a loop which only polls memory,
+// see idle_loop.h. Loads through registers can't be checked here.
+static int is_polling_loop(int i)
+{
+  int t=(ba[i]-start)>>2;
+  if(!g_dev.r4300.idle_loop_skip||ba[i]<start||t>=i||i+1>=slen) return 0;
+  return r4300_idle_loop_kind(source+t,i+2-t)==IDLE_LOOP_STATIC;
+}
+
 static void do_cc(int i,signed char i_regmap[],int *adj,int addr,int taken,int invert)
 {
   int count;
@@ -5730,6 +5916,19 @@ static void do_cc(int i,signed char i_regmap[],int *adj,int addr,int taken,int i
     jaddr=(int)out;
     emit_jmp(0);
   }
+  else if(taken==TAKEN && is_polling_loop(i)) {
+    // Polling loop, take the interrupt now and run the loop again after it
+    #ifdef HOST_TEMPREG
+    emit_movimm((int)&polling_cycle_count,HOST_TEMPREG);
+    emit_writeword_indexed(HOST_CCREG,0,HOST_TEMPREG);
+    #else
+    emit_writeword(HOST_CCREG,(int)&polling_cycle_count);
+    #endif
+    emit_andimm(HOST_CCREG,3,HOST_CCREG);
+    if(*adj==0) emit_addimm(HOST_CCREG,CLOCK_DIVIDER*(count+2),HOST_CCREG);
+    jaddr=(int)out;
+    emit_jmp(0);
+  }
   else if(*adj==0||invert) {
     emit_addimm_and_set_flags(CLOCK_DIVIDER*(count+2),HOST_CCREG);
     jaddr=(int)out;
@@ -7592,15 +7791,26 @@ void new_dynarec_init(void)
   DebugMessage(M64MSG_INFO, "Init new dynarec");
 
 #if NEW_DYNAREC == NEW_DYNAREC_ARM
-  if ((base_addr = mmap ((u_char *)BASE_ADDR, 1<<TARGET_SIZE_2,
+  // The ARM code region is a fixed block reserved by linkage_arm.S
+  cache_size_2=TARGET_SIZE_2;
+#else
+  cache_size_2=MIN_CACHE_SIZE_2;
+  if(translation_cache_mb==0) cache_size_2=TARGET_SIZE_2;
+  while(cache_size_2<TARGET_SIZE_2&&(1u<<(cache_size_2-20))<translation_cache_mb) cache_size_2++;
+#endif
+  DebugMessage(M64MSG_VERBOSE, "Translation cache: %u MB", 1u<<(cache_size_2-20));
+  memset(&cache_stats,0,sizeof(cache_stats));
+
+#if NEW_DYNAREC == NEW_DYNAREC_ARM
+  if ((base_addr = mmap ((u_char *)BASE_ADDR, 1<<cache_size_2,
             PROT_READ | PROT_WRITE | PROT_EXEC,
             MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS,
             -1, 0)) <= 0) {DebugMessage(M64MSG_ERROR, "mmap() failed");}
 #else
 #if defined(WIN32)
-  base_addr = VirtualAlloc(NULL, 1<<TARGET_SIZE_2, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+  base_addr = VirtualAlloc(NULL, 1<<cache_size_2, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
 #else
-  if ((base_addr = mmap (NULL, 1<<TARGET_SIZE_2,
+  if ((base_addr = mmap (NULL, 1<<cache_size_2,
             PROT_READ | PROT_WRITE | PROT_EXEC,
             MAP_PRIVATE | MAP_ANONYMOUS,
             -1, 0)) <= 0) {DebugMessage(M64MSG_ERROR, "mmap() failed");}
@@ -7621,6 +7831,8 @@ void new_dynarec_init(void)
   memset(restore_candidate,0,sizeof(restore_candidate));
   copy_size=0;
   expirep=16384; // Expiry pointer, +2 blocks
+  memset(chunk_samples,0,sizeof(chunk_samples));
+  memset(chunk_kept,0,sizeof(chunk_kept));
   pending_exception=0;
   literalcount=0;
 #ifdef HOST_IMM8
@@ -7683,17 +7895,19 @@ void new_dynarec_cleanup(void)
   for(n=0;n<4096;n++) ll_clear(jump_out+n);
   for(n=0;n<4096;n++) ll_clear(jump_dirty+n);
   assert(copy_size==0);
+  DebugMessage(M64MSG_INFO, "Translation cache: %u lookups, %u misses, %u PC samples, %u evictions, %u hot eighths kept",
+               cache_stats.lookups, cache_stats.misses, cache_stats.samples, cache_stats.evictions, cache_stats.kept);
 #if defined(WIN32)
   VirtualFree(base_addr, 0, MEM_RELEASE);
 #else
-  if (munmap (base_addr, 1<<TARGET_SIZE_2) < 0) {DebugMessage(M64MSG_ERROR, "munmap() failed");}
+  if (munmap (base_addr, 1<<cache_size_2) < 0) {DebugMessage(M64MSG_ERROR, "munmap() failed");}
 #endif
   #ifdef ROM_COPY
   if (munmap (ROM_COPY, 67108864) < 0) {DebugMessage(M64MSG_ERROR, "munmap() failed");}
   #endif
 }
 
-int new_recompile_block(int addr)
+static int do_new_recompile_block(int addr)
 {
   assem_debug("NOTCOMPILED: addr = %x -> %x", (int)addr, (int)out);
 #if COUNT_NOTCOMPILEDS
@@ -10902,8 +11116,9 @@ int new_recompile_block(int addr)
 
   // If we're within 256K of the end of the buffer,
   // start over from the beginning. (Is 256K enough?)
-  if(out > (u_char *)((u_char *)base_addr+(1<<TARGET_SIZE_2)-MAX_OUTPUT_BLOCK_SIZE-JUMP_TABLE_SIZE))
+  if(out > (u_char *)((u_char *)base_addr+(1<<cache_size_2)-MAX_OUTPUT_BLOCK_SIZE-JUMP_TABLE_SIZE))
     out=(u_char *)base_addr;
+  skip_kept_chunks();
   
   // Trap writes to any of the pages we compiled
   for(i=start>>12;i<=(int)((start+slen*4-4)>>12);i++) {
@@ -10919,22 +11134,23 @@ int new_recompile_block(int addr)
     }
   }
   
-  /* Pass 10 - Free memory by expiring oldest blocks */
+  /* Pass 10 - Free memory by expiring oldest blocks, except in hot eighths */
   
-  int end=((((intptr_t)out-(intptr_t)base_addr)>>(TARGET_SIZE_2-16))+16384)&65535;
-  while(expirep!=end)
+  int end=((((intptr_t)out-(intptr_t)base_addr)>>(cache_size_2-16))+16384)&65535;
+  // Skipping kept eighths may take the expiry pointer past the end
+  while(expirep!=end&&((end-expirep)&65535)<32768)
   {
-    int shift=TARGET_SIZE_2-3; // Divide into 8 blocks
+    int shift=cache_size_2-3; // Divide into 8 blocks
     int base=(int)base_addr+((expirep>>13)<<shift); // Base address of this block
     inv_debug("EXP: Phase %d\n",expirep);
     switch((expirep>>11)&3)
     {
       case 0:
         // Clear jump_in and jump_dirty
-        ll_remove_matching_addrs(jump_in+(expirep&2047),base,shift);
-        ll_remove_matching_addrs(jump_dirty+(expirep&2047),base,shift);
-        ll_remove_matching_addrs(jump_in+2048+(expirep&2047),base,shift);
-        ll_remove_matching_addrs(jump_dirty+2048+(expirep&2047),base,shift);
+        ll_remove_matching_addrs(jump_in+(expirep&2047),base,shift,1);
+        ll_remove_matching_addrs(jump_dirty+(expirep&2047),base,shift,1);
+        ll_remove_matching_addrs(jump_in+2048+(expirep&2047),base,shift,1);
+        ll_remove_matching_addrs(jump_dirty+2048+(expirep&2047),base,shift,1);
         break;
       case 1:
         // Clear pointers
@@ -10943,21 +11159,8 @@ int new_recompile_block(int addr)
         break;
       case 2:
         // Clear hash table
-        for(i=0;i<32;i++) {
-          u_int *ht_bin=hash_table[((expirep&2047)<<5)+i];
-          if(((ht_bin[3]-(u_int)base_addr)>>shift)==((base-(u_int)base_addr)>>shift) ||
-             ((ht_bin[3]-(u_int)base_addr-MAX_OUTPUT_BLOCK_SIZE)>>shift)==((base-(u_int)base_addr)>>shift)) {
-            inv_debug("EXP: Remove hash %x -> %x\n",ht_bin[2],ht_bin[3]);
-            ht_bin[2]=ht_bin[3]=-1;
-          }
-          if(((ht_bin[1]-(u_int)base_addr)>>shift)==((base-(u_int)base_addr)>>shift) ||
-             ((ht_bin[1]-(u_int)base_addr-MAX_OUTPUT_BLOCK_SIZE)>>shift)==((base-(u_int)base_addr)>>shift)) {
-            inv_debug("EXP: Remove hash %x -> %x\n",ht_bin[0],ht_bin[1]);
-            ht_bin[0]=ht_bin[2];
-            ht_bin[1]=ht_bin[3];
-            ht_bin[2]=ht_bin[3]=-1;
-          }
-        }
+        for(i=0;i<32;i++)
+          ht_remove_matching_addrs(hash_table[((expirep&2047)<<5)+i],base,shift);
         break;
       case 3:
         // Clear jump_out
@@ -10965,15 +11168,26 @@ int new_recompile_block(int addr)
         if((expirep&2047)==0) 
           do_clear_cache();
         #endif
-        ll_remove_matching_addrs(jump_out+(expirep&2047),base,shift);
-        ll_remove_matching_addrs(jump_out+2048+(expirep&2047),base,shift);
+        // The code at the start of a kept eighth stays, keep its links
+        ll_remove_matching_addrs(jump_out+(expirep&2047),base,shift,!chunk_kept[((expirep>>13)+1)&(CACHE_CHUNKS-1)]);
+        ll_remove_matching_addrs(jump_out+2048+(expirep&2047),base,shift,!chunk_kept[((expirep>>13)+1)&(CACHE_CHUNKS-1)]);
         break;
     }
     expirep=(expirep+1)&65535;
+    if((expirep&8191)==0) expirep=enter_chunk(expirep>>13);
   }
   return 0;
 }
 
+// Compilation is always timed, for M64CMD_GET_RUN_STATS
+int new_recompile_block(int addr)
+{
+  uint64_t start=get_monotonic_time_ns(NULL);
+  int r=do_new_recompile_block(addr);
+  g_dev.r4300.compile_ns+=get_monotonic_time_ns(NULL)-start;
+  return r;
+}
+
 /* interpreted opcode */
 static void div64(int64_t dividend,int64_t divisor)
 {
@@ -11013,150 +11227,82 @@ static uint64_t ldr_merge(uint64_t original,uint64_t loaded,u_int bits)
   return original;
 }
 
-static void TLBWI_new(void)
+/* Only the pages whose translation changes are invalidated and remapped,
+   rewriting an entry with the same mapping leaves the cached code alone. */
+static size_t tlb_write_begin_new(unsigned int idx, struct tlb_page_range* ranges)
 {
+  struct tlb_entry e;
+  size_t k, n;
   unsigned int i;
+  tlb_entry_from_cp0(&e,r4300_cp0_regs()[CP0_ENTRYLO0_REG],r4300_cp0_regs()[CP0_ENTRYLO1_REG],
+                     r4300_cp0_regs()[CP0_ENTRYHI_REG],r4300_cp0_regs()[CP0_PAGEMASK_REG]);
+  n=tlb_changed_pages(&g_dev.r4300.cp0.tlb,idx,&e,ranges);
   /* Remove old entries */
-  unsigned int old_start_even=g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].start_even;
-  unsigned int old_end_even=g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].end_even;
-  unsigned int old_start_odd=g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].start_odd;
-  unsigned int old_end_odd=g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].end_odd;
-  for (i=old_start_even>>12; i<=old_end_even>>12; i++)
-  {
-    if(i<0x80000||i>0xBFFFF)
-    {
-      invalidate_block(i);
-      memory_map[i]=-1;
-    }
-  }
-  for (i=old_start_odd>>12; i<=old_end_odd>>12; i++)
+  for (k=0;k<n;k++)
   {
-    if(i<0x80000||i>0xBFFFF)
+    if(!ranges[k].old) continue;
+    for (i=ranges[k].begin; i<=ranges[k].end; i++)
     {
-      invalidate_block(i);
-      memory_map[i]=-1;
-    }
-  }
-  cached_interpreter_table.TLBWI();
-  //DebugMessage(M64MSG_VERBOSE, "TLBWI: index=%d",r4300_cp0_regs()[CP0_INDEX_REG]);
-  //DebugMessage(M64MSG_VERBOSE, "TLBWI: start_even=%x end_even=%x phys_even=%x v=%d d=%d",g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].start_even,g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].end_even,g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].phys_even,g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].v_even,g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].d_even);
-  //DebugMessage(M64MSG_VERBOSE, "TLBWI: start_odd=%x end_odd=%x phys_odd=%x v=%d d=%d",g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].start_odd,g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].end_odd,g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].phys_odd,g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].v_odd,g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].d_odd);
-  /* Combine g_dev.r4300.cp0.tlb.LUT_r, g_dev.r4300.cp0.tlb.LUT_w, and invalid_code into a single table
-     for fast look up. */
-  for (i=g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].start_even>>12; i<=g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].end_even>>12; i++)
-  {
-    //DebugMessage(M64MSG_VERBOSE, "%x: r:%8x w:%8x",i,g_dev.r4300.cp0.tlb.LUT_r[i],g_dev.r4300.cp0.tlb.LUT_w[i]);
-    if(i<0x80000||i>0xBFFFF)
-    {
-      if(g_dev.r4300.cp0.tlb.LUT_r[i]) {
-        memory_map[i]=((g_dev.r4300.cp0.tlb.LUT_r[i]&0xFFFFF000)-(i<<12)+(unsigned int)g_dev.ri.rdram.dram-0x80000000)>>2;
-        // FIXME: should make sure the physical page is invalid too
-        if(!g_dev.r4300.cp0.tlb.LUT_w[i]||!g_dev.r4300.cached_interp.invalid_code[i]) {
-          memory_map[i]|=0x40000000; // Write protect
-        }else{
-          assert(g_dev.r4300.cp0.tlb.LUT_r[i]==g_dev.r4300.cp0.tlb.LUT_w[i]);
-        }
-        if(!using_tlb) DebugMessage(M64MSG_VERBOSE, "Enabled TLB");
-        // Tell the dynamic recompiler to generate tlb lookup code
-        using_tlb=1;
+      if(i<0x80000||i>0xBFFFF)
+      {
+        invalidate_block(i);
+        memory_map[i]=-1;
       }
-      else memory_map[i]=-1;
     }
-    //DebugMessage(M64MSG_VERBOSE, "memory_map[%x]: %8x (+%8x)",i,memory_map[i],memory_map[i]<<2);
   }
-  for (i=g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].start_odd>>12; i<=g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_INDEX_REG]&0x3F].end_odd>>12; i++)
+  return n;
+}
+
+static void tlb_write_end_new(const struct tlb_page_range* ranges, size_t n)
+{
+  size_t k;
+  unsigned int i;
+  /* Combine g_dev.r4300.cp0.tlb.LUT_r, g_dev.r4300.cp0.tlb.LUT_w, and invalid_code into a single table
+     for fast look up. The old ranges are recomputed too, since tlb_write
+     maps again the unchanged halves and other entries that overlap them. */
+  for (k=0;k<n;k++)
   {
-    //DebugMessage(M64MSG_VERBOSE, "%x: r:%8x w:%8x",i,g_dev.r4300.cp0.tlb.LUT_r[i],g_dev.r4300.cp0.tlb.LUT_w[i]);
-    if(i<0x80000||i>0xBFFFF)
+    for (i=ranges[k].begin; i<=ranges[k].end; i++)
     {
-      if(g_dev.r4300.cp0.tlb.LUT_r[i]) {
-        memory_map[i]=((g_dev.r4300.cp0.tlb.LUT_r[i]&0xFFFFF000)-(i<<12)+(unsigned int)g_dev.ri.rdram.dram-0x80000000)>>2;
-        // FIXME: should make sure the physical page is invalid too
-        if(!g_dev.r4300.cp0.tlb.LUT_w[i]||!g_dev.r4300.cached_interp.invalid_code[i]) {
-          memory_map[i]|=0x40000000; // Write protect
-        }else{
-          assert(g_dev.r4300.cp0.tlb.LUT_r[i]==g_dev.r4300.cp0.tlb.LUT_w[i]);
+      //DebugMessage(M64MSG_VERBOSE, "%x: r:%8x w:%8x",i,g_dev.r4300.cp0.tlb.LUT_r[i],g_dev.r4300.cp0.tlb.LUT_w[i]);
+      if(i<0x80000||i>0xBFFFF)
+      {
+        if(g_dev.r4300.cp0.tlb.LUT_r[i]) {
+          memory_map[i]=((g_dev.r4300.cp0.tlb.LUT_r[i]&0xFFFFF000)-(i<<12)+(unsigned int)g_dev.ri.rdram.dram-0x80000000)>>2;
+          // FIXME: should make sure the physical page is invalid too
+          if(!g_dev.r4300.cp0.tlb.LUT_w[i]||!g_dev.r4300.cached_interp.invalid_code[i]) {
+            memory_map[i]|=0x40000000; // Write protect
+          }else{
+            assert(g_dev.r4300.cp0.tlb.LUT_r[i]==g_dev.r4300.cp0.tlb.LUT_w[i]);
+          }
+          if(!using_tlb) DebugMessage(M64MSG_VERBOSE, "Enabled TLB");
+          // Tell the dynamic recompiler to generate tlb lookup code
+          using_tlb=1;
         }
-        if(!using_tlb) DebugMessage(M64MSG_VERBOSE, "Enabled TLB");
-        // Tell the dynamic recompiler to generate tlb lookup code
-        using_tlb=1;
+        else memory_map[i]=-1;
       }
-      else memory_map[i]=-1;
+      //DebugMessage(M64MSG_VERBOSE, "memory_map[%x]: %8x (+%8x)",i,memory_map[i],memory_map[i]<<2);
     }
-    //DebugMessage(M64MSG_VERBOSE, "memory_map[%x]: %8x (+%8x)",i,memory_map[i],memory_map[i]<<2);
   }
 }
 
+static void TLBWI_new(void)
+{
+  struct tlb_page_range ranges[TLB_MAX_CHANGED_RANGES];
+  size_t n=tlb_write_begin_new(r4300_cp0_regs()[CP0_INDEX_REG]&0x3F,ranges);
+  cached_interpreter_table.TLBWI();
+  //DebugMessage(M64MSG_VERBOSE, "TLBWI: index=%d",r4300_cp0_regs()[CP0_INDEX_REG]);
+  tlb_write_end_new(ranges,n);
+}
+
 static void TLBWR_new(void)
 {
-  unsigned int i;
+  struct tlb_page_range ranges[TLB_MAX_CHANGED_RANGES];
+  size_t n;
   r4300_cp0_regs()[CP0_RANDOM_REG] = (r4300_cp0_regs()[CP0_COUNT_REG]/2 % (32 - r4300_cp0_regs()[CP0_WIRED_REG])) + r4300_cp0_regs()[CP0_WIRED_REG];
-  /* Remove old entries */
-  unsigned int old_start_even=g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_RANDOM_REG]&0x3F].start_even;
-  unsigned int old_end_even=g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_RANDOM_REG]&0x3F].end_even;
-  unsigned int old_start_odd=g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_RANDOM_REG]&0x3F].start_odd;
-  unsigned int old_end_odd=g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_RANDOM_REG]&0x3F].end_odd;
-  for (i=old_start_even>>12; i<=old_end_even>>12; i++)
-  {
-    if(i<0x80000||i>0xBFFFF)
-    {
-      invalidate_block(i);
-      memory_map[i]=-1;
-    }
-  }
-  for (i=old_start_odd>>12; i<=old_end_odd>>12; i++)
-  {
-    if(i<0x80000||i>0xBFFFF)
-    {
-      invalidate_block(i);
-      memory_map[i]=-1;
-    }
-  }
+  n=tlb_write_begin_new(r4300_cp0_regs()[CP0_RANDOM_REG]&0x3F,ranges);
   cached_interpreter_table.TLBWR();
-  /* Combine g_dev.r4300.cp0.tlb.LUT_r, g_dev.r4300.cp0.tlb.LUT_w, and invalid_code into a single table
-     for fast look up. */
-  for (i=g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_RANDOM_REG]&0x3F].start_even>>12; i<=g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_RANDOM_REG]&0x3F].end_even>>12; i++)
-  {
-    //DebugMessage(M64MSG_VERBOSE, "%x: r:%8x w:%8x",i,g_dev.r4300.cp0.tlb.LUT_r[i],g_dev.r4300.cp0.tlb.LUT_w[i]);
-    if(i<0x80000||i>0xBFFFF)
-    {
-      if(g_dev.r4300.cp0.tlb.LUT_r[i]) {
-        memory_map[i]=((g_dev.r4300.cp0.tlb.LUT_r[i]&0xFFFFF000)-(i<<12)+(unsigned int)g_dev.ri.rdram.dram-0x80000000)>>2;
-        // FIXME: should make sure the physical page is invalid too
-        if(!g_dev.r4300.cp0.tlb.LUT_w[i]||!g_dev.r4300.cached_interp.invalid_code[i]) {
-          memory_map[i]|=0x40000000; // Write protect
-        }else{
-          assert(g_dev.r4300.cp0.tlb.LUT_r[i]==g_dev.r4300.cp0.tlb.LUT_w[i]);
-        }
-        if(!using_tlb) DebugMessage(M64MSG_VERBOSE, "Enabled TLB");
-        // Tell the dynamic recompiler to generate tlb lookup code
-        using_tlb=1;
-      }
-      else memory_map[i]=-1;
-    }
-    //DebugMessage(M64MSG_VERBOSE, "memory_map[%x]: %8x (+%8x)",i,memory_map[i],memory_map[i]<<2);
-  }
-  for (i=g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_RANDOM_REG]&0x3F].start_odd>>12; i<=g_dev.r4300.cp0.tlb.entries[r4300_cp0_regs()[CP0_RANDOM_REG]&0x3F].end_odd>>12; i++)
-  {
-    //DebugMessage(M64MSG_VERBOSE, "%x: r:%8x w:%8x",i,g_dev.r4300.cp0.tlb.LUT_r[i],g_dev.r4300.cp0.tlb.LUT_w[i]);
-    if(i<0x80000||i>0xBFFFF)
-    {
-      if(g_dev.r4300.cp0.tlb.LUT_r[i]) {
-        memory_map[i]=((g_dev.r4300.cp0.tlb.LUT_r[i]&0xFFFFF000)-(i<<12)+(unsigned int)g_dev.ri.rdram.dram-0x80000000)>>2;
-        // FIXME: should make sure the physical page is invalid too
-        if(!g_dev.r4300.cp0.tlb.LUT_w[i]||!g_dev.r4300.cached_interp.invalid_code[i]) {
-          memory_map[i]|=0x40000000; // Write protect
-        }else{
-          assert(g_dev.r4300.cp0.tlb.LUT_r[i]==g_dev.r4300.cp0.tlb.LUT_w[i]);
-        }
-        if(!using_tlb) DebugMessage(M64MSG_VERBOSE, "Enabled TLB");
-        // Tell the dynamic recompiler to generate tlb lookup code
-        using_tlb=1;
-      }
-      else memory_map[i]=-1;
-    }
-    //DebugMessage(M64MSG_VERBOSE, "memory_map[%x]: %8x (+%8x)",i,memory_map[i],memory_map[i]<<2);
-  }
+  tlb_write_end_new(ranges,n);
 }
 
 /* used in assembler files */
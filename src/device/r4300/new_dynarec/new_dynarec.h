@@ -31,9 +31,24 @@
 
 struct r4300_core;
 
+/* Translation cache counters, kept since new_dynarec_init */
+struct new_dynarec_cache_stats
+{
+    unsigned int size;          /* bytes reserved for generated code */
+    unsigned int used;          /* current output offset within the cache */
+    unsigned int lookups;       /* C dispatcher lookups resolved to compiled code,
+                                   including the one right after a compile;
+                                   linked jumps and hash table hits are not seen */
+    unsigned int misses;        /* C dispatcher lookups which had to compile */
+    unsigned int samples;       /* PCs sampled at interrupts to find hot code */
+    unsigned int evictions;     /* entry points expired to make room */
+    unsigned int kept;          /* times an eighth of the cache was spared by expiry for being hot */
+};
+
 extern int pcaddr;
 extern int pending_exception;
 extern unsigned int stop_after_jal;
+extern unsigned int translation_cache_mb;
 extern unsigned int using_tlb;
 
 #if NEW_DYNAREC == NEW_DYNAREC_ARM
@@ -61,8 +76,12 @@ extern uint32_t g_dev_r4300_cp1_fcr31;
 
 void invalidate_all_pages(void);
 void invalidate_cached_code_new_dynarec(struct r4300_core* r4300, uint32_t address, size_t size);
+void invalidate_rdram_cached_code_new_dynarec(struct r4300_core* r4300, uint32_t address, size_t size);
 void new_dynarec_init(void);
 void new_dyna_start(void);
 void new_dynarec_cleanup(void);
+void new_dynarec_get_cache_stats(struct new_dynarec_cache_stats* stats);
+void new_dynarec_sample_pc(unsigned int vaddr);
+void new_dynarec_count_polling_skip(void);
 
 #endif /* M64P_DEVICE_R4300_NEW_DYNAREC_H */
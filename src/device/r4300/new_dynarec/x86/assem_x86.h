@@ -14,7 +14,7 @@
 
 #define USE_MINI_HT 1
 
-#define TARGET_SIZE_2 25 // 2^25 = 32 megabytes
+#define TARGET_SIZE_2 25 // 2^25 = 32 megabytes, largest translation cache
 #define JUMP_TABLE_SIZE 0 // Not needed for 32-bit x86
 
 /* x86 calling convention:
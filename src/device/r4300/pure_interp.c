@@ -19,7 +19,10 @@
  *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
+#include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
@@ -34,8 +37,11 @@
 #include "device/r4300/cp1.h"
 #include "device/r4300/exception.h"
 #include "device/r4300/interrupt.h"
+#include "device/r4300/pure_interp.h"
 #include "device/r4300/tlb.h"
+#include "fuzzer/fuzzer_coverage.h"
 #include "main/main.h"
+#include "main/rom.h"
 #include "osal/preproc.h"
 
 #ifdef DBG
@@ -45,6 +51,7 @@
 
 
 static void InterpretOpcode(void);
+static void ExecuteOpcode(uint32_t op);
 
 #define PCADDR g_dev.r4300.interp_PC.addr
 #define ADD_TO_PC(x) g_dev.r4300.interp_PC.addr += x*4;
@@ -54,6 +61,7 @@ static void InterpretOpcode(void);
    { \
       const int take_jump = (condition); \
       const uint32_t jump_target = (destination); \
+      const uint32_t branch_pc = g_dev.r4300.interp_PC.addr; \
       int64_t *link_register = (link); \
       if (cop1 && check_cop1_unusable(&g_dev.r4300)) return; \
       if (link_register != &r4300_regs()[0]) \
@@ -77,6 +85,7 @@ static void InterpretOpcode(void);
          g_dev.r4300.interp_PC.addr += 8; \
          cp0_update_count(); \
       } \
+      fuzzer_coverage_edge(branch_pc, g_dev.r4300.interp_PC.addr); \
       g_dev.r4300.cp0.last_addr = g_dev.r4300.interp_PC.addr; \
       if (*r4300_cp0_next_interrupt() <= r4300_cp0_regs()[CP0_COUNT_REG]) gen_interrupt(); \
    } \
@@ -171,9 +180,8 @@ static void InterpretOpcode(void);
 
 #include "interpreter.def"
 
-void InterpretOpcode()
+static void ExecuteOpcode(uint32_t op)
 {
-	uint32_t op = *fast_mem_access(*r4300_pc());
 	switch ((op >> 26) & 0x3F) {
 	case 0: /* SPECIAL prefix */
 		switch (op & 0x3F) {
@@ -720,11 +728,220 @@ void InterpretOpcode()
 	} /* switch ((op >> 26) & 0x3F) */
 }
 
+/* Decoded instruction cache.
+ *
+ * Rather than fetching every instruction through fast_mem_access and then
+ * going through the switch above, the handler each instruction decodes to
+ * is kept per physical page. An entry is only used while the word it was
+ * decoded from is still the one in memory, so code overwritten by the CPU,
+ * DMA or the RSP never runs stale. What is cached across instructions is
+ * the mapping of the page holding the PC, which is dropped whenever it may
+ * have changed: after COP0 instructions and on invalidate_r4300_cached_code.
+ * Branches which may be idle loops depend on more than their own word and
+ * keep going through ExecuteOpcode, as does everything rarely executed. */
+typedef void (*pure_handler)(uint32_t op);
+
+struct decoded_op
+{
+	pure_handler handler;
+	uint32_t op;
+};
+
+struct decoded_page
+{
+	uint32_t paddr;
+	struct decoded_op ops[0x400];
+};
+
+/* Direct mapped on the physical page number */
+#define DECODED_PAGES 256
+
+static struct decoded_page* l_decoded[DECODED_PAGES];
+
+/* The page holding the PC. l_fetch_vaddr is not page aligned while there is none. */
+#define NO_FETCH_PAGE UINT32_C(1)
+static uint32_t l_fetch_vaddr = NO_FETCH_PAGE;
+static const uint32_t* l_fetch_mem;
+static struct decoded_page* l_fetch_page;
+
+static void COP0_REMAP(uint32_t op)
+{
+	ExecuteOpcode(op);
+	l_fetch_vaddr = NO_FETCH_PAGE;
+}
+
+static pure_handler DecodeOpcode(uint32_t op)
+{
+	switch ((op >> 26) & 0x3F) {
+	case 0: /* SPECIAL prefix */
+		switch (op & 0x3F) {
+		case 0: return RD_OF(op) != 0 ? SLL : NOP;
+		case 2: return RD_OF(op) != 0 ? SRL : NOP;
+		case 3: return RD_OF(op) != 0 ? SRA : NOP;
+		case 4: return RD_OF(op) != 0 ? SLLV : NOP;
+		case 6: return RD_OF(op) != 0 ? SRLV : NOP;
+		case 7: return RD_OF(op) != 0 ? SRAV : NOP;
+		case 16: return RD_OF(op) != 0 ? MFHI : NOP;
+		case 17: return MTHI;
+		case 18: return RD_OF(op) != 0 ? MFLO : NOP;
+		case 19: return MTLO;
+		case 20: return RD_OF(op) != 0 ? DSLLV : NOP;
+		case 22: return RD_OF(op) != 0 ? DSRLV : NOP;
+		case 23: return RD_OF(op) != 0 ? DSRAV : NOP;
+		case 24: return MULT;
+		case 25: return MULTU;
+		case 26: return DIV;
+		case 27: return DIVU;
+		case 28: return DMULT;
+		case 29: return DMULTU;
+		case 30: return DDIV;
+		case 31: return DDIVU;
+		case 32: return RD_OF(op) != 0 ? ADD : NOP;
+		case 33: return RD_OF(op) != 0 ? ADDU : NOP;
+		case 34: return RD_OF(op) != 0 ? SUB : NOP;
+		case 35: return RD_OF(op) != 0 ? SUBU : NOP;
+		case 36: return RD_OF(op) != 0 ? AND : NOP;
+		case 37: return RD_OF(op) != 0 ? OR : NOP;
+		case 38: return RD_OF(op) != 0 ? XOR : NOP;
+		case 39: return RD_OF(op) != 0 ? NOR : NOP;
+		case 42: return RD_OF(op) != 0 ? SLT : NOP;
+		case 43: return RD_OF(op) != 0 ? SLTU : NOP;
+		case 44: return RD_OF(op) != 0 ? DADD : NOP;
+		case 45: return RD_OF(op) != 0 ? DADDU : NOP;
+		case 46: return RD_OF(op) != 0 ? DSUB : NOP;
+		case 47: return RD_OF(op) != 0 ? DSUBU : NOP;
+		case 56: return RD_OF(op) != 0 ? DSLL : NOP;
+		case 58: return RD_OF(op) != 0 ? DSRL : NOP;
+		case 59: return RD_OF(op) != 0 ? DSRA : NOP;
+		case 60: return RD_OF(op) != 0 ? DSLL32 : NOP;
+		case 62: return RD_OF(op) != 0 ? DSRL32 : NOP;
+		case 63: return RD_OF(op) != 0 ? DSRA32 : NOP;
+		}
+		break;
+	case 8: return RT_OF(op) != 0 ? ADDI : NOP;
+	case 9: return RT_OF(op) != 0 ? ADDIU : NOP;
+	case 10: return RT_OF(op) != 0 ? SLTI : NOP;
+	case 11: return RT_OF(op) != 0 ? SLTIU : NOP;
+	case 12: return RT_OF(op) != 0 ? ANDI : NOP;
+	case 13: return RT_OF(op) != 0 ? ORI : NOP;
+	case 14: return RT_OF(op) != 0 ? XORI : NOP;
+	case 15: return RT_OF(op) != 0 ? LUI : NOP;
+	case 16: return COP0_REMAP;
+	case 24: return RT_OF(op) != 0 ? DADDI : NOP;
+	case 25: return RT_OF(op) != 0 ? DADDIU : NOP;
+	case 32: return RT_OF(op) != 0 ? LB : NOP;
+	case 33: return RT_OF(op) != 0 ? LH : NOP;
+	case 35: return RT_OF(op) != 0 ? LW : NOP;
+	case 36: return RT_OF(op) != 0 ? LBU : NOP;
+	case 37: return RT_OF(op) != 0 ? LHU : NOP;
+	case 39: return RT_OF(op) != 0 ? LWU : NOP;
+	case 40: return SB;
+	case 41: return SH;
+	case 43: return SW;
+	case 49: return LWC1;
+	case 53: return LDC1;
+	case 55: return RT_OF(op) != 0 ? LD : NOP;
+	case 57: return SWC1;
+	case 61: return SDC1;
+	case 63: return SD;
+	}
+	return ExecuteOpcode;
+}
+
+/* Sets up the page holding vaddr for fetching, if it is mapped in memory
+ * which can be read directly. Otherwise the instruction has to be fetched
+ * through fast_mem_access, which also raises the TLB miss if there is one. */
+static int MapFetchPage(uint32_t vaddr)
+{
+	uint32_t paddr;
+	struct decoded_page* page;
+
+	l_fetch_vaddr = NO_FETCH_PAGE;
+	vaddr &= ~UINT32_C(0xFFF);
+
+	if ((vaddr & UINT32_C(0xc0000000)) == UINT32_C(0x80000000))
+		paddr = vaddr & UINT32_C(0x1ffff000);
+	else if (isGoldeneyeRom && vaddr >= UINT32_C(0x7f000000) && vaddr < UINT32_C(0x80000000))
+		return 0; /* not mapped on a page boundary */
+	else if (g_dev.r4300.cp0.tlb.LUT_r[vaddr >> 12])
+		paddr = g_dev.r4300.cp0.tlb.LUT_r[vaddr >> 12] & UINT32_C(0x1ffff000);
+	else
+		return 0;
+
+	if (paddr < RDRAM_MAX_SIZE)
+		l_fetch_mem = (const uint32_t*) ((uint8_t*) g_dev.ri.rdram.dram + paddr);
+	else if (paddr >= UINT32_C(0x10000000))
+		l_fetch_mem = (const uint32_t*) ((uint8_t*) g_dev.pi.cart_rom.rom + (paddr - UINT32_C(0x10000000)));
+	else if ((paddr & UINT32_C(0xffffe000)) == UINT32_C(0x04000000))
+		l_fetch_mem = (const uint32_t*) ((uint8_t*) g_dev.sp.mem + (paddr & UINT32_C(0x1000)));
+	else
+		return 0;
+
+	page = l_decoded[(paddr >> 12) & (DECODED_PAGES - 1)];
+	if (page == NULL)
+	{
+		page = calloc(1, sizeof(*page));
+		if (page == NULL)
+			return 0;
+		page->paddr = paddr;
+		l_decoded[(paddr >> 12) & (DECODED_PAGES - 1)] = page;
+	}
+	else if (page->paddr != paddr)
+	{
+		memset(page->ops, 0, sizeof(page->ops));
+		page->paddr = paddr;
+	}
+
+	l_fetch_page = page;
+	l_fetch_vaddr = vaddr;
+	return 1;
+}
+
+static void InterpretOpcode(void)
+{
+	uint32_t addr = *r4300_pc();
+	struct decoded_op* entry;
+	uint32_t op;
+
+	if ((addr & ~UINT32_C(0xFFF)) != l_fetch_vaddr && !MapFetchPage(addr))
+	{
+		ExecuteOpcode(*fast_mem_access(addr));
+		return;
+	}
+
+	op = l_fetch_mem[(addr & 0xFFF) >> 2];
+	entry = &l_fetch_page->ops[(addr & 0xFFF) >> 2];
+	if (entry->handler == NULL || entry->op != op)
+	{
+		entry->handler = DecodeOpcode(op);
+		entry->op = op;
+	}
+	entry->handler(op);
+}
+
+void invalidate_cached_code_pure_interp(struct r4300_core* r4300, uint32_t address, size_t size)
+{
+	l_fetch_vaddr = NO_FETCH_PAGE;
+}
+
+static void free_decoded_pages(void)
+{
+	int i;
+
+	for (i = 0; i < DECODED_PAGES; i++)
+	{
+		free(l_decoded[i]);
+		l_decoded[i] = NULL;
+	}
+	l_fetch_vaddr = NO_FETCH_PAGE;
+}
+
 void run_pure_interpreter(struct r4300_core* r4300)
 {
    *r4300_stop() = 0;
    *r4300_pc_struct() = &r4300->interp_PC;
    *r4300_pc() = r4300->cp0.last_addr = 0xa4000040;
+   l_fetch_vaddr = NO_FETCH_PAGE;
 
    while (!*r4300_stop())
    {
@@ -736,4 +953,6 @@ void run_pure_interpreter(struct r4300_core* r4300)
 #endif
      InterpretOpcode();
    }
+
+   free_decoded_pages();
 }
@@ -47,12 +47,13 @@ extern int64_t g_dev_r4300_lo;
 extern struct precomp_instr* g_dev_r4300_pc;
 extern int g_dev_r4300_stop;
 
-void init_r4300(struct r4300_core* r4300, unsigned int emumode, unsigned int count_per_op, int no_compiled_jump)
+void init_r4300(struct r4300_core* r4300, unsigned int emumode, unsigned int count_per_op, int no_compiled_jump, int idle_loop_skip)
 {
     r4300->emumode = emumode;
     init_cp0(&r4300->cp0, count_per_op);
 
     r4300->recomp.no_compiled_jump = no_compiled_jump;
+    r4300->idle_loop_skip = idle_loop_skip;
 }
 
 void poweron_r4300(struct r4300_core* r4300)
@@ -70,6 +71,8 @@ void poweron_r4300(struct r4300_core* r4300)
     r4300->dyna_interp = 0;
     //r4300->current_instruction_table;
     r4300->reset_hard_job = 0;
+    r4300->idle_skipped_cycles = 0;
+    r4300->compile_ns = 0;
 
     r4300->jumps_table = NULL;
     r4300->jumps_number = 0;
@@ -96,7 +99,9 @@ void poweron_r4300(struct r4300_core* r4300)
 
     /* recomp init */
     r4300->recomp.fast_memory = 1;
+    r4300->recomp.fast_memory_fb_check = 0;
     r4300->recomp.delay_slot_compiled = 0;
+    r4300->recomp.compile_depth = 0;
 
     r4300->branch_taken = 0;
 
@@ -191,6 +196,9 @@ void run_r4300(struct r4300_core* r4300)
 
     DebugMessage(M64MSG_INFO, "R4300 emulator finished.");
 
+    if (r4300->idle_skipped_cycles != 0)
+        DebugMessage(M64MSG_INFO, "Idle loops skipped %llu cycles.", (unsigned long long)r4300->idle_skipped_cycles);
+
     /* print instruction counts */
 #if defined(COUNT_INSTR)
     if (r4300->emumode == EMUMODE_DYNAREC)
@@ -273,7 +281,11 @@ unsigned int get_r4300_emumode(struct r4300_core* r4300)
 
 void invalidate_r4300_cached_code(struct r4300_core* r4300, uint32_t address, size_t size)
 {
-    if (r4300->emumode != EMUMODE_PURE_INTERPRETER)
+    if (r4300->emumode == EMUMODE_PURE_INTERPRETER)
+    {
+        invalidate_cached_code_pure_interp(r4300, address, size);
+    }
+    else
     {
 #ifdef NEW_DYNAREC
         if (r4300->emumode == EMUMODE_DYNAREC)
@@ -288,6 +300,23 @@ void invalidate_r4300_cached_code(struct r4300_core* r4300, uint32_t address, si
     }
 }
 
+void invalidate_r4300_cached_rdram(struct r4300_core* r4300, uint32_t address, size_t size)
+{
+    if (r4300->emumode != EMUMODE_PURE_INTERPRETER)
+    {
+#ifdef NEW_DYNAREC
+        if (r4300->emumode == EMUMODE_DYNAREC)
+        {
+            invalidate_rdram_cached_code_new_dynarec(r4300, address, size);
+        }
+        else
+#endif
+        {
+            invalidate_rdram_cached_code_hacktarux(r4300, address, size);
+        }
+    }
+}
+
 
 void generic_jump_to(struct r4300_core* r4300, uint32_t address)
 {
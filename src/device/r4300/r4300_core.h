@@ -133,6 +133,7 @@ struct r4300_core
         struct precomp_block *dst_block;    /* the current block that we are recompiling */
         uint32_t src;                       /* the current recompiled instruction */
         int fast_memory;
+        int fast_memory_fb_check;           /* exclude protected framebuffers from fast memory accesses */
         int no_compiled_jump;               /* use cached interpreter instead of recompiler for jumps */
         void (*recomp_func)(void);          /* pointer to the dynarec's generator
                                                function for the latest decoded opcode */
@@ -142,6 +143,9 @@ struct r4300_core
 
         uint32_t jump_to_address;
 
+        unsigned int compile_depth;         /* nesting of timed compilations, see compile_ns */
+        uint64_t compile_start_ns;          /* start of the outermost timed compilation */
+
 #if defined(PROFILE_R4300)
         FILE* pfProfile;
 #endif
@@ -161,6 +165,13 @@ struct r4300_core
 
     unsigned int emumode;
 
+    /* skip polling loops to the next interrupt, see idle_loop.h */
+    int idle_loop_skip;
+    uint64_t idle_skipped_cycles;
+
+    /* host time spent compiling guest code, in ns */
+    uint64_t compile_ns;
+
     struct cp0 cp0;
 
     struct cp1 cp1;
@@ -168,7 +179,7 @@ struct r4300_core
     struct mi_controller mi;
 };
 
-void init_r4300(struct r4300_core* r4300, unsigned int emumode, unsigned int count_per_op, int no_compiled_jump);
+void init_r4300(struct r4300_core* r4300, unsigned int emumode, unsigned int count_per_op, int no_compiled_jump, int idle_loop_skip);
 void poweron_r4300(struct r4300_core* r4300);
 
 void run_r4300(struct r4300_core* r4300);
@@ -191,6 +202,12 @@ unsigned int get_r4300_emumode(struct r4300_core* r4300);
  */
 void invalidate_r4300_cached_code(struct r4300_core* r4300, uint32_t address, size_t size);
 
+/* Same as above but for a DMA into physical RDRAM [address, address+size]:
+ * invalidates both cached (kseg0) and uncached (kseg1) mirrors
+ * in a single pass.
+ */
+void invalidate_r4300_cached_rdram(struct r4300_core* r4300, uint32_t address, size_t size);
+
 
 /* Jump to the given address. This works for all r4300 emulator, but is slower.
  * Use this for common code which can be executed from any r4300 emulator. */
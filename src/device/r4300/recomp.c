@@ -38,16 +38,36 @@
 #include "device/memory/memory.h"
 #include "device/r4300/cached_interp.h"
 #include "device/r4300/exception.h"
+#include "device/r4300/idle_loop.h"
 #include "device/r4300/ops.h"
 #include "device/r4300/recomp.h"
 #include "device/r4300/recomph.h" //include for function prototypes
 #include "device/r4300/tlb.h"
+#include "fuzzer/fuzzer_coverage.h"
 #include "main/main.h"
 #include "main/profile.h"
+#include "plugin/get_monotonic_time.h"
 
 static void *malloc_exec(size_t size);
 static void free_exec(void *ptr, size_t length);
 
+/* Backward branches closing a polling loop inside the block get the _IDLE
+ * handler too, see idle_loop.h. The kind is kept in the branch so that the
+ * handler only checks IDLE_LOOP_DYNAMIC loops again. */
+static int is_polling_loop(uint32_t target)
+{
+    const struct precomp_block* block = g_dev.r4300.recomp.dst_block;
+    uint32_t addr = g_dev.r4300.recomp.dst->addr;
+    size_t length;
+
+    if (!g_dev.r4300.idle_loop_skip || target >= addr || target < block->start || addr + 4 >= block->end)
+        return 0;
+
+    length = (addr - target) / 4 + 2;
+    g_dev.r4300.recomp.dst->idle_loop_kind = r4300_idle_loop_kind(g_dev.r4300.recomp.SRC - (length - 2), length);
+    return g_dev.r4300.recomp.dst->idle_loop_kind != IDLE_LOOP_NONE;
+}
+
 static void RSV(void)
 {
     g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.RESERVED;
@@ -533,6 +553,11 @@ static void RBLTZ(void)
         g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BLTZ_OUT;
         g_dev.r4300.recomp.recomp_func = genbltz_out;
     }
+    else if (is_polling_loop(target))
+    {
+        g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BLTZ_IDLE;
+        g_dev.r4300.recomp.recomp_func = genidle_loop;
+    }
 }
 
 static void RBGEZ(void)
@@ -555,6 +580,11 @@ static void RBGEZ(void)
         g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BGEZ_OUT;
         g_dev.r4300.recomp.recomp_func = genbgez_out;
     }
+    else if (is_polling_loop(target))
+    {
+        g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BGEZ_IDLE;
+        g_dev.r4300.recomp.recomp_func = genidle_loop;
+    }
 }
 
 static void RBLTZL(void)
@@ -577,6 +607,11 @@ static void RBLTZL(void)
         g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BLTZL_OUT;
         g_dev.r4300.recomp.recomp_func = genbltzl_out;
     }
+    else if (is_polling_loop(target))
+    {
+        g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BLTZL_IDLE;
+        g_dev.r4300.recomp.recomp_func = genidle_loop;
+    }
 }
 
 static void RBGEZL(void)
@@ -599,6 +634,11 @@ static void RBGEZL(void)
         g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BGEZL_OUT;
         g_dev.r4300.recomp.recomp_func = genbgezl_out;
     }
+    else if (is_polling_loop(target))
+    {
+        g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BGEZL_IDLE;
+        g_dev.r4300.recomp.recomp_func = genidle_loop;
+    }
 }
 
 static void RTGEI(void)
@@ -1616,6 +1656,11 @@ static void RJ(void)
         g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.J_OUT;
         g_dev.r4300.recomp.recomp_func = genj_out;
     }
+    else if (is_polling_loop(target))
+    {
+        g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.J_IDLE;
+        g_dev.r4300.recomp.recomp_func = genidle_loop;
+    }
 }
 
 static void RJAL(void)
@@ -1660,6 +1705,11 @@ static void RBEQ(void)
         g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BEQ_OUT;
         g_dev.r4300.recomp.recomp_func = genbeq_out;
     }
+    else if (is_polling_loop(target))
+    {
+        g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BEQ_IDLE;
+        g_dev.r4300.recomp.recomp_func = genidle_loop;
+    }
 }
 
 static void RBNE(void)
@@ -1682,6 +1732,11 @@ static void RBNE(void)
         g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BNE_OUT;
         g_dev.r4300.recomp.recomp_func = genbne_out;
     }
+    else if (is_polling_loop(target))
+    {
+        g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BNE_IDLE;
+        g_dev.r4300.recomp.recomp_func = genidle_loop;
+    }
 }
 
 static void RBLEZ(void)
@@ -1704,6 +1759,11 @@ static void RBLEZ(void)
         g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BLEZ_OUT;
         g_dev.r4300.recomp.recomp_func = genblez_out;
     }
+    else if (is_polling_loop(target))
+    {
+        g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BLEZ_IDLE;
+        g_dev.r4300.recomp.recomp_func = genidle_loop;
+    }
 }
 
 static void RBGTZ(void)
@@ -1726,6 +1786,11 @@ static void RBGTZ(void)
         g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BGTZ_OUT;
         g_dev.r4300.recomp.recomp_func = genbgtz_out;
     }
+    else if (is_polling_loop(target))
+    {
+        g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BGTZ_IDLE;
+        g_dev.r4300.recomp.recomp_func = genidle_loop;
+    }
 }
 
 static void RADDI(void)
@@ -1822,6 +1887,11 @@ static void RBEQL(void)
         g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BEQL_OUT;
         g_dev.r4300.recomp.recomp_func = genbeql_out;
     }
+    else if (is_polling_loop(target))
+    {
+        g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BEQL_IDLE;
+        g_dev.r4300.recomp.recomp_func = genidle_loop;
+    }
 }
 
 static void RBNEL(void)
@@ -1844,6 +1914,11 @@ static void RBNEL(void)
         g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BNEL_OUT;
         g_dev.r4300.recomp.recomp_func = genbnel_out;
     }
+    else if (is_polling_loop(target))
+    {
+        g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BNEL_IDLE;
+        g_dev.r4300.recomp.recomp_func = genidle_loop;
+    }
 }
 
 static void RBLEZL(void)
@@ -1866,6 +1941,11 @@ static void RBLEZL(void)
         g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BLEZL_OUT;
         g_dev.r4300.recomp.recomp_func = genblezl_out;
     }
+    else if (is_polling_loop(target))
+    {
+        g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BLEZL_IDLE;
+        g_dev.r4300.recomp.recomp_func = genidle_loop;
+    }
 }
 
 static void RBGTZL(void)
@@ -1888,6 +1968,11 @@ static void RBGTZL(void)
         g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BGTZL_OUT;
         g_dev.r4300.recomp.recomp_func = genbgtzl_out;
     }
+    else if (is_polling_loop(target))
+    {
+        g_dev.r4300.recomp.dst->ops = g_dev.r4300.current_instruction_table.BGTZL_IDLE;
+        g_dev.r4300.recomp.recomp_func = genidle_loop;
+    }
 }
 
 static void RDADDI(void)
@@ -2140,10 +2225,9 @@ static size_t get_block_memsize(const struct precomp_block *block)
 /**********************************************************************
  ******************** initialize an empty block ***********************
  **********************************************************************/
-void init_block(struct r4300_core* r4300, struct precomp_block* block)
+static void do_init_block(struct r4300_core* r4300, struct precomp_block* block)
 {
     int i, length, already_exist = 1;
-    timed_section_start(TIMED_SECTION_COMPILER);
 #ifdef DBG
     DebugMessage(M64MSG_INFO, "init block %" PRIX32 " - %" PRIX32, block->start, block->end);
 #endif
@@ -2278,7 +2362,7 @@ void init_block(struct r4300_core* r4300, struct precomp_block* block)
             r4300->cached_interp.blocks[paddr>>12]->start = paddr & ~UINT32_C(0xFFF);
             r4300->cached_interp.blocks[paddr>>12]->end = (paddr & ~UINT32_C(0xFFF)) + UINT32_C(0x1000);
         }
-        init_block(r4300, r4300->cached_interp.blocks[paddr>>12]);
+        do_init_block(r4300, r4300->cached_interp.blocks[paddr>>12]);
 
         paddr += block->end - block->start - 4;
         r4300->cached_interp.invalid_code[paddr>>12] = 0;
@@ -2292,7 +2376,7 @@ void init_block(struct r4300_core* r4300, struct precomp_block* block)
             r4300->cached_interp.blocks[paddr>>12]->start = paddr & ~UINT32_C(0xFFF);
             r4300->cached_interp.blocks[paddr>>12]->end = (paddr & ~UINT32_C(0xFFF)) + UINT32_C(0x1000);
         }
-        init_block(r4300, r4300->cached_interp.blocks[paddr>>12]);
+        do_init_block(r4300, r4300->cached_interp.blocks[paddr>>12]);
     }
     else
     {
@@ -2310,10 +2394,32 @@ void init_block(struct r4300_core* r4300, struct precomp_block* block)
                 r4300->cached_interp.blocks[alt_addr>>12]->start = alt_addr & ~UINT32_C(0xFFF);
                 r4300->cached_interp.blocks[alt_addr>>12]->end = (alt_addr & ~UINT32_C(0xFFF)) + UINT32_C(0x1000);
             }
-            init_block(r4300, r4300->cached_interp.blocks[alt_addr>>12]);
+            do_init_block(r4300, r4300->cached_interp.blocks[alt_addr>>12]);
         }
     }
+}
+
+/* Compilation is always timed, for M64CMD_GET_RUN_STATS. Only the outermost
+ * of nested timed calls reads the clock, so time is counted once. */
+static void compile_timer_start(struct r4300_core* r4300)
+{
+    if (r4300->recomp.compile_depth++ == 0)
+        r4300->recomp.compile_start_ns = get_monotonic_time_ns(NULL);
+}
+
+static void compile_timer_end(struct r4300_core* r4300)
+{
+    if (--r4300->recomp.compile_depth == 0)
+        r4300->compile_ns += get_monotonic_time_ns(NULL) - r4300->recomp.compile_start_ns;
+}
+
+void init_block(struct r4300_core* r4300, struct precomp_block* block)
+{
+    compile_timer_start(r4300);
+    timed_section_start(TIMED_SECTION_COMPILER);
+    do_init_block(r4300, block);
     timed_section_end(TIMED_SECTION_COMPILER);
+    compile_timer_end(r4300);
 }
 
 void free_block(struct r4300_core* r4300, struct precomp_block* block)
@@ -2341,6 +2447,7 @@ void recompile_block(struct r4300_core* r4300, const uint32_t* source, struct pr
 {
     uint32_t i;
     int length, finished = 0;
+    compile_timer_start(r4300);
     timed_section_start(TIMED_SECTION_COMPILER);
     length = (block->end-block->start)/4;
     r4300->recomp.dst_block = block;
@@ -2378,6 +2485,7 @@ void recompile_block(struct r4300_core* r4300, const uint32_t* source, struct pr
         r4300->recomp.dst->addr = block->start + i*4;
         r4300->recomp.dst->reg_cache_infos.need_map = 0;
         r4300->recomp.dst->local_addr = r4300->recomp.code_length;
+        r4300->recomp.dst->idle_loop_kind = IDLE_LOOP_NONE;
 #ifdef COMPARE_CORE
         if (r4300->emumode == EMUMODE_DYNAREC) { gendebug(); }
 #endif
@@ -2478,6 +2586,7 @@ void recompile_block(struct r4300_core* r4300, const uint32_t* source, struct pr
     r4300->recomp.pfProfile = NULL;
 #endif
     timed_section_end(TIMED_SECTION_COMPILER);
+    compile_timer_end(r4300);
 }
 
 static int is_jump(const struct r4300_core* r4300)
@@ -2558,6 +2667,7 @@ static int is_jump(const struct r4300_core* r4300)
  **********************************************************************/
 void recompile_opcode(struct r4300_core* r4300)
 {
+    compile_timer_start(r4300);
     r4300->recomp.SRC++;
     r4300->recomp.src = *r4300->recomp.SRC;
     r4300->recomp.dst++;
@@ -2587,6 +2697,7 @@ void recompile_opcode(struct r4300_core* r4300)
         if (r4300->emumode == EMUMODE_DYNAREC) { r4300->recomp.recomp_func(); }
     }
     r4300->recomp.delay_slot_compiled = 2;
+    compile_timer_end(r4300);
 }
 
 #if defined(PROFILE_R4300)
@@ -2619,6 +2730,10 @@ void profile_write_end_of_code_blocks(struct r4300_core* r4300)
 /* Parameterless version of cached_interpreter_dynarec_jump_to to ease usage in dynarec. */
 void dynarec_jump_to_address(void)
 {
+    /* Jumps out of the page and through registers are the only ones that
+     * come back to C, fuzzer coverage sees the dynarec at that grain. */
+    if (!g_dev.r4300.skip_jump)
+        fuzzer_coverage_block(g_dev.r4300.recomp.jump_to_address);
     cached_interpreter_dynarec_jump_to(&g_dev.r4300, g_dev.r4300.recomp.jump_to_address);
 }
 
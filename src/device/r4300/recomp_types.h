@@ -70,6 +70,7 @@ struct precomp_instr
    uint32_t addr; /* word-aligned instruction address in r4300 address space */
    unsigned int local_addr; /* byte offset to start of corresponding x86_64 instructions, from start of code block */
    struct reg_cache reg_cache_infos;
+   unsigned char idle_loop_kind; /* enum idle_loop_kind of the polling loop closed by this branch */
 };
 
 struct precomp_block
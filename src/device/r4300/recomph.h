@@ -101,6 +101,7 @@ void gensllv(void);
 void gensrlv(void);
 void genjr(void);
 void genni(void);
+void genidle_loop(void);
 void genmfhi(void);
 void genmthi(void);
 void genmtc0(void);
@@ -37,70 +37,223 @@ void poweron_tlb(struct tlb* tlb)
     memset(tlb->LUT_w, 0, 0x100000 * sizeof(tlb->LUT_w[0]));
 }
 
-void tlb_unmap(struct tlb* tlb, size_t entry)
+/* Fill count consecutive LUT slots with value, value+step, value+2*step, ...
+ * Kept as a plain counted loop so the compiler can vectorize it. */
+static void tlb_fill(uint32_t* lut, uint32_t start, uint32_t end, uint32_t value, uint32_t step)
 {
-    unsigned int i;
-    const struct tlb_entry* e;
+    size_t k, count;
+    uint32_t* p;
 
-    assert(entry < 32);
-    e = &tlb->entries[entry];
+    if (start >= end)
+        return;
+
+    /* same page count as stepping by 0x1000 from start while below end */
+    count = (size_t)(((uint64_t)end - start + 0xFFF) >> 12);
+    p = &lut[start >> 12];
 
-    if (e->v_even)
+    if (step == 0 && value == 0)
     {
-        for (i=e->start_even; i<e->end_even; i += 0x1000)
-            tlb->LUT_r[i>>12] = 0;
-        if (e->d_even)
-            for (i=e->start_even; i<e->end_even; i += 0x1000)
-                tlb->LUT_w[i>>12] = 0;
+        memset(p, 0, count * sizeof(*p));
+        return;
     }
 
-    if (e->v_odd)
+    for (k = 0; k < count; ++k)
+        p[k] = value + (uint32_t)k * step;
+}
+
+static void tlb_unmap_half(struct tlb* tlb, char v, char d, uint32_t start, uint32_t end)
+{
+    if (!v)
+        return;
+
+    tlb_fill(tlb->LUT_r, start, end, 0, 0);
+    if (d)
+        tlb_fill(tlb->LUT_w, start, end, 0, 0);
+}
+
+static void tlb_map_half(struct tlb* tlb, char v, char d, uint32_t start, uint32_t end, uint32_t phys)
+{
+    uint32_t value;
+
+    if (!v)
+        return;
+
+    if (start < end &&
+        !(start >= 0x80000000 && end < 0xC0000000) &&
+        phys < 0x20000000)
     {
-        for (i=e->start_odd; i<e->end_odd; i += 0x1000)
-            tlb->LUT_r[i>>12] = 0;
-        if (e->d_odd)
-            for (i=e->start_odd; i<e->end_odd; i += 0x1000)
-                tlb->LUT_w[i>>12] = 0;
+        value = UINT32_C(0x80000000) | (phys + 0xFFF);
+
+        tlb_fill(tlb->LUT_r, start, end, value, 0x1000);
+        if (d)
+            tlb_fill(tlb->LUT_w, start, end, value, 0x1000);
     }
 }
 
-void tlb_map(struct tlb* tlb, size_t entry)
+static int tlb_even_equal(const struct tlb_entry* a, const struct tlb_entry* b)
 {
-    unsigned int i;
-    const struct tlb_entry* e;
+    return a->v_even == b->v_even
+        && a->d_even == b->d_even
+        && a->start_even == b->start_even
+        && a->end_even == b->end_even
+        && a->phys_even == b->phys_even;
+}
+
+static int tlb_odd_equal(const struct tlb_entry* a, const struct tlb_entry* b)
+{
+    return a->v_odd == b->v_odd
+        && a->d_odd == b->d_odd
+        && a->start_odd == b->start_odd
+        && a->end_odd == b->end_odd
+        && a->phys_odd == b->phys_odd;
+}
+
+static size_t add_page_range(struct tlb_page_range* ranges, size_t n, int old, char v, uint32_t start, uint32_t end)
+{
+    if (v && (start >> 12) <= (end >> 12))
+    {
+        ranges[n].begin = start >> 12;
+        ranges[n].end = end >> 12;
+        ranges[n].old = old;
+        ++n;
+    }
+
+    return n;
+}
+
+void tlb_entry_from_cp0(struct tlb_entry* e,
+                        uint32_t entrylo0, uint32_t entrylo1,
+                        uint32_t entryhi, uint32_t pagemask)
+{
+    memset(e, 0, sizeof(*e));
+
+    e->g = (entrylo0 & entrylo1 & 1);
+    e->pfn_even = (entrylo0 & UINT32_C(0x3FFFFFC0)) >> 6;
+    e->pfn_odd = (entrylo1 & UINT32_C(0x3FFFFFC0)) >> 6;
+    e->c_even = (entrylo0 & UINT32_C(0x38)) >> 3;
+    e->c_odd = (entrylo1 & UINT32_C(0x38)) >> 3;
+    e->d_even = (entrylo0 & UINT32_C(0x4)) >> 2;
+    e->d_odd = (entrylo1 & UINT32_C(0x4)) >> 2;
+    e->v_even = (entrylo0 & UINT32_C(0x2)) >> 1;
+    e->v_odd = (entrylo1 & UINT32_C(0x2)) >> 1;
+    e->asid = (entryhi & UINT32_C(0xFF));
+    e->vpn2 = (entryhi & UINT32_C(0xFFFFE000)) >> 13;
+    //e->r = (entryhi & 0xC000000000000000LL) >> 62;
+    e->mask = (pagemask & UINT32_C(0x1FFE000)) >> 13;
+
+    e->start_even = e->vpn2 << 13;
+    e->end_even = e->start_even + (e->mask << 12) + UINT32_C(0xFFF);
+    e->phys_even = e->pfn_even << 12;
+
+    e->start_odd = e->end_even + 1;
+    e->end_odd = e->start_odd + (e->mask << 12) + UINT32_C(0xFFF);
+    e->phys_odd = e->pfn_odd << 12;
+}
+
+size_t tlb_changed_pages(const struct tlb* tlb, size_t entry, const struct tlb_entry* e,
+                         struct tlb_page_range ranges[TLB_MAX_CHANGED_RANGES])
+{
+    size_t n = 0;
+    const struct tlb_entry* old;
 
     assert(entry < 32);
-    e = &tlb->entries[entry];
+    old = &tlb->entries[entry];
 
-    if (e->v_even)
+    if (!tlb_even_equal(old, e))
     {
-        if (e->start_even < e->end_even &&
-            !(e->start_even >= 0x80000000 && e->end_even < 0xC0000000) &&
-            e->phys_even < 0x20000000)
-        {
-            for (i=e->start_even;i<e->end_even;i+=0x1000)
-                tlb->LUT_r[i>>12] = UINT32_C(0x80000000) | (e->phys_even + (i - e->start_even) + 0xFFF);
-            if (e->d_even)
-                for (i=e->start_even;i<e->end_even;i+=0x1000)
-                    tlb->LUT_w[i>>12] = UINT32_C(0x80000000) | (e->phys_even + (i - e->start_even) + 0xFFF);
-        }
+        n = add_page_range(ranges, n, 1, old->v_even, old->start_even, old->end_even);
+        n = add_page_range(ranges, n, 0, e->v_even, e->start_even, e->end_even);
     }
 
-    if (e->v_odd)
+    if (!tlb_odd_equal(old, e))
     {
-        if (e->start_odd < e->end_odd &&
-            !(e->start_odd >= 0x80000000 && e->end_odd < 0xC0000000) &&
-            e->phys_odd < 0x20000000)
-        {
-            for (i=e->start_odd;i<e->end_odd;i+=0x1000)
-                tlb->LUT_r[i>>12] = UINT32_C(0x80000000) | (e->phys_odd + (i - e->start_odd) + 0xFFF);
-            if (e->d_odd)
-                for (i=e->start_odd;i<e->end_odd;i+=0x1000)
-                    tlb->LUT_w[i>>12] = UINT32_C(0x80000000) | (e->phys_odd + (i - e->start_odd) + 0xFFF);
-        }
+        n = add_page_range(ranges, n, 1, old->v_odd, old->start_odd, old->end_odd);
+        n = add_page_range(ranges, n, 0, e->v_odd, e->start_odd, e->end_odd);
+    }
+
+    return n;
+}
+
+/* Map again the halves that share pages with the unmapped range
+ * [start, end], as unmapping cleared their LUT slots too. The changed
+ * halves of entry are left to the caller. */
+static void tlb_remap_overlapping(struct tlb* tlb, size_t entry, int even_changed, int odd_changed,
+                                  uint32_t start, uint32_t end)
+{
+    size_t i;
+    const struct tlb_entry* e;
+
+    for (i = 0; i < 32; ++i)
+    {
+        e = &tlb->entries[i];
+
+        if ((i != entry || !even_changed) && e->v_even
+            && e->start_even <= end && start <= e->end_even)
+            tlb_map_half(tlb, e->v_even, e->d_even, e->start_even, e->end_even, e->phys_even);
+
+        if ((i != entry || !odd_changed) && e->v_odd
+            && e->start_odd <= end && start <= e->end_odd)
+            tlb_map_half(tlb, e->v_odd, e->d_odd, e->start_odd, e->end_odd, e->phys_odd);
     }
 }
 
+void tlb_write(struct tlb* tlb, size_t entry, const struct tlb_entry* e)
+{
+    struct tlb_entry* old;
+    struct tlb_entry prev;
+    int even_changed, odd_changed;
+
+    assert(entry < 32);
+    old = &tlb->entries[entry];
+
+    even_changed = !tlb_even_equal(old, e);
+    odd_changed = !tlb_odd_equal(old, e);
+
+    /* unmap every stale half before mapping, as halves of the new entry
+     * may overlap the other half of the old one */
+    if (even_changed)
+        tlb_unmap_half(tlb, old->v_even, old->d_even, old->start_even, old->end_even);
+    if (odd_changed)
+        tlb_unmap_half(tlb, old->v_odd, old->d_odd, old->start_odd, old->end_odd);
+
+    prev = *old;
+    *old = *e;
+
+    /* restore unchanged halves and other entries caught in the unmapped
+     * pages, then map the new halves over them */
+    if (even_changed && prev.v_even)
+        tlb_remap_overlapping(tlb, entry, even_changed, odd_changed, prev.start_even, prev.end_even);
+    if (odd_changed && prev.v_odd)
+        tlb_remap_overlapping(tlb, entry, even_changed, odd_changed, prev.start_odd, prev.end_odd);
+
+    if (even_changed)
+        tlb_map_half(tlb, e->v_even, e->d_even, e->start_even, e->end_even, e->phys_even);
+    if (odd_changed)
+        tlb_map_half(tlb, e->v_odd, e->d_odd, e->start_odd, e->end_odd, e->phys_odd);
+}
+
+void tlb_unmap(struct tlb* tlb, size_t entry)
+{
+    const struct tlb_entry* e;
+
+    assert(entry < 32);
+    e = &tlb->entries[entry];
+
+    tlb_unmap_half(tlb, e->v_even, e->d_even, e->start_even, e->end_even);
+    tlb_unmap_half(tlb, e->v_odd, e->d_odd, e->start_odd, e->end_odd);
+}
+
+void tlb_map(struct tlb* tlb, size_t entry)
+{
+    const struct tlb_entry* e;
+
+    assert(entry < 32);
+    e = &tlb->entries[entry];
+
+    tlb_map_half(tlb, e->v_even, e->d_even, e->start_even, e->end_even, e->phys_even);
+    tlb_map_half(tlb, e->v_odd, e->d_odd, e->start_odd, e->end_odd, e->phys_odd);
+}
+
 uint32_t virtual_to_physical_address(struct r4300_core* r4300, uint32_t address, int w)
 {
     if (address >= UINT32_C(0x7f000000) && address < UINT32_C(0x80000000) && isGoldeneyeRom)
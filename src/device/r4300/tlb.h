@@ -52,6 +52,17 @@ struct tlb_entry
    unsigned int phys_odd;
 };
 
+/* range of virtual pages [begin, end] */
+struct tlb_page_range
+{
+    uint32_t begin;
+    uint32_t end;
+    int old; /* 1 if the range is unmapped by the write, 0 if it gets mapped */
+};
+
+/* old and new ranges of both halves of an entry */
+#define TLB_MAX_CHANGED_RANGES 4
+
 struct tlb
 {
     struct tlb_entry entries[32];
@@ -64,6 +75,19 @@ void poweron_tlb(struct tlb* tlb);
 void tlb_unmap(struct tlb* tlb, size_t entry);
 void tlb_map(struct tlb* tlb, size_t entry);
 
+/* Decode cp0 EntryLo0/EntryLo1/EntryHi/PageMask registers into a TLB entry. */
+void tlb_entry_from_cp0(struct tlb_entry* e,
+                        uint32_t entrylo0, uint32_t entrylo1,
+                        uint32_t entryhi, uint32_t pagemask);
+
+/* List the virtual pages whose translation changes if entry is replaced by e.
+ * Returns the number of ranges stored, 0 if the lookup tables are left as is. */
+size_t tlb_changed_pages(const struct tlb* tlb, size_t entry, const struct tlb_entry* e,
+                         struct tlb_page_range ranges[TLB_MAX_CHANGED_RANGES]);
+
+/* Replace entry by e, only refilling the lookup tables of changed halves. */
+void tlb_write(struct tlb* tlb, size_t entry, const struct tlb_entry* e);
+
 uint32_t virtual_to_physical_address(struct r4300_core* r4300, uint32_t address, int w);
 
 #endif /* M64P_DEVICE_R4300_TLB_H */
@@ -291,6 +291,28 @@ static void genbgtz_test(void)
      }
 }
 
+/* Test if the address in EBX can be accessed directly in RDRAM ("fast memory").
+ * Leaves ZF set if so. EAX must hold a copy of the address and is trashed. */
+static void gencheck_fast_memory(void)
+{
+   if (g_dev.r4300.recomp.fast_memory_fb_check)
+   {
+     /* protected framebuffers must go through the memory handlers */
+     mov_reg32_reg32(EAX, EBX);
+     and_eax_imm32(0x7FFFFF);
+     sub_reg32_m32(EAX, (unsigned int *)&g_dev.dp.fb.window_begin);
+     cmp_reg32_m32(EAX, (unsigned int *)&g_dev.dp.fb.window_size);
+     jb_rj(0); /* ZF is clear when taken */
+     jump_start_rel8();
+     mov_reg32_reg32(EAX, EBX);
+   }
+
+   and_eax_imm32(0xDF800000);
+   cmp_eax_imm32(0x80000000);
+
+   if (g_dev.r4300.recomp.fast_memory_fb_check)
+     jump_end_rel8();
+}
 
 /* global functions */
 
@@ -374,6 +396,12 @@ void genni(void)
    gencallinterp((unsigned int)cached_interpreter_table.NI, 0);
 }
 
+/* polling loop, the interpreter handler checks it before skipping */
+void genidle_loop(void)
+{
+   gencallinterp((unsigned int)g_dev.r4300.recomp.dst->ops, 1);
+}
+
 void genreserved(void)
 {
    gencallinterp((unsigned int)cached_interpreter_table.RESERVED, 0);
@@ -1277,8 +1305,7 @@ void genlb(void)
    mov_reg32_reg32(EBX, EAX);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory();
      }
    else
      {
@@ -1317,8 +1344,7 @@ void genlh(void)
    mov_reg32_reg32(EBX, EAX);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory();
      }
    else
      {
@@ -1362,8 +1388,7 @@ void genlw(void)
    mov_reg32_reg32(EBX, EAX);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory();
      }
    else
      {
@@ -1401,8 +1426,7 @@ void genlbu(void)
    mov_reg32_reg32(EBX, EAX);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory();
      }
    else
      {
@@ -1443,8 +1467,7 @@ void genlhu(void)
    mov_reg32_reg32(EBX, EAX);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory();
      }
    else
      {
@@ -1490,8 +1513,7 @@ void genlwu(void)
    mov_reg32_reg32(EBX, EAX);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory();
      }
    else
      {
@@ -1532,8 +1554,7 @@ void gensb(void)
    mov_reg32_reg32(EBX, EAX);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory();
      }
    else
      {
@@ -1589,8 +1610,7 @@ void gensh(void)
    mov_reg32_reg32(EBX, EAX);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory();
      }
    else
      {
@@ -1651,8 +1671,7 @@ void gensw(void)
    mov_reg32_reg32(EBX, EAX);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory();
      }
    else
      {
@@ -1735,8 +1754,7 @@ void genlwc1(void)
    mov_reg32_reg32(EBX, EAX);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory();
      }
    else
      {
@@ -1774,8 +1792,7 @@ void genldc1(void)
    mov_reg32_reg32(EBX, EAX);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory();
      }
    else
      {
@@ -1819,8 +1836,7 @@ void genld(void)
    mov_reg32_reg32(EBX, EAX);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory();
      }
    else
      {
@@ -1862,8 +1878,7 @@ void genswc1(void)
    mov_reg32_reg32(EBX, EAX);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory();
      }
    else
      {
@@ -1920,8 +1935,7 @@ void gensdc1(void)
    mov_reg32_reg32(EBX, EAX);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory();
      }
    else
      {
@@ -1980,8 +1994,7 @@ void gensd(void)
    mov_reg32_reg32(EBX, EAX);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory();
      }
    else
      {
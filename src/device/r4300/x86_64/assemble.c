@@ -185,6 +185,29 @@ void jump_end_rel8(void)
   g_dev.r4300.recomp.code_length = jump_end;
 }
 
+/* Same as jump_start_rel8/jump_end_rel8, for jumps which overlap another
+ * one: the mark is kept by the caller instead of in jump_start8. */
+unsigned int jump_mark_rel8(void)
+{
+  return g_dev.r4300.recomp.code_length;
+}
+
+void jump_patch_rel8(unsigned int mark)
+{
+  unsigned int jump_end = g_dev.r4300.recomp.code_length;
+  int jump_vec = jump_end - mark;
+
+  if (jump_vec > 127 || jump_vec < -128)
+  {
+    DebugMessage(M64MSG_ERROR, "Error: 8-bit relative jump too long! From %x to %x", mark, jump_end);
+    OSAL_BREAKPOINT_INTERRUPT;
+  }
+
+  g_dev.r4300.recomp.code_length = mark - 1;
+  put8(jump_vec);
+  g_dev.r4300.recomp.code_length = jump_end;
+}
+
 void jump_end_rel32(void)
 {
   unsigned int jump_end = g_dev.r4300.recomp.code_length;
@@ -41,6 +41,14 @@
 #define RBP 5
 #define RSI 6
 #define RDI 7
+#define R8  8
+#define R9  9
+#define R10 10
+#define R11 11
+#define R12 12
+#define R13 13
+#define R14 14
+#define R15 15
 
 #define EAX 0
 #define ECX 1
@@ -69,10 +77,15 @@
 #define DH 6
 #define BH 7
 
+#define XMM0 0
+#define XMM1 1
+
 extern const uint16_t trunc_mode, round_mode, ceil_mode, floor_mode;
 
 void jump_start_rel8(void);
 void jump_end_rel8(void);
+unsigned int jump_mark_rel8(void);
+void jump_patch_rel8(unsigned int mark);
 void jump_start_rel32(void);
 void jump_end_rel32(void);
 void add_jump(unsigned int pc_addr, unsigned int mi_addr, unsigned int absolute64);
@@ -110,6 +123,84 @@ static osal_inline void put64(unsigned long long qword)
   g_dev.r4300.recomp.code_length += 8;
 }
 
+/* REX prefix for operands in R8-R15: reg is the ModRM reg field, index the
+ * SIB index and rm the ModRM rm or SIB base field. Left out when it would be
+ * a bare 0x40, so that the encodings of the first eight registers keep their
+ * length. */
+static osal_inline void put_rex(int w, int reg, int index, int rm)
+{
+   unsigned char rex = 0x40 | (w << 3) | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((rm & 8) >> 3);
+
+   if (rex != 0x40)
+      put8(rex);
+}
+
+/* Byte registers 4-7 are SPL-DIL only with a REX prefix, AH-BH without */
+static osal_inline void put_rex8(int reg8, int index, int rm8)
+{
+   put8(0x40 | ((reg8 & 8) >> 1) | ((index & 8) >> 2) | ((rm8 & 8) >> 3));
+}
+
+static osal_inline void put_modrm_reg(int reg, int rm)
+{
+   put8(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* [base]: RSP and R12 need a SIB byte, RBP and R13 only exist with a displacement */
+static osal_inline void put_modrm_preg64(int reg, int base)
+{
+   if ((base & 7) == RBP)
+   {
+      put8(0x45 | ((reg & 7) << 3));
+      put8(0);
+   }
+   else
+   {
+      put8(((reg & 7) << 3) | (base & 7));
+      if ((base & 7) == RSP)
+         put8(0x24);
+   }
+}
+
+static osal_inline void put_modrm_preg64pimm8(int reg, int base, unsigned char imm8)
+{
+   put8(0x40 | ((reg & 7) << 3) | (base & 7));
+   if ((base & 7) == RSP)
+      put8(0x24);
+   put8(imm8);
+}
+
+static osal_inline void put_modrm_preg64pimm32(int reg, int base, unsigned int imm32)
+{
+   put8(0x80 | ((reg & 7) << 3) | (base & 7));
+   if ((base & 7) == RSP)
+      put8(0x24);
+   put32(imm32);
+}
+
+/* [base + index * (1 << scale)], same RBP and R13 exception as above */
+static osal_inline void put_modrm_sib(int reg, int scale, int index, int base)
+{
+   if ((base & 7) == RBP)
+   {
+      put8(0x44 | ((reg & 7) << 3));
+      put8((scale << 6) | ((index & 7) << 3) | (base & 7));
+      put8(0);
+   }
+   else
+   {
+      put8(0x04 | ((reg & 7) << 3));
+      put8((scale << 6) | ((index & 7) << 3) | (base & 7));
+   }
+}
+
+static osal_inline void put_modrm_sibpimm32(int reg, int scale, int index, int base, unsigned int imm32)
+{
+   put8(0x84 | ((reg & 7) << 3));
+   put8((scale << 6) | ((index & 7) << 3) | (base & 7));
+   put32(imm32);
+}
+
 static osal_inline int rel_r15_offset(void *dest, const char *op_name)
 {
     /* calculate the destination pointer's offset from the base of the r4300 registers */
@@ -198,52 +289,55 @@ static osal_inline void cmp_xreg64_m64rel(int xreg64, unsigned long long *m64)
 
 static osal_inline void cmp_reg32_reg32(int reg1, int reg2)
 {
+   put_rex(0, reg2, 0, reg1);
    put8(0x39);
-   put8((reg2 << 3) | reg1 | 0xC0);
+   put_modrm_reg(reg2, reg1);
 }
 
 static osal_inline void cmp_reg64_reg64(int reg1, int reg2)
 {
-   put8(0x48);
+   put_rex(1, reg2, 0, reg1);
    put8(0x39);
-   put8((reg2 << 3) | reg1 | 0xC0);
+   put_modrm_reg(reg2, reg1);
 }
 
 static osal_inline void cmp_reg32_imm8(int reg32, unsigned char imm8)
 {
+   put_rex(0, 0, 0, reg32);
    put8(0x83);
-   put8(0xF8 + reg32);
+   put_modrm_reg(7, reg32);
    put8(imm8);
 }
 
 static osal_inline void cmp_reg64_imm8(int reg64, unsigned char imm8)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0x83);
-   put8(0xF8 + reg64);
+   put_modrm_reg(7, reg64);
    put8(imm8);
 }
 
 static osal_inline void cmp_reg32_imm32(int reg32, unsigned int imm32)
 {
+   put_rex(0, 0, 0, reg32);
    put8(0x81);
-   put8(0xF8 + reg32);
+   put_modrm_reg(7, reg32);
    put32(imm32);
 }
 
 static osal_inline void cmp_reg64_imm32(int reg64, unsigned int imm32)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0x81);
-   put8(0xF8 + reg64);
+   put_modrm_reg(7, reg64);
    put32(imm32);
 }
 
 static osal_inline void cmp_preg64preg64_imm8(int reg1, int reg2, unsigned char imm8)
 {
+   put_rex(0, 0, reg1, reg2);
    put8(0x80);
-   put8(0x3C);
-   put8((reg1 << 3) | reg2);
+   put_modrm_sib(7, 0, reg1, reg2);
    put8(imm8);
 }
 
@@ -315,18 +409,18 @@ static osal_inline void setge_m8rel(unsigned char *m8)
 
 static osal_inline void setl_reg8(unsigned int reg8)
 {
-   put8(0x40);  /* we need an REX prefix to use the uniform byte registers */
+   put_rex8(0, 0, reg8);  /* we need an REX prefix to use the uniform byte registers */
    put8(0x0F);
    put8(0x9C);
-   put8(0xC0 | reg8);
+   put_modrm_reg(0, reg8);
 }
 
 static osal_inline void setb_reg8(unsigned int reg8)
 {
-   put8(0x40);  /* we need an REX prefix to use the uniform byte registers */
+   put_rex8(0, 0, reg8);  /* we need an REX prefix to use the uniform byte registers */
    put8(0x0F);
    put8(0x92);
-   put8(0xC0 | reg8);
+   put_modrm_reg(0, reg8);
 }
 
 static osal_inline void test_m32rel_imm32(unsigned int *m32, unsigned int imm32)
@@ -362,22 +456,23 @@ static osal_inline void sub_xreg32_m32rel(int xreg32, unsigned int *m32)
 
 static osal_inline void sub_reg32_reg32(int reg1, int reg2)
 {
+   put_rex(0, reg2, 0, reg1);
    put8(0x29);
-   put8((reg2 << 3) | reg1 | 0xC0);
+   put_modrm_reg(reg2, reg1);
 }
 
 static osal_inline void sub_reg64_reg64(int reg1, int reg2)
 {
-   put8(0x48);
+   put_rex(1, reg2, 0, reg1);
    put8(0x29);
-   put8((reg2 << 3) | reg1 | 0xC0);
+   put_modrm_reg(reg2, reg1);
 }
 
 static osal_inline void sub_reg64_imm32(int reg64, unsigned int imm32)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0x81);
-   put8(0xE8 + reg64);
+   put_modrm_reg(5, reg64);
    put32(imm32);
 }
 
@@ -411,6 +506,12 @@ static osal_inline void ja_rj(unsigned char saut)
    put8(saut);
 }
 
+static osal_inline void jb_rj(unsigned char saut)
+{
+   put8(0x72);
+   put8(saut);
+}
+
 static osal_inline void jae_rj(unsigned char saut)
 {
    put8(0x73);
@@ -432,14 +533,15 @@ static osal_inline void je_near_rj(unsigned int saut)
 
 static osal_inline void mov_reg32_imm32(int reg32, unsigned int imm32)
 {
-   put8(0xB8+reg32);
+   put_rex(0, 0, 0, reg32);
+   put8(0xB8 + (reg32 & 7));
    put32(imm32);
 }
 
 static osal_inline void mov_reg64_imm64(int reg64, unsigned long long imm64)
 {
-   put8(0x48);
-   put8(0xB8+reg64);
+   put_rex(1, 0, 0, reg64);
+   put8(0xB8 + (reg64 & 7));
    put64(imm64);
 }
 
@@ -462,16 +564,16 @@ static osal_inline void or_m32rel_imm32(unsigned int *m32, unsigned int imm32)
 
 static osal_inline void or_reg64_reg64(unsigned int reg1, unsigned int reg2)
 {
-   put8(0x48);
+   put_rex(1, reg2, 0, reg1);
    put8(0x09);
-   put8(0xC0 | (reg2 << 3) | reg1);
+   put_modrm_reg(reg2, reg1);
 }
 
 static osal_inline void and_reg64_reg64(unsigned int reg1, unsigned int reg2)
 {
-   put8(0x48);
+   put_rex(1, reg2, 0, reg1);
    put8(0x21);
-   put8(0xC0 | (reg2 << 3) | reg1);
+   put_modrm_reg(reg2, reg1);
 }
 
 static osal_inline void and_m32rel_imm32(unsigned int *m32, unsigned int imm32)
@@ -487,29 +589,31 @@ static osal_inline void and_m32rel_imm32(unsigned int *m32, unsigned int imm32)
 
 static osal_inline void xor_reg32_reg32(unsigned int reg1, unsigned int reg2)
 {
+   put_rex(0, reg2, 0, reg1);
    put8(0x31);
-   put8(0xC0 | (reg2 << 3) | reg1);
+   put_modrm_reg(reg2, reg1);
 }
 
 static osal_inline void xor_reg64_reg64(unsigned int reg1, unsigned int reg2)
 {
-   put8(0x48);
+   put_rex(1, reg2, 0, reg1);
    put8(0x31);
-   put8(0xC0 | (reg2 << 3) | reg1);
+   put_modrm_reg(reg2, reg1);
 }
 
 static osal_inline void add_reg64_imm32(unsigned int reg64, unsigned int imm32)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0x81);
-   put8(0xC0+reg64);
+   put_modrm_reg(0, reg64);
    put32(imm32);
 }
 
 static osal_inline void add_reg32_imm32(unsigned int reg32, unsigned int imm32)
 {
+   put_rex(0, 0, 0, reg32);
    put8(0x81);
-   put8(0xC0+reg32);
+   put_modrm_reg(0, reg32);
    put32(imm32);
 }
 
@@ -567,76 +671,82 @@ static osal_inline void cdq(void)
 
 static osal_inline void call_reg64(unsigned int reg64)
 {
+   put_rex(0, 0, 0, reg64);
    put8(0xFF);
-   put8(0xD0+reg64);
+   put_modrm_reg(2, reg64);
 }
 
 static osal_inline void shr_reg64_imm8(unsigned int reg64, unsigned char imm8)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0xC1);
-   put8(0xE8+reg64);
+   put_modrm_reg(5, reg64);
    put8(imm8);
 }
 
 static osal_inline void shr_reg32_imm8(unsigned int reg32, unsigned char imm8)
 {
+   put_rex(0, 0, 0, reg32);
    put8(0xC1);
-   put8(0xE8+reg32);
+   put_modrm_reg(5, reg32);
    put8(imm8);
 }
 
 static osal_inline void shr_reg32_cl(unsigned int reg32)
 {
+   put_rex(0, 0, 0, reg32);
    put8(0xD3);
-   put8(0xE8+reg32);
+   put_modrm_reg(5, reg32);
 }
 
 static osal_inline void shr_reg64_cl(unsigned int reg64)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0xD3);
-   put8(0xE8+reg64);
+   put_modrm_reg(5, reg64);
 }
 
 static osal_inline void sar_reg32_cl(unsigned int reg32)
 {
+   put_rex(0, 0, 0, reg32);
    put8(0xD3);
-   put8(0xF8+reg32);
+   put_modrm_reg(7, reg32);
 }
 
 static osal_inline void sar_reg64_cl(unsigned int reg64)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0xD3);
-   put8(0xF8+reg64);
+   put_modrm_reg(7, reg64);
 }
 
 static osal_inline void shl_reg32_cl(unsigned int reg32)
 {
+   put_rex(0, 0, 0, reg32);
    put8(0xD3);
-   put8(0xE0+reg32);
+   put_modrm_reg(4, reg32);
 }
 
 static osal_inline void shl_reg64_cl(unsigned int reg64)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0xD3);
-   put8(0xE0+reg64);
+   put_modrm_reg(4, reg64);
 }
 
 static osal_inline void sar_reg32_imm8(unsigned int reg32, unsigned char imm8)
 {
+   put_rex(0, 0, 0, reg32);
    put8(0xC1);
-   put8(0xF8+reg32);
+   put_modrm_reg(7, reg32);
    put8(imm8);
 }
 
 static osal_inline void sar_reg64_imm8(unsigned int reg64, unsigned char imm8)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0xC1);
-   put8(0xF8+reg64);
+   put_modrm_reg(7, reg64);
    put8(imm8);
 }
 
@@ -652,187 +762,187 @@ static osal_inline void mul_m32rel(unsigned int *m32)
 
 static osal_inline void imul_reg32(unsigned int reg32)
 {
+   put_rex(0, 0, 0, reg32);
    put8(0xF7);
-   put8(0xE8+reg32);
+   put_modrm_reg(5, reg32);
 }
 
 static osal_inline void mul_reg64(unsigned int reg64)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0xF7);
-   put8(0xE0+reg64);
+   put_modrm_reg(4, reg64);
 }
 
 static osal_inline void mul_reg32(unsigned int reg32)
 {
+   put_rex(0, 0, 0, reg32);
    put8(0xF7);
-   put8(0xE0+reg32);
+   put_modrm_reg(4, reg32);
 }
 
 static osal_inline void idiv_reg32(unsigned int reg32)
 {
+   put_rex(0, 0, 0, reg32);
    put8(0xF7);
-   put8(0xF8+reg32);
+   put_modrm_reg(7, reg32);
 }
 
 static osal_inline void div_reg32(unsigned int reg32)
 {
+   put_rex(0, 0, 0, reg32);
    put8(0xF7);
-   put8(0xF0+reg32);
+   put_modrm_reg(6, reg32);
 }
 
 static osal_inline void add_reg32_reg32(unsigned int reg1, unsigned int reg2)
 {
+   put_rex(0, reg2, 0, reg1);
    put8(0x01);
-   put8(0xC0 | (reg2 << 3) | reg1);
+   put_modrm_reg(reg2, reg1);
 }
 
 static osal_inline void add_reg64_reg64(unsigned int reg1, unsigned int reg2)
 {
-   put8(0x48);
+   put_rex(1, reg2, 0, reg1);
    put8(0x01);
-   put8(0xC0 | (reg2 << 3) | reg1);
+   put_modrm_reg(reg2, reg1);
 }
 
 static osal_inline void jmp_reg64(unsigned int reg64)
 {
+   put_rex(0, 0, 0, reg64);
    put8(0xFF);
-   put8(0xE0 + reg64);
+   put_modrm_reg(4, reg64);
 }
 
 static osal_inline void mov_reg32_preg64(unsigned int reg1, unsigned int reg2)
 {
+   put_rex(0, reg1, 0, reg2);
    put8(0x8B);
-   put8((reg1 << 3) | reg2);
+   put_modrm_preg64(reg1, reg2);
 }
 
 static osal_inline void mov_preg64_reg32(int reg1, int reg2)
 {
+   put_rex(0, reg2, 0, reg1);
    put8(0x89);
-   put8((reg2 << 3) | reg1);
+   put_modrm_preg64(reg2, reg1);
 }
 
 static osal_inline void mov_reg64_preg64(int reg1, int reg2)
 {
-   put8(0x48);
+   put_rex(1, reg1, 0, reg2);
    put8(0x8B);
-   put8((reg1 << 3) | reg2);
+   put_modrm_preg64(reg1, reg2);
 }
 
 static osal_inline void mov_reg32_preg64preg64pimm32(int reg1, int reg2, int reg3, unsigned int imm32)
 {
+   put_rex(0, reg1, reg3, reg2);
    put8(0x8B);
-   put8((reg1 << 3) | 0x84);
-   put8(reg2 | (reg3 << 3));
-   put32(imm32);
+   put_modrm_sibpimm32(reg1, 0, reg3, reg2, imm32);
 }
 
 static osal_inline void mov_preg64preg64pimm32_reg32(int reg1, int reg2, unsigned int imm32, int reg3)
 {
+   put_rex(0, reg3, reg2, reg1);
    put8(0x89);
-   put8((reg3 << 3) | 0x84);
-   put8(reg1 | (reg2 << 3));
-   put32(imm32);
+   put_modrm_sibpimm32(reg3, 0, reg2, reg1, imm32);
 }
 
 static osal_inline void mov_reg64_preg64preg64pimm32(int reg1, int reg2, int reg3, unsigned int imm32)
 {
-   put8(0x48);
+   put_rex(1, reg1, reg3, reg2);
    put8(0x8B);
-   put8((reg1 << 3) | 0x84);
-   put8(reg2 | (reg3 << 3));
-   put32(imm32);
+   put_modrm_sibpimm32(reg1, 0, reg3, reg2, imm32);
 }
 
 static osal_inline void mov_reg32_preg64preg64(int reg1, int reg2, int reg3)
 {
+   put_rex(0, reg1, reg2, reg3);
    put8(0x8B);
-   put8((reg1 << 3) | 0x04);
-   put8((reg2 << 3) | reg3);
+   put_modrm_sib(reg1, 0, reg2, reg3);
 }
 
 static osal_inline void mov_reg64_preg64preg64(int reg1, int reg2, int reg3)
 {
-   put8(0x48);
+   put_rex(1, reg1, reg3, reg2);
    put8(0x8B);
-   put8((reg1 << 3) | 0x04);
-   put8(reg2 | (reg3 << 3));
+   put_modrm_sib(reg1, 0, reg3, reg2);
 }
 
 static osal_inline void mov_reg32_preg64pimm32(int reg1, int reg2, unsigned int imm32)
 {
+   put_rex(0, reg1, 0, reg2);
    put8(0x8B);
-   put8(0x80 | (reg1 << 3) | reg2);
-   put32(imm32);
+   put_modrm_preg64pimm32(reg1, reg2, imm32);
 }
 
 static osal_inline void mov_reg64_preg64pimm32(int reg1, int reg2, unsigned int imm32)
 {
-   put8(0x48);
+   put_rex(1, reg1, 0, reg2);
    put8(0x8B);
-   put8(0x80 | (reg1 << 3) | reg2);
-   put32(imm32);
+   put_modrm_preg64pimm32(reg1, reg2, imm32);
 }
 
 static osal_inline void mov_reg64_preg64pimm8(int reg1, int reg2, unsigned int imm8)
 {
-   put8(0x48);
+   put_rex(1, reg1, 0, reg2);
    put8(0x8B);
-   put8(0x40 | (reg1 << 3) | reg2);
-   put8(imm8);
+   put_modrm_preg64pimm8(reg1, reg2, imm8);
 }
 
 static osal_inline void mov_reg64_preg64x8preg64(int reg1, int reg2, int reg3)
 {
-   put8(0x48);
+   put_rex(1, reg1, reg2, reg3);
    put8(0x8B);
-   put8((reg1 << 3) | 4);
-   put8(0xC0 | (reg2 << 3) | reg3);
+   put_modrm_sib(reg1, 3, reg2, reg3);
 }
 
 static osal_inline void mov_preg64preg64_reg8(int reg1, int reg2, int reg8)
 {
+   if (reg8 >= 4 || reg1 >= 8 || reg2 >= 8)
+      put_rex8(reg8, reg1, reg2);
    put8(0x88);
-   put8(0x04 | (reg8 << 3));
-   put8((reg1 << 3) | reg2);
+   put_modrm_sib(reg8, 0, reg1, reg2);
 }
 
 static osal_inline void mov_preg64preg64_imm8(int reg1, int reg2, unsigned char imm8)
 {
+   put_rex(0, 0, reg1, reg2);
    put8(0xC6);
-   put8(0x04);
-   put8((reg1 << 3) | reg2);
+   put_modrm_sib(0, 0, reg1, reg2);
    put8(imm8);
 }
 
 static osal_inline void mov_preg64preg64_reg16(int reg1, int reg2, int reg16)
 {
    put8(0x66);
+   put_rex(0, reg16, reg1, reg2);
    put8(0x89);
-   put8(0x04 | (reg16 << 3));
-   put8((reg1 << 3) | reg2);
+   put_modrm_sib(reg16, 0, reg1, reg2);
 }
 
 static osal_inline void mov_preg64preg64_reg32(int reg1, int reg2, int reg32)
 {
+   put_rex(0, reg32, reg1, reg2);
    put8(0x89);
-   put8(0x04 | (reg32 << 3));
-   put8((reg1 << 3) | reg2);
+   put_modrm_sib(reg32, 0, reg1, reg2);
 }
 
 static osal_inline void mov_preg64pimm32_reg32(int reg1, unsigned int imm32, int reg2)
 {
+   put_rex(0, reg2, 0, reg1);
    put8(0x89);
-   put8(0x80 | reg1 | (reg2 << 3));
-   put32(imm32);
+   put_modrm_preg64pimm32(reg2, reg1, imm32);
 }
 
 static osal_inline void mov_preg64pimm8_reg64(int reg1, unsigned int imm8, int reg2)
 {
-   put8(0x48);
+   put_rex(1, reg2, 0, reg1);
    put8(0x89);
-   put8(0x40 | (reg2 << 3) | reg1);
-   put8(imm8);
+   put_modrm_preg64pimm8(reg2, reg1, imm8);
 }
 
 static osal_inline void add_eax_imm32(unsigned int imm32)
@@ -843,32 +953,34 @@ static osal_inline void add_eax_imm32(unsigned int imm32)
 
 static osal_inline void shl_reg32_imm8(unsigned int reg32, unsigned char imm8)
 {
+   put_rex(0, 0, 0, reg32);
    put8(0xC1);
-   put8(0xE0 + reg32);
+   put_modrm_reg(4, reg32);
    put8(imm8);
 }
 
 static osal_inline void shl_reg64_imm8(unsigned int reg64, unsigned char imm8)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0xC1);
-   put8(0xE0 + reg64);
+   put_modrm_reg(4, reg64);
    put8(imm8);
 }
 
 static osal_inline void mov_reg32_reg32(unsigned int reg1, unsigned int reg2)
 {
    if (reg1 == reg2) return;
+   put_rex(0, reg2, 0, reg1);
    put8(0x89);
-   put8(0xC0 | (reg2 << 3) | reg1);
+   put_modrm_reg(reg2, reg1);
 }
 
 static osal_inline void mov_reg64_reg64(unsigned int reg1, unsigned int reg2)
 {
    if (reg1 == reg2) return;
-   put8(0x48);
+   put_rex(1, reg2, 0, reg1);
    put8(0x89);
-   put8(0xC0 | (reg2 << 3) | reg1);
+   put_modrm_reg(reg2, reg1);
 }
 
 static osal_inline void mov_xreg32_m32rel(unsigned int xreg32, unsigned int *m32)
@@ -929,69 +1041,71 @@ static osal_inline void and_eax_imm32(unsigned int imm32)
 
 static osal_inline void or_reg64_imm32(int reg64, unsigned int imm32)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0x81);
-   put8(0xC8 + reg64);
+   put_modrm_reg(1, reg64);
    put32(imm32);
 }
 
 static osal_inline void and_reg32_imm32(int reg32, unsigned int imm32)
 {
+   put_rex(0, 0, 0, reg32);
    put8(0x81);
-   put8(0xE0 + reg32);
+   put_modrm_reg(4, reg32);
    put32(imm32);
 }
 
 static osal_inline void and_reg64_imm32(int reg64, unsigned int imm32)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0x81);
-   put8(0xE0 + reg64);
+   put_modrm_reg(4, reg64);
    put32(imm32);
 }
 
 static osal_inline void and_reg64_imm8(int reg64, unsigned char imm8)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0x83);
-   put8(0xE0 + reg64);
+   put_modrm_reg(4, reg64);
    put8(imm8);
 }
 
 static osal_inline void xor_reg64_imm32(int reg64, unsigned int imm32)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0x81);
-   put8(0xF0 + reg64);
+   put_modrm_reg(6, reg64);
    put32(imm32);
 }
 
 static osal_inline void xor_reg8_imm8(int reg8, unsigned char imm8)
 {
-   put8(0x40);  /* we need an REX prefix to use the uniform byte registers */
+   put_rex8(0, 0, reg8);  /* we need an REX prefix to use the uniform byte registers */
    put8(0x80);
-   put8(0xF0 + reg8);
+   put_modrm_reg(6, reg8);
    put8(imm8);
 }
 
 static osal_inline void not_reg64(unsigned int reg64)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0xF7);
-   put8(0xD0 + reg64);
+   put_modrm_reg(2, reg64);
 }
 
 static osal_inline void neg_reg32(unsigned int reg32)
 {
+   put_rex(0, 0, 0, reg32);
    put8(0xF7);
-   put8(0xD8 + reg32);
+   put_modrm_reg(3, reg32);
 }
 
 static osal_inline void neg_reg64(unsigned int reg64)
 {
-   put8(0x48);
+   put_rex(1, 0, 0, reg64);
    put8(0xF7);
-   put8(0xD8 + reg64);
+   put_modrm_reg(3, reg64);
 }
 
 static osal_inline void movsx_xreg32_m8rel(int xreg32, unsigned char *m8)
@@ -1007,18 +1121,18 @@ static osal_inline void movsx_xreg32_m8rel(int xreg32, unsigned char *m8)
 
 static osal_inline void movsx_reg32_8preg64preg64(int reg1, int reg2, int reg3)
 {
+   put_rex(0, reg1, reg2, reg3);
    put8(0x0F);
    put8(0xBE);
-   put8((reg1 << 3) | 0x04);
-   put8((reg2 << 3) | reg3);
+   put_modrm_sib(reg1, 0, reg2, reg3);
 }
 
 static osal_inline void movsx_reg32_16preg64preg64(int reg1, int reg2, int reg3)
 {
+   put_rex(0, reg1, reg2, reg3);
    put8(0x0F);
    put8(0xBF);
-   put8((reg1 << 3) | 0x04);
-   put8((reg2 << 3) | reg3);
+   put_modrm_sib(reg1, 0, reg2, reg3);
 }
 
 static osal_inline void movsx_xreg32_m16rel(int xreg32, unsigned short *m16)
@@ -1034,9 +1148,9 @@ static osal_inline void movsx_xreg32_m16rel(int xreg32, unsigned short *m16)
 
 static osal_inline void movsxd_reg64_reg32(int reg64, int reg32)
 {
-   put8(0x48);
+   put_rex(1, reg64, 0, reg32);
    put8(0x63);
-   put8((reg64 << 3) | reg32 | 0xC0);
+   put_modrm_reg(reg64, reg32);
 }
 
 static osal_inline void fldcw_m16rel(unsigned short *m16)
@@ -1181,5 +1295,134 @@ static osal_inline void ffree_fpreg(int fpreg)
    put8(0xC0 + fpreg);
 }
 
+static osal_inline void ldmxcsr_m32rel(unsigned int *m32)
+{
+   int offset = rel_r15_offset(m32, "ldmxcsr_m32rel");
+
+   put8(0x41);
+   put8(0x0F);
+   put8(0xAE);
+   put8(0x97);
+   put32(offset);
+}
+
+static osal_inline void sse_xmm_preg64(unsigned char prefix, unsigned char opcode, int xmm, int reg64)
+{
+   if (prefix)
+      put8(prefix);
+   put8(0x0F);
+   put8(opcode);
+   put8((xmm << 3) | reg64);
+}
+
+static osal_inline void sse_xmm_xmm(unsigned char prefix, unsigned char opcode, int xmm1, int xmm2)
+{
+   if (prefix)
+      put8(prefix);
+   put8(0x0F);
+   put8(opcode);
+   put8(0xC0 | (xmm1 << 3) | xmm2);
+}
+
+static osal_inline void movss_xmm_preg64(int xmm, int reg64)
+{
+   sse_xmm_preg64(0xF3, 0x10, xmm, reg64);
+}
+
+static osal_inline void movss_preg64_xmm(int reg64, int xmm)
+{
+   sse_xmm_preg64(0xF3, 0x11, xmm, reg64);
+}
+
+static osal_inline void addss_xmm_preg64(int xmm, int reg64)
+{
+   sse_xmm_preg64(0xF3, 0x58, xmm, reg64);
+}
+
+static osal_inline void mulss_xmm_preg64(int xmm, int reg64)
+{
+   sse_xmm_preg64(0xF3, 0x59, xmm, reg64);
+}
+
+static osal_inline void subss_xmm_preg64(int xmm, int reg64)
+{
+   sse_xmm_preg64(0xF3, 0x5C, xmm, reg64);
+}
+
+static osal_inline void divss_xmm_preg64(int xmm, int reg64)
+{
+   sse_xmm_preg64(0xF3, 0x5E, xmm, reg64);
+}
+
+static osal_inline void sqrtss_xmm_preg64(int xmm, int reg64)
+{
+   sse_xmm_preg64(0xF3, 0x51, xmm, reg64);
+}
+
+static osal_inline void cvtss2sd_xmm_preg64(int xmm, int reg64)
+{
+   sse_xmm_preg64(0xF3, 0x5A, xmm, reg64);
+}
+
+static osal_inline void ucomiss_xmm_xmm(int xmm1, int xmm2)
+{
+   sse_xmm_xmm(0, 0x2E, xmm1, xmm2);
+}
+
+static osal_inline void comiss_xmm_xmm(int xmm1, int xmm2)
+{
+   sse_xmm_xmm(0, 0x2F, xmm1, xmm2);
+}
+
+static osal_inline void movsd_xmm_preg64(int xmm, int reg64)
+{
+   sse_xmm_preg64(0xF2, 0x10, xmm, reg64);
+}
+
+static osal_inline void movsd_preg64_xmm(int reg64, int xmm)
+{
+   sse_xmm_preg64(0xF2, 0x11, xmm, reg64);
+}
+
+static osal_inline void addsd_xmm_preg64(int xmm, int reg64)
+{
+   sse_xmm_preg64(0xF2, 0x58, xmm, reg64);
+}
+
+static osal_inline void mulsd_xmm_preg64(int xmm, int reg64)
+{
+   sse_xmm_preg64(0xF2, 0x59, xmm, reg64);
+}
+
+static osal_inline void subsd_xmm_preg64(int xmm, int reg64)
+{
+   sse_xmm_preg64(0xF2, 0x5C, xmm, reg64);
+}
+
+static osal_inline void divsd_xmm_preg64(int xmm, int reg64)
+{
+   sse_xmm_preg64(0xF2, 0x5E, xmm, reg64);
+}
+
+static osal_inline void sqrtsd_xmm_preg64(int xmm, int reg64)
+{
+   sse_xmm_preg64(0xF2, 0x51, xmm, reg64);
+}
+
+static osal_inline void cvtsd2ss_xmm_preg64(int xmm, int reg64)
+{
+   sse_xmm_preg64(0xF2, 0x5A, xmm, reg64);
+}
+
+static osal_inline void ucomisd_xmm_xmm(int xmm1, int xmm2)
+{
+   sse_xmm_xmm(0x66, 0x2E, xmm1, xmm2);
+}
+
+static osal_inline void comisd_xmm_xmm(int xmm1, int xmm2)
+{
+   sse_xmm_xmm(0x66, 0x2F, xmm1, xmm2);
+}
+
 #endif /* M64P_DEVICE_R4300_X86_64_ASSEMBLE_H */
 
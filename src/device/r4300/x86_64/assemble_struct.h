@@ -26,19 +26,19 @@
 struct precomp_instr;
 
 struct regcache_state {
-    unsigned long long * reg_content[8];
-    struct precomp_instr* last_access[8];
-    struct precomp_instr* free_since[8];
-    int dirty[8];
-    int is64bits[8];
+    unsigned long long * reg_content[16];
+    struct precomp_instr* last_access[16];
+    struct precomp_instr* free_since[16];
+    int dirty[16];
+    int is64bits[16];
     unsigned long long *r0;
 };
 
 struct reg_cache
 {
    int need_map;
-   void *needed_registers[8];
-   unsigned char jump_wrapper[84];
+   void *needed_registers[16];
+   unsigned char jump_wrapper[133];
    int need_cop1_check;
 };
 
@@ -36,6 +36,15 @@
 #include "device/r4300/instr_counters.h"
 #endif
 
+/* COP1 arithmetic is generated as scalar SSE2 working from memory: each
+ * instruction loads its operands through the regs_simple/regs_double
+ * pointers into XMM0/XMM1 and stores the result back. FPRs are not kept in
+ * XMM registers across instructions. The pointers resolve FR=0 pairing at
+ * run time, so two FPR numbers may or may not alias, and the register
+ * cache (needed_registers and the jump wrappers of regcache.c) only knows
+ * about GPRs. The conversions to integer formats stay on x87 because they
+ * use the FLDCW rounding overrides below. There is no AVX path. */
+
 /* These are constants with addresses so that FLDCW can read them.
  * They are declared 'extern' so that other files can do the same. */
 const uint16_t trunc_mode = 0xF3F;
@@ -159,6 +168,15 @@ void genctc1(void)
    mov_m32rel_imm32((unsigned int*)&g_dev.r4300.cp1.rounding_mode, 0x73F); // 11
    
    fldcw_m16rel((unsigned short*)&g_dev.r4300.cp1.rounding_mode);
+
+   /* MXCSR RC is nearest, down, up, zero where FCR31 RM is nearest, zero,
+    * up, down, so RC = -RM & 3 with all exceptions masked */
+   neg_reg32(EAX);
+   and_eax_imm32(3);
+   shl_reg32_imm8(EAX, 13);
+   or_reg64_imm32(RAX, 0x1F80);
+   mov_m32rel_xreg32((unsigned int*)&g_dev.r4300.cp1.sse_rounding_mode, EAX);
+   ldmxcsr_m32rel((unsigned int*)&g_dev.r4300.cp1.sse_rounding_mode);
 #endif
 }
 
@@ -43,11 +43,11 @@ void genadd_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fadd_preg64_qword(RAX);
+   addsd_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fd]));
-   fstp_preg64_qword(RAX);
+   movsd_preg64_xmm(RAX, XMM0);
 #endif
 }
 
@@ -61,11 +61,11 @@ void gensub_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fsub_preg64_qword(RAX);
+   subsd_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fd]));
-   fstp_preg64_qword(RAX);
+   movsd_preg64_xmm(RAX, XMM0);
 #endif
 }
 
@@ -79,11 +79,11 @@ void genmul_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fmul_preg64_qword(RAX);
+   mulsd_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fd]));
-   fstp_preg64_qword(RAX);
+   movsd_preg64_xmm(RAX, XMM0);
 #endif
 }
 
@@ -97,11 +97,11 @@ void gendiv_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fdiv_preg64_qword(RAX);
+   divsd_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fd]));
-   fstp_preg64_qword(RAX);
+   movsd_preg64_xmm(RAX, XMM0);
 #endif
 }
 
@@ -115,10 +115,9 @@ void gensqrt_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
-   fsqrt();
+   sqrtsd_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fd]));
-   fstp_preg64_qword(RAX);
+   movsd_preg64_xmm(RAX, XMM0);
 #endif
 }
 
@@ -328,9 +327,9 @@ void gencvt_s_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
+   cvtsd2ss_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fd]));
-   fstp_preg64_dword(RAX);
+   movss_preg64_xmm(RAX, XMM0);
 #endif
 }
 
@@ -389,11 +388,10 @@ void genc_un_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
-   fucomip_fpreg(1);
-   ffree_fpreg(0);
+   movsd_xmm_preg64(XMM0, RAX);
+   ucomisd_xmm_xmm(XMM0, XMM1);
    jp_rj(13);
    and_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), ~0x800000); // 11
    jmp_imm_short(11); // 2
@@ -411,11 +409,10 @@ void genc_eq_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
-   fucomip_fpreg(1);
-   ffree_fpreg(0);
+   movsd_xmm_preg64(XMM0, RAX);
+   ucomisd_xmm_xmm(XMM0, XMM1);
    jne_rj(13); // 2
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
    jmp_imm_short(11); // 2
@@ -433,11 +430,10 @@ void genc_ueq_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
-   fucomip_fpreg(1);
-   ffree_fpreg(0);
+   movsd_xmm_preg64(XMM0, RAX);
+   ucomisd_xmm_xmm(XMM0, XMM1);
    jp_rj(15);
    jne_rj(13);
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
@@ -456,11 +452,10 @@ void genc_olt_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
-   fucomip_fpreg(1);
-   ffree_fpreg(0);
+   movsd_xmm_preg64(XMM0, RAX);
+   ucomisd_xmm_xmm(XMM0, XMM1);
    jae_rj(13); // 2
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
    jmp_imm_short(11); // 2
@@ -478,11 +473,10 @@ void genc_ult_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
-   fucomip_fpreg(1);
-   ffree_fpreg(0);
+   movsd_xmm_preg64(XMM0, RAX);
+   ucomisd_xmm_xmm(XMM0, XMM1);
    jp_rj(15);
    jae_rj(13); // 2
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
@@ -501,11 +495,10 @@ void genc_ole_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
-   fucomip_fpreg(1);
-   ffree_fpreg(0);
+   movsd_xmm_preg64(XMM0, RAX);
+   ucomisd_xmm_xmm(XMM0, XMM1);
    ja_rj(13); // 2
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
    jmp_imm_short(11); // 2
@@ -523,11 +516,10 @@ void genc_ule_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
-   fucomip_fpreg(1);
-   ffree_fpreg(0);
+   movsd_xmm_preg64(XMM0, RAX);
+   ucomisd_xmm_xmm(XMM0, XMM1);
    jp_rj(15);
    ja_rj(13); // 2
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
@@ -546,11 +538,10 @@ void genc_sf_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
-   fcomip_fpreg(1);
-   ffree_fpreg(0);
+   movsd_xmm_preg64(XMM0, RAX);
+   comisd_xmm_xmm(XMM0, XMM1);
    and_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), ~0x800000);
 #endif
 }
@@ -565,11 +556,10 @@ void genc_ngle_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
-   fcomip_fpreg(1);
-   ffree_fpreg(0);
+   movsd_xmm_preg64(XMM0, RAX);
+   comisd_xmm_xmm(XMM0, XMM1);
    jp_rj(13);
    and_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), ~0x800000); // 11
    jmp_imm_short(11); // 2
@@ -587,11 +577,10 @@ void genc_seq_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
-   fcomip_fpreg(1);
-   ffree_fpreg(0);
+   movsd_xmm_preg64(XMM0, RAX);
+   comisd_xmm_xmm(XMM0, XMM1);
    jne_rj(13); // 2
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
    jmp_imm_short(11); // 2
@@ -609,11 +598,10 @@ void genc_ngl_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
-   fcomip_fpreg(1);
-   ffree_fpreg(0);
+   movsd_xmm_preg64(XMM0, RAX);
+   comisd_xmm_xmm(XMM0, XMM1);
    jp_rj(15);
    jne_rj(13);
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
@@ -632,11 +620,10 @@ void genc_lt_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
-   fcomip_fpreg(1);
-   ffree_fpreg(0);
+   movsd_xmm_preg64(XMM0, RAX);
+   comisd_xmm_xmm(XMM0, XMM1);
    jae_rj(13); // 2
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
    jmp_imm_short(11); // 2
@@ -654,11 +641,10 @@ void genc_nge_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
-   fcomip_fpreg(1);
-   ffree_fpreg(0);
+   movsd_xmm_preg64(XMM0, RAX);
+   comisd_xmm_xmm(XMM0, XMM1);
    jp_rj(15);
    jae_rj(13); // 2
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
@@ -677,11 +663,10 @@ void genc_le_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
-   fcomip_fpreg(1);
-   ffree_fpreg(0);
+   movsd_xmm_preg64(XMM0, RAX);
+   comisd_xmm_xmm(XMM0, XMM1);
    ja_rj(13); // 2
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
    jmp_imm_short(11); // 2
@@ -699,11 +684,10 @@ void genc_ngt_d(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_qword(RAX);
+   movsd_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_qword(RAX);
-   fcomip_fpreg(1);
-   ffree_fpreg(0);
+   movsd_xmm_preg64(XMM0, RAX);
+   comisd_xmm_xmm(XMM0, XMM1);
    jp_rj(15);
    ja_rj(13); // 2
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
@@ -44,11 +44,11 @@ void genadd_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fadd_preg64_dword(RAX);
+   addss_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fd]));
-   fstp_preg64_dword(RAX);
+   movss_preg64_xmm(RAX, XMM0);
 #endif
 }
 
@@ -62,11 +62,11 @@ void gensub_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fsub_preg64_dword(RAX);
+   subss_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fd]));
-   fstp_preg64_dword(RAX);
+   movss_preg64_xmm(RAX, XMM0);
 #endif
 }
 
@@ -80,11 +80,11 @@ void genmul_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fmul_preg64_dword(RAX);
+   mulss_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fd]));
-   fstp_preg64_dword(RAX);
+   movss_preg64_xmm(RAX, XMM0);
 #endif
 }
 
@@ -98,11 +98,11 @@ void gendiv_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fdiv_preg64_dword(RAX);
+   divss_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fd]));
-   fstp_preg64_dword(RAX);
+   movss_preg64_xmm(RAX, XMM0);
 #endif
 }
 
@@ -116,10 +116,9 @@ void gensqrt_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
-   fsqrt();
+   sqrtss_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fd]));
-   fstp_preg64_dword(RAX);
+   movss_preg64_xmm(RAX, XMM0);
 #endif
 }
 
@@ -327,9 +326,9 @@ void gencvt_d_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
+   cvtss2sd_xmm_preg64(XMM0, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_double())[g_dev.r4300.recomp.dst->f.cf.fd]));
-   fstp_preg64_qword(RAX);
+   movsd_preg64_xmm(RAX, XMM0);
 #endif
 }
 
@@ -388,11 +387,10 @@ void genc_un_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
-   fucomip_fpreg(1);
-   ffree_fpreg(0);
+   movss_xmm_preg64(XMM0, RAX);
+   ucomiss_xmm_xmm(XMM0, XMM1);
    jp_rj(13);
    and_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), ~0x800000); // 11
    jmp_imm_short(11); // 2
@@ -410,11 +408,10 @@ void genc_eq_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
-   fucomip_fpreg(1);
-   ffree_fpreg(0);
+   movss_xmm_preg64(XMM0, RAX);
+   ucomiss_xmm_xmm(XMM0, XMM1);
    jne_rj(13);
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
    jmp_imm_short(11); // 2
@@ -432,11 +429,10 @@ void genc_ueq_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
-   fucomip_fpreg(1);
-   ffree_fpreg(0);
+   movss_xmm_preg64(XMM0, RAX);
+   ucomiss_xmm_xmm(XMM0, XMM1);
    jp_rj(15);
    jne_rj(13);
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
@@ -455,11 +451,10 @@ void genc_olt_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
-   fucomip_fpreg(1);
-   ffree_fpreg(0);
+   movss_xmm_preg64(XMM0, RAX);
+   ucomiss_xmm_xmm(XMM0, XMM1);
    jae_rj(13);
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
    jmp_imm_short(11); // 2
@@ -477,11 +472,10 @@ void genc_ult_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
-   fucomip_fpreg(1);
-   ffree_fpreg(0);
+   movss_xmm_preg64(XMM0, RAX);
+   ucomiss_xmm_xmm(XMM0, XMM1);
    jp_rj(15);
    jae_rj(13);
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
@@ -500,11 +494,10 @@ void genc_ole_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
-   fucomip_fpreg(1);
-   ffree_fpreg(0);
+   movss_xmm_preg64(XMM0, RAX);
+   ucomiss_xmm_xmm(XMM0, XMM1);
    ja_rj(13);
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
    jmp_imm_short(11); // 2
@@ -522,11 +515,10 @@ void genc_ule_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
-   fucomip_fpreg(1);
-   ffree_fpreg(0);
+   movss_xmm_preg64(XMM0, RAX);
+   ucomiss_xmm_xmm(XMM0, XMM1);
    jp_rj(15);
    ja_rj(13);
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
@@ -545,11 +537,10 @@ void genc_sf_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
-   fcomip_fpreg(1);
-   ffree_fpreg(0);
+   movss_xmm_preg64(XMM0, RAX);
+   comiss_xmm_xmm(XMM0, XMM1);
    and_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), ~0x800000);
 #endif
 }
@@ -564,11 +555,10 @@ void genc_ngle_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
-   fcomip_fpreg(1);
-   ffree_fpreg(0);
+   movss_xmm_preg64(XMM0, RAX);
+   comiss_xmm_xmm(XMM0, XMM1);
    jp_rj(13);
    and_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), ~0x800000); // 11
    jmp_imm_short(11); // 2
@@ -586,11 +576,10 @@ void genc_seq_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
-   fcomip_fpreg(1);
-   ffree_fpreg(0);
+   movss_xmm_preg64(XMM0, RAX);
+   comiss_xmm_xmm(XMM0, XMM1);
    jne_rj(13);
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
    jmp_imm_short(11); // 2
@@ -608,11 +597,10 @@ void genc_ngl_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
-   fcomip_fpreg(1);
-   ffree_fpreg(0);
+   movss_xmm_preg64(XMM0, RAX);
+   comiss_xmm_xmm(XMM0, XMM1);
    jp_rj(15);
    jne_rj(13);
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
@@ -631,11 +619,10 @@ void genc_lt_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
-   fcomip_fpreg(1);
-   ffree_fpreg(0);
+   movss_xmm_preg64(XMM0, RAX);
+   comiss_xmm_xmm(XMM0, XMM1);
    jae_rj(13);
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
    jmp_imm_short(11); // 2
@@ -653,11 +640,10 @@ void genc_nge_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
-   fcomip_fpreg(1);
-   ffree_fpreg(0);
+   movss_xmm_preg64(XMM0, RAX);
+   comiss_xmm_xmm(XMM0, XMM1);
    jp_rj(15);
    jae_rj(13);
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
@@ -676,11 +662,10 @@ void genc_le_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
-   fcomip_fpreg(1);
-   ffree_fpreg(0);
+   movss_xmm_preg64(XMM0, RAX);
+   comiss_xmm_xmm(XMM0, XMM1);
    ja_rj(13);
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
    jmp_imm_short(11); // 2
@@ -698,11 +683,10 @@ void genc_ngt_s(void)
 #else
    gencheck_cop1_unusable();
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.ft]));
-   fld_preg64_dword(RAX);
+   movss_xmm_preg64(XMM1, RAX);
    mov_xreg64_m64rel(RAX, (unsigned long long *)(&(r4300_cp1_regs_simple())[g_dev.r4300.recomp.dst->f.cf.fs]));
-   fld_preg64_dword(RAX);
-   fcomip_fpreg(1);
-   ffree_fpreg(0);
+   movss_xmm_preg64(XMM0, RAX);
+   comiss_xmm_xmm(XMM0, XMM1);
    jp_rj(15);
    ja_rj(13);
    or_m32rel_imm32((unsigned int*)&(*r4300_cp1_fcr31()), 0x800000); // 11
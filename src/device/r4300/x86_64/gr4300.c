@@ -249,6 +249,28 @@ static void ld_register_alloc(int *pGpr1, int *pGpr2, int *pBase1, int *pBase2)
    *pBase2 = base2;
 }
 
+/* Test if the address in addr_reg can be accessed directly in RDRAM ("fast memory").
+ * Leaves ZF set if so. check_reg must hold a copy of the address and is trashed. */
+static void gencheck_fast_memory(int check_reg, int addr_reg)
+{
+   if (g_dev.r4300.recomp.fast_memory_fb_check)
+   {
+     /* protected framebuffers must go through the memory handlers */
+     mov_reg32_reg32(check_reg, addr_reg);
+     and_reg32_imm32(check_reg, 0x7FFFFF);
+     sub_xreg32_m32rel(check_reg, (unsigned int *)&g_dev.dp.fb.window_begin);
+     cmp_xreg32_m32rel(check_reg, (unsigned int *)&g_dev.dp.fb.window_size);
+     jb_rj(0); /* ZF is clear when taken */
+     jump_start_rel8();
+     mov_reg32_reg32(check_reg, addr_reg);
+   }
+
+   and_reg32_imm32(check_reg, 0xDF800000);
+   cmp_reg32_imm32(check_reg, 0x80000000);
+
+   if (g_dev.r4300.recomp.fast_memory_fb_check)
+     jump_end_rel8();
+}
 
 /* global functions */
 
@@ -343,6 +365,12 @@ void genni(void)
    gencallinterp((unsigned long long)cached_interpreter_table.NI, 0);
 }
 
+/* polling loop, the interpreter handler checks it before skipping */
+void genidle_loop(void)
+{
+   gencallinterp((unsigned long long)g_dev.r4300.recomp.dst->ops, 1);
+}
+
 void genreserved(void)
 {
 #if defined(COUNT_INSTR)
@@ -1318,6 +1346,7 @@ void genldr(void)
 void genlb(void)
 {
    int gpr1, gpr2, base1, base2 = 0;
+   unsigned int fast;
 #if defined(COUNT_INSTR)
    inc_m32rel(&instr_count[24]);
 #endif
@@ -1331,8 +1360,7 @@ void genlb(void)
    mov_reg64_imm64(base1, (unsigned long long) g_dev.mem.readmemb);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_reg32_imm32(gpr1, 0xDF800000);
-    cmp_reg32_imm32(gpr1, 0x80000000);
+    gencheck_fast_memory(gpr1, gpr2);
      }
    else
      {
@@ -1353,13 +1381,15 @@ void genlb(void)
    mov_reg64_preg64x8preg64(gpr2, gpr2, base1);
    call_reg64(gpr2);
    movsx_xreg32_m8rel(gpr1, (unsigned char *)g_dev.r4300.recomp.dst->f.i.rt);
-   jmp_imm_short(24);
+   jmp_imm_short(0);
+   fast = jump_mark_rel8();
 
    jump_end_rel8();
-   mov_reg64_imm64(base1, (unsigned long long) g_dev.ri.rdram.dram); // 10
-   and_reg32_imm32(gpr2, 0x7FFFFF); // 6
-   xor_reg8_imm8(gpr2, 3); // 4
-   movsx_reg32_8preg64preg64(gpr1, gpr2, base1); // 4
+   mov_reg64_imm64(base1, (unsigned long long) g_dev.ri.rdram.dram);
+   and_reg32_imm32(gpr2, 0x7FFFFF);
+   xor_reg8_imm8(gpr2, 3);
+   movsx_reg32_8preg64preg64(gpr1, gpr2, base1);
+   jump_patch_rel8(fast);
 
    set_register_state(gpr1, (unsigned int*)g_dev.r4300.recomp.dst->f.i.rt, 1, 0);
 #endif
@@ -1368,6 +1398,7 @@ void genlb(void)
 void genlh(void)
 {
    int gpr1, gpr2, base1, base2 = 0;
+   unsigned int fast;
 #if defined(COUNT_INSTR)
    inc_m32rel(&instr_count[25]);
 #endif
@@ -1381,8 +1412,7 @@ void genlh(void)
    mov_reg64_imm64(base1, (unsigned long long) g_dev.mem.readmemh);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_reg32_imm32(gpr1, 0xDF800000);
-    cmp_reg32_imm32(gpr1, 0x80000000);
+    gencheck_fast_memory(gpr1, gpr2);
      }
    else
      {
@@ -1403,13 +1433,15 @@ void genlh(void)
    mov_reg64_preg64x8preg64(gpr2, gpr2, base1);
    call_reg64(gpr2);
    movsx_xreg32_m16rel(gpr1, (unsigned short *)g_dev.r4300.recomp.dst->f.i.rt);
-   jmp_imm_short(24);
+   jmp_imm_short(0);
+   fast = jump_mark_rel8();
 
    jump_end_rel8();   
-   mov_reg64_imm64(base1, (unsigned long long) g_dev.ri.rdram.dram); // 10
-   and_reg32_imm32(gpr2, 0x7FFFFF); // 6
-   xor_reg8_imm8(gpr2, 2); // 4
-   movsx_reg32_16preg64preg64(gpr1, gpr2, base1); // 4
+   mov_reg64_imm64(base1, (unsigned long long) g_dev.ri.rdram.dram);
+   and_reg32_imm32(gpr2, 0x7FFFFF);
+   xor_reg8_imm8(gpr2, 2);
+   movsx_reg32_16preg64preg64(gpr1, gpr2, base1);
+   jump_patch_rel8(fast);
 
    set_register_state(gpr1, (unsigned int*)g_dev.r4300.recomp.dst->f.i.rt, 1, 0);
 #endif
@@ -1426,6 +1458,7 @@ void genlwl(void)
 void genlw(void)
 {
    int gpr1, gpr2, base1, base2 = 0;
+   unsigned int slow;
 #if defined(COUNT_INSTR)
    inc_m32rel(&instr_count[26]);
 #endif
@@ -1439,8 +1472,7 @@ void genlw(void)
    mov_reg64_imm64(base1, (unsigned long long) g_dev.mem.readmem);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_reg32_imm32(gpr1, 0xDF800000);
-    cmp_reg32_imm32(gpr1, 0x80000000);
+    gencheck_fast_memory(gpr1, gpr2);
      }
    else
      {
@@ -1449,14 +1481,16 @@ void genlw(void)
     mov_reg64_preg64x8preg64(gpr1, gpr1, base1);
     cmp_reg64_reg64(gpr1, base2);
      }
-   jne_rj(21);
+   jne_rj(0);
+   slow = jump_mark_rel8();
 
-   mov_reg64_imm64(base1, (unsigned long long) g_dev.ri.rdram.dram); // 10
-   and_reg32_imm32(gpr2, 0x7FFFFF); // 6
-   mov_reg32_preg64preg64(gpr1, gpr2, base1); // 3
-   jmp_imm_short(0); // 2
+   mov_reg64_imm64(base1, (unsigned long long) g_dev.ri.rdram.dram);
+   and_reg32_imm32(gpr2, 0x7FFFFF);
+   mov_reg32_preg64preg64(gpr1, gpr2, base1);
+   jmp_imm_short(0);
    jump_start_rel8();
 
+   jump_patch_rel8(slow);
    mov_reg64_imm64(gpr1, (unsigned long long) (g_dev.r4300.recomp.dst+1));
    mov_m64rel_xreg64((unsigned long long *)(&(*r4300_pc_struct())), gpr1);
    mov_m32rel_xreg32((unsigned int *)(memory_address()), gpr2);
@@ -1476,6 +1510,7 @@ void genlw(void)
 void genlbu(void)
 {
    int gpr1, gpr2, base1, base2 = 0;
+   unsigned int fast;
 #if defined(COUNT_INSTR)
    inc_m32rel(&instr_count[28]);
 #endif
@@ -1489,8 +1524,7 @@ void genlbu(void)
    mov_reg64_imm64(base1, (unsigned long long) g_dev.mem.readmemb);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_reg32_imm32(gpr1, 0xDF800000);
-    cmp_reg32_imm32(gpr1, 0x80000000);
+    gencheck_fast_memory(gpr1, gpr2);
      }
    else
      {
@@ -1511,14 +1545,16 @@ void genlbu(void)
    mov_reg64_preg64x8preg64(gpr2, gpr2, base1);
    call_reg64(gpr2);
    mov_xreg32_m32rel(gpr1, (unsigned int *)g_dev.r4300.recomp.dst->f.i.rt);
-   jmp_imm_short(23);
+   jmp_imm_short(0);
+   fast = jump_mark_rel8();
 
    jump_end_rel8();
-   mov_reg64_imm64(base1, (unsigned long long) g_dev.ri.rdram.dram); // 10
-   and_reg32_imm32(gpr2, 0x7FFFFF); // 6
-   xor_reg8_imm8(gpr2, 3); // 4
-   mov_reg32_preg64preg64(gpr1, gpr2, base1); // 3
-   
+   mov_reg64_imm64(base1, (unsigned long long) g_dev.ri.rdram.dram);
+   and_reg32_imm32(gpr2, 0x7FFFFF);
+   xor_reg8_imm8(gpr2, 3);
+   mov_reg32_preg64preg64(gpr1, gpr2, base1);
+   jump_patch_rel8(fast);
+
    and_reg32_imm32(gpr1, 0xFF);
    set_register_state(gpr1, (unsigned int*)g_dev.r4300.recomp.dst->f.i.rt, 1, 0);
 #endif
@@ -1527,6 +1563,7 @@ void genlbu(void)
 void genlhu(void)
 {
    int gpr1, gpr2, base1, base2 = 0;
+   unsigned int fast;
 #if defined(COUNT_INSTR)
    inc_m32rel(&instr_count[29]);
 #endif
@@ -1540,8 +1577,7 @@ void genlhu(void)
    mov_reg64_imm64(base1, (unsigned long long) g_dev.mem.readmemh);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_reg32_imm32(gpr1, 0xDF800000);
-    cmp_reg32_imm32(gpr1, 0x80000000);
+    gencheck_fast_memory(gpr1, gpr2);
      }
    else
      {
@@ -1562,13 +1598,15 @@ void genlhu(void)
    mov_reg64_preg64x8preg64(gpr2, gpr2, base1);
    call_reg64(gpr2);
    mov_xreg32_m32rel(gpr1, (unsigned int *)g_dev.r4300.recomp.dst->f.i.rt);
-   jmp_imm_short(23);
+   jmp_imm_short(0);
+   fast = jump_mark_rel8();
 
    jump_end_rel8();
-   mov_reg64_imm64(base1, (unsigned long long) g_dev.ri.rdram.dram); // 10
-   and_reg32_imm32(gpr2, 0x7FFFFF); // 6
-   xor_reg8_imm8(gpr2, 2); // 4
-   mov_reg32_preg64preg64(gpr1, gpr2, base1); // 3
+   mov_reg64_imm64(base1, (unsigned long long) g_dev.ri.rdram.dram);
+   and_reg32_imm32(gpr2, 0x7FFFFF);
+   xor_reg8_imm8(gpr2, 2);
+   mov_reg32_preg64preg64(gpr1, gpr2, base1);
+   jump_patch_rel8(fast);
 
    and_reg32_imm32(gpr1, 0xFFFF);
    set_register_state(gpr1, (unsigned int*)g_dev.r4300.recomp.dst->f.i.rt, 1, 0);
@@ -1586,6 +1624,7 @@ void genlwr(void)
 void genlwu(void)
 {
    int gpr1, gpr2, base1, base2 = 0;
+   unsigned int fast;
 #if defined(COUNT_INSTR)
    inc_m32rel(&instr_count[30]);
 #endif
@@ -1599,8 +1638,7 @@ void genlwu(void)
    mov_reg64_imm64(base1, (unsigned long long) g_dev.mem.readmem);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_reg32_imm32(gpr1, 0xDF800000);
-    cmp_reg32_imm32(gpr1, 0x80000000);
+    gencheck_fast_memory(gpr1, gpr2);
      }
    else
      {
@@ -1621,12 +1659,14 @@ void genlwu(void)
    mov_reg64_preg64x8preg64(gpr2, gpr2, base1);
    call_reg64(gpr2);
    mov_xreg32_m32rel(gpr1, (unsigned int *)g_dev.r4300.recomp.dst->f.i.rt);
-   jmp_imm_short(19);
+   jmp_imm_short(0);
+   fast = jump_mark_rel8();
 
    jump_end_rel8();
-   mov_reg64_imm64(base1, (unsigned long long) g_dev.ri.rdram.dram); // 10
-   and_reg32_imm32(gpr2, 0x7FFFFF); // 6
-   mov_reg32_preg64preg64(gpr1, gpr2, base1); // 3
+   mov_reg64_imm64(base1, (unsigned long long) g_dev.ri.rdram.dram);
+   and_reg32_imm32(gpr2, 0x7FFFFF);
+   mov_reg32_preg64preg64(gpr1, gpr2, base1);
+   jump_patch_rel8(fast);
 
    set_register_state(gpr1, (unsigned int*)g_dev.r4300.recomp.dst->f.i.rt, 1, 1);
 #endif
@@ -1649,8 +1689,7 @@ void gensb(void)
    mov_reg64_imm64(RSI, (unsigned long long) g_dev.mem.writememb);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory(EAX, EBX);
      }
    else
      {
@@ -1716,8 +1755,7 @@ void gensh(void)
    mov_reg64_imm64(RSI, (unsigned long long) g_dev.mem.writememh);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory(EAX, EBX);
      }
    else
      {
@@ -1791,8 +1829,7 @@ void gensw(void)
    mov_reg64_imm64(RSI, (unsigned long long) g_dev.mem.writemem);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory(EAX, EBX);
      }
    else
      {
@@ -1893,8 +1930,7 @@ void genlwc1(void)
    mov_reg64_imm64(RSI, (unsigned long long) g_dev.mem.readmem);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory(EAX, EBX);
      }
    else
      {
@@ -1939,8 +1975,7 @@ void genldc1(void)
    mov_reg64_imm64(RSI, (unsigned long long) g_dev.mem.readmemd);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory(EAX, EBX);
      }
    else
      {
@@ -1991,8 +2026,7 @@ void genld(void)
    mov_reg64_imm64(RSI, (unsigned long long) g_dev.mem.readmemd);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory(EAX, EBX);
      }
    else
      {
@@ -2044,8 +2078,7 @@ void genswc1(void)
    mov_reg64_imm64(RSI, (unsigned long long) g_dev.mem.writemem);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory(EAX, EBX);
      }
    else
      {
@@ -2112,8 +2145,7 @@ void gensdc1(void)
    mov_reg64_imm64(RSI, (unsigned long long) g_dev.mem.writememd);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory(EAX, EBX);
      }
    else
      {
@@ -2181,8 +2213,7 @@ void gensd(void)
    mov_reg64_imm64(RSI, (unsigned long long) g_dev.mem.writememd);
    if(g_dev.r4300.recomp.fast_memory)
      {
-    and_eax_imm32(0xDF800000);
-    cmp_eax_imm32(0x80000000);
+    gencheck_fast_memory(EAX, EBX);
      }
    else
      {
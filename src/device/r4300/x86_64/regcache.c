@@ -34,7 +34,7 @@
 void init_cache(struct precomp_instr* start)
 {
   int i;
-  for (i=0; i<8; i++)
+  for (i=0; i<16; i++)
   {
     g_dev.r4300.regcache_state.reg_content[i] = NULL;
     g_dev.r4300.regcache_state.last_access[i] = NULL;
@@ -53,7 +53,7 @@ void free_all_registers(void)
 #endif
 
   int i;
-  for (i=0; i<8; i++)
+  for (i=0; i<16; i++)
   {
 #if defined(PROFILE_R4300)
     if (g_dev.r4300.regcache_state.last_access[i] && g_dev.r4300.regcache_state.dirty[i]) flushed = 1;
@@ -92,7 +92,7 @@ static void simplify_access(void)
 {
    int i;
    g_dev.r4300.recomp.dst->local_addr = g_dev.r4300.recomp.code_length;
-   for(i=0; i<8; i++) g_dev.r4300.recomp.dst->reg_cache_infos.needed_registers[i] = NULL;
+   for(i=0; i<16; i++) g_dev.r4300.recomp.dst->reg_cache_infos.needed_registers[i] = NULL;
 }
 
 void free_registers_move_start(void)
@@ -105,6 +105,142 @@ void free_registers_move_start(void)
 
 }
 
+/* Liveness of the r4300 GPRs, found by scanning the instructions which
+ * follow the one being recompiled. A dirty value need not be written back
+ * if the straight-line code after it overwrites its register before
+ * reading it. The scan gives up (and keeps the value) at anything it does
+ * not decode, at branches and jumps, and at the end of the block, since
+ * the code reached from there may read every register. Exceptions raised
+ * on the way are fine: handlers save and restore the context they
+ * interrupt, which does not read the value either. */
+#define LIVENESS_WINDOW 32
+
+/* Returns 1 if op may leave the straight-line code, otherwise sets the
+ * masks of the GPRs it reads and writes */
+static int gpr_usage(uint32_t op, uint32_t *read, uint32_t *written)
+{
+  uint32_t rs = 1u << ((op >> 21) & 0x1F);
+  uint32_t rt = 1u << ((op >> 16) & 0x1F);
+  uint32_t rd = 1u << ((op >> 11) & 0x1F);
+
+  *read = 0;
+  *written = 0;
+
+  switch (op >> 26)
+  {
+    case 0x00: /* SPECIAL */
+      switch (op & 0x3F)
+      {
+        case 0x00: case 0x02: case 0x03: /* SLL, SRL, SRA */
+        case 0x38: case 0x3A: case 0x3B: /* DSLL, DSRL, DSRA */
+        case 0x3C: case 0x3E: case 0x3F: /* DSLL32, DSRL32, DSRA32 */
+          *read = rt;
+          *written = rd;
+          return 0;
+        case 0x04: case 0x06: case 0x07: /* SLLV, SRLV, SRAV */
+        case 0x14: case 0x16: case 0x17: /* DSLLV, DSRLV, DSRAV */
+        case 0x20: case 0x21: case 0x22: case 0x23: /* ADD, ADDU, SUB, SUBU */
+        case 0x24: case 0x25: case 0x26: case 0x27: /* AND, OR, XOR, NOR */
+        case 0x2A: case 0x2B:                       /* SLT, SLTU */
+        case 0x2C: case 0x2D: case 0x2E: case 0x2F: /* DADD, DADDU, DSUB, DSUBU */
+          *read = rs | rt;
+          *written = rd;
+          return 0;
+        case 0x10: case 0x12: /* MFHI, MFLO */
+          *written = rd;
+          return 0;
+        case 0x11: case 0x13: /* MTHI, MTLO */
+          *read = rs;
+          return 0;
+        case 0x18: case 0x19: case 0x1A: case 0x1B: /* MULT, MULTU, DIV, DIVU */
+        case 0x1C: case 0x1D: case 0x1E: case 0x1F: /* DMULT, DMULTU, DDIV, DDIVU */
+          *read = rs | rt;
+          return 0;
+        case 0x0F: /* SYNC */
+          return 0;
+      }
+      return 1;
+    case 0x08: case 0x09: case 0x0A: case 0x0B: /* ADDI, ADDIU, SLTI, SLTIU */
+    case 0x0C: case 0x0D: case 0x0E:            /* ANDI, ORI, XORI */
+    case 0x18: case 0x19:                       /* DADDI, DADDIU */
+    case 0x20: case 0x21: case 0x23: case 0x24: /* LB, LH, LW, LBU */
+    case 0x25: case 0x27: case 0x30: case 0x34: /* LHU, LWU, LL, LLD */
+    case 0x37:                                  /* LD */
+      *read = rs;
+      *written = rt;
+      return 0;
+    case 0x0F: /* LUI */
+      *written = rt;
+      return 0;
+    case 0x1A: case 0x1B: case 0x22: case 0x26: /* LDL, LDR, LWL, LWR */
+    case 0x38: case 0x3C:                       /* SC, SCD */
+      *read = rs | rt;
+      *written = rt;
+      return 0;
+    case 0x28: case 0x29: case 0x2A: case 0x2B: /* SB, SH, SWL, SW */
+    case 0x2C: case 0x2D: case 0x2E: case 0x3F: /* SDL, SDR, SWR, SD */
+      *read = rs | rt;
+      return 0;
+    case 0x31: case 0x35: case 0x39: case 0x3D: /* LWC1, LDC1, SWC1, SDC1 */
+      *read = rs;
+      return 0;
+    case 0x11: /* COP1 */
+      switch ((op >> 21) & 0x1F)
+      {
+        case 0x00: case 0x01: case 0x02: /* MFC1, DMFC1, CFC1 */
+          *written = rt;
+          return 0;
+        case 0x04: case 0x05: case 0x06: /* MTC1, DMTC1, CTC1 */
+          *read = rt;
+          return 0;
+        case 0x08: /* BC1 */
+          return 1;
+      }
+      return 0;
+  }
+  return 1;
+}
+
+static int is_dead(unsigned long long *content)
+{
+#ifdef COMPARE_CORE
+  /* the register file is compared with the interpreter's after every instruction */
+  return 0;
+#else
+  const uint32_t *op = g_dev.r4300.recomp.SRC;
+  struct precomp_instr *dst = g_dev.r4300.recomp.dst;
+  long long gpr = content - (unsigned long long *) r4300_regs();
+  long long left = ((long long) g_dev.r4300.recomp.dst_block->end - dst->addr) / 4 - 1;
+  uint32_t read, written;
+  int i;
+
+  if (gpr <= 0 || gpr >= 32)
+    return 0;
+
+  /* after a delay slot comes the branch target, not the next instruction */
+  if (g_dev.r4300.recomp.delay_slot_compiled)
+    return 0;
+  if (dst > g_dev.r4300.recomp.dst_block->block && gpr_usage(op[-1], &read, &written))
+    return 0;
+
+  /* the current instruction may still read the value, and what it writes
+   * could be the value itself */
+  if (gpr_usage(op[0], &read, &written) || (read & (1u << gpr)))
+    return 0;
+
+  if (left > LIVENESS_WINDOW)
+    left = LIVENESS_WINDOW;
+  for (i = 1; i <= left; i++)
+  {
+    if (gpr_usage(op[i], &read, &written) || (read & (1u << gpr)))
+      return 0;
+    if (written & (1u << gpr))
+      return 1;
+  }
+  return 0;
+#endif
+}
+
 // this function frees a specific X86 GPR
 void free_register(int reg)
 {
@@ -129,7 +265,7 @@ void free_register(int reg)
     return;
   }
 
-  if (g_dev.r4300.regcache_state.dirty[reg]) 
+  if (g_dev.r4300.regcache_state.dirty[reg] && !is_dead(g_dev.r4300.regcache_state.reg_content[reg]))
   {
     if (g_dev.r4300.regcache_state.is64bits[reg])
     {
@@ -146,13 +282,14 @@ void free_register(int reg)
   g_dev.r4300.regcache_state.free_since[reg] = g_dev.r4300.recomp.dst+1;
 }
 
+/* RSP is the stack pointer and R15 the base of the r4300 registers */
 int lru_register(void)
 {
    unsigned long long oldest_access = 0xFFFFFFFFFFFFFFFFULL;
    int i, reg = 0;
-   for (i=0; i<8; i++)
+   for (i=0; i<16; i++)
      {
-    if (i != ESP && (unsigned long long) g_dev.r4300.regcache_state.last_access[i] < oldest_access)
+    if (i != RSP && i != R15 && (unsigned long long) g_dev.r4300.regcache_state.last_access[i] < oldest_access)
       {
          oldest_access = (unsigned long long) g_dev.r4300.regcache_state.last_access[i];
          reg = i;
@@ -161,13 +298,13 @@ int lru_register(void)
    return reg;
 }
 
-int lru_base_register(void) /* EBP cannot be used as a base register for SIB addressing byte */
+int lru_base_register(void) /* RBP and R13 cannot be used as a base register for SIB addressing byte */
 {
    unsigned long long oldest_access = 0xFFFFFFFFFFFFFFFFULL;
    int i, reg = 0;
-   for (i=0; i<8; i++)
+   for (i=0; i<16; i++)
      {
-    if (i != ESP && i != EBP && (unsigned long long) g_dev.r4300.regcache_state.last_access[i] < oldest_access)
+    if (i != RSP && i != RBP && i != R13 && i != R15 && (unsigned long long) g_dev.r4300.regcache_state.last_access[i] < oldest_access)
       {
          oldest_access = (unsigned long long) g_dev.r4300.regcache_state.last_access[i];
          reg = i;
@@ -211,7 +348,7 @@ int allocate_register_32(unsigned int *addr)
   // is it already cached ?
   if (addr != NULL)
   {
-    for (i = 0; i < 8; i++)
+    for (i = 0; i < 16; i++)
     {
       if (g_dev.r4300.regcache_state.last_access[i] != NULL && (unsigned int *) g_dev.r4300.regcache_state.reg_content[i] == addr)
       {
@@ -268,7 +405,7 @@ int allocate_register_64(unsigned long long *addr)
   // is it already cached?
   if (addr != NULL)
   {
-    for (i = 0; i < 8; i++)
+    for (i = 0; i < 16; i++)
     {
       if (g_dev.r4300.regcache_state.last_access[i] != NULL && g_dev.r4300.regcache_state.reg_content[i] == addr)
       {
@@ -327,7 +464,7 @@ int allocate_register_64(unsigned long long *addr)
 int is64(unsigned int *addr)
 {
   int i;
-  for (i = 0; i < 8; i++)
+  for (i = 0; i < 16; i++)
   {
     if (g_dev.r4300.regcache_state.last_access[i] != NULL && g_dev.r4300.regcache_state.reg_content[i] == (unsigned long long *) addr)
     {
@@ -342,7 +479,7 @@ int allocate_register_32_w(unsigned int *addr)
   int reg = 0, i;
    
   // is it already cached ?
-  for (i = 0; i < 8; i++)
+  for (i = 0; i < 16; i++)
   {
     if (g_dev.r4300.regcache_state.last_access[i] != NULL && g_dev.r4300.regcache_state.reg_content[i] == (unsigned long long *) addr)
     {
@@ -387,7 +524,7 @@ int allocate_register_64_w(unsigned long long *addr)
   int reg, i;
 
   // is it already cached?
-  for (i = 0; i < 8; i++)
+  for (i = 0; i < 16; i++)
   {
     if (g_dev.r4300.regcache_state.last_access[i] != NULL && g_dev.r4300.regcache_state.reg_content[i] == addr)
     {
@@ -458,7 +595,7 @@ void allocate_register_32_manually(int reg, unsigned int *addr)
   }
 
   /* if the r4300 register is already cached in a different x86 register, then copy it to the requested x86 register */
-  for (i=0; i<8; i++)
+  for (i=0; i<16; i++)
   {
     if (g_dev.r4300.regcache_state.last_access[i] != NULL && g_dev.r4300.regcache_state.reg_content[i] == (unsigned long long *) addr)
     {
@@ -528,7 +665,7 @@ void allocate_register_32_manually_w(int reg, unsigned int *addr)
   }
 
   /* if the r4300 register is already cached in a different x86 register, then free it and bind to the requested x86 register */
-  for (i = 0; i < 8; i++)
+  for (i = 0; i < 16; i++)
   {
     if (g_dev.r4300.regcache_state.last_access[i] != NULL && g_dev.r4300.regcache_state.reg_content[i] == (unsigned long long *) addr)
     {
@@ -562,15 +699,13 @@ void allocate_register_32_manually_w(int reg, unsigned int *addr)
 // 0x48 0x05                   0xXXXXXXXX add rax, dword (local_addr)
 // 0x48 0x89 0x04 0x24                    mov [rsp], rax
 // 0x48 0xB8           0xXXXXXXXXXXXXXXXX mov rax, &reg[0]
+// 0x4C 0x8B (reg<<3)|0x80     0xXXXXXXXX mov r14, [rax + XXXXXXXX]
+// ...                                    (r13 down to r8, rsp and r15 are never cached)
 // 0x48 0x8B (reg<<3)|0x80     0xXXXXXXXX mov rdi, [rax + XXXXXXXX]
-// 0x48 0x8B (reg<<3)|0x80     0xXXXXXXXX mov rsi, [rax + XXXXXXXX]
-// 0x48 0x8B (reg<<3)|0x80     0xXXXXXXXX mov rbp, [rax + XXXXXXXX]
-// 0x48 0x8B (reg<<3)|0x80     0xXXXXXXXX mov rdx, [rax + XXXXXXXX]
-// 0x48 0x8B (reg<<3)|0x80     0xXXXXXXXX mov rcx, [rax + XXXXXXXX]
-// 0x48 0x8B (reg<<3)|0x80     0xXXXXXXXX mov rbx, [rax + XXXXXXXX]
+// ...                                    (rsi down to rcx)
 // 0x48 0x8B (reg<<3)|0x80     0xXXXXXXXX mov rax, [rax + XXXXXXXX]
 // 0xC3 ret
-// total : 84 bytes
+// total : 133 bytes
 
 static void build_wrapper(struct precomp_instr *instr, unsigned char* pCode, struct precomp_block* block)
 {
@@ -609,14 +744,14 @@ static void build_wrapper(struct precomp_instr *instr, unsigned char* pCode, str
    *((unsigned long long *) pCode) = (unsigned long long) &r4300_regs()[0];
    pCode += 8;
 
-   for (i=7; i>=0; i--)
+   for (i=15; i>=0; i--)
    {
      long long riprel;
      if (instr->reg_cache_infos.needed_registers[i] != NULL)
      {
-       *pCode++ = 0x48;
+       *pCode++ = 0x48 | ((i & 8) >> 1);
        *pCode++ = 0x8B;
-       *pCode++ = 0x80 | (i << 3);
+       *pCode++ = 0x80 | ((i & 7) << 3);
        riprel = (long long) ((unsigned char *) instr->reg_cache_infos.needed_registers[i] - (unsigned char *) &r4300_regs()[0]);
        *((int *) pCode) = (int) riprel;
        pCode += 4;
@@ -637,7 +772,7 @@ void build_wrappers(struct precomp_instr *instr, int start, int end, struct prec
    for (i=start; i<end; i++)
      {
     instr[i].reg_cache_infos.need_map = 0;
-    for (reg=0; reg<8; reg++)
+    for (reg=0; reg<16; reg++)
       {
          if (instr[i].reg_cache_infos.needed_registers[reg] != NULL)
            {
@@ -37,46 +37,43 @@ void poweron_fb(struct fb* fb)
 }
 
 
-static void pre_framebuffer_read(struct fb* fb, uint32_t address)
+/* only the framebuffers overlapping the page are checked, each against its
+ * own range, so a gap between two framebuffers sharing a page is not covered */
+static int fb_page_covers(const struct fb* fb, const struct fb_page* page, uint32_t address)
 {
     size_t i;
 
-    for(i = 0; i < FB_INFOS_COUNT; ++i)
+    address &= 0x7FFFFF;
+
+    for (i = 0; i < FB_INFOS_COUNT; ++i)
     {
-        if (fb->infos[i].addr)
-        {
-            unsigned int start = fb->infos[i].addr & 0x7FFFFF;
-            unsigned int end = start + fb->infos[i].width*
-                               fb->infos[i].height*
-                               fb->infos[i].size - 1;
-            if ((address & 0x7FFFFF) >= start && (address & 0x7FFFFF) <= end &&
-                    fb->dirty_page[(address & 0x7FFFFF)>>12])
-            {
-                gfx.fBRead(address);
-                fb->dirty_page[(address & 0x7FFFFF)>>12] = 0;
-            }
-        }
+        if ((page->infos & (1 << i))
+         && address >= fb->ranges[i].begin && address <= fb->ranges[i].end)
+            return 1;
     }
+
+    return 0;
 }
 
-static void pre_framebuffer_write(struct fb* fb, uint32_t address)
+static void pre_framebuffer_read(struct fb* fb, uint32_t address)
 {
-    size_t i;
+    struct fb_page* page = &fb->pages[(address & 0x7FFFFF) >> 12];
 
-    for(i = 0; i < FB_INFOS_COUNT; ++i)
+    if (page->dirty && fb_page_covers(fb, page, address))
     {
-        if (fb->infos[i].addr)
-        {
-            unsigned int start = fb->infos[i].addr & 0x7FFFFF;
-            unsigned int end = start + fb->infos[i].width*
-                               fb->infos[i].height*
-                               fb->infos[i].size - 1;
-            if ((address & 0x7FFFFF) >= start && (address & 0x7FFFFF) <= end)
-                gfx.fBWrite(address, 4);
-        }
+        gfx.fBRead(address);
+        page->dirty = 0;
     }
 }
 
+static void pre_framebuffer_write(struct fb* fb, uint32_t address)
+{
+    const struct fb_page* page = &fb->pages[(address & 0x7FFFFF) >> 12];
+
+    if (page->infos != 0 && fb_page_covers(fb, page, address))
+        gfx.fBWrite(address, 4);
+}
+
 int read_rdram_fb(void* opaque, uint32_t address, uint32_t* value)
 {
     struct rdp_core* dp = (struct rdp_core*)opaque;
@@ -96,6 +93,16 @@ int write_rdram_fb(void* opaque, uint32_t address, uint32_t value, uint32_t mask
 #define W(x) write_ ## x ## b, write_ ## x ## h, write_ ## x, write_ ## x ## d
 #define RW(x) R(x), W(x)
 
+/* last RDRAM byte of a framebuffer (clamped to RDRAM) */
+static uint32_t fb_info_end(const FrameBufferInfo* info)
+{
+    uint32_t start = info->addr & 0x7FFFFF;
+    uint32_t length = info->width*info->height*info->size;
+    uint32_t end = (length == 0) ? start : start + length - 1;
+
+    return (end > 0x7FFFFF) ? 0x7FFFFF : end;
+}
+
 void protect_framebuffers(struct rdp_core* dp)
 {
     struct fb* fb = &dp->fb;
@@ -106,41 +113,48 @@ void protect_framebuffers(struct rdp_core* dp)
             && fb->infos[0].addr)
     {
         size_t i;
+        uint32_t window_begin = 0x800000;
+        uint32_t window_end = 0;
+
         for(i = 0; i < FB_INFOS_COUNT; ++i)
         {
             if (fb->infos[i].addr)
             {
-                int j;
-                int start = fb->infos[i].addr & 0x7FFFFF;
-                int end = start + fb->infos[i].width*
-                          fb->infos[i].height*
-                          fb->infos[i].size - 1;
-                int start1 = start;
-                int end1 = end;
-                start >>= 16;
-                end >>= 16;
-                for (j=start; j<=end; j++)
+                uint32_t j;
+                uint32_t start = fb->infos[i].addr & 0x7FFFFF;
+                uint32_t end = fb_info_end(&fb->infos[i]);
+
+                for (j = (start >> 16); j <= (end >> 16); j++)
                 {
                     map_region(&g_dev.mem, 0x8000+j, M64P_MEM_RDRAM, RW(rdramFB));
                     map_region(&g_dev.mem, 0xa000+j, M64P_MEM_RDRAM, RW(rdramFB));
                 }
-                start <<= 4;
-                end <<= 4;
-                for (j=start; j<=end; j++)
-                {
-                    if (j>=start1 && j<=end1) fb->dirty_page[j]=1;
-                    else fb->dirty_page[j] = 0;
-                }
 
-                /* disable "fast memory" if framebuffer handlers are used */
-                if (fb->once != 0)
-                {
-                    fb->once = 0;
-                    dp->r4300->recomp.fast_memory = 0;
-                    invalidate_r4300_cached_code(dp->r4300, 0, 0);
-                }
+                /* precompute which framebuffers overlap each page, so that
+                 * accesses only check those */
+                fb->ranges[i].begin = start;
+                fb->ranges[i].end = end;
+                for (j = (start >> 12); j <= (end >> 12); j++)
+                    fb->pages[j].infos |= (1 << i);
+
+                if (start < window_begin)
+                    window_begin = start;
+                if (end > window_end)
+                    window_end = end;
             }
         }
+
+        fb->window_begin = window_begin;
+        fb->window_size = window_end - window_begin + 1;
+
+        /* make the dynarec check the framebuffer window in its "fast memory" path
+         * (instead of disabling it) and recompile code compiled without that check */
+        if (fb->once != 0)
+        {
+            fb->once = 0;
+            dp->r4300->recomp.fast_memory_fb_check = 1;
+            invalidate_r4300_cached_code(dp->r4300, 0, 0);
+        }
     }
 }
 
@@ -156,20 +170,46 @@ void unprotect_framebuffers(struct rdp_core* dp)
         {
             if (fb->infos[i].addr)
             {
-                int j;
-                int start = fb->infos[i].addr & 0x7FFFFF;
-                int end = start + fb->infos[i].width*
-                          fb->infos[i].height*
-                          fb->infos[i].size - 1;
-                start = start >> 16;
-                end = end >> 16;
-
-                for (j=start; j<=end; j++)
+                uint32_t j;
+                uint32_t start = fb->infos[i].addr & 0x7FFFFF;
+                uint32_t end = fb_info_end(&fb->infos[i]);
+
+                for (j = (start >> 16); j <= (end >> 16); j++)
                 {
                     map_region(&g_dev.mem, 0x8000+j, M64P_MEM_RDRAM, RW(rdram));
                     map_region(&g_dev.mem, 0xa000+j, M64P_MEM_RDRAM, RW(rdram));
                 }
+
+                for (j = (start >> 12); j <= (end >> 12); j++)
+                {
+                    memset(&fb->pages[j], 0, sizeof(fb->pages[j]));
+                }
             }
         }
+
+        /* empty window: every RDRAM access may use the fast path */
+        fb->window_begin = 0;
+        fb->window_size = 0;
+    }
+}
+
+/* Called after the RDP ran: the pages of the protected framebuffers must be
+ * read back from the plugin on their first CPU read. Only the pages within
+ * the ranges of the last queried framebuffers are visited. */
+void mark_framebuffers_dirty(struct fb* fb)
+{
+    size_t i;
+    uint32_t j;
+
+    for (i = 0; i < FB_INFOS_COUNT; ++i)
+    {
+        if (fb->infos[i].addr == 0)
+            continue;
+
+        for (j = (fb->ranges[i].begin >> 12); j <= (fb->ranges[i].end >> 12); ++j)
+        {
+            if (fb->pages[j].infos & (1 << i))
+                fb->pages[j].dirty = 1;
+        }
     }
 }
@@ -29,13 +29,33 @@
 struct rdp_core;
 
 enum { FB_INFOS_COUNT = 6 };
-enum { FB_DIRTY_PAGES_COUNT = 0x800 };
+enum { FB_PAGES_COUNT = 0x800 };
+
+/* Framebuffer state of a 4KB RDRAM page */
+struct fb_page
+{
+    uint8_t infos;      /* bitmask of the infos[] entries overlapping the page (0: none) */
+    uint8_t dirty;      /* written by the RDP, must be read back from the plugin before CPU access */
+};
+
+/* RDRAM bytes [begin, end] of one infos[] entry */
+struct fb_range
+{
+    uint32_t begin;
+    uint32_t end;
+};
 
 struct fb
 {
-    unsigned char dirty_page[FB_DIRTY_PAGES_COUNT];
+    struct fb_page pages[FB_PAGES_COUNT];
     FrameBufferInfo infos[FB_INFOS_COUNT];
+    struct fb_range ranges[FB_INFOS_COUNT];
     unsigned int once;
+
+    /* RDRAM range [window_begin, window_begin+window_size) enclosing all
+     * protected framebuffers. Read by the dynarec fast memory path. */
+    uint32_t window_begin;
+    uint32_t window_size;
 };
 
 void poweron_fb(struct fb* fb);
@@ -45,5 +65,6 @@ int write_rdram_fb(void* opaque, uint32_t address, uint32_t value, uint32_t mask
 
 void protect_framebuffers(struct rdp_core* dp);
 void unprotect_framebuffers(struct rdp_core* dp);
+void mark_framebuffers_dirty(struct fb* fb);
 
 #endif
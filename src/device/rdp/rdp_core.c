@@ -111,6 +111,7 @@ int write_dpc_regs(void* opaque, uint32_t address, uint32_t value, uint32_t mask
         break;
     case DPC_END_REG:
         gfx.processRDPList();
+        mark_framebuffers_dirty(&dp->fb);
         signal_rcp_interrupt(dp->r4300, MI_INTR_DP);
         break;
     }
@@ -23,6 +23,7 @@
 
 #include <string.h>
 
+#include "device/memory/dma_copy.h"
 #include "device/memory/memory.h"
 #include "device/r4300/r4300_core.h"
 #include "device/rdp/rdp_core.h"
@@ -33,7 +34,7 @@
 
 static void dma_sp_write(struct rsp_core* sp)
 {
-    unsigned int i,j;
+    unsigned int j;
 
     unsigned int l = sp->regs[SP_RD_LEN_REG];
 
@@ -48,18 +49,15 @@ static void dma_sp_write(struct rsp_core* sp)
     unsigned char *dram = (unsigned char*)sp->ri->rdram.dram;
 
     for(j=0; j<count; j++) {
-        for(i=0; i<length; i++) {
-            spmem[memaddr^S8] = dram[dramaddr^S8];
-            memaddr++;
-            dramaddr++;
-        }
-        dramaddr+=skip;
+        dma_copy(spmem, memaddr, dram, dramaddr, length);
+        memaddr+=length;
+        dramaddr+=length+skip;
     }
 }
 
 static void dma_sp_read(struct rsp_core* sp)
 {
-    unsigned int i,j;
+    unsigned int j;
 
     unsigned int l = sp->regs[SP_WR_LEN_REG];
 
@@ -74,12 +72,9 @@ static void dma_sp_read(struct rsp_core* sp)
     unsigned char *dram = (unsigned char*)sp->ri->rdram.dram;
 
     for(j=0; j<count; j++) {
-        for(i=0; i<length; i++) {
-            dram[dramaddr^S8] = spmem[memaddr^S8];
-            memaddr++;
-            dramaddr++;
-        }
-        dramaddr+=skip;
+        dma_copy(dram, dramaddr, spmem, memaddr, length);
+        memaddr+=length;
+        dramaddr+=length+skip;
     }
 }
 
@@ -294,6 +289,7 @@ void do_SP_Task(struct rsp_core* sp)
         sp->regs[SP_STATUS_REG] &= ~SP_STATUS_TASKDONE;
 
         protect_framebuffers(sp->dp);
+        mark_framebuffers_dirty(&sp->dp->fb);
     }
     else if (sp->mem[0xfc0/4] == 2)
     {
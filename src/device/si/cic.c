@@ -32,11 +32,40 @@
 #include <inttypes.h>
 
 
-void init_cic_using_ipl3(struct cic* cic, const void* ipl3)
+static uint64_t ipl3_crc(const void* ipl3)
 {
     size_t i;
     uint64_t crc = 0;
 
+    for (i = 0; i < 0xfc0/4; i++)
+        crc += ((uint32_t*)ipl3)[i];
+
+    return crc;
+}
+
+int cic_version_from_ipl3(const void* ipl3, enum cic_version* version)
+{
+    switch(ipl3_crc(ipl3))
+    {
+        default:
+            *version = CIC_X102;
+            return 0;
+        case UINT64_C(0x000000D057C85244): *version = CIC_X102; break;
+        case UINT64_C(0x000000D0027FDF31):
+        case UINT64_C(0x000000CFFB631223): *version = CIC_X101; break;
+        case UINT64_C(0x000000D6497E414B): *version = CIC_X103; break;
+        case UINT64_C(0x0000011A49F60E96): *version = CIC_X105; break;
+        case UINT64_C(0x000000D6D5BE5580): *version = CIC_X106; break;
+    }
+
+    return 1;
+}
+
+void init_cic_using_ipl3(struct cic* cic, const void* ipl3)
+{
+    enum cic_version version;
+
+    /* indexed by enum cic_version */
     static const struct cic cics[] =
     {
         { CIC_X101, 0x3f },
@@ -46,22 +75,8 @@ void init_cic_using_ipl3(struct cic* cic, const void* ipl3)
         { CIC_X106, 0x85 }
     };
 
-    for (i = 0; i < 0xfc0/4; i++)
-        crc += ((uint32_t*)ipl3)[i];
+    if (!cic_version_from_ipl3(ipl3, &version))
+        DebugMessage(M64MSG_WARNING, "Unknown CIC type (%016" PRIX64 ")! using CIC 6102.", ipl3_crc(ipl3));
 
-    switch(crc)
-    {
-        default:
-            DebugMessage(M64MSG_WARNING, "Unknown CIC type (%016" PRIX64 ")! using CIC 6102.", crc);
-            /* fall through */
-        case UINT64_C(0x000000D057C85244): i = 1; break; /* CIC_X102 */
-        case UINT64_C(0x000000D0027FDF31):               /* CIC_X101 */
-        case UINT64_C(0x000000CFFB631223): i = 0; break; /* CIC_X101 */
-        case UINT64_C(0x000000D6497E414B): i = 2; break; /* CIC_X103 */
-        case UINT64_C(0x0000011A49F60E96): i = 3; break; /* CIC_X105 */
-        case UINT64_C(0x000000D6D5BE5580): i = 4; break; /* CIC_X106 */
-    }
-
-    memcpy(cic, &cics[i], sizeof(*cic));
+    memcpy(cic, &cics[version], sizeof(*cic));
 }
-
@@ -37,6 +37,10 @@ struct cic
     unsigned int seed;
 };
 
+/* Returns 0 for an unknown IPL3, with *version set to the CIC 6102
+ * fallback. Unlike init_cic_using_ipl3 it does not log anything. */
+int cic_version_from_ipl3(const void* ipl3, enum cic_version* version);
+
 void init_cic_using_ipl3(struct cic* cic, const void* ipl3);
 
 #endif
@@ -35,6 +35,7 @@
 #include "device/r4300/r4300_core.h"
 #include "device/si/n64_cic_nus_6105.h"
 #include "device/si/si_controller.h"
+#include "plugin/emulate_game_controller_via_input_plugin.h"
 #include "plugin/plugin.h"
 
 #define __STDC_FORMAT_MACROS
@@ -67,6 +68,13 @@ static void process_cart_command(struct pif* pif, uint8_t* cmd)
     }
 }
 
+/* channels served from the input snapshot never go to the input plugin */
+static int uses_raw_input_plugin(int channel)
+{
+    return Controls[channel].Present && Controls[channel].RawData
+        && !egcvip_has_input_snapshot(channel);
+}
+
 
 void init_pif(struct pif* pif,
     struct controller_input_backend* cins,
@@ -217,7 +225,7 @@ void update_pif_write(struct si_controller* si)
             {
                 if (channel < 4)
                 {
-                    if (Controls[channel].Present && Controls[channel].RawData)
+                    if (uses_raw_input_plugin(channel))
                         input.controllerCommand(channel, &pif->ram[i]);
                     else
                         process_controller_command(&pif->controllers[channel], &pif->ram[i]);
@@ -274,7 +282,7 @@ void update_pif_read(struct si_controller* si)
             {
                 if (channel < 4)
                 {
-                    if (Controls[channel].Present && Controls[channel].RawData)
+                    if (uses_raw_input_plugin(channel))
                         input.readController(channel, &pif->ram[i]);
                     else
                         read_controller(&pif->controllers[channel], &pif->ram[i]);
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include <lua.h>
 #include <lauxlib.h>
 #include <lualib.h>
@@ -6,9 +7,209 @@
 #include "api\m64p_plugin.h"
 #include "fuzzer\fuzzer_lualib.h"
 #include "fuzzer\fuzzer_inputs.h"
+#include "fuzzer\fuzzer_engine.h"
+#include "plugin\emulate_game_controller_via_input_plugin.h"
 
 lua_State *L = NULL;
 
+// Callbacks of the Fuzzer table run on every VI and controller read. They are
+// resolved once into registry references instead of being looked up by name
+// on each call. The Fuzzer table gets a metatable which keeps these fields in
+// a hidden table, so that assigning one of them from the script goes through
+// __newindex and only then are the references resolved again. A metatable the
+// script already set is copied and its __index/__newindex are chained to.
+enum fuzzer_hook {
+	HOOK_UPDATE,
+	HOOK_GET_INPUTS,
+	HOOK_INPUTS,
+	HOOK_OBJECTIVE,
+	HOOK_COUNT
+};
+
+static const char * hookNames[HOOK_COUNT] = { "update", "get_inputs", "Inputs", "objective" };
+static int hookRefs[HOOK_COUNT] = { LUA_NOREF, LUA_NOREF, LUA_NOREF, LUA_NOREF };
+static int hookFailures[HOOK_COUNT] = { 0 };
+static int hooksRef = LUA_NOREF;
+static int hooksDirty = 1;
+
+static int hook_index(const char * name) {
+	int i;
+	for (i = 0; i < HOOK_COUNT; i++) {
+		if (strcmp(name, hookNames[i]) == 0)
+			return i;
+	}
+	return -1;
+}
+
+static int is_hook_key(lua_State *L, int idx) {
+	return lua_type(L, idx) == LUA_TSTRING && hook_index(lua_tostring(L, idx)) >= 0;
+}
+
+// __index of the Fuzzer table, upvalues are the hidden table and the __index
+// of the script's own metatable, if any
+static int fuzzer_index(lua_State *L) {
+	if (is_hook_key(L, 2)) {
+		lua_pushvalue(L, 2);
+		lua_rawget(L, lua_upvalueindex(1));
+		return 1;
+	}
+
+	lua_pushvalue(L, lua_upvalueindex(2));
+	if (lua_isfunction(L, -1)) {
+		lua_pushvalue(L, 1);
+		lua_pushvalue(L, 2);
+		lua_call(L, 2, 1);
+	}
+	else if (lua_istable(L, -1)) {
+		lua_pushvalue(L, 2);
+		lua_gettable(L, -2);
+	}
+	else {
+		lua_pushnil(L);
+	}
+	return 1;
+}
+
+// __newindex of the Fuzzer table: only reached for absent keys, which the
+// hooks always are since they live in the hidden table. Upvalues are the
+// hidden table and the __newindex of the script's own metatable, if any.
+static int fuzzer_newindex(lua_State *L) {
+	if (is_hook_key(L, 2)) {
+		lua_pushvalue(L, 2);
+		lua_pushvalue(L, 3);
+		lua_rawset(L, lua_upvalueindex(1));
+		hooksDirty = 1;
+		return 0;
+	}
+
+	lua_pushvalue(L, lua_upvalueindex(2));
+	if (lua_isfunction(L, -1)) {
+		lua_pushvalue(L, 1);
+		lua_pushvalue(L, 2);
+		lua_pushvalue(L, 3);
+		lua_call(L, 3, 0);
+	}
+	else if (lua_istable(L, -1)) {
+		lua_pushvalue(L, 2);
+		lua_pushvalue(L, 3);
+		lua_settable(L, -3);
+	}
+	else {
+		lua_pop(L, 1);
+		lua_rawset(L, 1);
+	}
+	return 0;
+}
+
+static void install_hooks(void) {
+	int i;
+
+	lua_getglobal(L, "Fuzzer");
+	if (!lua_istable(L, -1)) {
+		lua_pop(L, 1);
+		return;
+	}
+
+	// Move the hooks out of the Fuzzer table, using raw accesses so that an
+	// existing metatable isn't involved
+	lua_newtable(L);
+	for (i = 0; i < HOOK_COUNT; i++) {
+		lua_pushstring(L, hookNames[i]);
+		lua_rawget(L, -3);
+		lua_setfield(L, -2, hookNames[i]);
+		lua_pushstring(L, hookNames[i]);
+		lua_pushnil(L);
+		lua_rawset(L, -4);
+	}
+
+	// Copy the script's metatable, it may be shared so it isn't modified
+	lua_newtable(L);
+	if (lua_getmetatable(L, -3)) {
+		lua_pushnil(L);
+		while (lua_next(L, -2)) {
+			lua_pushvalue(L, -2);
+			lua_insert(L, -2);
+			lua_rawset(L, -5);
+		}
+		lua_getfield(L, -1, "__index");
+		lua_getfield(L, -2, "__newindex");
+		lua_remove(L, -3);
+	}
+	else {
+		lua_pushnil(L);
+		lua_pushnil(L);
+	}
+
+	// stack: Fuzzer, hooks, metatable, __index, __newindex
+	lua_pushvalue(L, -4);
+	lua_insert(L, -2);
+	lua_pushcclosure(L, fuzzer_newindex, 2);
+	lua_setfield(L, -3, "__newindex");
+	lua_pushvalue(L, -3);
+	lua_insert(L, -2);
+	lua_pushcclosure(L, fuzzer_index, 2);
+	lua_setfield(L, -2, "__index");
+	lua_setmetatable(L, -3);
+
+	hooksRef = luaL_ref(L, LUA_REGISTRYINDEX);
+	lua_pop(L, 1);
+	hooksDirty = 1;
+}
+
+static void resolve_hooks(void) {
+	int i;
+
+	for (i = 0; i < HOOK_COUNT; i++) {
+		luaL_unref(L, LUA_REGISTRYINDEX, hookRefs[i]);
+		hookRefs[i] = LUA_NOREF;
+		hookFailures[i] = 0;
+	}
+	hooksDirty = 0;
+
+	if (hooksRef == LUA_NOREF)
+		return;
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, hooksRef);
+	for (i = 0; i < HOOK_COUNT; i++) {
+		lua_getfield(L, -1, hookNames[i]);
+		// luaL_ref pops the value and gives LUA_REFNIL for nil
+		hookRefs[i] = luaL_ref(L, LUA_REGISTRYINDEX);
+	}
+	lua_pop(L, 1);
+}
+
+static void release_hooks(void) {
+	int i;
+
+	for (i = 0; i < HOOK_COUNT; i++) {
+		if (hookFailures[i] > 1)
+			printf("Fuzzer:%s() failed %d times\n", hookNames[i], hookFailures[i]);
+		luaL_unref(L, LUA_REGISTRYINDEX, hookRefs[i]);
+		hookRefs[i] = LUA_NOREF;
+		hookFailures[i] = 0;
+	}
+	luaL_unref(L, LUA_REGISTRYINDEX, hooksRef);
+	hooksRef = LUA_NOREF;
+	hooksDirty = 1;
+}
+
+// Push a hook, returns 0 if the script doesn't define it
+static int push_hook(enum fuzzer_hook hook) {
+	if (hooksDirty)
+		resolve_hooks();
+	if (hookRefs[hook] == LUA_NOREF || hookRefs[hook] == LUA_REFNIL)
+		return 0;
+	lua_rawgeti(L, LUA_REGISTRYINDEX, hookRefs[hook]);
+	return 1;
+}
+
+// Report the first failure of a hook only, the count is printed at stop
+static void hook_failed(enum fuzzer_hook hook) {
+	if (hookFailures[hook]++ == 0)
+		printf("error running function `Fuzzer:%s()': %s\n", hookNames[hook], lua_tostring(L, -1));
+	lua_pop(L, 1);
+}
+
 m64p_error fuzzer_main_run(const char * luaFileName) {
 
 	// Don't start the fuzzer if there is nothing to do
@@ -50,6 +251,8 @@ m64p_error fuzzer_main_run(const char * luaFileName) {
 	}
 	lua_pop(L, 1);
 
+	install_hooks();
+
 	return lua_status(L) == 0 ? M64ERR_SUCCESS : M64ERR_PLUGIN_FAIL;
 }
 
@@ -72,6 +275,10 @@ void fuzzer_main_stop(void) {
 		}
 	}
 	lua_pop(L, 1);
+	fuzzer_engine_stop();
+	release_hooks();
+	// Frame inputs set by the script are not valid anymore
+	egcvip_set_input_snapshot(0, NULL);
 	luaclose_fuzzerlib(L);
 	lua_close(L);
 	L = NULL;
@@ -82,23 +289,30 @@ void fuzzer_vi() {
 		return;
 
 	// Call lua VI event
-	lua_getglobal(L, "Fuzzer");
-	int type = lua_type(L, -1);
-	if (!lua_isnil(L, -1)) {
-		lua_getfield(L, -1, "update");
-		if (!lua_isnil(L, -1)) {
-			lua_pushnumber(L, 5);
-			type = lua_type(L, -1);
-			//lua_pushnil(L);
-			if (lua_pcall(L, 1, 0, 0) != 0) {
-				printf("error running function `Fuzzer:update()': %s\n", lua_tostring(L, -1));
-			}
-		}
-		else {
-			lua_pop(L, 1);
-		}
+	if (push_hook(HOOK_UPDATE)) {
+		lua_pushnumber(L, 5);
+		if (lua_pcall(L, 1, 0, 0) != 0)
+			hook_failed(HOOK_UPDATE);
+	}
+
+	fuzzer_engine_vi();
+}
+
+int fuzzer_objective(double * value) {
+	if (L == NULL || !push_hook(HOOK_OBJECTIVE))
+		return 0;
+	lua_pushnil(L);
+	if (lua_pcall(L, 1, 1, 0) != 0) {
+		hook_failed(HOOK_OBJECTIVE);
+		return 0;
 	}
+	if (!lua_isnumber(L, -1)) {
+		lua_pop(L, 1);
+		return 0;
+	}
+	*value = lua_tonumber(L, -1);
 	lua_pop(L, 1);
+	return 1;
 }
 
 void fuzzer_GetKeys(BUTTONS * Keys) {
@@ -109,20 +323,14 @@ void fuzzer_GetKeys(BUTTONS * Keys) {
 	}
 
 	// Call lua get keys
-	lua_getglobal(L, "Fuzzer");
-	if (!lua_isnil(L, -1)) {
-		lua_getfield(L, -1, "get_inputs");
-		if (!lua_isnil(L, -1)) {
+	if (push_hook(HOOK_GET_INPUTS)) {
+		lua_pushnil(L);
+		if (hookRefs[HOOK_INPUTS] == LUA_NOREF || hookRefs[HOOK_INPUTS] == LUA_REFNIL)
 			lua_pushnil(L);
-			lua_getfield(L, -3, "Inputs");
-			if (lua_pcall(L, 2, 0, 0) != 0) {
-				printf("error running function `Fuzzer:update()': %s\n", lua_tostring(L, -1));
-			}
-		}
-		else {
-			lua_pop(L, 1);
-		}
+		else
+			lua_rawgeti(L, LUA_REGISTRYINDEX, hookRefs[HOOK_INPUTS]);
+		if (lua_pcall(L, 2, 0, 0) != 0)
+			hook_failed(HOOK_GET_INPUTS);
 	}
-	lua_pop(L, 1);
 	Keys->Value = fuzzerInputs.Value;
-}
\ No newline at end of file
+}
@@ -10,4 +10,8 @@ void fuzzer_main_stop(void);
 void fuzzer_GetKeys(BUTTONS * Keys);
 void fuzzer_vi();
 
+// Score of the current state according to Fuzzer.objective, higher is
+// better. Returns 0 if the script doesn't define one.
+int fuzzer_objective(double * value);
+
 #endif
\ No newline at end of file
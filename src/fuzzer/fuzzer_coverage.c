@@ -0,0 +1,63 @@
+#include <stddef.h>
+#include <stdint.h>
+#include "fuzzer\fuzzer_coverage.h"
+
+uint8_t * fuzzerCoverage = NULL;
+uint32_t fuzzerCoveragePrev = 0;
+
+// Hit count -> bucket bit, so that loops only matter by order of magnitude
+static const uint8_t countClass[256] = {
+	0, 1, 2, 4, 8, 8, 8, 8,
+	16, 16, 16, 16, 16, 16, 16, 16,
+	32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128,
+	128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128,
+	128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128,
+	128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128,
+	128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128,
+	128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128,
+	128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128,
+	128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128
+};
+
+void fuzzer_coverage_set_map(uint8_t * map) {
+	fuzzerCoverage = map;
+	fuzzerCoveragePrev = 0;
+}
+
+int fuzzer_coverage_merge(uint8_t * map, uint8_t * virgin) {
+	int ret = 0;
+	size_t i;
+
+	for (i = 0; i < FUZZER_COVERAGE_SIZE; i++) {
+		uint8_t bucket;
+		if (map[i] == 0)
+			continue;
+		bucket = map[i] = countClass[map[i]];
+		if (bucket & virgin[i]) {
+			if (virgin[i] == 0xff)
+				ret = 2;
+			else if (ret == 0)
+				ret = 1;
+			virgin[i] &= ~bucket;
+		}
+	}
+	return ret;
+}
+
+unsigned int fuzzer_coverage_count(const uint8_t * virgin) {
+	unsigned int count = 0;
+	size_t i;
+
+	for (i = 0; i < FUZZER_COVERAGE_SIZE; i++) {
+		if (virgin[i] != 0xff)
+			count++;
+	}
+	return count;
+}
@@ -0,0 +1,47 @@
+#ifndef FUZZER_COVERAGE_H_INCLUDED
+#define FUZZER_COVERAGE_H_INCLUDED
+
+#include <stdint.h>
+#include "osal\preproc.h"
+
+// Edge coverage of the guest code, AFL style: every branch executed by the
+// interpreters bumps the counter of the hashed (branch pc, next pc) pair.
+// The old dynarec only reports the jumps it takes out of a page or through
+// a register, as (previous such target, target) pairs. The new dynarec
+// links its blocks in generated code and reports nothing.
+// The counters wrap, only their bucket is looked at.
+#define FUZZER_COVERAGE_BITS 16
+#define FUZZER_COVERAGE_SIZE (1 << FUZZER_COVERAGE_BITS)
+
+// Counters of the current run, NULL while coverage is off
+extern uint8_t * fuzzerCoverage;
+
+static osal_inline void fuzzer_coverage_edge(uint32_t from, uint32_t to) {
+	uint32_t h;
+	if (fuzzerCoverage == NULL)
+		return;
+	h = (from >> 2) * UINT32_C(0x9E3779B1) ^ (to >> 2) * UINT32_C(0x85EBCA6B);
+	fuzzerCoverage[(h ^ (h >> 16)) & (FUZZER_COVERAGE_SIZE - 1)]++;
+}
+
+// Target of the last jump passed to fuzzer_coverage_block
+extern uint32_t fuzzerCoveragePrev;
+
+static osal_inline void fuzzer_coverage_block(uint32_t to) {
+	fuzzer_coverage_edge(fuzzerCoveragePrev, to);
+	fuzzerCoveragePrev = to;
+}
+
+// Start recording into map (FUZZER_COVERAGE_SIZE bytes), NULL stops it.
+// Every run sets its map again, so that it starts without a previous target.
+void fuzzer_coverage_set_map(uint8_t * map);
+
+// Bucket the hit counts of map in place and merge them into virgin, which
+// keeps the buckets never seen so far cleared (start it all 0xff).
+// Returns 2 for a new edge, 1 for a new hit count bucket of a known one.
+int fuzzer_coverage_merge(uint8_t * map, uint8_t * virgin);
+
+// Number of edges ever hit according to virgin
+unsigned int fuzzer_coverage_count(const uint8_t * virgin);
+
+#endif
@@ -0,0 +1,502 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+#include "api\m64p_types.h"
+#include "api\m64p_plugin.h"
+#include "fuzzer\fuzzer.h"
+#include "fuzzer\fuzzer_coverage.h"
+#include "fuzzer\fuzzer_engine.h"
+#include "fuzzer\fuzzer_forkserver.h"
+#include "fuzzer\fuzzer_m64input.h"
+#include "fuzzer\luaext.h"
+#include "main\file_storage.h"
+#include "main\main.h"
+#include "main\savestates.h"
+#include "main\util.h"
+#include "osal\files.h"
+#include "plugin\emulate_game_controller_via_input_plugin.h"
+
+// Native coverage guided fuzzing. Every run restores the same in-memory
+// state, plays a stream of per-frame BUTTONS (.m64 layout: one value per
+// controller per frame) for a fixed number of frames, then keeps the stream
+// in the corpus if it reached new guest edges or beat Fuzzer.objective.
+// New streams are mutated from the corpus. Lua only starts it, the update
+// hook keeps running on every VI for scripts that track their own state.
+
+typedef struct CorpusEntry {
+	uint32_t * inputs;
+	double objective;
+} CorpusEntry;
+
+enum engine_state {
+	ENGINE_OFF,
+	ENGINE_SNAPSHOT,  // waiting for the state every run starts from
+	ENGINE_RUNNING
+};
+
+static struct {
+	enum engine_state state;
+	int frames;
+	int controllers;
+	unsigned int maxRuns;
+	int workers;          // fork server workers, 0 fuzzes in process
+	unsigned int timeout; // seconds before a worker's run counts as a hang
+	int worker;           // this process is one of those workers
+	char * corpusDir;
+	uint64_t rng;
+
+	CorpusEntry * corpus;
+	unsigned int corpusCount;
+	unsigned int corpusCapacity;
+
+	// Seed streams, run once unmutated before any mutation
+	uint32_t ** seeds;
+	unsigned int seedCount;
+	unsigned int seedIndex;
+
+	uint32_t * inputs;
+	int frame;
+	unsigned int runs;
+	unsigned int crashes;
+	int hasObjective;
+	double bestObjective;
+
+	uint8_t map[FUZZER_COVERAGE_SIZE];
+	uint8_t virgin[FUZZER_COVERAGE_SIZE];
+} engine;
+
+static int stream_length(void) {
+	return engine.frames * engine.controllers;
+}
+
+// xorshift64*, returns [0, limit)
+static uint32_t rnd(uint32_t limit) {
+	engine.rng ^= engine.rng >> 12;
+	engine.rng ^= engine.rng << 25;
+	engine.rng ^= engine.rng >> 27;
+	return (uint32_t)((engine.rng * UINT64_C(2685821657736338717)) >> 32) % (limit ? limit : 1);
+}
+
+static uint32_t rnd32(void) {
+	return rnd(0x10000) << 16 | rnd(0x10000);
+}
+
+static void mutate(uint32_t * inputs) {
+	const int C = engine.controllers;
+	int i, f, stack = 1 << rnd(4);
+
+	for (i = 0; i < stack; i++) {
+		int start = rnd(engine.frames);
+		int len = 1 + rnd(engine.frames - start < 60 ? engine.frames - start : 60);
+		int c = rnd(C);
+		uint32_t v;
+		const uint32_t * other;
+
+		switch (rnd(6)) {
+		case 0: // toggle a button
+			v = 1 << rnd(16);
+			for (f = start; f < start + len; f++)
+				inputs[f * C + c] ^= v;
+			break;
+		case 1: // hold the stick somewhere, buttons untouched
+			v = rnd(256) << 16 | rnd(256) << 24;
+			for (f = start; f < start + len; f++)
+				inputs[f * C + c] = (inputs[f * C + c] & 0xffff) | v;
+			break;
+		case 2: // noise
+			for (f = start; f < start + len; f++)
+				inputs[f * C + c] = rnd32();
+			break;
+		case 3: // repeat a frame
+			v = inputs[start * C + c];
+			for (f = start; f < start + len; f++)
+				inputs[f * C + c] = v;
+			break;
+		case 4: // release everything
+			for (f = start; f < start + len; f++)
+				inputs[f * C + c] = 0;
+			break;
+		case 5: // splice in the same frames of another entry, all controllers
+			if (engine.corpusCount == 0)
+				break;
+			other = engine.corpus[rnd(engine.corpusCount)].inputs;
+			memcpy(inputs + start * C, other + start * C, len * C * sizeof(uint32_t));
+			break;
+		}
+	}
+}
+
+static void write_m64(const char * path, const uint32_t * inputs) {
+	M64Header header;
+	M64Writer * writer;
+	int frame, ok = 1;
+
+	m64_default_header(&header, engine.controllers, M64_START_SNAPSHOT);
+	writer = m64writer_open(path, &header, 0);
+	if (writer != NULL) {
+		for (frame = 0; frame < engine.frames && ok; frame++)
+			ok = m64writer_write_frame(writer, inputs + frame * engine.controllers);
+		ok &= m64writer_close(writer);
+	}
+	if (writer == NULL || !ok)
+		printf("Fuzzer engine: could not write '%s'\n", path);
+}
+
+static void add_to_corpus(const uint32_t * inputs, double objective) {
+	CorpusEntry * entry;
+
+	if (engine.corpusCount == engine.corpusCapacity) {
+		unsigned int capacity = engine.corpusCapacity ? engine.corpusCapacity * 2 : 64;
+		CorpusEntry * corpus = realloc(engine.corpus, capacity * sizeof(CorpusEntry));
+		if (corpus == NULL)
+			return;
+		engine.corpus = corpus;
+		engine.corpusCapacity = capacity;
+	}
+	entry = &engine.corpus[engine.corpusCount];
+	entry->inputs = malloc(stream_length() * sizeof(uint32_t));
+	if (entry->inputs == NULL)
+		return;
+	memcpy(entry->inputs, inputs, stream_length() * sizeof(uint32_t));
+	entry->objective = objective;
+	engine.corpusCount++;
+
+	if (engine.corpusDir != NULL) {
+		char * path = formatstr("%s/%06u.m64", engine.corpusDir, engine.corpusCount - 1);
+		if (path != NULL) {
+			write_m64(path, inputs);
+			free(path);
+		}
+	}
+}
+
+static void set_frame_inputs(int frame) {
+	uint32_t keys[4] = { 0 };
+	int c;
+
+	for (c = 0; c < engine.controllers; c++)
+		keys[c] = engine.inputs[frame * engine.controllers + c];
+	egcvip_set_input_snapshot((1 << engine.controllers) - 1, keys);
+}
+
+static void next_inputs(uint32_t * inputs) {
+	if (engine.seedIndex < engine.seedCount) {
+		memcpy(inputs, engine.seeds[engine.seedIndex++], stream_length() * sizeof(uint32_t));
+		return;
+	}
+	if (engine.corpusCount > 0)
+		memcpy(inputs, engine.corpus[rnd(engine.corpusCount)].inputs, stream_length() * sizeof(uint32_t));
+	else
+		memset(inputs, 0, stream_length() * sizeof(uint32_t));
+	mutate(inputs);
+}
+
+static void begin_run(void) {
+	if (engine.worker) {
+		uint8_t * map;
+		// Never returns once the fork server stops
+		memcpy(engine.inputs, forkserver_take(&map), stream_length() * sizeof(uint32_t));
+		fuzzer_coverage_set_map(map);
+	}
+	else {
+		next_inputs(engine.inputs);
+		memset(engine.map, 0, sizeof(engine.map));
+		fuzzer_coverage_set_map(engine.map);
+	}
+
+	engine.frame = 0;
+	set_frame_inputs(0);
+	// Applied as soon as the current interrupt is handled
+	savestates_set_job(savestates_job_load, savestates_type_m64p_memory, NULL);
+	engine.state = ENGINE_RUNNING;
+}
+
+static void record_run(const uint32_t * inputs, uint8_t * map, int hasObjective, double objective) {
+	int coverage = fuzzer_coverage_merge(map, engine.virgin);
+	int better = hasObjective && (!engine.hasObjective || objective > engine.bestObjective);
+
+	engine.runs++;
+	if (better) {
+		engine.hasObjective = 1;
+		engine.bestObjective = objective;
+	}
+	if (coverage || better) {
+		add_to_corpus(inputs, objective);
+		printf("Fuzzer engine: run %u, entry %u (%u edges%s)\n", engine.runs, engine.corpusCount - 1,
+			fuzzer_coverage_count(engine.virgin), better ? ", new best objective" : "");
+	}
+}
+
+static void record_crash(const uint32_t * inputs, int hang) {
+	const char * kind = hang ? "hang" : "crash";
+
+	engine.runs++;
+	engine.crashes++;
+	printf("Fuzzer engine: run %u, %s %u\n", engine.runs, kind, engine.crashes - 1);
+	if (engine.corpusDir != NULL) {
+		char * path = formatstr("%s/%s_%06u.m64", engine.corpusDir, kind, engine.crashes - 1);
+		if (path != NULL) {
+			write_m64(path, inputs);
+			free(path);
+		}
+	}
+}
+
+static void end_run(void) {
+	double objective = 0;
+	int hasObjective = fuzzer_objective(&objective);
+
+	if (engine.worker)
+		forkserver_done(hasObjective, objective);
+	else
+		record_run(engine.inputs, engine.map, hasObjective, objective);
+}
+
+// Parent of the fork server: keeps the workers fed until the runs are done
+// or emulation is stopped, without emulating anything itself. Workers come
+// back from here as if from a plain VI and go run what they are given.
+static void coordinate(void) {
+	struct forkserver_result result;
+	unsigned int queued = 0;
+	int event;
+
+	switch (forkserver_start(engine.workers, stream_length(), engine.timeout)) {
+	case FORKSERVER_CHILD:
+		engine.worker = 1;
+		begin_run();
+		return;
+	case FORKSERVER_FAILED:
+		printf("Fuzzer engine: fork server unavailable, fuzzing in process\n");
+		engine.workers = 0;
+		begin_run();
+		return;
+	}
+
+	for (;;) {
+		while ((engine.maxRuns == 0 || queued < engine.maxRuns) && forkserver_free_slots() > 0) {
+			next_inputs(engine.inputs);
+			forkserver_submit(engine.inputs);
+			queued++;
+		}
+
+		event = forkserver_wait(&result);
+		if (event == FORKSERVER_CHILD) {
+			engine.worker = 1;
+			begin_run();
+			return;
+		}
+		if (event == FORKSERVER_STOPPED)
+			break;
+		if (event == FORKSERVER_DONE)
+			record_run(result.inputs, result.map, result.hasObjective, result.objective);
+		else
+			record_crash(result.inputs, event == FORKSERVER_HANG);
+		forkserver_release(result.slot);
+
+		if (engine.maxRuns != 0 && engine.runs >= engine.maxRuns)
+			break;
+	}
+
+	forkserver_stop();
+	fuzzer_engine_stop();
+}
+
+void fuzzer_engine_vi(void) {
+	switch (engine.state) {
+	case ENGINE_OFF:
+		return;
+	case ENGINE_SNAPSHOT:
+		if (savestates_has_memory_state()) {
+			if (engine.workers > 0) {
+				coordinate();
+				return;
+			}
+			begin_run();
+			return;
+		}
+#ifdef NEW_DYNAREC
+		// The new dynarec records no edges, and runs without coverage are useless
+		if (get_r4300_emumode(&g_dev.r4300) == EMUMODE_DYNAREC) {
+			printf("Fuzzer engine: no coverage under the new dynarec, switch R4300Emulator to an interpreter. Stopping.\n");
+			fuzzer_engine_stop();
+			return;
+		}
+#endif
+		// Taken once the current interrupt is handled, every run starts there
+		savestates_set_job(savestates_job_save, savestates_type_m64p_memory, NULL);
+		return;
+	case ENGINE_RUNNING:
+		if (++engine.frame < engine.frames) {
+			set_frame_inputs(engine.frame);
+			return;
+		}
+		end_run();
+		if (!engine.worker && engine.maxRuns != 0 && engine.runs >= engine.maxRuns)
+			fuzzer_engine_stop();
+		else
+			begin_run();
+		return;
+	}
+}
+
+void fuzzer_engine_stop(void) {
+	unsigned int i;
+
+	if (engine.state == ENGINE_OFF)
+		return;
+
+	if (engine.runs > 0 && !engine.worker)
+		printf("Fuzzer engine: %u runs, %u corpus entries, %u edges, %u crashes\n", engine.runs, engine.corpusCount,
+			fuzzer_coverage_count(engine.virgin), engine.crashes);
+
+	fuzzer_coverage_set_map(NULL);
+	egcvip_set_input_snapshot(0, NULL);
+	savestates_free_memory_state();
+
+	for (i = 0; i < engine.corpusCount; i++)
+		free(engine.corpus[i].inputs);
+	free(engine.corpus);
+	for (i = 0; i < engine.seedCount; i++)
+		free(engine.seeds[i]);
+	free(engine.seeds);
+	free(engine.inputs);
+	free(engine.corpusDir);
+	memset(&engine, 0, sizeof(engine));
+}
+
+static lua_Integer opt_field(lua_State *L, int t, const char * name, lua_Integer def) {
+	lua_Integer value;
+	lua_getfield(L, t, name);
+	value = lua_isnil(L, -1) ? def : luaL_checkinteger(L, -1);
+	lua_pop(L, 1);
+	return value;
+}
+
+// Raises the Lua errors of the corpus and seeds fields before anything is allocated
+static void check_paths(lua_State *L) {
+	int i, count;
+
+	lua_getfield(L, 2, "corpus");
+	luaL_argcheck(L, lua_isnil(L, -1) || lua_isstring(L, -1), 2, "corpus must be a directory name");
+	lua_pop(L, 1);
+
+	lua_getfield(L, 2, "seeds");
+	if (lua_istable(L, -1)) {
+		count = (int)lua_objlen(L, -1);
+		for (i = 1; i <= count; i++) {
+			lua_rawgeti(L, -1, i);
+			luaL_argcheck(L, lua_isstring(L, -1), 2, "seeds must be .m64 file names");
+			lua_pop(L, 1);
+		}
+	}
+	lua_pop(L, 1);
+}
+
+// Fuzzer:startEngine{ frames=600, controllers=1, runs=0, seed=time, corpus="dir", seeds={"a.m64", ...},
+//                     workers=0, timeout=60 }
+// Every run starts from the state the machine is in right after the next VI.
+// With workers, this process forks them from there and only coordinates;
+// streams of runs killing a worker or overrunning timeout (seconds) are
+// written to the corpus directory as crash_*.m64 and hang_*.m64.
+static int lua_startengine(lua_State *L) {
+	int i;
+
+	luaL_checktype(L, 2, LUA_TTABLE);
+#ifdef NEW_DYNAREC
+	if (g_EmulatorRunning && get_r4300_emumode(&g_dev.r4300) == EMUMODE_DYNAREC)
+		return luaL_error(L, "the fuzzing engine needs an interpreter, the new dynarec records no coverage");
+#endif
+	check_paths(L);
+	fuzzer_engine_stop();
+
+	engine.frames = (int)opt_field(L, 2, "frames", 600);
+	engine.controllers = (int)opt_field(L, 2, "controllers", 1);
+	engine.maxRuns = (unsigned int)opt_field(L, 2, "runs", 0);
+	engine.workers = (int)opt_field(L, 2, "workers", 0);
+	engine.timeout = (unsigned int)opt_field(L, 2, "timeout", 60);
+	engine.rng = (uint64_t)opt_field(L, 2, "seed", (lua_Integer)time(NULL)) * UINT64_C(0x9E3779B97F4A7C15) | 1;
+	luaL_argcheck(L, engine.frames > 0, 2, "frames must be positive");
+	luaL_argcheck(L, engine.controllers >= 1 && engine.controllers <= 4, 2, "controllers must be 1 to 4");
+	luaL_argcheck(L, engine.workers >= 0, 2, "workers must not be negative");
+
+	engine.inputs = calloc(stream_length(), sizeof(uint32_t));
+	if (engine.inputs == NULL)
+		return luaL_error(L, "out of memory");
+	memset(engine.virgin, 0xff, sizeof(engine.virgin));
+
+	lua_getfield(L, 2, "corpus");
+	if (!lua_isnil(L, -1)) {
+		const char * dir = lua_tostring(L, -1);
+		if (osal_mkdirp(dir, 0700) != 0)
+			printf("Fuzzer engine: could not create corpus directory '%s'\n", dir);
+		else
+			engine.corpusDir = strdup(dir);
+	}
+	lua_pop(L, 1);
+
+	lua_getfield(L, 2, "seeds");
+	if (lua_istable(L, -1)) {
+		int count = (int)lua_objlen(L, -1);
+		engine.seeds = calloc(count ? count : 1, sizeof(uint32_t *));
+		for (i = 1; i <= count && engine.seeds != NULL; i++) {
+			uint32_t * seed;
+			lua_rawgeti(L, -1, i);
+			seed = m64_read_frames(lua_tostring(L, -1), engine.frames, engine.controllers);
+			if (seed == NULL)
+				printf("Fuzzer engine: could not read seed '%s'\n", lua_tostring(L, -1));
+			else
+				engine.seeds[engine.seedCount++] = seed;
+			lua_pop(L, 1);
+		}
+	}
+	lua_pop(L, 1);
+
+	// Fuzzed runs must not overwrite the user's save files, in process or
+	// from the workers forked later. The in-memory copies stay dirty, so
+	// this lasts until emulation stops, not until the engine does.
+	set_file_storage_volatile(1);
+
+	savestates_free_memory_state();
+	engine.state = ENGINE_SNAPSHOT;
+	return 0;
+}
+
+static int lua_stopengine(lua_State *L) {
+	fuzzer_engine_stop();
+	return 0;
+}
+
+static int lua_enginestats(lua_State *L) {
+	lua_newtable(L);
+	lua_pushboolean(L, engine.state != ENGINE_OFF);
+	lua_setfield(L, -2, "running");
+	lua_pushinteger(L, engine.runs);
+	lua_setfield(L, -2, "runs");
+	lua_pushinteger(L, engine.corpusCount);
+	lua_setfield(L, -2, "corpus");
+	lua_pushinteger(L, engine.crashes);
+	lua_setfield(L, -2, "crashes");
+	lua_pushinteger(L, engine.state != ENGINE_OFF ? fuzzer_coverage_count(engine.virgin) : 0);
+	lua_setfield(L, -2, "edges");
+	if (engine.hasObjective) {
+		lua_pushnumber(L, engine.bestObjective);
+		lua_setfield(L, -2, "objective");
+	}
+	return 1;
+}
+
+static const luaL_Reg engineFuncs[] = {
+	{ "startEngine", lua_startengine },
+	{ "stopEngine", lua_stopengine },
+	{ "engineStats", lua_enginestats },
+	{ NULL, NULL }  /* sentinel */
+};
+
+int luaopen_fuzzerengine(lua_State *L) {
+	luaL_setfuncs(L, engineFuncs, 0);
+	return 1;
+}
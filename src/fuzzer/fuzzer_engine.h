@@ -0,0 +1,12 @@
+#ifndef FUZZER_ENGINE_H_INCLUDED
+#define FUZZER_ENGINE_H_INCLUDED
+
+#include <lua.h>
+
+// Called on every VI after the Lua update hook
+void fuzzer_engine_vi(void);
+void fuzzer_engine_stop(void);
+
+int luaopen_fuzzerengine(lua_State *L);
+
+#endif
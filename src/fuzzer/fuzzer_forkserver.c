@@ -0,0 +1,317 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fuzzer\fuzzer_coverage.h"
+#include "fuzzer\fuzzer_forkserver.h"
+#include "main\main.h"
+
+#ifdef WIN32
+
+int forkserver_start(int workers, int streamLength, unsigned int timeout) {
+	printf("Fork server: not supported on this platform\n");
+	return FORKSERVER_FAILED;
+}
+
+int forkserver_free_slots(void) { return 0; }
+void forkserver_submit(const uint32_t * inputs) { }
+int forkserver_wait(struct forkserver_result * result) { return FORKSERVER_STOPPED; }
+void forkserver_release(int slot) { }
+void forkserver_stop(void) { }
+const uint32_t * forkserver_take(uint8_t ** map) { return NULL; }
+void forkserver_done(int hasObjective, double objective) { }
+
+#else
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// A slot goes FREE -> QUEUED (parent) -> RUNNING + worker (worker)
+// -> DONE (worker) -> FREE (parent). The worker index is part of the
+// running state so that claiming a slot is a single compare and swap.
+enum slot_state {
+	SLOT_FREE,
+	SLOT_QUEUED,
+	SLOT_DONE,
+	SLOT_RUNNING
+};
+
+struct slot {
+	volatile int state;
+	volatile time_t started;
+	int hasObjective;
+	double objective;
+	uint8_t map[FUZZER_COVERAGE_SIZE];
+	uint32_t inputs[];
+};
+
+// Shared memory is this header, padded to SLOTS_OFFSET, then the slots
+struct shared {
+	volatile int stop;
+};
+
+#define SLOTS_OFFSET 64
+
+static struct shared * shared = NULL;
+static size_t sharedSize;
+static size_t slotSize;
+static size_t streamSize;
+static int slotCount;
+static unsigned int runTimeout;
+
+// Parent side
+static pid_t * pids = NULL;
+static int workerCount;
+static int * respawn = NULL;
+static int respawnCount;
+static char * killed = NULL;
+
+// Worker side
+static int self = -1;
+static pid_t parent;
+static struct slot * current = NULL;
+
+static struct slot * get_slot(int i) {
+	return (struct slot *)((char *)shared + SLOTS_OFFSET + i * slotSize);
+}
+
+static void sleep_ms(long ms) {
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	nanosleep(&ts, NULL);
+}
+
+static int spawn(int worker) {
+	pid_t pid;
+
+	// Or whatever is still buffered gets printed by every worker too
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		printf("Fork server: could not fork worker %d\n", worker);
+		pids[worker] = 0;
+		return FORKSERVER_FAILED;
+	}
+	if (pid == 0) {
+		self = worker;
+		parent = getppid();
+		return FORKSERVER_CHILD;
+	}
+	pids[worker] = pid;
+	return FORKSERVER_PARENT;
+}
+
+static void release_shared(void) {
+	if (shared != NULL)
+		munmap(shared, sharedSize);
+	shared = NULL;
+	free(pids);
+	pids = NULL;
+	free(respawn);
+	respawn = NULL;
+	free(killed);
+	killed = NULL;
+}
+
+int forkserver_start(int workers, int streamLength, unsigned int timeout) {
+	int i, started = 0;
+
+	workerCount = workers;
+	slotCount = workers * 2;  // so that a worker finds its next run already queued
+	streamSize = streamLength * sizeof(uint32_t);
+	slotSize = (offsetof(struct slot, inputs) + streamSize + 63) & ~(size_t)63;
+	sharedSize = SLOTS_OFFSET + slotCount * slotSize;
+	runTimeout = timeout;
+	respawnCount = 0;
+
+	shared = mmap(NULL, sharedSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED) {
+		shared = NULL;
+		printf("Fork server: could not map %lu bytes of shared memory\n", (unsigned long)sharedSize);
+		return FORKSERVER_FAILED;
+	}
+	pids = calloc(workers, sizeof(pid_t));
+	respawn = calloc(workers, sizeof(int));
+	killed = calloc(slotCount, 1);
+	if (pids == NULL || respawn == NULL || killed == NULL) {
+		release_shared();
+		return FORKSERVER_FAILED;
+	}
+
+	for (i = 0; i < workers; i++) {
+		switch (spawn(i)) {
+		case FORKSERVER_CHILD:
+			return FORKSERVER_CHILD;
+		case FORKSERVER_PARENT:
+			started++;
+			break;
+		}
+	}
+	if (started == 0) {
+		release_shared();
+		return FORKSERVER_FAILED;
+	}
+	printf("Fork server: %d workers\n", started);
+	return FORKSERVER_PARENT;
+}
+
+int forkserver_free_slots(void) {
+	int i, count = 0;
+	for (i = 0; i < slotCount; i++) {
+		if (get_slot(i)->state == SLOT_FREE)
+			count++;
+	}
+	return count;
+}
+
+void forkserver_submit(const uint32_t * inputs) {
+	int i;
+	for (i = 0; i < slotCount; i++) {
+		struct slot * slot = get_slot(i);
+		if (slot->state == SLOT_FREE) {
+			memcpy(slot->inputs, inputs, streamSize);
+			__sync_synchronize();
+			slot->state = SLOT_QUEUED;
+			return;
+		}
+	}
+}
+
+static void fill_result(struct forkserver_result * result, int i) {
+	struct slot * slot = get_slot(i);
+	result->slot = i;
+	result->inputs = slot->inputs;
+	result->map = slot->map;
+	result->hasObjective = slot->hasObjective;
+	result->objective = slot->objective;
+	result->status = 0;
+}
+
+int forkserver_wait(struct forkserver_result * result) {
+	int i, alive, status;
+
+	// Replace the workers lost since the last call
+	while (respawnCount > 0) {
+		if (spawn(respawn[--respawnCount]) == FORKSERVER_CHILD)
+			return FORKSERVER_CHILD;
+	}
+
+	for (;;) {
+		time_t now = time(NULL);
+
+		if (*r4300_stop())
+			return FORKSERVER_STOPPED;
+
+		for (i = 0; i < slotCount; i++) {
+			if (get_slot(i)->state == SLOT_DONE) {
+				__sync_synchronize();
+				fill_result(result, i);
+				return FORKSERVER_DONE;
+			}
+		}
+
+		alive = 0;
+		for (i = 0; i < workerCount; i++) {
+			int s;
+			if (pids[i] == 0)
+				continue;
+			if (waitpid(pids[i], &status, WNOHANG) != pids[i]) {
+				alive++;
+				continue;
+			}
+
+			pids[i] = 0;
+			respawn[respawnCount++] = i;
+			for (s = 0; s < slotCount; s++) {
+				if (get_slot(s)->state == SLOT_RUNNING + i) {
+					int event = killed[s] ? FORKSERVER_HANG : FORKSERVER_CRASH;
+					killed[s] = 0;
+					fill_result(result, s);
+					result->status = status;
+					return event;
+				}
+			}
+			printf("Fork server: worker %d exited outside of a run\n", i);
+			return forkserver_wait(result);
+		}
+		if (alive == 0)
+			return FORKSERVER_STOPPED;
+
+		if (runTimeout != 0) {
+			for (i = 0; i < slotCount; i++) {
+				struct slot * slot = get_slot(i);
+				int state = slot->state;
+				time_t started = slot->started;
+				if (state >= SLOT_RUNNING && !killed[i] && started != 0 && now - started > (time_t)runTimeout) {
+					// kill(0) would take down the whole process group
+					pid_t pid = pids[state - SLOT_RUNNING];
+					if (pid > 0) {
+						killed[i] = 1;
+						kill(pid, SIGKILL);
+					}
+				}
+			}
+		}
+
+		sleep_ms(1);
+	}
+}
+
+void forkserver_release(int slot) {
+	get_slot(slot)->started = 0;
+	__sync_synchronize();
+	get_slot(slot)->state = SLOT_FREE;
+}
+
+void forkserver_stop(void) {
+	int i, status;
+
+	if (shared == NULL)
+		return;
+	// Runs in progress are not worth waiting for
+	shared->stop = 1;
+	for (i = 0; i < workerCount; i++) {
+		if (pids[i] > 0) {
+			kill(pids[i], SIGKILL);
+			waitpid(pids[i], &status, 0);
+		}
+	}
+	release_shared();
+}
+
+const uint32_t * forkserver_take(uint8_t ** map) {
+	int i;
+
+	for (;;) {
+		if (shared->stop || getppid() != parent)
+			_exit(0);
+
+		for (i = 0; i < slotCount; i++) {
+			struct slot * slot = get_slot(i);
+			if (slot->state == SLOT_QUEUED &&
+				__sync_bool_compare_and_swap(&slot->state, SLOT_QUEUED, SLOT_RUNNING + self)) {
+				slot->started = time(NULL);
+				memset(slot->map, 0, sizeof(slot->map));
+				current = slot;
+				*map = slot->map;
+				return slot->inputs;
+			}
+		}
+		sleep_ms(1);
+	}
+}
+
+void forkserver_done(int hasObjective, double objective) {
+	current->hasObjective = hasObjective;
+	current->objective = objective;
+	__sync_synchronize();
+	current->state = SLOT_DONE;
+	current = NULL;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef FUZZER_FORKSERVER_H_INCLUDED
+#define FUZZER_FORKSERVER_H_INCLUDED
+
+#include <stdint.h>
+
+// Fork server for the fuzzing engine: the process which booted and took the
+// base state forks copy-on-write workers. They run the input streams queued
+// by the parent from that state and hand back coverage and objective through
+// shared memory. Workers that die or overrun the timeout are reported and
+// replaced by a new fork. Not available on Windows.
+
+enum forkserver_event {
+	FORKSERVER_FAILED = -1,
+	FORKSERVER_PARENT,    // forkserver_start in the parent
+	FORKSERVER_CHILD,     // in a newly forked worker, which must go run inputs
+	FORKSERVER_DONE,      // a run finished
+	FORKSERVER_CRASH,     // a worker died during a run
+	FORKSERVER_HANG,      // a run overran the timeout, its worker was killed
+	FORKSERVER_STOPPED    // emulation is being stopped
+};
+
+struct forkserver_result {
+	int slot;
+	const uint32_t * inputs;
+	uint8_t * map;
+	int hasObjective;
+	double objective;
+	int status;           // wait status of a dead worker
+};
+
+// Parent side
+int forkserver_start(int workers, int streamLength, unsigned int timeout);
+int forkserver_free_slots(void);
+void forkserver_submit(const uint32_t * inputs);
+int forkserver_wait(struct forkserver_result * result);
+void forkserver_release(int slot);
+void forkserver_stop(void);
+
+// Worker side: take blocks until a stream is queued and never returns once
+// the parent stops, done hands the run back
+const uint32_t * forkserver_take(uint8_t ** map);
+void forkserver_done(int hasObjective, double objective);
+
+#endif
@@ -6,7 +6,9 @@
 #include "main\savestates.h"
 #include "fuzzer\fuzzer_inputs.h"
 #include "fuzzer\fuzzer_memory.h"
+#include "fuzzer\fuzzer_engine.h"
 #include "fuzzer\fuzzer_m64input.h"
+#include "plugin\emulate_game_controller_via_input_plugin.h"
 #include <fuzzer\luaext.h>
 
 static int lua_loadstate(lua_State *L) {
@@ -22,10 +24,34 @@ static int lua_savestate(lua_State *L) {
 	return 0;
 }
 
+// Fuzzer:setFrameInputs(p1, p2, p3, p4): raw BUTTONS of each controller, nil to leave it to the input plugin.
+// Controller reads are then served by the core until the next call, without calling back into Lua.
+static int lua_setframeinputs(lua_State *L) {
+	uint32_t keys[4] = { 0 };
+	unsigned int mask = 0;
+	int i;
+	for (i = 0; i < 4; i++) {
+		if (!lua_isnoneornil(L, 2 + i)) {
+			keys[i] = (uint32_t)luaL_checkinteger(L, 2 + i);
+			mask |= 1 << i;
+		}
+	}
+	egcvip_set_input_snapshot(mask, keys);
+	return 0;
+}
+
+static int lua_clearframeinputs(lua_State *L) {
+	egcvip_set_input_snapshot(0, NULL);
+	return 0;
+}
+
 static const luaL_Reg mylib[] = {
 	{ "saveState", lua_savestate },
 	{ "loadState", lua_loadstate },
+	{ "setFrameInputs", lua_setframeinputs },
+	{ "clearFrameInputs", lua_clearframeinputs },
 	{ "openM64", luam64_open },
+	{ "recordM64", luam64_record },
 	{ NULL, NULL }  /* sentinel */
 };
 
@@ -36,6 +62,7 @@ int luaopen_fuzzerlib(lua_State *L) {
 	luaopen_fuzzerinputs(L);
 	lua_setfield(L, -2, "Inputs");
 	luaopen_fuzzermemory(L);
+	luaopen_fuzzerengine(L);
 	return 1;
 }
 
@@ -1,19 +1,321 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <lua.h>
 #include <lauxlib.h>
 #include <lualib.h>
 #include "api\m64p_types.h"
 #include "api\m64p_plugin.h"
+#include "device\memory\memory.h"
 #include "fuzzer\fuzzer_lualib.h"
+#include "fuzzer\fuzzer_m64input.h"
 #include "fuzzer\luaext.h"
-#include <math.h>
+#include "main\rom.h"
+#include "main\util.h"
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #define LUA_M64_TABLE_BUFFER_FIELD "_m64InputBuffer"
+#define LUA_M64_WRITER_FIELD "_m64Writer"
+
+#define M64_HEADER_SIZE_V1 0x200
+#define M64_HEADER_SIZE_V3 0x400
+
+// Longest chain of parent references followed, also ends cycles
+#define M64_MAX_PARENTS 64
+
+static uint32_t get_le32(const unsigned char * p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t get_le16(const unsigned char * p) {
+	return p[0] | p[1] << 8;
+}
+
+static void put_le32(unsigned char * p, uint32_t value) {
+	p[0] = value & 0xff;
+	p[1] = (value >> 8) & 0xff;
+	p[2] = (value >> 16) & 0xff;
+	p[3] = value >> 24;
+}
+
+static void put_le16(unsigned char * p, uint16_t value) {
+	p[0] = value & 0xff;
+	p[1] = value >> 8;
+}
+
+static void get_string(char * dst, const unsigned char * src, size_t size) {
+	memcpy(dst, src, size);
+	dst[size] = '\0';
+}
+
+static void put_string(unsigned char * dst, const char * src, size_t size) {
+	size_t len = strlen(src);
+	memcpy(dst, src, len < size ? len : size);
+}
+
+// Returns the size of the header, 0 if data isn't a movie
+static size_t parse_header(M64Header * header, const unsigned char * data, size_t size) {
+	size_t headerSize;
+
+	if (size < M64_HEADER_SIZE_V1 || memcmp(data, "M64\x1a", 4) != 0)
+		return 0;
+	memset(header, 0, sizeof(*header));
+	header->version = get_le32(data + 0x04);
+	switch (header->version) {
+		case 1:
+		case 2:
+			headerSize = M64_HEADER_SIZE_V1;
+			break;
+		case 3:
+			headerSize = M64_HEADER_SIZE_V3;
+			break;
+		default:
+			return 0;
+	}
+	if (size < headerSize)
+		return 0;
+
+	header->uid = get_le32(data + 0x08);
+	header->viCount = get_le32(data + 0x0c);
+	header->rerecords = get_le32(data + 0x10);
+	header->fps = data[0x14];
+	header->controllers = data[0x15];
+	// An N64 has 4 ports, anything else is a corrupt or crafted file
+	if (header->controllers > 4)
+		return 0;
+	header->samples = get_le32(data + 0x18);
+	header->startType = get_le16(data + 0x1c);
+	header->controllerFlags = get_le32(data + 0x20);
+	get_string(header->romName, data + 0xc4, 32);
+	header->romCrc = get_le32(data + 0xe4);
+	header->countryCode = get_le16(data + 0xe8);
+	if (header->version == 3) {
+		get_string(header->videoPlugin, data + 0x122, 64);
+		get_string(header->soundPlugin, data + 0x162, 64);
+		get_string(header->inputPlugin, data + 0x1a2, 64);
+		get_string(header->rspPlugin, data + 0x1e2, 64);
+		get_string(header->author, data + 0x222, 222);
+		get_string(header->description, data + 0x300, 256);
+	}
+	return headerSize;
+}
+
+static void serialize_header(unsigned char * data, const M64Header * header, uint32_t viCount, uint32_t samples) {
+	memset(data, 0, M64_HEADER_SIZE_V3);
+	memcpy(data, "M64\x1a", 4);
+	put_le32(data + 0x04, 3);
+	put_le32(data + 0x08, header->uid);
+	put_le32(data + 0x0c, viCount);
+	put_le32(data + 0x10, header->rerecords);
+	data[0x14] = header->fps;
+	data[0x15] = header->controllers;
+	put_le32(data + 0x18, samples);
+	put_le16(data + 0x1c, header->startType);
+	put_le32(data + 0x20, header->controllerFlags);
+	put_string(data + 0xc4, header->romName, 32);
+	put_le32(data + 0xe4, header->romCrc);
+	put_le16(data + 0xe8, header->countryCode);
+	put_string(data + 0x122, header->videoPlugin, 64);
+	put_string(data + 0x162, header->soundPlugin, 64);
+	put_string(data + 0x1a2, header->inputPlugin, 64);
+	put_string(data + 0x1e2, header->rspPlugin, 64);
+	put_string(data + 0x222, header->author, 222);
+	put_string(data + 0x300, header->description, 256);
+}
+
+void m64_default_header(M64Header * header, int controllers, int startType) {
+	memset(header, 0, sizeof(*header));
+	header->version = 3;
+	header->uid = (uint32_t)time(NULL);
+	header->fps = ROM_PARAMS.systemtype == SYSTEM_PAL ? 50 : 60;
+	header->controllers = (uint8_t)controllers;
+	header->startType = (uint16_t)startType;
+	header->controllerFlags = (1 << controllers) - 1;
+	memcpy(header->romName, ROM_HEADER.Name, sizeof(ROM_HEADER.Name));
+	header->romCrc = sl(ROM_HEADER.CRC1);
+	header->countryCode = ROM_HEADER.Country_code;
+}
+
+/* ---- Reading ---- */
+
+// Read-only mapping of a movie file, shared with the movies branched off it
+typedef struct M64Mapping {
+	int refs;
+	const unsigned char * data;
+	size_t size;
+	char * path;
+	const unsigned char * inputs;  // samples of the file, after its header
+	int count;
+	struct M64Mapping * parent;    // movie the file continues, see recordM64
+	int parentCount;               // samples taken from it before the file's
+#ifdef WIN32
+	HANDLE file;
+	HANDLE map;
+#else
+	dev_t dev;  // to recognize the file when recording
+	ino_t ino;
+#endif
+} M64Mapping;
+
+static M64Mapping * map_file(const char * path) {
+	M64Mapping * mapping = (M64Mapping *)calloc(1, sizeof(M64Mapping));
+	if (mapping == NULL)
+		return NULL;
+	mapping->refs = 1;
+
+#ifdef WIN32
+	{
+		LARGE_INTEGER size;
+		mapping->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (mapping->file == INVALID_HANDLE_VALUE)
+			goto map_file_fail;
+		if (!GetFileSizeEx(mapping->file, &size) || size.QuadPart == 0) {
+			CloseHandle(mapping->file);
+			goto map_file_fail;
+		}
+		mapping->size = (size_t)size.QuadPart;
+		mapping->map = CreateFileMappingA(mapping->file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping->map == NULL) {
+			CloseHandle(mapping->file);
+			goto map_file_fail;
+		}
+		mapping->data = (const unsigned char *)MapViewOfFile(mapping->map, FILE_MAP_READ, 0, 0, 0);
+		if (mapping->data == NULL) {
+			CloseHandle(mapping->map);
+			CloseHandle(mapping->file);
+			goto map_file_fail;
+		}
+	}
+#else
+	{
+		struct stat st;
+		void * data;
+		int fd = open(path, O_RDONLY);
+		if (fd < 0)
+			goto map_file_fail;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {
+			close(fd);
+			goto map_file_fail;
+		}
+		mapping->size = (size_t)st.st_size;
+		mapping->dev = st.st_dev;
+		mapping->ino = st.st_ino;
+		data = mmap(NULL, mapping->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		// The mapping stays valid without the descriptor
+		close(fd);
+		if (data == MAP_FAILED)
+			goto map_file_fail;
+		mapping->data = (const unsigned char *)data;
+	}
+#endif
+	return mapping;
+
+map_file_fail:
+	free(mapping);
+	return NULL;
+}
+
+static void unref_mapping(M64Mapping * mapping) {
+	if (--mapping->refs > 0)
+		return;
+	if (mapping->parent != NULL)
+		unref_mapping(mapping->parent);
+	free(mapping->path);
+#ifdef WIN32
+	UnmapViewOfFile(mapping->data);
+	CloseHandle(mapping->map);
+	CloseHandle(mapping->file);
+#else
+	munmap((void *)mapping->data, mapping->size);
+#endif
+	free(mapping);
+}
+
+static uint32_t mapping_sample(const M64Mapping * mapping, int pos) {
+	while (pos < mapping->parentCount)
+		mapping = mapping->parent;
+	return get_le32(mapping->inputs + (pos - mapping->parentCount) * sizeof(uint32_t));
+}
+
+static char * parent_ref_path(const char * path) {
+	return formatstr("%s.parent", path);
+}
+
+static M64Mapping * open_mapping(const char * path, M64Header * header, int depth);
+
+// A movie recorded from a parent has a "<path>.parent" file next to it,
+// holding one line: the number of frames taken from the parent, then the
+// parent's path. Returns 0 if that reference can't be resolved.
+static int resolve_parent(M64Mapping * mapping, int controllers, int depth) {
+	char parentPath[4096];
+	char * refPath = parent_ref_path(mapping->path);
+	FILE * f;
+	M64Header header;
+	size_t len;
+	int frames, total;
+
+	if (refPath == NULL)
+		return 0;
+	f = fopen(refPath, "r");
+	free(refPath);
+	if (f == NULL)
+		return 1;
+	if (depth >= M64_MAX_PARENTS || fscanf(f, "%d ", &frames) != 1 || frames < 0 ||
+		fgets(parentPath, sizeof(parentPath), f) == NULL) {
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+	len = strlen(parentPath);
+	while (len > 0 && (parentPath[len - 1] == '\n' || parentPath[len - 1] == '\r'))
+		parentPath[--len] = '\0';
+
+	mapping->parent = open_mapping(parentPath, &header, depth + 1);
+	if (mapping->parent == NULL)
+		return 0;
+	if ((header.controllers > 0 ? header.controllers : 1) != controllers)
+		return 0;
+	total = mapping->parent->parentCount + mapping->parent->count;
+	mapping->parentCount = frames < total / controllers ? frames * controllers : total - total % controllers;
+	return 1;
+}
+
+static M64Mapping * open_mapping(const char * path, M64Header * header, int depth) {
+	M64Mapping * mapping = map_file(path);
+	size_t headerSize;
+
+	if (mapping == NULL)
+		return NULL;
+	headerSize = parse_header(header, mapping->data, mapping->size);
+	mapping->path = strdup(path);
+	if (headerSize == 0 || mapping->path == NULL)
+		goto open_mapping_fail;
+	mapping->inputs = mapping->data + headerSize;
+	mapping->count = (int)((mapping->size - headerSize) / sizeof(uint32_t));
+	if (!resolve_parent(mapping, header->controllers > 0 ? header->controllers : 1, depth))
+		goto open_mapping_fail;
+	return mapping;
+
+open_mapping_fail:
+	unref_mapping(mapping);
+	return NULL;
+}
 
 typedef struct M64File {
 	int pos;
-	int count;
-	uint32_t * inputs;
+	int count;                     // samples
+	int controllers;               // samples per frame
+	M64Header header;
+	M64Mapping * mapping;
 } M64File;
 
 typedef struct M64List {
@@ -22,24 +324,28 @@ typedef struct M64List {
 	struct M64List * prev;
 } M64List;
 
-M64List * m64List = NULL;
+static M64List * m64List = NULL;
 
-void freeM64(M64File * m64) {
-	free(m64->inputs);
+static uint32_t m64_sample(const M64File * m64, int pos) {
+	return mapping_sample(m64->mapping, pos);
+}
+
+static void freeM64(M64File * m64) {
+	unref_mapping(m64->mapping);
 	free(m64);
 }
 
-void freeM64List()
-{
+static void freeM64List(void) {
 	M64List * next;
 	while (m64List != NULL) {
 		next = m64List->next;
+		freeM64(m64List->file);
 		free(m64List);
 		m64List = next;
 	}
 }
 
-M64List * findM64(M64File * m64) {
+static M64List * findM64(M64File * m64) {
 	M64List * find = m64List;
 	if (m64 == NULL)
 		return NULL;
@@ -48,22 +354,27 @@ M64List * findM64(M64File * m64) {
 		if (m64 == find->file) {
 			return find;
 		}
+		find = find->next;
 	}
 	return NULL;
 }
 
-void closeM64(M64File * m64) {
+static void closeM64(M64File * m64) {
 	M64List * list = findM64(m64);
 	if (list == NULL)
 		return;
 
 	freeM64(list->file);
-	list->prev->next = list->next;
-	list->next->prev = list->prev;
+	if (list->prev != NULL)
+		list->prev->next = list->next;
+	else
+		m64List = list->next;
+	if (list->next != NULL)
+		list->next->prev = list->prev;
 	free(list);
 }
 
-M64File * luam64_checkm64(lua_State *L, int n) {
+static M64File * luam64_checkm64(lua_State *L, int n) {
 	M64File *m64;
 	// Check for table
 	if (!lua_istable(L, n))
@@ -79,29 +390,32 @@ M64File * luam64_checkm64(lua_State *L, int n) {
 	m64 = (M64File *)lua_touserdata(L, -1);
 	lua_pop(L, 1);
 
+	// Closed already
+	if (findM64(m64) == NULL)
+		return NULL;
 	return m64;
 }
 
-int luam64_close(lua_State *L) {
+static int luam64_close(lua_State *L) {
 	M64File * m64 = luam64_checkm64(L, 1);
 	closeM64(m64);
 	return 0;
 }
 
-int luam64_getinputat(lua_State *L) {
+static int luam64_getinputat(lua_State *L) {
 	M64File * m64 = luam64_checkm64(L, 1);
 	int pos = (int)luaL_checkinteger(L, 2);
 	if (m64 == NULL) {
 		lua_pushnil(L);
 		return 1;
 	}
-	luaL_argcheck(L, pos <= m64->count, 2, "input position past maximum");
+	luaL_argcheck(L, pos < m64->count, 2, "input position past maximum");
 	luaL_argcheck(L, pos >= 0, 2, "input position negative");
-	lua_pushnumber(L, m64->inputs[pos]);
+	lua_pushnumber(L, m64_sample(m64, pos));
 	return 1;
 }
 
-volatile int luam64_setpos(lua_State *L) {
+static int luam64_setpos(lua_State *L) {
 	M64File * m64 = luam64_checkm64(L, 1);
 	if (m64 == NULL) {
 		return 0;
@@ -114,7 +428,7 @@ volatile int luam64_setpos(lua_State *L) {
 	return 0;
 }
 
-int luam64_getpos(lua_State *L) {
+static int luam64_getpos(lua_State *L) {
 	M64File * m64 = luam64_checkm64(L, 1);
 	if (m64 == NULL) {
 		lua_pushnil(L);
@@ -124,7 +438,7 @@ int luam64_getpos(lua_State *L) {
 	return 1;
 }
 
-int luam64_getinputcount(lua_State *L) {
+static int luam64_getinputcount(lua_State *L) {
 	M64File * m64 = luam64_checkm64(L, 1);
 	if (m64 == NULL) {
 		lua_pushnil(L);
@@ -134,7 +448,7 @@ int luam64_getinputcount(lua_State *L) {
 	return 1;
 }
 
-int luam64_getfinished(lua_State *L) {
+static int luam64_getfinished(lua_State *L) {
 	M64File * m64 = luam64_checkm64(L, 1);
 	if (m64 == NULL) {
 		lua_pushnil(L);
@@ -144,14 +458,14 @@ int luam64_getfinished(lua_State *L) {
 	return 1;
 }
 
-int luam64_getnextinput(lua_State *L) {
+static int luam64_getnextinput(lua_State *L) {
 	M64File * m64 = luam64_checkm64(L, 1);
 	if (m64 == NULL) {
 		lua_pushnil(L);
 		return 1;
 	}
 	if (m64->pos < m64->count) {
-		lua_pushinteger(L, m64->inputs[m64->pos]);
+		lua_pushinteger(L, m64_sample(m64, m64->pos));
 		m64->pos++;
 	}
 	else {
@@ -161,6 +475,120 @@ int luam64_getnextinput(lua_State *L) {
 	return 1;
 }
 
+static int luam64_getframecount(lua_State *L) {
+	M64File * m64 = luam64_checkm64(L, 1);
+	if (m64 == NULL) {
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_pushinteger(L, m64->count / m64->controllers);
+	return 1;
+}
+
+static int luam64_getcontrollercount(lua_State *L) {
+	M64File * m64 = luam64_checkm64(L, 1);
+	if (m64 == NULL) {
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_pushinteger(L, m64->controllers);
+	return 1;
+}
+
+// m64:getFrame(frame): one BUTTONS value per controller
+static int luam64_getframe(lua_State *L) {
+	M64File * m64 = luam64_checkm64(L, 1);
+	int frame = (int)luaL_checkinteger(L, 2);
+	int c;
+	if (m64 == NULL) {
+		lua_pushnil(L);
+		return 1;
+	}
+	luaL_argcheck(L, frame >= 0 && frame < m64->count / m64->controllers, 2, "frame out of range");
+	luaL_checkstack(L, m64->controllers, "too many controllers");
+	for (c = 0; c < m64->controllers; c++)
+		lua_pushinteger(L, m64_sample(m64, frame * m64->controllers + c));
+	return m64->controllers;
+}
+
+static int luam64_getheader(lua_State *L) {
+	M64File * m64 = luam64_checkm64(L, 1);
+	const M64Header * header;
+	if (m64 == NULL) {
+		lua_pushnil(L);
+		return 1;
+	}
+	header = &m64->header;
+	lua_newtable(L);
+	lua_pushinteger(L, header->version);
+	lua_setfield(L, -2, "version");
+	lua_pushnumber(L, header->uid);
+	lua_setfield(L, -2, "uid");
+	lua_pushinteger(L, header->viCount);
+	lua_setfield(L, -2, "viCount");
+	lua_pushinteger(L, header->rerecords);
+	lua_setfield(L, -2, "rerecords");
+	lua_pushinteger(L, header->fps);
+	lua_setfield(L, -2, "fps");
+	lua_pushinteger(L, header->controllers);
+	lua_setfield(L, -2, "controllers");
+	lua_pushinteger(L, header->samples);
+	lua_setfield(L, -2, "samples");
+	lua_pushinteger(L, header->startType);
+	lua_setfield(L, -2, "startType");
+	lua_pushinteger(L, header->controllerFlags);
+	lua_setfield(L, -2, "controllerFlags");
+	lua_pushstring(L, header->romName);
+	lua_setfield(L, -2, "romName");
+	lua_pushnumber(L, header->romCrc);
+	lua_setfield(L, -2, "romCrc");
+	lua_pushinteger(L, header->countryCode);
+	lua_setfield(L, -2, "countryCode");
+	lua_pushstring(L, header->videoPlugin);
+	lua_setfield(L, -2, "videoPlugin");
+	lua_pushstring(L, header->soundPlugin);
+	lua_setfield(L, -2, "soundPlugin");
+	lua_pushstring(L, header->inputPlugin);
+	lua_setfield(L, -2, "inputPlugin");
+	lua_pushstring(L, header->rspPlugin);
+	lua_setfield(L, -2, "rspPlugin");
+	lua_pushstring(L, header->author);
+	lua_setfield(L, -2, "author");
+	lua_pushstring(L, header->description);
+	lua_setfield(L, -2, "description");
+	return 1;
+}
+
+static int push_m64(lua_State *L, M64File * m64);
+
+// m64:branch(frames): movie made of the first frames of this one. It
+// shares the mapping instead of copying them, and recordM64{ parent = branch }
+// only refers to them.
+static int luam64_branch(lua_State *L) {
+	M64File * m64 = luam64_checkm64(L, 1);
+	int frames = (int)luaL_checkinteger(L, 2);
+	M64File * branch;
+	if (m64 == NULL) {
+		lua_pushnil(L);
+		return 1;
+	}
+	luaL_argcheck(L, frames >= 0, 2, "negative frame count");
+
+	branch = (M64File *)malloc(sizeof(M64File));
+	if (branch == NULL) {
+		lua_pushnil(L);
+		return 1;
+	}
+	*branch = *m64;
+	branch->pos = 0;
+	if (frames * m64->controllers < m64->count)
+		branch->count = frames * m64->controllers;
+	branch->header.viCount = branch->count / branch->controllers;
+	branch->header.samples = branch->count;
+	branch->mapping->refs++;
+	return push_m64(L, branch);
+}
+
 static const luaL_Reg m64FileFuncs[] = {
 	{ "close", luam64_close },
 	{ "getPosition", luam64_getpos },
@@ -168,62 +596,23 @@ static const luaL_Reg m64FileFuncs[] = {
 	{ "isFinished", luam64_getfinished },
 	{ "getInputAt", luam64_getinputat },
 	{ "getNextInput", luam64_getnextinput },
+	{ "getInputCount", luam64_getinputcount },
+	{ "getFrameCount", luam64_getframecount },
+	{ "getControllerCount", luam64_getcontrollercount },
+	{ "getFrame", luam64_getframe },
+	{ "getHeader", luam64_getheader },
+	{ "branch", luam64_branch },
 	{ NULL, NULL }  /* sentinel */
 };
 
-int luam64_open(lua_State *L) {
-	M64File * m64;
-	M64List * newLink;
-	char signature[4];
-	int version;
-	int fLen = 0;
-	int readCount = 0;
-	int headerSize;
-
-	// Open file
-	FILE * f = fopen(luaL_checkstring(L, 2), "rb");
-	if (f == NULL) 
-		goto luam64_open_fail;
-
-	// Read file length
-	fseek(f, 0, SEEK_END);
-	fLen = ftell(f);
-	rewind(f);
-
-	// Verifiy version and signature
-	if (fLen < 8)
-		goto luam64_open_fail;
-	readCount += fread(signature, sizeof(char), 4, f);
-	readCount += fread(&version, sizeof(int), 1, f);
-	if (readCount != 5 || memcmp(signature, "M64\x1a", 4) != 0)
-		goto luam64_open_fail;
-	switch (version) {
-		case 1:
-		case 2:
-			headerSize = 0x200;
-			break;
-		case 3:
-			headerSize = 0x400;
-			break;
-		default:
-			goto luam64_open_fail;
-	}
-
-	// Skip header
-	fseek(f, headerSize, SEEK_SET);
-
-	// Buffer data
-	m64 = (M64File *)malloc(sizeof(M64File));
-	m64->inputs = malloc(fLen - headerSize);
-	m64->count = (fLen - headerSize) / sizeof(uint32_t);
-	m64->pos = 0;
-	if (fread(m64->inputs, sizeof(uint32_t), m64->count, f) != m64->count) {
+static int push_m64(lua_State *L, M64File * m64) {
+	// Add new linklist
+	M64List * newLink = (M64List *) malloc(sizeof(M64List));
+	if (newLink == NULL) {
 		freeM64(m64);
-		goto luam64_open_fail;
+		lua_pushnil(L);
+		return 1;
 	}
-
-	// Add new linklist
-	newLink = (M64List *) malloc(sizeof(M64List));
 	newLink->file = m64;
 	newLink->next = m64List;
 	newLink->prev = NULL;
@@ -237,14 +626,376 @@ int luam64_open(lua_State *L) {
 	lua_pushlightuserdata(L, m64);
 	lua_setfield(L, -2, LUA_M64_TABLE_BUFFER_FIELD);
 	return 1;
+}
+
+static M64File * open_m64(const char * path) {
+	M64File * m64 = (M64File *)malloc(sizeof(M64File));
+	if (m64 == NULL)
+		return NULL;
+
+	m64->mapping = open_mapping(path, &m64->header, 0);
+	if (m64->mapping == NULL) {
+		free(m64);
+		return NULL;
+	}
+	m64->count = m64->mapping->parentCount + m64->mapping->count;
+	m64->controllers = m64->header.controllers > 0 ? m64->header.controllers : 1;
+	m64->header.viCount = m64->count / m64->controllers;
+	m64->header.samples = m64->count;
+	m64->pos = 0;
+	return m64;
+}
+
+uint32_t * m64_read_frames(const char * path, int frames, int controllers) {
+	M64File * m64 = open_m64(path);
+	uint32_t * samples;
+	int frame, c, movieFrames, movieControllers;
+
+	if (m64 == NULL)
+		return NULL;
+	samples = (uint32_t *)calloc(frames * controllers, sizeof(uint32_t));
+	if (samples != NULL) {
+		movieFrames = m64->count / m64->controllers;
+		movieControllers = m64->controllers < controllers ? m64->controllers : controllers;
+		for (frame = 0; frame < frames && frame < movieFrames; frame++)
+			for (c = 0; c < movieControllers; c++)
+				samples[frame * controllers + c] = m64_sample(m64, frame * m64->controllers + c);
+	}
+	freeM64(m64);
+	return samples;
+}
+
+// Fuzzer:openM64(path): the file is mapped, not read
+int luam64_open(lua_State *L) {
+	M64File * m64 = open_m64(luaL_checkstring(L, 2));
+	if (m64 == NULL) {
+		lua_pushnil(L);
+		return 1;
+	}
+	return push_m64(L, m64);
+}
+
+/* ---- Recording ---- */
+
+struct M64Writer {
+	FILE * f;
+	M64Header header;
+	uint32_t samples;
+	unsigned int syncFrames;
+	unsigned int unsynced;
+};
+
+typedef struct M64WriterList {
+	M64Writer * writer;
+	struct M64WriterList * next;
+} M64WriterList;
+
+static M64WriterList * writerList = NULL;
+
+static void sync_file(FILE * f) {
+#ifdef WIN32
+	_commit(_fileno(f));
+#else
+	fsync(fileno(f));
+#endif
+}
+
+M64Writer * m64writer_open(const char * path, const M64Header * header, unsigned int syncFrames) {
+	unsigned char data[M64_HEADER_SIZE_V3];
+	M64Writer * writer = (M64Writer *)calloc(1, sizeof(M64Writer));
+	if (writer == NULL)
+		return NULL;
+
+	writer->f = fopen(path, "wb");
+	if (writer->f == NULL) {
+		free(writer);
+		return NULL;
+	}
+	setvbuf(writer->f, NULL, _IOFBF, 1 << 16);
+	writer->header = *header;
+	// keys and the frame buffer hold 4 controllers
+	if (writer->header.controllers == 0)
+		writer->header.controllers = 1;
+	else if (writer->header.controllers > 4)
+		writer->header.controllers = 4;
+	writer->syncFrames = syncFrames;
+
+	serialize_header(data, &writer->header, 0, 0);
+	if (fwrite(data, 1, sizeof(data), writer->f) != sizeof(data)) {
+		fclose(writer->f);
+		free(writer);
+		return NULL;
+	}
+	return writer;
+}
+
+static int m64writer_write_samples(M64Writer * writer, const unsigned char * samples, int count) {
+	if (fwrite(samples, sizeof(uint32_t), count, writer->f) != (size_t)count)
+		return 0;
+	writer->samples += count;
+	return 1;
+}
+
+int m64writer_write_frame(M64Writer * writer, const uint32_t * keys) {
+	unsigned char data[4 * sizeof(uint32_t)];
+	int c;
+
+	for (c = 0; c < writer->header.controllers; c++)
+		put_le32(data + c * sizeof(uint32_t), keys[c]);
+	if (!m64writer_write_samples(writer, data, writer->header.controllers))
+		return 0;
+	if (writer->syncFrames != 0 && ++writer->unsynced >= writer->syncFrames)
+		return m64writer_sync(writer);
+	return 1;
+}
+
+int m64writer_sync(M64Writer * writer) {
+	unsigned char data[4];
+	int ok = 1;
+
+	writer->unsynced = 0;
+	ok &= fflush(writer->f) == 0;
+
+	// Patch the counts in, the input data is only ever appended
+	put_le32(data, writer->samples / writer->header.controllers);
+	ok &= fseek(writer->f, 0x0c, SEEK_SET) == 0 && fwrite(data, 1, 4, writer->f) == 4;
+	put_le32(data, writer->samples);
+	ok &= fseek(writer->f, 0x18, SEEK_SET) == 0 && fwrite(data, 1, 4, writer->f) == 4;
+	ok &= fseek(writer->f, 0, SEEK_END) == 0;
+
+	ok &= fflush(writer->f) == 0;
+	sync_file(writer->f);
+	return ok;
+}
+
+int m64writer_close(M64Writer * writer) {
+	int ok = m64writer_sync(writer);
+	ok &= fclose(writer->f) == 0;
+	free(writer);
+	return ok;
+}
+
+static M64Writer * luam64_checkwriter(lua_State *L, int n) {
+	M64WriterList * find = writerList;
+	M64Writer * writer;
+
+	if (!lua_istable(L, n))
+		return NULL;
+	lua_getfield(L, n, LUA_M64_WRITER_FIELD);
+	writer = lua_islightuserdata(L, -1) ? (M64Writer *)lua_touserdata(L, -1) : NULL;
+	lua_pop(L, 1);
+
+	// Closed already
+	while (find != NULL && find->writer != writer)
+		find = find->next;
+	return find != NULL ? writer : NULL;
+}
+
+static int luam64_writer_close(lua_State *L) {
+	M64WriterList ** link = &writerList;
+	M64Writer * writer = luam64_checkwriter(L, 1);
+	if (writer == NULL)
+		return 0;
+
+	while ((*link)->writer != writer)
+		link = &(*link)->next;
+	{
+		M64WriterList * found = *link;
+		*link = found->next;
+		free(found);
+	}
+	lua_pushboolean(L, m64writer_close(writer));
+	return 1;
+}
 
-luam64_open_fail:
-	lua_pushnil(L);
+// recorder:write(p1, ...): appends one frame, missing controllers record 0
+static int luam64_writer_write(lua_State *L) {
+	uint32_t keys[4] = { 0 };
+	M64Writer * writer = luam64_checkwriter(L, 1);
+	int c;
+	if (writer == NULL)
+		return luaL_error(L, "movie recorder is closed");
+	for (c = 0; c < writer->header.controllers; c++)
+		keys[c] = (uint32_t)luaL_optinteger(L, 2 + c, 0);
+	lua_pushboolean(L, m64writer_write_frame(writer, keys));
+	return 1;
+}
+
+static int luam64_writer_sync(lua_State *L) {
+	M64Writer * writer = luam64_checkwriter(L, 1);
+	if (writer == NULL)
+		return luaL_error(L, "movie recorder is closed");
+	lua_pushboolean(L, m64writer_sync(writer));
+	return 1;
+}
+
+static int luam64_writer_getframecount(lua_State *L) {
+	M64Writer * writer = luam64_checkwriter(L, 1);
+	if (writer == NULL) {
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_pushinteger(L, writer->samples / writer->header.controllers);
+	return 1;
+}
+
+static const luaL_Reg m64WriterFuncs[] = {
+	{ "write", luam64_writer_write },
+	{ "sync", luam64_writer_sync },
+	{ "getFrameCount", luam64_writer_getframecount },
+	{ "close", luam64_writer_close },
+	{ NULL, NULL }  /* sentinel */
+};
+
+static void optfield_string(lua_State *L, int t, const char * name, char * dst, size_t size) {
+	lua_getfield(L, t, name);
+	if (!lua_isnil(L, -1)) {
+		strncpy(dst, luaL_checkstring(L, -1), size - 1);
+		dst[size - 1] = '\0';
+	}
+	lua_pop(L, 1);
+}
+
+static lua_Integer optfield_integer(lua_State *L, int t, const char * name, lua_Integer def) {
+	lua_Integer value;
+	lua_getfield(L, t, name);
+	value = lua_isnil(L, -1) ? def : luaL_checkinteger(L, -1);
+	lua_pop(L, 1);
+	return value;
+}
+
+// Truncating a movie which is still mapped would pull its pages from under
+// the readers (SIGBUS). Windows refuses to open it for writing anyway.
+static int is_mapped(const char * path) {
+#ifdef WIN32
+	return 0;
+#else
+	struct stat st;
+	M64List * link;
+	if (stat(path, &st) != 0)
+		return 0;
+	for (link = m64List; link != NULL; link = link->next) {
+		const M64Mapping * mapping;
+		for (mapping = link->file->mapping; mapping != NULL; mapping = mapping->parent) {
+			if (mapping->dev == st.st_dev && mapping->ino == st.st_ino)
+				return 1;
+		}
+	}
+	return 0;
+#endif
+}
+
+// Writes the parent reference of a recording, or removes a stale one
+static int write_parent_ref(const char * path, const M64File * parent) {
+	char * refPath = parent_ref_path(path);
+	FILE * f;
+	int ok;
+
+	if (refPath == NULL)
+		return 0;
+	if (parent == NULL) {
+		remove(refPath);
+		free(refPath);
+		return 1;
+	}
+	f = fopen(refPath, "w");
+	free(refPath);
+	if (f == NULL)
+		return 0;
+	ok = fprintf(f, "%d %s\n", parent->count / parent->controllers, parent->mapping->path) > 0;
+	ok &= fflush(f) == 0;
+	sync_file(f);
+	ok &= fclose(f) == 0;
+	return ok;
+}
+
+// Fuzzer:recordM64(path, { controllers=1, start="snapshot", author="", description="",
+//                          sync=600, parent=m64 })
+// sync is the number of frames between fsyncs, 0 only syncs on close. A
+// parent movie (or a branch of one) gives its header and its frames, which
+// are not copied: the file only holds the new frames and "<path>.parent"
+// names the parent (by the path it was opened with) and how many of its
+// frames come first. Openers of the movie resolve that reference, so the
+// parent file must stay where it is and must not be recorded over.
+int luam64_record(lua_State *L) {
+	static const char * const startTypes[] = { "snapshot", "poweron", "eeprom", NULL };
+	static const int startValues[] = { M64_START_SNAPSHOT, M64_START_POWERON, M64_START_EEPROM };
+	const char * path = luaL_checkstring(L, 2);
+	M64File * parent = NULL;
+	M64Header header;
+	M64Writer * writer;
+	M64WriterList * link;
+	unsigned int syncFrames = 600;
+	int options = !lua_isnoneornil(L, 3);
+
+	if (options) {
+		luaL_checktype(L, 3, LUA_TTABLE);
+		lua_getfield(L, 3, "parent");
+		parent = luam64_checkm64(L, lua_gettop(L));
+		lua_pop(L, 1);
+	}
+
+	if (parent != NULL) {
+		header = parent->header;
+		header.version = 3;
+		header.controllers = (uint8_t)parent->controllers;
+	}
+	else {
+		int controllers = options ? (int)optfield_integer(L, 3, "controllers", 1) : 1;
+		int start = 0;
+		luaL_argcheck(L, controllers >= 1 && controllers <= 4, 3, "controllers must be 1 to 4");
+		if (options) {
+			lua_getfield(L, 3, "start");
+			start = luaL_checkoption(L, lua_gettop(L), "snapshot", startTypes);
+			lua_pop(L, 1);
+		}
+		m64_default_header(&header, controllers, startValues[start]);
+	}
+	if (options) {
+		optfield_string(L, 3, "author", header.author, sizeof(header.author));
+		optfield_string(L, 3, "description", header.description, sizeof(header.description));
+		syncFrames = (unsigned int)optfield_integer(L, 3, "sync", syncFrames);
+	}
+
+	if (is_mapped(path))
+		return luaL_error(L, "cannot record over an open movie: %s", path);
+
+	writer = m64writer_open(path, &header, syncFrames);
+	if (writer == NULL) {
+		lua_pushnil(L);
+		return 1;
+	}
+	if (!write_parent_ref(path, parent)) {
+		m64writer_close(writer);
+		lua_pushnil(L);
+		return 1;
+	}
+
+	link = (M64WriterList *)malloc(sizeof(M64WriterList));
+	if (link == NULL) {
+		m64writer_close(writer);
+		lua_pushnil(L);
+		return 1;
+	}
+	link->writer = writer;
+	link->next = writerList;
+	writerList = link;
+
+	lua_newtable(L);
+	luaL_setfuncs(L, m64WriterFuncs, 0);
+	lua_pushlightuserdata(L, writer);
+	lua_setfield(L, -2, LUA_M64_WRITER_FIELD);
 	return 1;
 }
 
 int luaclose_fuzzerm64inputs(lua_State * L) {
-	// Free all data
+	// Free all data, recordings left open are completed
 	freeM64List();
+	while (writerList != NULL) {
+		M64WriterList * next = writerList->next;
+		m64writer_close(writerList->writer);
+		free(writerList);
+		writerList = next;
+	}
 	return 1;
-}
\ No newline at end of file
+}
@@ -1,9 +1,57 @@
 #ifndef FUZZER_M64_INPUTS_H_INCLUDED
 #define FUZZER_M64_INPUTS_H_INCLUDED
 
+#include <stdint.h>
 #include <lua.h>
 
+// .m64 movies: a header followed by one 32-bit BUTTONS sample per present
+// controller per frame. Version 1 and 2 headers are 0x200 bytes, version 3
+// (the only one written) 0x400 bytes. Everything is little endian.
+
+#define M64_START_SNAPSHOT 1
+#define M64_START_POWERON  2
+#define M64_START_EEPROM   4
+
+typedef struct M64Header {
+	uint32_t version;
+	uint32_t uid;
+	uint32_t viCount;
+	uint32_t rerecords;
+	uint8_t fps;
+	uint8_t controllers;
+	uint32_t samples;
+	uint16_t startType;
+	uint32_t controllerFlags;
+	char romName[33];
+	uint32_t romCrc;
+	uint16_t countryCode;
+	char videoPlugin[65];
+	char soundPlugin[65];
+	char inputPlugin[65];
+	char rspPlugin[65];
+	char author[223];
+	char description[257];
+} M64Header;
+
+// Header for a new movie of the current ROM
+void m64_default_header(M64Header * header, int controllers, int startType);
+
+// The first frames of a movie as frames * controllers samples, frames and
+// controllers the movie doesn't have are 0. NULL if path isn't a movie.
+uint32_t * m64_read_frames(const char * path, int frames, int controllers);
+
+// Buffered append-only writer. The frame and sample counts of the header
+// are patched in on every sync, so that a file cut short by a crash is
+// still a valid movie up to its last sync.
+typedef struct M64Writer M64Writer;
+
+M64Writer * m64writer_open(const char * path, const M64Header * header, unsigned int syncFrames);
+int m64writer_write_frame(M64Writer * writer, const uint32_t * keys);
+int m64writer_sync(M64Writer * writer);
+int m64writer_close(M64Writer * writer);
+
 int luam64_open(lua_State *L);
+int luam64_record(lua_State *L);
 int luaclose_fuzzerm64inputs(lua_State *L);
 
-#endif
\ No newline at end of file
+#endif
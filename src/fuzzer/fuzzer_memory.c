@@ -4,6 +4,8 @@
 #include <lualib.h>
 #include "fuzzer\fuzzer_lualib.h"
 #include "main\main.h"
+#include "main\cheat.h"
+#include "main\ram_search.h"
 #include "device\memory\memory.h"
 #include "fuzzer\luaext.h"
 
@@ -11,37 +13,355 @@ typedef uint16_t hword;
 typedef uint32_t word;
 typedef uint64_t dword;
 
-#define luamem(T, lookup, luaType, luaExplictType) \
+#define RDRAM_VIEW_METATABLE "Fuzzer.RDRAMView"
+#define CHEAT_SET_METATABLE "Fuzzer.CheatSet"
+
+// Offset in RDRAM of a KSEG0/KSEG1 address range, -1 if it isn't all RDRAM.
+// Other addresses go through the memory dispatch tables.
+static int64_t rdram_offset(uint32_t address, uint32_t size) {
+	if ((address & 0xc0000000) != 0x80000000)
+		return -1;
+	address &= 0x1fffffff;
+	if (address > g_dev.ri.rdram.dram_size || size > g_dev.ri.rdram.dram_size - address)
+		return -1;
+	return address;
+}
+
+// RDRAM is stored as host-endian words, S8/S16 give the byte swizzle
+static uint8_t rdram_byte(uint32_t offset) {
+	return ((const uint8_t *)g_dev.ri.rdram.dram)[offset ^ S8];
+}
+
+// Read through the dispatch table without clobbering the core's
+// address and rdword globals
+static uint64_t dispatch_read(uint32_t address, void (*read)(void)) {
+	uint32_t savedAddress = *memory_address();
+	uint64_t * savedRdword = g_dev.mem.rdword;
+	uint64_t raw = 0;
+
+	*memory_address() = address;
+	g_dev.mem.rdword = &raw;
+	read();
+	*memory_address() = savedAddress;
+	g_dev.mem.rdword = savedRdword;
+	return raw;
+}
+
+static uint8_t read8(uint32_t address) {
+	int64_t offset = rdram_offset(address, 1);
+	if (offset >= 0)
+		return rdram_byte((uint32_t)offset);
+	return (uint8_t)dispatch_read(address, g_dev.mem.readmemb[address >> 16]);
+}
+
+static uint16_t read16(uint32_t address) {
+	int64_t offset = rdram_offset(address, 2);
+	if (offset >= 0 && (offset & 1) == 0)
+		return *(const uint16_t *)((const uint8_t *)g_dev.ri.rdram.dram + (offset ^ S16));
+	return (uint16_t)dispatch_read(address, g_dev.mem.readmemh[address >> 16]);
+}
+
+static uint32_t read32(uint32_t address) {
+	int64_t offset = rdram_offset(address, 4);
+	if (offset >= 0 && (offset & 3) == 0)
+		return g_dev.ri.rdram.dram[offset >> 2];
+	return (uint32_t)dispatch_read(address, g_dev.mem.readmem[address >> 16]);
+}
+
+static uint64_t read64(uint32_t address) {
+	int64_t offset = rdram_offset(address, 8);
+	if (offset >= 0 && (offset & 3) == 0)
+		return ((uint64_t)g_dev.ri.rdram.dram[offset >> 2] << 32) | g_dev.ri.rdram.dram[(offset >> 2) + 1];
+	return dispatch_read(address, g_dev.mem.readmemd[address >> 16]);
+}
+
+// Writes still go through the dispatch table, which takes care of
+// invalidating recompiled code
+#define luamem(T, bits, lookup, luaType, luaExplictType) \
 static int lua_get##T (lua_State *L) { \
-	uint64_t raw; \
-	*memory_address() = (uint32_t)luaL_checkinteger(L, 2); \
-	g_dev.mem.rdword = &raw; \
-	read_##lookup##_in_memory(); \
+	uint##bits##_t raw = read##bits((uint32_t)luaL_checkinteger(L, 2)); \
 	lua_push##luaType(L, (luaExplictType) *((T *) &raw)); \
 	return 1; \
 } \
 \
 static int lua_set##T (lua_State *L) { \
 	T value = (T)luaL_check##luaType(L, 3); \
+	uint32_t savedAddress = *memory_address(); \
 	*memory_address() = (uint32_t)luaL_checkinteger(L, 2); \
 	*memory_w##lookup() = *((lookup *)&value); \
 	write_##lookup##_in_memory(); \
+	*memory_address() = savedAddress; \
 	return 0; \
 } 
 
-luamem(int8_t, byte, integer, lua_Integer)
-luamem(uint8_t, byte, integer, lua_Integer)
-luamem(int16_t, hword, integer, lua_Integer)
-luamem(uint16_t, hword, integer, lua_Integer)
-luamem(int32_t, word, integer, lua_Integer)
-luamem(uint32_t, word, integer, lua_Integer)
-luamem(int64_t, dword, number, lua_Number)
-luamem(uint64_t, dword, number, lua_Number)
-luamem(float, word, number, lua_Number)
-luamem(double, dword, number, lua_Number)
+luamem(int8_t, 8, byte, integer, lua_Integer)
+luamem(uint8_t, 8, byte, integer, lua_Integer)
+luamem(int16_t, 16, hword, integer, lua_Integer)
+luamem(uint16_t, 16, hword, integer, lua_Integer)
+luamem(int32_t, 32, word, integer, lua_Integer)
+luamem(uint32_t, 32, word, integer, lua_Integer)
+luamem(int64_t, 64, dword, number, lua_Number)
+luamem(uint64_t, 64, dword, number, lua_Number)
+luamem(float, 32, word, number, lua_Number)
+luamem(double, 64, dword, number, lua_Number)
+
+// Bulk accessors, RDRAM only (KSEG0/KSEG1 addresses). Bytes are in N64 order.
+
+static uint32_t check_rdram_range(lua_State *L, int arg, uint32_t address, uint32_t length) {
+	int64_t offset = rdram_offset(address, length);
+	luaL_argcheck(L, offset >= 0, arg, "range outside RDRAM");
+	return (uint32_t)offset;
+}
+
+// Fuzzer:readBlock(address, length): the bytes as a string
+static int lua_readblock(lua_State *L) {
+	uint32_t address = (uint32_t)luaL_checkinteger(L, 2);
+	uint32_t length = (uint32_t)luaL_checkinteger(L, 3);
+	uint32_t offset = check_rdram_range(L, 2, address, length);
+	luaL_Buffer b;
+	uint32_t i;
+
+	luaL_buffinit(L, &b);
+	for (i = 0; i < length; i++)
+		luaL_addchar(&b, (char)rdram_byte(offset + i));
+	luaL_pushresult(&b);
+	return 1;
+}
+
+// Fuzzer:compare(address, bytes): nil if memory matches the string,
+// otherwise the offset of the first differing byte
+static int lua_compare(lua_State *L) {
+	uint32_t address = (uint32_t)luaL_checkinteger(L, 2);
+	size_t length;
+	const char * bytes = luaL_checklstring(L, 3, &length);
+	uint32_t offset = check_rdram_range(L, 2, address, (uint32_t)length);
+	uint32_t i;
+
+	for (i = 0; i < length; i++) {
+		if (rdram_byte(offset + i) != (uint8_t)bytes[i]) {
+			lua_pushinteger(L, i);
+			return 1;
+		}
+	}
+	lua_pushnil(L);
+	return 1;
+}
+
+// Fuzzer:search(address, length, bytes): address of the first occurrence
+// of the string in [address, address + length), nil if not found
+static int lua_search(lua_State *L) {
+	uint32_t address = (uint32_t)luaL_checkinteger(L, 2);
+	uint32_t length = (uint32_t)luaL_checkinteger(L, 3);
+	size_t patternLength;
+	const uint8_t * pattern = (const uint8_t *)luaL_checklstring(L, 4, &patternLength);
+	uint32_t offset = check_rdram_range(L, 2, address, length);
+	uint32_t i, j;
+
+	if (patternLength == 0 || patternLength > length) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	for (i = 0; i <= length - patternLength; i++) {
+		if (rdram_byte(offset + i) != pattern[0])
+			continue;
+		for (j = 1; j < patternLength && rdram_byte(offset + i + j) == pattern[j]; j++)
+			;
+		if (j == patternLength) {
+			lua_pushinteger(L, address + i);
+			return 1;
+		}
+	}
+	lua_pushnil(L);
+	return 1;
+}
+
+// Fuzzer:hash(address, length): 32-bit FNV-1a of the range
+static int lua_hash(lua_State *L) {
+	uint32_t address = (uint32_t)luaL_checkinteger(L, 2);
+	uint32_t length = (uint32_t)luaL_checkinteger(L, 3);
+	uint32_t offset = check_rdram_range(L, 2, address, length);
+	uint32_t hash = 0x811c9dc5;
+	uint32_t i;
+
+	for (i = 0; i < length; i++)
+		hash = (hash ^ rdram_byte(offset + i)) * 0x01000193;
+	lua_pushnumber(L, hash);
+	return 1;
+}
+
+// Typed read-only view of RDRAM: Fuzzer:view(address, count, type) where
+// type is one of "u8", "s8", "u16", "s16", "u32", "s32", "float".
+// view[1] is the element at address, #view is count.
+enum rdram_view_type { VIEW_U8, VIEW_S8, VIEW_U16, VIEW_S16, VIEW_U32, VIEW_S32, VIEW_FLOAT };
+
+static const char * viewTypeNames[] = { "u8", "s8", "u16", "s16", "u32", "s32", "float", NULL };
+static const uint32_t viewTypeSizes[] = { 1, 1, 2, 2, 4, 4, 4 };
+
+typedef struct RDRAMView {
+	uint32_t offset;
+	uint32_t count;
+	int type;
+} RDRAMView;
+
+static int lua_view(lua_State *L) {
+	uint32_t address = (uint32_t)luaL_checkinteger(L, 2);
+	uint32_t count = (uint32_t)luaL_checkinteger(L, 3);
+	int type = luaL_checkoption(L, 4, "u32", viewTypeNames);
+	uint32_t offset;
+	RDRAMView * view;
+
+	luaL_argcheck(L, (address & (viewTypeSizes[type] - 1)) == 0, 2, "unaligned address");
+	luaL_argcheck(L, count <= g_dev.ri.rdram.dram_size / viewTypeSizes[type], 3, "too many elements");
+	offset = check_rdram_range(L, 2, address, count * viewTypeSizes[type]);
+
+	view = (RDRAMView *)lua_newuserdata(L, sizeof(RDRAMView));
+	view->offset = offset;
+	view->count = count;
+	view->type = type;
+	luaL_getmetatable(L, RDRAM_VIEW_METATABLE);
+	lua_setmetatable(L, -2);
+	return 1;
+}
+
+static int lua_view_index(lua_State *L) {
+	RDRAMView * view = (RDRAMView *)luaL_checkudata(L, 1, RDRAM_VIEW_METATABLE);
+	lua_Integer i = luaL_checkinteger(L, 2);
+	uint32_t offset;
+	uint32_t value;
+
+	if (i < 1 || (lua_Integer)view->count < i) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	offset = view->offset + (uint32_t)(i - 1) * viewTypeSizes[view->type];
+	switch (view->type) {
+	case VIEW_U8: lua_pushinteger(L, rdram_byte(offset)); break;
+	case VIEW_S8: lua_pushinteger(L, (int8_t)rdram_byte(offset)); break;
+	case VIEW_U16: lua_pushinteger(L, *(const uint16_t *)((const uint8_t *)g_dev.ri.rdram.dram + (offset ^ S16))); break;
+	case VIEW_S16: lua_pushinteger(L, *(const int16_t *)((const uint8_t *)g_dev.ri.rdram.dram + (offset ^ S16))); break;
+	case VIEW_U32: lua_pushnumber(L, g_dev.ri.rdram.dram[offset >> 2]); break;
+	case VIEW_S32: lua_pushinteger(L, (int32_t)g_dev.ri.rdram.dram[offset >> 2]); break;
+	default:
+		value = g_dev.ri.rdram.dram[offset >> 2];
+		lua_pushnumber(L, *(float *)&value);
+		break;
+	}
+	return 1;
+}
+
+static int lua_view_len(lua_State *L) {
+	RDRAMView * view = (RDRAMView *)luaL_checkudata(L, 1, RDRAM_VIEW_METATABLE);
+	lua_pushinteger(L, view->count);
+	return 1;
+}
 
 // TODO: set flag
 
+// Fuzzer:getRDRAM(): RDRAM as a light userdata and its size, for direct
+// access through LuaJIT's FFI, e.g. ffi.cast("uint32_t*", ptr).
+// RDRAM is kept as host-endian 32-bit words: on little-endian hosts bytes
+// are found at address ^ 3 and halfwords at address ^ 2.
+static int lua_getrdram(lua_State *L) {
+	lua_pushlightuserdata(L, g_dev.ri.rdram.dram);
+	lua_pushinteger(L, (lua_Integer)g_dev.ri.rdram.dram_size);
+	return 2;
+}
+
+// RAM search, see main/ram_search.h. Types are the same as for views.
+static const char * searchOpNames[] = { "eq", "ne", "lt", "gt", "changed", "unchanged", "increased", "decreased", NULL };
+
+// Fuzzer:ramSearchStart(type): every aligned value of RDRAM becomes a candidate
+static int lua_ramsearchstart(lua_State *L) {
+	int type = luaL_checkoption(L, 2, "u32", viewTypeNames);
+	m64p_error err = ram_search_start((m64p_ram_search_type)type);
+	if (err != M64ERR_SUCCESS)
+		return luaL_error(L, "could not start RAM search (error %d)", (int)err);
+	return 0;
+}
+
+// Fuzzer:ramSearchFilter(op, value): keep the candidates passing the test,
+// returns how many are left. value is only used by eq, ne, lt and gt, the
+// others compare with the previous filter.
+static int lua_ramsearchfilter(lua_State *L) {
+	int op = luaL_checkoption(L, 2, NULL, searchOpNames);
+	double value = luaL_optnumber(L, 3, 0);
+	lua_pushinteger(L, (lua_Integer)ram_search_filter((m64p_ram_search_op)op, value));
+	return 1;
+}
+
+// Fuzzer:ramSearchResults(first, max): addresses and current values of the
+// candidates first to first + max - 1, as two arrays
+static int lua_ramsearchresults(lua_State *L) {
+	lua_Integer first = luaL_optinteger(L, 2, 1);
+	lua_Integer max = luaL_optinteger(L, 3, 100);
+	m64p_ram_search_result * results;
+	size_t i, count;
+
+	luaL_argcheck(L, first >= 1, 2, "must be at least 1");
+	luaL_argcheck(L, max >= 0 && max <= 0x100000, 3, "out of range");
+	results = (m64p_ram_search_result *)lua_newuserdata(L, (size_t)max * sizeof(m64p_ram_search_result) + 1);
+	count = ram_search_results((size_t)(first - 1), results, (size_t)max);
+
+	lua_createtable(L, (int)count, 0);
+	lua_createtable(L, (int)count, 0);
+	for (i = 0; i < count; i++) {
+		lua_pushinteger(L, results[i].address);
+		lua_rawseti(L, -3, (lua_Integer)i + 1);
+		lua_pushnumber(L, results[i].value);
+		lua_rawseti(L, -2, (lua_Integer)i + 1);
+	}
+	return 2;
+}
+
+// Fuzzer:ramSearchCheat(name, address, value): add an enabled cheat forcing
+// value at address, with the type of the current search
+static int lua_ramsearchcheat(lua_State *L) {
+	const char * name = luaL_checkstring(L, 2);
+	uint32_t address = (uint32_t)luaL_checkinteger(L, 3);
+	double value = luaL_checknumber(L, 4);
+	m64p_cheat_code codes[2];
+	int count = ram_search_cheat_codes(address, value, codes);
+
+	lua_pushboolean(L, count > 0 && cheat_add_new(name, codes, count));
+	return 1;
+}
+
+static int lua_ramsearchstop(lua_State *L) {
+	ram_search_stop();
+	return 0;
+}
+
+// Fuzzer:cheatSetCapture(): precompiled copy of the current cheats, nil on
+// failure. Installing it again skips parsing, e.g. to give each fork server
+// worker its own set.
+static int lua_cheatsetcapture(lua_State *L) {
+	struct cheat_set ** set = (struct cheat_set **)lua_newuserdata(L, sizeof(struct cheat_set *));
+	*set = cheat_set_capture();
+	if (*set == NULL) {
+		lua_pushnil(L);
+		return 1;
+	}
+	luaL_getmetatable(L, CHEAT_SET_METATABLE);
+	lua_setmetatable(L, -2);
+	return 1;
+}
+
+// Fuzzer:cheatSetInstall(set): replace the current cheats with the set
+static int lua_cheatsetinstall(lua_State *L) {
+	struct cheat_set ** set = (struct cheat_set **)luaL_checkudata(L, 2, CHEAT_SET_METATABLE);
+	lua_pushboolean(L, cheat_set_install(*set));
+	return 1;
+}
+
+static int lua_cheatset_gc(lua_State *L) {
+	struct cheat_set ** set = (struct cheat_set **)luaL_checkudata(L, 1, CHEAT_SET_METATABLE);
+	cheat_set_free(*set);
+	*set = NULL;
+	return 0;
+}
+
 static const luaL_Reg memoryFuncs[] = {
 	{ "setChar", lua_setint8_t },
 	{ "setByte", lua_setuint8_t },
@@ -63,10 +383,35 @@ static const luaL_Reg memoryFuncs[] = {
 	{ "getULong", lua_getuint64_t },
 	{ "getFloat", lua_getfloat },
 	{ "getDouble", lua_getdouble },
+	{ "getRDRAM", lua_getrdram },
+	{ "readBlock", lua_readblock },
+	{ "compare", lua_compare },
+	{ "search", lua_search },
+	{ "hash", lua_hash },
+	{ "view", lua_view },
+	{ "ramSearchStart", lua_ramsearchstart },
+	{ "ramSearchFilter", lua_ramsearchfilter },
+	{ "ramSearchResults", lua_ramsearchresults },
+	{ "ramSearchCheat", lua_ramsearchcheat },
+	{ "ramSearchStop", lua_ramsearchstop },
+	{ "cheatSetCapture", lua_cheatsetcapture },
+	{ "cheatSetInstall", lua_cheatsetinstall },
 	{ NULL, NULL }  /* sentinel */
 };
 
 int luaopen_fuzzermemory(lua_State *L) {
+	luaL_newmetatable(L, RDRAM_VIEW_METATABLE);
+	lua_pushcfunction(L, lua_view_index);
+	lua_setfield(L, -2, "__index");
+	lua_pushcfunction(L, lua_view_len);
+	lua_setfield(L, -2, "__len");
+	lua_pop(L, 1);
+
+	luaL_newmetatable(L, CHEAT_SET_METATABLE);
+	lua_pushcfunction(L, lua_cheatset_gc);
+	lua_setfield(L, -2, "__gc");
+	lua_pop(L, 1);
+
 	luaL_setfuncs(L, memoryFuncs, 0);
 	return 1;
 }
\ No newline at end of file
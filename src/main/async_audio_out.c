@@ -0,0 +1,285 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - main/async_audio_out.c                                  *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "async_audio_out.h"
+
+#include <SDL.h>
+#include <SDL_thread.h>
+#include <string.h>
+
+#include "api/callbacks.h"
+#include "api/m64p_types.h"
+#include "backends/audio_out_backend.h"
+#include "osal/preproc.h"
+
+enum async_audio_record_type
+{
+    RECORD_PADDING,
+    RECORD_FORMAT,
+    RECORD_SAMPLES,
+    RECORD_QUIT
+};
+
+/* record header, followed by size bytes of payload.
+ * Records are kept 16 bytes aligned, and never wrap around the ring end. */
+struct async_audio_record
+{
+    uint32_t type;
+    uint32_t size;
+    uint32_t frequency;
+    uint32_t bits;
+};
+
+ALIGN(16, uint8_t g_async_audio_ring[ASYNC_AUDIO_RING_SIZE]);
+
+
+#if defined(WIN32) && !defined(__MINGW32__)
+#include <intrin.h>
+/* x86/x64 only: plain accesses are already acquire/release,
+ * only compiler reordering has to be prevented */
+static osal_inline size_t load_acquire(const size_t* p)
+{
+    size_t v = *(const volatile size_t*)p;
+    _ReadWriteBarrier();
+    return v;
+}
+
+static osal_inline void store_release(size_t* p, size_t v)
+{
+    _ReadWriteBarrier();
+    *(volatile size_t*)p = v;
+}
+#else
+static osal_inline size_t load_acquire(const size_t* p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static osal_inline void store_release(size_t* p, size_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+#endif
+
+static size_t record_length(size_t size)
+{
+    return (sizeof(struct async_audio_record) + size + 15) & ~(size_t)15;
+}
+
+/* Consume one record. Returns 0 when the quit record is reached. */
+static int consume_record(struct async_audio_out* aaout)
+{
+    size_t tail = aaout->tail;
+    const struct async_audio_record* rec =
+        (const struct async_audio_record*)&g_async_audio_ring[tail & (ASYNC_AUDIO_RING_SIZE - 1)];
+    int running = 1;
+
+    switch(rec->type)
+    {
+    case RECORD_FORMAT:
+        audio_out_set_format(aaout->target, rec->frequency, rec->bits);
+        break;
+    case RECORD_SAMPLES:
+        audio_out_push_samples(aaout->target, rec + 1, rec->size);
+        store_release(&aaout->consumed, aaout->consumed + 1);
+        break;
+    case RECORD_QUIT:
+        running = 0;
+        break;
+    default:
+        break;
+    }
+
+    store_release(&aaout->tail, tail + record_length(rec->size));
+
+    if (aaout->thread != NULL)
+        SDL_SemPost(aaout->space_avail);
+
+    return running;
+}
+
+static int async_audio_out_thread(void* data)
+{
+    struct async_audio_out* aaout = (struct async_audio_out*)data;
+
+    do
+    {
+        SDL_SemWait(aaout->data_avail);
+    } while(consume_record(aaout));
+
+    return 0;
+}
+
+static int has_room(const struct async_audio_out* aaout, size_t needed, int samples)
+{
+    size_t used = aaout->head - load_acquire(&aaout->tail);
+
+    if (ASYNC_AUDIO_RING_SIZE - used < needed)
+        return 0;
+
+    if (samples && aaout->max_pending != 0
+     && aaout->produced - load_acquire(&aaout->consumed) >= aaout->max_pending)
+        return 0;
+
+    return 1;
+}
+
+static void commit_record(struct async_audio_out* aaout, size_t length)
+{
+    store_release(&aaout->head, aaout->head + length);
+
+    /* without audio thread, records are consumed right away */
+    if (aaout->thread == NULL)
+        consume_record(aaout);
+    else
+        SDL_SemPost(aaout->data_avail);
+}
+
+/* Reserve room for a record of size bytes of payload.
+ * Blocks while the audio thread lags too much behind. */
+static struct async_audio_record* reserve_record(struct async_audio_out* aaout, uint32_t type, size_t size)
+{
+    size_t length = record_length(size);
+    size_t offset, padding;
+    struct async_audio_record* rec;
+
+    for(;;)
+    {
+        offset = aaout->head & (ASYNC_AUDIO_RING_SIZE - 1);
+        padding = (offset + length > ASYNC_AUDIO_RING_SIZE)
+                ? ASYNC_AUDIO_RING_SIZE - offset
+                : 0;
+
+        if (has_room(aaout, padding + length, type == RECORD_SAMPLES))
+            break;
+
+        SDL_SemWait(aaout->space_avail);
+    }
+
+    /* skip the end of the ring, so payload stays contiguous */
+    if (padding != 0)
+    {
+        rec = (struct async_audio_record*)&g_async_audio_ring[offset];
+        rec->type = RECORD_PADDING;
+        rec->size = (uint32_t)(padding - sizeof(*rec));
+        commit_record(aaout, padding);
+        offset = 0;
+    }
+
+    rec = (struct async_audio_record*)&g_async_audio_ring[offset];
+    rec->type = type;
+    rec->size = (uint32_t)size;
+    rec->frequency = 0;
+    rec->bits = 0;
+
+    return rec;
+}
+
+
+int init_async_audio_out(struct async_audio_out* aaout,
+                         struct audio_out_backend* target,
+                         size_t max_pending)
+{
+    memset(aaout, 0, sizeof(*aaout));
+    aaout->target = target;
+    aaout->max_pending = max_pending;
+
+    aaout->data_avail = SDL_CreateSemaphore(0);
+    aaout->space_avail = SDL_CreateSemaphore(0);
+    if (aaout->data_avail == NULL || aaout->space_avail == NULL)
+    {
+        DebugMessage(M64MSG_WARNING, "Could not create audio thread semaphores, audio samples will be pushed synchronously");
+        release_async_audio_out(aaout);
+        aaout->target = target;
+        return -1;
+    }
+
+#if SDL_VERSION_ATLEAST(2,0,0)
+    aaout->thread = SDL_CreateThread(async_audio_out_thread, "m64paudio", aaout);
+#else
+    aaout->thread = SDL_CreateThread(async_audio_out_thread, aaout);
+#endif
+    if (aaout->thread == NULL)
+    {
+        DebugMessage(M64MSG_WARNING, "Could not create audio thread, audio samples will be pushed synchronously");
+        return -1;
+    }
+
+    return 0;
+}
+
+void release_async_audio_out(struct async_audio_out* aaout)
+{
+    int status;
+
+    /* let the audio thread drain the ring before quitting */
+    if (aaout->thread != NULL)
+    {
+        reserve_record(aaout, RECORD_QUIT, 0);
+        commit_record(aaout, record_length(0));
+        SDL_WaitThread(aaout->thread, &status);
+        aaout->thread = NULL;
+    }
+
+    if (aaout->data_avail != NULL)
+        SDL_DestroySemaphore(aaout->data_avail);
+    if (aaout->space_avail != NULL)
+        SDL_DestroySemaphore(aaout->space_avail);
+
+    memset(aaout, 0, sizeof(*aaout));
+}
+
+size_t async_audio_out_pending(const struct async_audio_out* aaout)
+{
+    return aaout->produced - load_acquire(&aaout->consumed);
+}
+
+
+void set_audio_format_via_async_audio_out(void* user_data, unsigned int frequency, unsigned int bits)
+{
+    struct async_audio_out* aaout = (struct async_audio_out*)user_data;
+    struct async_audio_record* rec = reserve_record(aaout, RECORD_FORMAT, 0);
+
+    rec->frequency = frequency;
+    rec->bits = bits;
+
+    commit_record(aaout, record_length(0));
+}
+
+void push_audio_samples_via_async_audio_out(void* user_data, const void* buffer, size_t size)
+{
+    struct async_audio_out* aaout = (struct async_audio_out*)user_data;
+    struct async_audio_record* rec;
+
+    if (record_length(size) > ASYNC_AUDIO_RING_SIZE)
+    {
+        DebugMessage(M64MSG_WARNING, "Audio buffer of %u bytes too large for audio thread, dropping it", (unsigned int)size);
+        return;
+    }
+
+    rec = reserve_record(aaout, RECORD_SAMPLES, size);
+
+    /* samples keep their RDRAM word layout */
+    memcpy(rec + 1, buffer, size);
+    aaout->produced += 1;
+
+    commit_record(aaout, record_length(size));
+}
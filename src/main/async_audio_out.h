@@ -0,0 +1,74 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - main/async_audio_out.h                                  *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_MAIN_ASYNC_AUDIO_OUT_H
+#define M64P_MAIN_ASYNC_AUDIO_OUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct SDL_Thread;
+struct SDL_semaphore;
+struct audio_out_backend;
+
+/* must be a power of two, and large enough for the largest AI DMA */
+#define ASYNC_AUDIO_RING_SIZE 0x100000
+
+/* Ring storage. Also given to a threaded audio plugin as its RDRAM view,
+ * so that queued samples can be handed over without another copy. */
+extern uint8_t g_async_audio_ring[ASYNC_AUDIO_RING_SIZE];
+
+/* Lock-free single producer / single consumer ring of audio records
+ * (samples and format changes) written by the emulation thread
+ * and fed to the target backend by a dedicated audio thread. */
+struct async_audio_out
+{
+    struct audio_out_backend* target;
+
+    /* written by the producer only */
+    size_t head;
+    size_t produced;
+
+    /* written by the consumer only */
+    size_t tail;
+    size_t consumed;
+
+    /* max number of queued sample records, 0 for no limit */
+    size_t max_pending;
+
+    struct SDL_Thread* thread;
+    struct SDL_semaphore* data_avail;
+    struct SDL_semaphore* space_avail;
+};
+
+int init_async_audio_out(struct async_audio_out* aaout,
+                         struct audio_out_backend* target,
+                         size_t max_pending);
+void release_async_audio_out(struct async_audio_out* aaout);
+
+/* Number of sample records not yet fed to the target backend.
+ * Meant to be called from the producer thread. */
+size_t async_audio_out_pending(const struct async_audio_out* aaout);
+
+void set_audio_format_via_async_audio_out(void* user_data, unsigned int frequency, unsigned int bits);
+void push_audio_samples_via_async_audio_out(void* user_data, const void* buffer, size_t size);
+
+#endif
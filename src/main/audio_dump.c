@@ -0,0 +1,107 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - main/audio_dump.c                                       *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "audio_dump.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "api/callbacks.h"
+#include "api/m64p_types.h"
+
+int open_audio_dump(struct audio_dump* dump, const char* filename)
+{
+    memset(dump, 0, sizeof(*dump));
+
+    /* null sink */
+    if (filename == NULL || filename[0] == '\0')
+        return 0;
+
+    dump->file = fopen(filename, "wb");
+    if (dump->file == NULL)
+    {
+        DebugMessage(M64MSG_WARNING, "couldn't open audio dump file '%s' for writing", filename);
+        return -1;
+    }
+
+    DebugMessage(M64MSG_INFO, "Dumping raw audio samples to '%s'", filename);
+    return 0;
+}
+
+void close_audio_dump(struct audio_dump* dump)
+{
+    if (dump->file == NULL)
+        return;
+
+    fclose(dump->file);
+    DebugMessage(M64MSG_INFO, "Dumped %u KiB of audio samples", (unsigned int)(dump->bytes >> 10));
+
+    dump->file = NULL;
+}
+
+void set_audio_format_via_audio_dump(void* user_data, unsigned int frequency, unsigned int bits)
+{
+    struct audio_dump* dump = (struct audio_dump*)user_data;
+
+    /* raw PCM has no header, so just report format changes */
+    if (dump->file != NULL && (frequency != dump->frequency || bits != dump->bits))
+        DebugMessage(M64MSG_INFO, "Audio dump format: %u Hz, %u bits (at byte %u)",
+                     frequency, bits, (unsigned int)dump->bytes);
+
+    dump->frequency = frequency;
+    dump->bits = bits;
+}
+
+void push_audio_samples_via_audio_dump(void* user_data, const void* buffer, size_t size)
+{
+    struct audio_dump* dump = (struct audio_dump*)user_data;
+    const uint32_t* words = (const uint32_t*)buffer;
+    uint8_t pcm[4096];
+    size_t i, n;
+
+    if (dump->file == NULL)
+        return;
+
+    /* each RDRAM word holds a stereo frame: left sample in the high half */
+    while (size >= 4)
+    {
+        n = (size / 4 < sizeof(pcm) / 4) ? size / 4 : sizeof(pcm) / 4;
+
+        for (i = 0; i < n; ++i)
+        {
+            pcm[4*i+0] = (uint8_t)(words[i] >> 16);
+            pcm[4*i+1] = (uint8_t)(words[i] >> 24);
+            pcm[4*i+2] = (uint8_t)(words[i] >>  0);
+            pcm[4*i+3] = (uint8_t)(words[i] >>  8);
+        }
+
+        if (fwrite(pcm, 4, n, dump->file) != n)
+        {
+            DebugMessage(M64MSG_WARNING, "failed to write audio dump, stopping it");
+            close_audio_dump(dump);
+            return;
+        }
+
+        dump->bytes += 4 * n;
+        words += n;
+        size -= 4 * n;
+    }
+}
@@ -0,0 +1,45 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - main/audio_dump.h                                       *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_MAIN_AUDIO_DUMP_H
+#define M64P_MAIN_AUDIO_DUMP_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Audio sink writing raw PCM (signed 16-bit little-endian, interleaved L/R)
+ * to a file, or discarding samples when no file is given.
+ * Meant to be fed from the audio thread for headless recording. */
+struct audio_dump
+{
+    FILE* file;
+    unsigned int frequency;
+    unsigned int bits;
+    uint64_t bytes;
+};
+
+int open_audio_dump(struct audio_dump* dump, const char* filename);
+void close_audio_dump(struct audio_dump* dump);
+
+void set_audio_format_via_audio_dump(void* user_data, unsigned int frequency, unsigned int bits);
+void push_audio_samples_via_audio_dump(void* user_data, const void* buffer, size_t size);
+
+#endif
@@ -42,6 +42,7 @@
 #include "main.h"
 #include "osal/preproc.h"
 #include "rom.h"
+#include "util.h"
 
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
@@ -65,6 +66,21 @@ typedef struct cheat {
     struct list_head list;
 } cheat_t;
 
+struct cheat_set_entry {
+    char *name;
+    int enabled;
+    unsigned int first_code;
+    unsigned int num_codes;
+};
+
+// codes are stored already expanded, so installing a set is only a copy
+struct cheat_set {
+    unsigned int num_cheats;
+    unsigned int num_codes;
+    struct cheat_set_entry *cheats;
+    m64p_cheat_code *codes;
+};
+
 // local variables
 static LIST_HEAD(active_cheats);
 #ifdef USE_SDL
@@ -195,6 +211,52 @@ static cheat_t *find_or_create_cheat(const char *name)
     return cheat;
 }
 
+// must be called with the cheat mutex held when cheats is active_cheats
+static void free_cheats(struct list_head *cheats)
+{
+    cheat_t *cheat, *safe_cheat;
+    cheat_code_t *code, *safe_code;
+
+    list_for_each_entry_safe_t(cheat, safe_cheat, cheats, cheat_t, list) {
+        free(cheat->name);
+
+        list_for_each_entry_safe_t(code, safe_code, &cheat->cheat_codes, cheat_code_t, list) {
+            list_del(&code->list);
+            free(code);
+        }
+        list_del(&cheat->list);
+        free(cheat);
+    }
+}
+
+static void move_cheats(struct list_head *to, struct list_head *from)
+{
+    while (!list_empty(from))
+    {
+        struct list_head *entry = from->next;
+        list_del(entry);
+        list_add_tail(entry, to);
+    }
+}
+
+static unsigned char *put_state_word(unsigned char *curr, uint32_t value)
+{
+    value = little32(value);
+    memcpy(curr, &value, sizeof(value));
+    return curr + sizeof(value);
+}
+
+// returns 0 when there are less than 4 bytes left
+static int get_state_word(const unsigned char **curr, const unsigned char *end, uint32_t *value)
+{
+    if (end - *curr < (ptrdiff_t)sizeof(*value))
+        return 0;
+    memcpy(value, *curr, sizeof(*value));
+    *value = little32(*value);
+    *curr += sizeof(*value);
+    return 1;
+}
+
 
 // public functions
 void cheat_init(void)
@@ -326,9 +388,6 @@ void cheat_apply_cheats(int entry)
 
 void cheat_delete_all(void)
 {
-    cheat_t *cheat, *safe_cheat;
-    cheat_code_t *code, *safe_code;
-
     if (list_empty(&active_cheats))
         return;
 
@@ -340,16 +399,7 @@ void cheat_delete_all(void)
     }
 #endif
 
-    list_for_each_entry_safe_t(cheat, safe_cheat, &active_cheats, cheat_t, list) {
-        free(cheat->name);
-
-        list_for_each_entry_safe_t(code, safe_code, &cheat->cheat_codes, cheat_code_t, list) {
-            list_del(&code->list);
-            free(code);
-        }
-        list_del(&cheat->list);
-        free(cheat);
-    }
+    free_cheats(&active_cheats);
 
 #ifdef USE_SDL
     SDL_UnlockMutex(cheat_mutex);
@@ -555,3 +605,289 @@ out:
     free(cheat_raw);
     return 0;
 }
+
+/* The state is a list of little endian words:
+ *   GameShark boot counter, number of cheats, then for each cheat
+ *   name length, name (padded to 4 bytes), enabled, was_enabled,
+ *   number of codes and the old value of each code. */
+unsigned char *cheat_save_state(size_t *size)
+{
+    cheat_t *cheat;
+    cheat_code_t *code;
+    unsigned int num_cheats = 0;
+    unsigned char *data, *curr;
+
+#ifdef USE_SDL
+    if (cheat_mutex == NULL || SDL_LockMutex(cheat_mutex) != 0)
+    {
+        DebugMessage(M64MSG_ERROR, "Internal error: failed to lock mutex in cheat_save_state()");
+        return NULL;
+    }
+#endif
+
+    *size = 8;
+    list_for_each_entry_t(cheat, &active_cheats, cheat_t, list) {
+        *size += 16 + ((strlen(cheat->name) + 3) & ~(size_t)3);
+        list_for_each_entry_t(code, &cheat->cheat_codes, cheat_code_t, list)
+            *size += 4;
+        num_cheats++;
+    }
+
+    data = curr = calloc(1, *size);
+    if (data != NULL)
+    {
+        curr = put_state_word(curr, (uint32_t)g_gs_vi_counter);
+        curr = put_state_word(curr, num_cheats);
+
+        list_for_each_entry_t(cheat, &active_cheats, cheat_t, list) {
+            size_t name_length = strlen(cheat->name);
+            unsigned char *num_codes;
+            uint32_t count = 0;
+
+            curr = put_state_word(curr, (uint32_t)name_length);
+            memcpy(curr, cheat->name, name_length);
+            curr += (name_length + 3) & ~(size_t)3;
+            curr = put_state_word(curr, (uint32_t)cheat->enabled);
+            curr = put_state_word(curr, (uint32_t)cheat->was_enabled);
+            num_codes = curr;
+            curr += 4;
+            list_for_each_entry_t(code, &cheat->cheat_codes, cheat_code_t, list) {
+                curr = put_state_word(curr, (uint32_t)code->old_value);
+                count++;
+            }
+            put_state_word(num_codes, count);
+        }
+    }
+
+#ifdef USE_SDL
+    SDL_UnlockMutex(cheat_mutex);
+#endif
+    return data;
+}
+
+/* Cheats are matched by name and number of codes. Those missing from the
+ * state were not running at the time it was made, so they are reset. */
+int cheat_load_state(const unsigned char *data, size_t size)
+{
+    const unsigned char *curr = data, *end = data + size, *entries;
+    cheat_t *cheat;
+    cheat_code_t *code;
+    uint32_t vi_counter, num_cheats, name_length, enabled, was_enabled, num_codes, value;
+    unsigned int i;
+
+    if (!get_state_word(&curr, end, &vi_counter) || !get_state_word(&curr, end, &num_cheats))
+        return 0;
+
+    /* validate everything before touching the cheats */
+    entries = curr;
+    for (i = 0; i < num_cheats; ++i)
+    {
+        /* compare before rounding up, which could wrap around */
+        if (!get_state_word(&curr, end, &name_length)
+         || name_length > (size_t)(end - curr)
+         || ((name_length + (size_t)3) & ~(size_t)3) > (size_t)(end - curr))
+            return 0;
+        curr += ((name_length + (size_t)3) & ~(size_t)3);
+        if (!get_state_word(&curr, end, &enabled)
+         || !get_state_word(&curr, end, &was_enabled)
+         || !get_state_word(&curr, end, &num_codes)
+         || (size_t)(end - curr) / 4 < num_codes)
+            return 0;
+        curr += (size_t)num_codes * 4;
+    }
+
+#ifdef USE_SDL
+    if (cheat_mutex == NULL || SDL_LockMutex(cheat_mutex) != 0)
+    {
+        DebugMessage(M64MSG_ERROR, "Internal error: failed to lock mutex in cheat_load_state()");
+        return 0;
+    }
+#endif
+
+    g_gs_vi_counter = (int)vi_counter;
+
+    list_for_each_entry_t(cheat, &active_cheats, cheat_t, list) {
+        cheat->was_enabled = 0;
+        list_for_each_entry_t(code, &cheat->cheat_codes, cheat_code_t, list)
+            code->old_value = CHEAT_CODE_MAGIC_VALUE;
+    }
+
+    curr = entries;
+    for (i = 0; i < num_cheats; ++i)
+    {
+        const char *name;
+        unsigned int count = 0;
+
+        get_state_word(&curr, end, &name_length);
+        name = (const char *)curr;
+        curr += ((name_length + (size_t)3) & ~(size_t)3);
+        get_state_word(&curr, end, &enabled);
+        get_state_word(&curr, end, &was_enabled);
+        get_state_word(&curr, end, &num_codes);
+
+        list_for_each_entry_t(cheat, &active_cheats, cheat_t, list) {
+            if (strlen(cheat->name) == name_length && memcmp(cheat->name, name, name_length) == 0)
+                break;
+        }
+        if (&cheat->list != &active_cheats)
+        {
+            list_for_each_entry_t(code, &cheat->cheat_codes, cheat_code_t, list)
+                count++;
+        }
+        if (&cheat->list == &active_cheats || count != num_codes)
+        {
+            DebugMessage(M64MSG_WARNING, "Savestate cheat '%.*s' does not match the current cheats", (int)name_length, name);
+            curr += (size_t)num_codes * 4;
+            continue;
+        }
+
+        cheat->enabled = (int)enabled;
+        cheat->was_enabled = (int)was_enabled;
+        list_for_each_entry_t(code, &cheat->cheat_codes, cheat_code_t, list) {
+            get_state_word(&curr, end, &value);
+            code->old_value = (int)value;
+        }
+    }
+
+#ifdef USE_SDL
+    SDL_UnlockMutex(cheat_mutex);
+#endif
+    return 1;
+}
+
+struct cheat_set *cheat_set_capture(void)
+{
+    cheat_t *cheat;
+    cheat_code_t *code;
+    struct cheat_set *set;
+    unsigned int i = 0, j = 0;
+    int failed;
+
+    set = calloc(1, sizeof(*set));
+    if (set == NULL)
+        return NULL;
+
+#ifdef USE_SDL
+    if (cheat_mutex == NULL || SDL_LockMutex(cheat_mutex) != 0)
+    {
+        DebugMessage(M64MSG_ERROR, "Internal error: failed to lock mutex in cheat_set_capture()");
+        free(set);
+        return NULL;
+    }
+#endif
+
+    list_for_each_entry_t(cheat, &active_cheats, cheat_t, list) {
+        set->num_cheats++;
+        list_for_each_entry_t(code, &cheat->cheat_codes, cheat_code_t, list)
+            set->num_codes++;
+    }
+
+    set->cheats = calloc(set->num_cheats + 1, sizeof(*set->cheats));
+    set->codes = malloc((set->num_codes + 1) * sizeof(*set->codes));
+    failed = (set->cheats == NULL || set->codes == NULL);
+    if (!failed)
+    {
+        list_for_each_entry_t(cheat, &active_cheats, cheat_t, list) {
+            set->cheats[i].name = strdup(cheat->name);
+            set->cheats[i].enabled = cheat->enabled;
+            set->cheats[i].first_code = j;
+            list_for_each_entry_t(code, &cheat->cheat_codes, cheat_code_t, list) {
+                set->codes[j].address = code->address;
+                set->codes[j].value = code->value;
+                j++;
+            }
+            set->cheats[i].num_codes = j - set->cheats[i].first_code;
+            failed |= (set->cheats[i++].name == NULL);
+        }
+    }
+
+#ifdef USE_SDL
+    SDL_UnlockMutex(cheat_mutex);
+#endif
+
+    if (failed)
+    {
+        cheat_set_free(set);
+        return NULL;
+    }
+    return set;
+}
+
+/* Replaces all cheats with the ones of the set. Their runtime state starts
+ * over, as with cheat_add_new. The new list is built before taking the
+ * mutex, so on failure the current cheats are kept and 0 is returned. */
+int cheat_set_install(const struct cheat_set *set)
+{
+    LIST_HEAD(cheats);
+    LIST_HEAD(old_cheats);
+    unsigned int i, j;
+
+    for (i = 0; i < set->num_cheats; ++i)
+    {
+        const struct cheat_set_entry *entry = &set->cheats[i];
+        cheat_t *cheat = malloc(sizeof(*cheat));
+
+        if (cheat == NULL)
+            goto fail;
+        cheat->name = strdup(entry->name);
+        if (cheat->name == NULL)
+        {
+            free(cheat);
+            goto fail;
+        }
+        cheat->enabled = entry->enabled;
+        cheat->was_enabled = 0;
+        INIT_LIST_HEAD(&cheat->cheat_codes);
+        list_add_tail(&cheat->list, &cheats);
+
+        for (j = entry->first_code; j < entry->first_code + entry->num_codes; ++j)
+        {
+            cheat_code_t *code = malloc(sizeof(*code));
+            if (code == NULL)
+                goto fail;
+            code->address = set->codes[j].address;
+            code->value = set->codes[j].value;
+            code->old_value = CHEAT_CODE_MAGIC_VALUE;
+            list_add_tail(&code->list, &cheat->cheat_codes);
+        }
+    }
+
+#ifdef USE_SDL
+    if (cheat_mutex == NULL || SDL_LockMutex(cheat_mutex) != 0)
+    {
+        DebugMessage(M64MSG_ERROR, "Internal error: failed to lock mutex in cheat_set_install()");
+        goto fail;
+    }
+#endif
+
+    move_cheats(&old_cheats, &active_cheats);
+    move_cheats(&active_cheats, &cheats);
+
+#ifdef USE_SDL
+    SDL_UnlockMutex(cheat_mutex);
+#endif
+
+    free_cheats(&old_cheats);
+    return 1;
+
+fail:
+    free_cheats(&cheats);
+    return 0;
+}
+
+void cheat_set_free(struct cheat_set *set)
+{
+    unsigned int i;
+
+    if (set == NULL)
+        return;
+
+    if (set->cheats != NULL)
+    {
+        for (i = 0; i < set->num_cheats; ++i)
+            free(set->cheats[i].name);
+    }
+    free(set->cheats);
+    free(set->codes);
+    free(set);
+}
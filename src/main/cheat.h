@@ -22,6 +22,8 @@
 #ifndef CHEAT_H
 #define CHEAT_H
 
+#include <stddef.h>
+
 #include "api/m64p_types.h"
 
 #define ENTRY_BOOT 0
@@ -36,6 +38,20 @@ int cheat_set_enabled(const char *name, int enabled);
 void cheat_delete_all(void);
 int cheat_add_hacks(void);
 
+/* Runtime state of the cheat engine (flags, values overwritten by the codes
+ * and the GameShark boot counter), as stored in savestates. cheat_save_state
+ * returns a malloc'd buffer, cheat_load_state returns 0 on a malformed one. */
+unsigned char *cheat_save_state(size_t *size);
+int cheat_load_state(const unsigned char *data, size_t size);
+
+/* Precompiled copy of the cheat list, which can be installed again later
+ * without going through cheat_add_new. */
+struct cheat_set;
+
+struct cheat_set *cheat_set_capture(void);
+int cheat_set_install(const struct cheat_set *set);
+void cheat_set_free(struct cheat_set *set);
+
 #endif // #define CHEAT_H
 
 
@@ -27,6 +27,7 @@
 #include "api/m64p_types.h"
 #include "util.h"
 
+static int l_volatile = 0;
 
 int open_file_storage(struct file_storage* storage, size_t size, const char* filename)
 {
@@ -70,6 +71,9 @@ void save_file_storage(void* opaque)
 {
     struct file_storage* storage = (struct file_storage*)opaque;
 
+    if (l_volatile)
+        return;
+
     switch(write_to_file(storage->filename, storage->data, storage->size))
     {
     case file_open_error:
@@ -82,3 +86,8 @@ void save_file_storage(void* opaque)
         break;
     }
 }
+
+void set_file_storage_volatile(int enabled)
+{
+    l_volatile = enabled;
+}
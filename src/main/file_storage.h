@@ -38,4 +38,8 @@ void close_file_storage(struct file_storage* storage);
 
 void save_file_storage(void* opaque);
 
+/* While set, saves only update the in-memory copy of the storages and the
+ * files on disk are left alone. */
+void set_file_storage_volatile(int enabled);
+
 #endif
@@ -0,0 +1,445 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - main/lockstep.c                                         *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define M64P_CORE_PROTOTYPES 1
+#include "api/callbacks.h"
+#include "api/m64p_debugger.h"
+#include "api/m64p_types.h"
+#include "device/device.h"
+#include "device/memory/memory.h"
+#include "device/r4300/cp0.h"
+#include "device/r4300/cp1.h"
+#include "device/r4300/r4300_core.h"
+#include "lockstep.h"
+#include "main.h"
+
+#ifdef DBG
+#include "debugger/dbg_decoder.h"
+#endif
+
+#define LOCKSTEP_PAGE_SIZE 0x1000
+#define LOCKSTEP_PAGE_COUNT (RDRAM_MAX_SIZE / LOCKSTEP_PAGE_SIZE)
+#define LOCKSTEP_MAX_REPORTED_PAGES 16
+
+struct lockstep_state
+{
+    uint32_t pc;
+    uint32_t fcr31;
+    int64_t gpr[32];
+    int64_t hi;
+    int64_t lo;
+    int64_t fpr[32];
+    uint32_t cp0[CP0_REGS_COUNT];
+};
+
+struct lockstep_snapshot
+{
+    struct lockstep_state state;
+    uint32_t prev_pc;
+    uint32_t prev_op;
+    int prev_op_valid;
+    uint64_t* pages;
+};
+
+static int l_active = 0;
+static int l_armed = 0;
+static int l_done = 0;
+static enum lockstep_pass l_pass = LOCKSTEP_RECORD;
+
+static unsigned int l_steps = 0;
+static unsigned int l_recorded = 0;
+static unsigned int l_step = 0;
+static uint64_t* l_digests = NULL;
+
+static unsigned int l_ram_interval = 0;
+static unsigned int l_boundaries = 0;
+static unsigned int l_ram_digest_count = 0;
+static uint64_t* l_ram_digests = NULL;
+
+static uint8_t* l_sync = NULL;
+static size_t l_sync_size = 0;
+static size_t l_sync_capacity = 0;
+static size_t l_sync_pos = 0;
+
+static struct lockstep_state l_prev;
+static int l_diverged = 0;
+static unsigned int l_divergence_step = 0;
+static struct lockstep_snapshot l_ref;
+static struct lockstep_snapshot l_test;
+
+static uint64_t hash_words(uint64_t h, const void* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t w;
+    size_t i;
+
+    for (i = 0; i + sizeof(w) <= size; i += sizeof(w))
+    {
+        memcpy(&w, p + i, sizeof(w));
+        h = (h ^ w) * UINT64_C(0x100000001b3);
+        h ^= h >> 29;
+    }
+
+    return h;
+}
+
+static uint64_t hash_rdram(uint64_t* pages)
+{
+    const uint8_t* dram = (const uint8_t*)g_dev.ri.rdram.dram;
+    size_t count = g_dev.ri.rdram.dram_size / LOCKSTEP_PAGE_SIZE;
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+    size_t i;
+
+    for (i = 0; i < count; ++i)
+    {
+        uint64_t page = hash_words(UINT64_C(0xcbf29ce484222325), dram + i * LOCKSTEP_PAGE_SIZE, LOCKSTEP_PAGE_SIZE);
+        if (pages != NULL)
+            pages[i] = page;
+        h = hash_words(h, &page, sizeof(page));
+    }
+
+    return h;
+}
+
+static void capture_state(struct lockstep_state* s)
+{
+    s->pc = *r4300_pc();
+    s->fcr31 = *r4300_cp1_fcr31();
+    memcpy(s->gpr, r4300_regs(), sizeof(s->gpr));
+    s->hi = *r4300_mult_hi();
+    s->lo = *r4300_mult_lo();
+    memcpy(s->fpr, r4300_cp1_regs(), sizeof(s->fpr));
+    memcpy(s->cp0, r4300_cp0_regs(), sizeof(s->cp0));
+    s->cp0[CP0_COUNT_REG] = 0;
+}
+
+static void take_snapshot(struct lockstep_snapshot* snap, const struct lockstep_state* cur)
+{
+    uint32_t* op;
+
+    snap->state = *cur;
+    snap->prev_pc = (l_step > 0) ? l_prev.pc : cur->pc;
+    snap->prev_op_valid = 0;
+
+    /* stay away from TLB mapped code: translating it may raise an exception */
+    if ((snap->prev_pc & UINT32_C(0xc0000000)) == UINT32_C(0x80000000)
+     && (op = fast_mem_access(snap->prev_pc)) != NULL)
+    {
+        snap->prev_op = *op;
+        snap->prev_op_valid = 1;
+    }
+
+    if (snap->pages != NULL)
+    {
+        memset(snap->pages, 0, LOCKSTEP_PAGE_COUNT * sizeof(snap->pages[0]));
+        hash_rdram(snap->pages);
+    }
+}
+
+static void lockstep_stop(void)
+{
+    l_done = 1;
+    main_stop();
+}
+
+static void lockstep_compare(unsigned int op)
+{
+    struct lockstep_state cur;
+    uint64_t digest;
+    uint64_t ram_digest = 0;
+    unsigned int ram_index = 0;
+    int ram_check = 0;
+
+    (void)op;
+
+    if (!l_armed || l_done)
+        return;
+
+    capture_state(&cur);
+    digest = hash_words(UINT64_C(0xcbf29ce484222325), &cur, sizeof(cur));
+
+    /* RDRAM is only hashed at block boundaries, every l_ram_interval of them */
+    if (l_step > 0 && cur.pc != l_prev.pc + 4 && l_ram_interval != 0
+     && (++l_boundaries % l_ram_interval) == 0)
+    {
+        ram_index = l_boundaries / l_ram_interval - 1;
+        ram_digest = hash_rdram(NULL);
+        ram_check = 1;
+    }
+
+    switch (l_pass)
+    {
+    case LOCKSTEP_RECORD:
+        l_digests[l_step] = digest;
+        if (ram_check)
+        {
+            l_ram_digests[ram_index] = ram_digest;
+            l_ram_digest_count = ram_index + 1;
+        }
+        break;
+
+    case LOCKSTEP_CHECK:
+        if (digest != l_digests[l_step]
+         || (ram_check && ram_index < l_ram_digest_count && ram_digest != l_ram_digests[ram_index]))
+        {
+            l_diverged = 1;
+            l_divergence_step = l_step;
+            take_snapshot(&l_test, &cur);
+            lockstep_stop();
+            return;
+        }
+        break;
+
+    case LOCKSTEP_CAPTURE:
+        if (l_step == l_divergence_step)
+        {
+            take_snapshot(&l_ref, &cur);
+            lockstep_stop();
+            return;
+        }
+        break;
+    }
+
+    l_prev = cur;
+    ++l_step;
+
+    if (l_pass == LOCKSTEP_RECORD)
+        l_recorded = l_step;
+
+    if (l_step >= ((l_pass == LOCKSTEP_RECORD) ? l_steps : l_recorded))
+        lockstep_stop();
+}
+
+static void lockstep_data_sync(int length, void* ptr)
+{
+    if (!l_armed || l_done || length <= 0)
+        return;
+
+    if (l_pass == LOCKSTEP_RECORD)
+    {
+        if (l_sync_size + length > l_sync_capacity)
+        {
+            size_t capacity = (l_sync_capacity == 0) ? 4096 : l_sync_capacity;
+            uint8_t* sync;
+
+            while (l_sync_size + length > capacity)
+                capacity *= 2;
+
+            sync = (uint8_t*)realloc(l_sync, capacity);
+            if (sync == NULL)
+            {
+                DebugMessage(M64MSG_ERROR, "Lockstep: out of memory while recording synced data");
+                lockstep_stop();
+                return;
+            }
+            l_sync = sync;
+            l_sync_capacity = capacity;
+        }
+
+        memcpy(l_sync + l_sync_size, ptr, length);
+        l_sync_size += length;
+    }
+    else if (l_sync_pos + length <= l_sync_size)
+    {
+        memcpy(ptr, l_sync + l_sync_pos, length);
+        l_sync_pos += length;
+    }
+    /* otherwise the emulator syncs more data than the reference did:
+     * leave it alone, the state digests will tell where they part */
+}
+
+int lockstep_init(unsigned int steps, unsigned int ram_interval)
+{
+    lockstep_release();
+
+    l_steps = steps;
+    l_ram_interval = ram_interval;
+
+    l_digests = (uint64_t*)malloc((size_t)steps * sizeof(l_digests[0]));
+    if (ram_interval != 0)
+        l_ram_digests = (uint64_t*)malloc((steps / ram_interval + 1) * sizeof(l_ram_digests[0]));
+    l_ref.pages = (uint64_t*)malloc(LOCKSTEP_PAGE_COUNT * sizeof(l_ref.pages[0]));
+    l_test.pages = (uint64_t*)malloc(LOCKSTEP_PAGE_COUNT * sizeof(l_test.pages[0]));
+
+    if (l_digests == NULL || (ram_interval != 0 && l_ram_digests == NULL)
+     || l_ref.pages == NULL || l_test.pages == NULL)
+    {
+        lockstep_release();
+        return -1;
+    }
+
+    l_recorded = 0;
+    l_diverged = 0;
+    l_divergence_step = 0;
+
+    return 0;
+}
+
+void lockstep_release(void)
+{
+    if (l_active)
+        DebugSetCoreCompare(NULL, NULL);
+
+    free(l_digests);
+    free(l_ram_digests);
+    free(l_sync);
+    free(l_ref.pages);
+    free(l_test.pages);
+
+    l_digests = NULL;
+    l_ram_digests = NULL;
+    l_sync = NULL;
+    l_sync_size = l_sync_capacity = l_sync_pos = 0;
+    l_ref.pages = NULL;
+    l_test.pages = NULL;
+    l_active = 0;
+    l_armed = 0;
+}
+
+void lockstep_start(enum lockstep_pass pass)
+{
+    l_pass = pass;
+    l_armed = 0;
+    l_done = 0;
+    l_step = 0;
+    l_boundaries = 0;
+    l_sync_pos = 0;
+
+    if (pass == LOCKSTEP_RECORD)
+    {
+        l_recorded = 0;
+        l_ram_digest_count = 0;
+        l_sync_size = 0;
+        l_diverged = 0;
+    }
+
+    DebugSetCoreCompare(lockstep_compare, lockstep_data_sync);
+    l_active = 1;
+}
+
+void lockstep_state_loaded(int ret)
+{
+    if (!l_active || l_done)
+        return;
+
+    if (l_armed)
+    {
+        DebugMessage(M64MSG_WARNING, "Lockstep: savestate loaded during a pass, stopping");
+        lockstep_stop();
+    }
+    else if (!ret)
+    {
+        DebugMessage(M64MSG_ERROR, "Lockstep: could not load the starting savestate");
+        lockstep_stop();
+    }
+    else
+    {
+        l_armed = 1;
+    }
+}
+
+unsigned int lockstep_completed_steps(void)
+{
+    return l_step;
+}
+
+int lockstep_diverged(unsigned int* step, uint32_t* pc)
+{
+    if (l_diverged)
+    {
+        *step = l_divergence_step;
+        *pc = l_test.state.pc;
+    }
+
+    return l_diverged;
+}
+
+static void report_diff(const char* name, int index, uint64_t ref, uint64_t test)
+{
+    if (ref == test)
+        return;
+
+    if (index < 0)
+        DebugMessage(M64MSG_ERROR, "Lockstep:   %-8s %016llx (reference) %016llx (test)",
+                     name, (unsigned long long)ref, (unsigned long long)test);
+    else
+        DebugMessage(M64MSG_ERROR, "Lockstep:   %s[%2d] %016llx (reference) %016llx (test)",
+                     name, index, (unsigned long long)ref, (unsigned long long)test);
+}
+
+void lockstep_report(void)
+{
+    const struct lockstep_state* ref = &l_ref.state;
+    const struct lockstep_state* test = &l_test.state;
+    unsigned int pages = 0;
+    size_t i;
+
+    if (!l_diverged)
+    {
+        DebugMessage(M64MSG_INFO, "Lockstep: no divergence in %u instructions", l_recorded);
+        return;
+    }
+
+    DebugMessage(M64MSG_ERROR, "Lockstep: first divergence before instruction %u", l_divergence_step);
+
+    if (l_ref.prev_op_valid)
+    {
+#ifdef DBG
+        char opcode[64];
+        char args[128];
+        r4300_decode_op(l_ref.prev_op, opcode, args, l_ref.prev_pc);
+        DebugMessage(M64MSG_ERROR, "Lockstep: after %08x: %08x %s %s", l_ref.prev_pc, l_ref.prev_op, opcode, args);
+#else
+        DebugMessage(M64MSG_ERROR, "Lockstep: after %08x: %08x", l_ref.prev_pc, l_ref.prev_op);
+#endif
+    }
+    else
+    {
+        DebugMessage(M64MSG_ERROR, "Lockstep: after %08x", l_ref.prev_pc);
+    }
+
+    report_diff("pc", -1, ref->pc, test->pc);
+    for (i = 0; i < 32; ++i)
+        report_diff("gpr", i, ref->gpr[i], test->gpr[i]);
+    report_diff("hi", -1, ref->hi, test->hi);
+    report_diff("lo", -1, ref->lo, test->lo);
+    for (i = 0; i < CP0_REGS_COUNT; ++i)
+        report_diff("cp0", i, ref->cp0[i], test->cp0[i]);
+    for (i = 0; i < 32; ++i)
+        report_diff("fpr", i, ref->fpr[i], test->fpr[i]);
+    report_diff("fcr31", -1, ref->fcr31, test->fcr31);
+
+    for (i = 0; i < g_dev.ri.rdram.dram_size / LOCKSTEP_PAGE_SIZE; ++i)
+    {
+        if (l_ref.pages[i] == l_test.pages[i])
+            continue;
+
+        if (pages++ < LOCKSTEP_MAX_REPORTED_PAGES)
+            DebugMessage(M64MSG_ERROR, "Lockstep:   RDRAM page %08x differs", (unsigned int)(i * LOCKSTEP_PAGE_SIZE));
+    }
+
+    if (pages > LOCKSTEP_MAX_REPORTED_PAGES)
+        DebugMessage(M64MSG_ERROR, "Lockstep:   ... and %u more RDRAM pages", pages - LOCKSTEP_MAX_REPORTED_PAGES);
+}
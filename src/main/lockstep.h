@@ -0,0 +1,71 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - main/lockstep.h                                         *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_MAIN_LOCKSTEP_H
+#define M64P_MAIN_LOCKSTEP_H
+
+#include <stdint.h>
+
+/* Differential lockstep testing of the r4300 emulators.
+ *
+ * Only one r4300 core can exist at a time (g_dev is global), so the two
+ * emulators are not run side by side but one after the other from the same
+ * savestate, through the COMPARE_CORE hooks:
+ *  - the record pass runs the reference emulator and stores a digest of the
+ *    CPU state before each instruction, a digest of RDRAM every few block
+ *    boundaries, and the data synced by the core (controller input),
+ *  - the check pass runs the emulator under test, replays the synced data and
+ *    stops at the first step whose digest differs,
+ *  - the capture pass, only run after a divergence, runs the reference
+ *    emulator again up to that step so both full states can be reported.
+ *
+ * CP0 Count is left out of the comparison: the emulators only bring it up to
+ * date at branches and interrupts.
+ */
+
+enum lockstep_pass
+{
+    LOCKSTEP_RECORD,
+    LOCKSTEP_CHECK,
+    LOCKSTEP_CAPTURE
+};
+
+int  lockstep_init(unsigned int steps, unsigned int ram_interval);
+void lockstep_release(void);
+
+/* Arm the hooks for the given pass. The pass starts counting instructions
+ * when the next savestate load completes. */
+void lockstep_start(enum lockstep_pass pass);
+
+/* Called by savestates_load once a load completed (ret != 0 on success). */
+void lockstep_state_loaded(int ret);
+
+/* Number of instructions compared (or recorded) by the last pass. */
+unsigned int lockstep_completed_steps(void);
+
+/* Returns non-zero if the check pass found a divergence. */
+int lockstep_diverged(unsigned int* step, uint32_t* pc);
+
+/* Log the first divergence: the instruction that led to it and the differing
+ * registers and RDRAM pages. Only meaningful after the capture pass. */
+void lockstep_report(void);
+
+#endif /* M64P_MAIN_LOCKSTEP_H */
@@ -29,6 +29,7 @@
  */
 
 #include <SDL.h>
+#include <SDL_thread.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -43,6 +44,8 @@
 #include "api/m64p_types.h"
 #include "api/m64p_vidext.h"
 #include "api/vidext.h"
+#include "async_audio_out.h"
+#include "audio_dump.h"
 #include "backends/audio_out_backend.h"
 #include "backends/clock_backend.h"
 #include "backends/controller_input_backend.h"
@@ -60,13 +63,17 @@
 #include "osd/screenshot.h"
 #include "plugin/emulate_game_controller_via_input_plugin.h"
 #include "plugin/emulate_speaker_via_audio_plugin.h"
+#include "plugin/get_monotonic_time.h"
 #include "plugin/get_time_using_time_plus_delta.h"
 #include "plugin/plugin.h"
 #include "plugin/rumble_via_input_plugin.h"
 #include "profile.h"
+#include "ram_search.h"
 #include "rom.h"
 #include "savestates.h"
+#include "speed_limiter.h"
 #include "file_storage.h"
+#include "lockstep.h"
 #include "util.h"
 
 #ifdef DBG
@@ -81,10 +88,20 @@
 /* version number for Core config section */
 #define CONFIG_PARAM_VERSION 1.01
 
+/* values of the AudioSink config parameter */
+enum { AUDIO_SINK_PLUGIN, AUDIO_SINK_NULL, AUDIO_SINK_DUMP };
+
+/* AI buffers a threaded audio plugin may lag behind before the emulation waits for it */
+#define AUDIO_THREAD_MAX_PENDING 4
+
+/* values of the SpeedLimiterPacing config parameter */
+enum { SPEED_PACING_CLOCK, SPEED_PACING_AUDIO };
+
 /** globals **/
 m64p_handle g_CoreConfig = NULL;
 
 m64p_frame_callback g_FrameCallback = NULL;
+m64p_frame_callback g_ViCallback = NULL;
 
 int         g_MemHasBeenBSwapped = 0;   // store byte-swapped flag so we don't swap twice when re-playing game
 int         g_EmulatorRunning = 0;      // need separate boolean to tell if emulator is running, since --nogui doesn't use a thread
@@ -123,15 +140,32 @@ int g_gs_vi_counter = 0;
 
 /** static (local) variables **/
 static int   l_CurrentFrame = 0;         // frame counter
+static unsigned int l_CurrentVI = 0;     // VI counter, reset by main_run
 static int   l_TakeScreenshot = 0;       // Tell OSD Rendering callback to take a screenshot just before drawing the OSD
 static int   l_SpeedFactor = 100;        // percentage of nominal game speed at which emulator is running
-static int   l_FrameAdvance = 0;         // variable to check if we pause on next frame
+static unsigned int l_FramesToAdvance = 0; // frames left to run before pausing again, 0 when not advancing
 static int   l_MainSpeedLimit = 1;       // insert delay during vi_interrupt to keep speed at real-time
+static struct speed_limiter l_SpeedLimiter;
 
 static osd_message_t *l_msgVol = NULL;
 static osd_message_t *l_msgFF = NULL;
 static osd_message_t *l_msgPause = NULL;
 
+/* Pause, resume, frame advance and stop wake the emulation thread through
+ * l_PauseChanged instead of it polling g_rom_pause. l_PauseLock guards
+ * g_rom_pause and l_FramesToAdvance while it exists. */
+static SDL_mutex *l_PauseLock = NULL;
+static SDL_cond  *l_PauseChanged = NULL;
+static unsigned long l_EmuThread = 0;
+
+/* Input snapshot set by the front-end, from any thread. It is handed to the
+ * game controllers on the emulation thread at the next VI, so that all the
+ * controller reads of a frame see the same snapshot. */
+static SDL_mutex *l_SnapshotLock = NULL;
+static int l_SnapshotPending = 0;
+static unsigned int l_SnapshotMask = 0;
+static uint32_t l_SnapshotKeys[GAME_CONTROLLERS_COUNT];
+
 /*********************************************************************************************************
 * static functions
 */
@@ -279,6 +313,11 @@ int main_set_core_defaults(void)
     ConfigSetDefaultInt(g_CoreConfig, "ViTiming", -1, "Use alternate VI timing (-1=Game default, 0=Don't use alternate timing, 1=Use alternate timing)");
     ConfigSetDefaultInt(g_CoreConfig, "CountPerScanline", -1, "Modify the default count per scanline(-1 or 0=Game default)");
     ConfigSetDefaultBool(g_CoreConfig, "DisableSpecRecomp", 1, "Disable speculative precompilation in new dynarec");
+    ConfigSetDefaultInt(g_CoreConfig, "DynarecCacheSize", 0, "Size of the new dynarec translation cache in MB, rounded up to a power of two from 4 to 32 (0=largest)");
+    ConfigSetDefaultBool(g_CoreConfig, "AudioThread", 0, "Feed the audio plugin from a separate thread, so a blocking audio plugin doesn't stall emulation (applied when the audio plugin is started, only if the plugin supports it)");
+    ConfigSetDefaultInt(g_CoreConfig, "AudioSink", AUDIO_SINK_PLUGIN, "Send audio samples to the audio plugin if 0, discard them if 1, or write them as raw PCM to AudioDumpPath if 2");
+    ConfigSetDefaultInt(g_CoreConfig, "SpeedLimiterPacing", SPEED_PACING_CLOCK, "Pace frames against the host monotonic clock if 0, or against the audio plugin if 1 (needs AudioThread, falls back to the clock otherwise)");
+    ConfigSetDefaultString(g_CoreConfig, "AudioDumpPath", "", "File receiving raw PCM samples (signed 16-bit little-endian stereo) when AudioSink is 2");
 
     /* handle upgrades */
     if (bUpgrade)
@@ -376,12 +415,61 @@ static int main_is_paused(void)
     return (g_EmulatorRunning && g_rom_pause);
 }
 
+void main_pause_init(void)
+{
+    l_PauseLock = SDL_CreateMutex();
+    l_PauseChanged = SDL_CreateCond();
+    if (l_PauseLock == NULL || l_PauseChanged == NULL)
+        DebugMessage(M64MSG_ERROR, "Could not create pause condition, pausing falls back to polling");
+
+    l_SnapshotLock = SDL_CreateMutex();
+    if (l_SnapshotLock == NULL)
+        DebugMessage(M64MSG_ERROR, "Could not create input snapshot lock");
+}
+
+void main_pause_deinit(void)
+{
+    if (l_PauseChanged != NULL)
+        SDL_DestroyCond(l_PauseChanged);
+    if (l_PauseLock != NULL)
+        SDL_DestroyMutex(l_PauseLock);
+    l_PauseChanged = NULL;
+    l_PauseLock = NULL;
+
+    if (l_SnapshotLock != NULL)
+        SDL_DestroyMutex(l_SnapshotLock);
+    l_SnapshotLock = NULL;
+}
+
+static void pause_lock(void)
+{
+    if (l_PauseLock != NULL)
+        SDL_LockMutex(l_PauseLock);
+}
+
+/* Wakes the emulation thread, and callers of main_advance_frames */
+static void pause_unlock_and_signal(void)
+{
+    if (l_PauseChanged != NULL)
+        SDL_CondBroadcast(l_PauseChanged);
+    if (l_PauseLock != NULL)
+        SDL_UnlockMutex(l_PauseLock);
+}
+
 void main_toggle_pause(void)
 {
+    int paused;
+
     if (!g_EmulatorRunning)
         return;
 
-    if (g_rom_pause)
+    /* callbacks run without the lock, they may call back into the core */
+    pause_lock();
+    paused = g_rom_pause = !g_rom_pause;
+    l_FramesToAdvance = 0;
+    pause_unlock_and_signal();
+
+    if (!paused)
     {
         DebugMessage(M64MSG_STATUS, "Emulation continued.");
         if(l_msgPause)
@@ -402,16 +490,97 @@ void main_toggle_pause(void)
         osd_message_set_user_managed(l_msgPause);
         StateChanged(M64CORE_EMU_STATE, M64EMU_PAUSED);
     }
-
-    g_rom_pause = !g_rom_pause;
-    l_FrameAdvance = 0;
 }
 
 void main_advance_one(void)
 {
-    l_FrameAdvance = 1;
-    g_rom_pause = 0;
+    main_advance_frames(1, 0);
+}
+
+m64p_error main_advance_frames(unsigned int count, int wait)
+{
+    if (!g_EmulatorRunning)
+        return M64ERR_INVALID_STATE;
+
+    /* notified before resuming, so it comes before the PAUSED of the last frame */
     StateChanged(M64CORE_EMU_STATE, M64EMU_RUNNING);
+
+    pause_lock();
+    l_FramesToAdvance = count;
+    g_rom_pause = 0;
+
+    /* the emulation thread cannot wait on itself, e.g. from the frame callback */
+    if (wait && l_PauseChanged != NULL && SDL_ThreadID() != l_EmuThread)
+    {
+        SDL_CondBroadcast(l_PauseChanged);
+        while (g_EmulatorRunning && l_FramesToAdvance != 0)
+            SDL_CondWait(l_PauseChanged, l_PauseLock);
+    }
+
+    pause_unlock_and_signal();
+    return g_EmulatorRunning ? M64ERR_SUCCESS : M64ERR_INVALID_STATE;
+}
+
+void main_set_input_snapshot(unsigned int mask, const uint32_t* keys)
+{
+    size_t i;
+
+    /* meant to be called once per VI, e.g. from the frame callback */
+    if (l_SnapshotLock == NULL)
+        return;
+
+    SDL_LockMutex(l_SnapshotLock);
+    for (i = 0; i < GAME_CONTROLLERS_COUNT; ++i)
+        l_SnapshotKeys[i] = (mask & (1 << i)) ? keys[i] : 0;
+    l_SnapshotMask = mask;
+    l_SnapshotPending = 1;
+    SDL_UnlockMutex(l_SnapshotLock);
+}
+
+static void apply_input_snapshot(void)
+{
+    if (l_SnapshotLock == NULL)
+        return;
+
+    SDL_LockMutex(l_SnapshotLock);
+    if (l_SnapshotPending)
+    {
+        egcvip_set_input_snapshot(l_SnapshotMask, l_SnapshotKeys);
+        l_SnapshotPending = 0;
+    }
+    SDL_UnlockMutex(l_SnapshotLock);
+}
+
+void main_get_run_stats(m64p_run_stats* stats)
+{
+    stats->vi_count = l_CurrentVI;
+    stats->count_per_op = g_dev.r4300.cp0.count_per_op;
+    stats->idle_skipped_cycles = g_dev.r4300.idle_skipped_cycles;
+    stats->compile_ns = (long long)g_dev.r4300.compile_ns;
+    memcpy(stats->frame_jitter, l_SpeedLimiter.jitter, sizeof(stats->frame_jitter));
+
+    stats->dynarec_cache_size = 0;
+    stats->dynarec_cache_used = 0;
+    stats->dynarec_lookups = 0;
+    stats->dynarec_misses = 0;
+    stats->dynarec_samples = 0;
+    stats->dynarec_evictions = 0;
+    stats->dynarec_kept = 0;
+#ifdef NEW_DYNAREC
+    if (get_r4300_emumode(&g_dev.r4300) == EMUMODE_DYNAREC)
+    {
+        struct new_dynarec_cache_stats cache;
+
+        new_dynarec_get_cache_stats(&cache);
+        stats->dynarec_cache_size = cache.size;
+        stats->dynarec_cache_used = cache.used;
+        stats->dynarec_lookups = cache.lookups;
+        stats->dynarec_misses = cache.misses;
+        stats->dynarec_samples = cache.samples;
+        stats->dynarec_evictions = cache.evictions;
+        stats->dynarec_kept = cache.kept;
+    }
+#endif
 }
 
 static void main_draw_volume_osd(void)
@@ -755,40 +924,25 @@ void new_frame(void)
     /* advance the current frame */
     l_CurrentFrame++;
 
-    if (l_FrameAdvance) {
-        g_rom_pause = 1;
-        l_FrameAdvance = 0;
-        StateChanged(M64CORE_EMU_STATE, M64EMU_PAUSED);
+    if (l_FramesToAdvance != 0) {
+        int paused = 0;
+
+        pause_lock();
+        if (l_FramesToAdvance != 0 && --l_FramesToAdvance == 0) {
+            g_rom_pause = 1;
+            paused = 1;
+        }
+        pause_unlock_and_signal();
+
+        if (paused)
+            StateChanged(M64CORE_EMU_STATE, M64EMU_PAUSED);
     }
 }
 
 static void apply_speed_limiter(void)
 {
-    static unsigned long totalVIs = 0;
-    static int resetOnce = 0;
-    static int lastSpeedFactor = 100;
-    static unsigned int StartFPSTime = 0;
-    static const double defaultSpeedFactor = 100.0;
-    unsigned int CurrentFPSTime = SDL_GetTicks();
-
-    // calculate frame duration based upon ROM setting (50/60hz) and mupen64plus speed adjustment
-    const double VILimitMilliseconds = 1000.0 / g_dev.vi.expected_refresh_rate;
-    const double SpeedFactorMultiple = defaultSpeedFactor/l_SpeedFactor;
-    const double AdjustedLimit = VILimitMilliseconds * SpeedFactorMultiple;
-
-    //if this is the first time or we are resuming from pause
-    if(StartFPSTime == 0 || !resetOnce || lastSpeedFactor != l_SpeedFactor)
-    {
-       StartFPSTime = CurrentFPSTime;
-       totalVIs = 0;
-       resetOnce = 1;
-    }
-    else
-    {
-        ++totalVIs;
-    }
-
-    lastSpeedFactor = l_SpeedFactor;
+    /* frame duration based upon ROM setting (50/60hz) and mupen64plus speed adjustment */
+    const uint64_t period_ns = (uint64_t)(1000000000.0 * 100.0 / (g_dev.vi.expected_refresh_rate * l_SpeedFactor));
 
     timed_section_start(TIMED_SECTION_IDLE);
 
@@ -796,23 +950,7 @@ static void apply_speed_limiter(void)
     if(g_DebuggerActive) DebuggerCallback(DEBUG_UI_VI, 0);
 #endif
 
-    double totalElapsedGameTime = AdjustedLimit*totalVIs;
-    double elapsedRealTime = CurrentFPSTime - StartFPSTime;
-    double sleepTime = totalElapsedGameTime - elapsedRealTime;
-
-    //Reset if the sleep needed is an unreasonable value
-    static const double minSleepNeeded = -50;
-    static const double maxSleepNeeded = 50;
-    if(sleepTime < minSleepNeeded || sleepTime > (maxSleepNeeded*SpeedFactorMultiple))
-    {
-       resetOnce = 0;
-    }
-    else if(sleepTime > 0.0 && l_MainSpeedLimit)
-    {
-       DebugMessage(M64MSG_VERBOSE, "    apply_speed_limiter(): Waiting %ims", (int) sleepTime);
-
-       SDL_Delay((int) sleepTime);
-    }
+    speed_limiter_wait(&l_SpeedLimiter, period_ns, l_MainSpeedLimit);
 
     timed_section_end(TIMED_SECTION_IDLE);
 }
@@ -840,9 +978,23 @@ static void pause_loop(void)
         VidExt_GL_SwapBuffers();
         while(g_rom_pause)
         {
-            SDL_Delay(10);
+            /* resume, advance and stop signal at once; the timeout is only
+             * there to keep pumping the window and keyboard events */
+            if (l_PauseChanged != NULL)
+            {
+                SDL_LockMutex(l_PauseLock);
+                if (g_rom_pause)
+                    SDL_CondWaitTimeout(l_PauseChanged, l_PauseLock, 10);
+                SDL_UnlockMutex(l_PauseLock);
+            }
+            else
+            {
+                SDL_Delay(10);
+            }
             main_check_inputs();
         }
+
+        speed_limiter_resync(&l_SpeedLimiter);
     }
 }
 
@@ -850,15 +1002,27 @@ static void pause_loop(void)
  * Allow the core to perform various things */
 void new_vi(void)
 {
+    if (g_ViCallback != NULL)
+        (*g_ViCallback)(l_CurrentVI);
+
+    l_CurrentVI++;
+
     gs_apply_cheats();
 
     main_check_inputs();
 
+    apply_input_snapshot();
+
     timed_sections_refresh();
 
     pause_loop();
 
     apply_speed_limiter();
+
+    /* the frontend callbacks, OSD and pause loop may have changed the host
+     * FPU state; plugin calls are covered by the wrappers in plugin.c */
+    invalidate_host_rounding_mode();
+    apply_sse_rounding_mode();
 }
 
 static void open_mpk_file(struct file_storage* storage)
@@ -952,6 +1116,10 @@ m64p_error main_run(void)
     struct file_storage mpk;
     struct file_storage sra;
     int channels[GAME_CONTROLLERS_COUNT];
+    int audio_sink;
+    struct audio_dump audio_dump;
+    struct async_audio_out async_aout;
+    struct audio_out_backend aout_sink;
     struct audio_out_backend aout;
     struct clock_backend clock;
     struct controller_input_backend cins[GAME_CONTROLLERS_COUNT];
@@ -966,6 +1134,7 @@ m64p_error main_run(void)
 
     /* take the r4300 emulator mode from the config file at this point and cache it in a global variable */
     emumode = ConfigGetParamInt(g_CoreConfig, "R4300Emulator");
+    l_CurrentVI = 0;
 
     /* set some other core parameters based on the config file values */
     savestates_set_autoinc_slot(ConfigGetParamBool(g_CoreConfig, "AutoStateSlotIncrement"));
@@ -973,6 +1142,7 @@ m64p_error main_run(void)
     no_compiled_jump = ConfigGetParamBool(g_CoreConfig, "NoCompiledJump");
 #ifdef NEW_DYNAREC
     stop_after_jal = ConfigGetParamBool(g_CoreConfig, "DisableSpecRecomp");
+    translation_cache_mb = ConfigGetParamInt(g_CoreConfig, "DynarecCacheSize");
 #endif
     g_delay_si = ConfigGetParamBool(g_CoreConfig, "DelaySI");
     count_per_op = ConfigGetParamInt(g_CoreConfig, "CountPerOp");
@@ -1004,8 +1174,45 @@ m64p_error main_run(void)
     open_sra_file(&sra);
 
     /* setup backends */
-    aout = (struct audio_out_backend){ &g_dev.ai, set_audio_format_via_audio_plugin, push_audio_samples_via_audio_plugin };
-    clock = (struct clock_backend){ NULL, get_time_using_time_plus_delta };
+    audio_sink = ConfigGetParamInt(g_CoreConfig, "AudioSink");
+    memset(&audio_dump, 0, sizeof(audio_dump));
+    memset(&async_aout, 0, sizeof(async_aout));
+
+    if (audio_sink == AUDIO_SINK_NULL || audio_sink == AUDIO_SINK_DUMP)
+    {
+        /* null and dump sinks are fed from the audio thread */
+        open_audio_dump(&audio_dump, (audio_sink == AUDIO_SINK_DUMP)
+                        ? ConfigGetParamString(g_CoreConfig, "AudioDumpPath")
+                        : NULL);
+        aout_sink = (struct audio_out_backend){ &audio_dump, set_audio_format_via_audio_dump, push_audio_samples_via_audio_dump };
+        init_async_audio_out(&async_aout, &aout_sink, 0);
+        aout = (struct audio_out_backend){ &async_aout, set_audio_format_via_async_audio_out, push_audio_samples_via_async_audio_out };
+    }
+    else if (plugin_audio_threaded())
+    {
+        aout_sink = (struct audio_out_backend){ &g_dev.ai, set_audio_format_via_threaded_audio_plugin, push_audio_samples_via_threaded_audio_plugin };
+        init_async_audio_out(&async_aout, &aout_sink, AUDIO_THREAD_MAX_PENDING);
+        aout = (struct audio_out_backend){ &async_aout, set_audio_format_via_async_audio_out, push_audio_samples_via_async_audio_out };
+    }
+    else
+    {
+        aout = (struct audio_out_backend){ &g_dev.ai, set_audio_format_via_audio_plugin, push_audio_samples_via_audio_plugin };
+    }
+
+    clock = (struct clock_backend){ NULL, get_time_using_time_plus_delta, get_monotonic_time_ns };
+
+    if (ConfigGetParamInt(g_CoreConfig, "SpeedLimiterPacing") == SPEED_PACING_AUDIO
+     && async_aout.thread != NULL && async_aout.max_pending != 0)
+    {
+        init_speed_limiter(&l_SpeedLimiter, &clock, &async_aout, AUDIO_THREAD_MAX_PENDING / 2);
+    }
+    else
+    {
+        if (ConfigGetParamInt(g_CoreConfig, "SpeedLimiterPacing") == SPEED_PACING_AUDIO)
+            DebugMessage(M64MSG_WARNING, "Audio pacing needs a threaded audio plugin and AudioThread, pacing against the clock");
+        init_speed_limiter(&l_SpeedLimiter, &clock, NULL, 0);
+    }
+
     fla_storage = (struct storage_backend){ fla.data, fla.size, &fla, save_file_storage };
     sra_storage = (struct storage_backend){ sra.data, sra.size, &sra, save_file_storage };
     eep_storage = (struct storage_backend){ eep.data, (ROM_SETTINGS.savetype != EEPROM_16KB) ? PIF_PDT_EEPROM_4K : PIF_PDT_EEPROM_16K, &eep, save_file_storage };
@@ -1054,6 +1261,7 @@ m64p_error main_run(void)
                 emumode,
                 count_per_op,
                 no_compiled_jump,
+                ROM_PARAMS.idleloopskip,
                 &aout,
                 g_rom, g_rom_size,
                 &fla_storage,
@@ -1108,6 +1316,8 @@ m64p_error main_run(void)
     /* Startup message on the OSD */
     osd_new_message(OSD_MIDDLE_CENTER, "Mupen64Plus Started...");
 
+    l_EmuThread = SDL_ThreadID();
+    l_FramesToAdvance = 0;
     g_EmulatorRunning = 1;
     StateChanged(M64CORE_EMU_STATE, M64EMU_RUNNING);
 
@@ -1116,6 +1326,13 @@ m64p_error main_run(void)
     run_device(&g_dev);
 
     /* now begin to shut down */
+    ram_search_stop();
+    DebugMessage(M64MSG_INFO, "Frame pacing jitter: <0.1ms %u, <0.25ms %u, <0.5ms %u, <1ms %u, <2ms %u, <4ms %u, <8ms %u, more %u",
+                 l_SpeedLimiter.jitter[0], l_SpeedLimiter.jitter[1], l_SpeedLimiter.jitter[2], l_SpeedLimiter.jitter[3],
+                 l_SpeedLimiter.jitter[4], l_SpeedLimiter.jitter[5], l_SpeedLimiter.jitter[6], l_SpeedLimiter.jitter[7]);
+    release_async_audio_out(&async_aout);
+    close_audio_dump(&audio_dump);
+
 #ifdef WITH_LIRC
     lircStop();
 #endif // WITH_LIRC
@@ -1136,6 +1353,7 @@ m64p_error main_run(void)
     close_file_storage(&fla);
     close_file_storage(&eep);
     close_file_storage(&mpk);
+    set_file_storage_volatile(0);
 
     if (ConfigGetParamBool(g_CoreConfig, "OnScreenDisplay"))
     {
@@ -1148,7 +1366,9 @@ m64p_error main_run(void)
     gfx.romClosed();
 
     // clean up
+    pause_lock();
     g_EmulatorRunning = 0;
+    pause_unlock_and_signal();
     StateChanged(M64CORE_EMU_STATE, M64EMU_STOPPED);
 
     return M64ERR_SUCCESS;
@@ -1158,6 +1378,9 @@ on_input_open_failure:
 on_audio_open_failure:
     gfx.romClosed();
 on_gfx_open_failure:
+    release_async_audio_out(&async_aout);
+    close_audio_dump(&audio_dump);
+
     /* release gb_carts */
     for(i = 0; i < GAME_CONTROLLERS_COUNT; ++i) {
         if (g_gb_rom_files[i] != NULL) {
@@ -1177,6 +1400,8 @@ on_gfx_open_failure:
 
 void main_stop(void)
 {
+    int was_paused;
+
     /* note: this operation is asynchronous.  It may be called from a thread other than the
        main emulator thread, and may return before the emulator is completely stopped */
     if (!g_EmulatorRunning)
@@ -1198,13 +1423,16 @@ void main_stop(void)
         osd_delete_message(l_msgVol);
         l_msgVol = NULL;
     }
-    if (g_rom_pause)
-    {
-        g_rom_pause = 0;
-        StateChanged(M64CORE_EMU_STATE, M64EMU_RUNNING);
-    }
+    pause_lock();
+    was_paused = g_rom_pause;
+    g_rom_pause = 0;
+    l_FramesToAdvance = 0;
 
     stop_device(&g_dev);
+    pause_unlock_and_signal();
+
+    if (was_paused)
+        StateChanged(M64CORE_EMU_STATE, M64EMU_RUNNING);
 
 #ifdef DBG
     if(g_DebuggerActive)
@@ -1213,3 +1441,66 @@ void main_stop(void)
     }
 #endif
 }
+
+m64p_error main_lockstep(m64p_lockstep_params* params)
+{
+#ifdef COMPARE_CORE
+    static const enum lockstep_pass passes[] = { LOCKSTEP_RECORD, LOCKSTEP_CHECK, LOCKSTEP_CAPTURE };
+    int saved_emumode = ConfigGetParamInt(g_CoreConfig, "R4300Emulator");
+    m64p_error rval = M64ERR_SUCCESS;
+    size_t i;
+
+#ifdef NEW_DYNAREC
+    /* new_dynarec has no per instruction compare hook */
+    if (params->reference_mode == EMUMODE_DYNAREC || params->test_mode == EMUMODE_DYNAREC)
+    {
+        DebugMessage(M64MSG_ERROR, "Lockstep: the dynamic recompiler can't be compared in this build");
+        return M64ERR_UNSUPPORTED;
+    }
+#endif
+
+    params->diverged = 0;
+    params->divergence_step = 0;
+    params->divergence_pc = 0;
+
+    if (lockstep_init(params->steps, params->ram_interval) < 0)
+        return M64ERR_NO_MEMORY;
+
+    for (i = 0; i < sizeof(passes) / sizeof(passes[0]); ++i)
+    {
+        int mode = (passes[i] == LOCKSTEP_CHECK) ? params->test_mode : params->reference_mode;
+
+        if (passes[i] == LOCKSTEP_CAPTURE && !params->diverged)
+            break;
+
+        ConfigSetParameter(g_CoreConfig, "R4300Emulator", M64TYPE_INT, &mode);
+        lockstep_start(passes[i]);
+        main_state_load(params->state_path);
+
+        rval = main_run();
+        if (rval != M64ERR_SUCCESS)
+            break;
+
+        if (passes[i] == LOCKSTEP_RECORD && lockstep_completed_steps() == 0)
+        {
+            rval = M64ERR_FILES;
+            break;
+        }
+
+        if (passes[i] == LOCKSTEP_CHECK)
+            params->diverged = lockstep_diverged(&params->divergence_step, &params->divergence_pc);
+    }
+
+    ConfigSetParameter(g_CoreConfig, "R4300Emulator", M64TYPE_INT, &saved_emumode);
+
+    if (rval == M64ERR_SUCCESS)
+        lockstep_report();
+
+    lockstep_release();
+
+    return rval;
+#else
+    (void)params;
+    return M64ERR_UNSUPPORTED;
+#endif
+}
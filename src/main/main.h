@@ -47,6 +47,7 @@ extern struct device g_dev;
 extern char* g_gb_rom_files[GAME_CONTROLLERS_COUNT];
 
 extern m64p_frame_callback g_FrameCallback;
+extern m64p_frame_callback g_ViCallback;
 
 extern int g_delay_si;
 
@@ -67,6 +68,12 @@ m64p_error main_run(void);
 void main_stop(void);
 void main_toggle_pause(void);
 void main_advance_one(void);
+m64p_error main_advance_frames(unsigned int count, int wait);
+void main_pause_init(void);
+void main_pause_deinit(void);
+void main_set_input_snapshot(unsigned int mask, const uint32_t* keys);
+m64p_error main_lockstep(m64p_lockstep_params* params);
+void main_get_run_stats(m64p_run_stats* stats);
 
 void main_speedup(int percent);
 void main_speeddown(int percent);
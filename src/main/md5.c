@@ -55,6 +55,16 @@
 
 #include <string.h>
 
+/* The build already knows the host byte order; use it instead of probing
+ * every block at run time. */
+#ifndef ARCH_IS_BIG_ENDIAN
+#  ifdef M64P_BIG_ENDIAN
+#    define ARCH_IS_BIG_ENDIAN 1
+#  else
+#    define ARCH_IS_BIG_ENDIAN 0
+#  endif
+#endif
+
 #undef BYTE_ORDER   /* 1 = big-endian, -1 = little-endian, 0 = unknown */
 #ifdef ARCH_IS_BIG_ENDIAN
 #  define BYTE_ORDER (ARCH_IS_BIG_ENDIAN ? 1 : -1)
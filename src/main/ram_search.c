@@ -0,0 +1,308 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - ram_search.c                                            *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "ram_search.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "device/device.h"
+#include "device/memory/memory.h"
+#include "main.h"
+#include "util.h"
+
+/* Candidates are tracked in blocks of 64 values, one bit each.
+ * The filters are written without branches in their loops,
+ * so that the compiler can vectorize them. */
+static struct
+{
+    m64p_ram_search_type type;
+    unsigned int shift;     /* log2 of the size of a value */
+    size_t blocks;
+    size_t remaining;
+    uint8_t* snapshot;      /* RDRAM as of the previous filter, same layout */
+    uint64_t* candidates;
+} l_search;
+
+/* Gather the 0/1 bytes of hits into a 64-bit mask */
+static uint64_t pack_hits(const uint8_t* hits)
+{
+    uint64_t mask = 0;
+    unsigned int i;
+
+    for (i = 0; i < 8; ++i)
+    {
+        uint64_t w;
+        memcpy(&w, hits + 8 * i, sizeof(w));
+        mask |= ((little64(w) * UINT64_C(0x0102040810204080)) >> 56) << (8 * i);
+    }
+
+    return mask;
+}
+
+/* Values are compared in host order, each block being made of whole
+ * RDRAM words: the masks are put back in N64 order afterwards. */
+#define FILTER_LOOP(test) \
+    for (j = 0; j < 64; ++j) \
+        hits[j] = (test)
+
+#define DEFINE_FILTER(name, T) \
+static uint64_t name(const T* cur, const T* prev, m64p_ram_search_op op, T value) \
+{ \
+    uint8_t hits[64]; \
+    unsigned int j; \
+    switch (op) \
+    { \
+    case M64P_RAM_SEARCH_EQUAL:     FILTER_LOOP(cur[j] == value); break; \
+    case M64P_RAM_SEARCH_NOT_EQUAL: FILTER_LOOP(cur[j] != value); break; \
+    case M64P_RAM_SEARCH_LESS:      FILTER_LOOP(cur[j] < value); break; \
+    case M64P_RAM_SEARCH_GREATER:   FILTER_LOOP(cur[j] > value); break; \
+    case M64P_RAM_SEARCH_CHANGED:   FILTER_LOOP(cur[j] != prev[j]); break; \
+    case M64P_RAM_SEARCH_UNCHANGED: FILTER_LOOP(cur[j] == prev[j]); break; \
+    case M64P_RAM_SEARCH_INCREASED: FILTER_LOOP(cur[j] > prev[j]); break; \
+    default:                        FILTER_LOOP(cur[j] < prev[j]); break; \
+    } \
+    return pack_hits(hits); \
+}
+
+DEFINE_FILTER(filter_u8, uint8_t)
+DEFINE_FILTER(filter_s8, int8_t)
+DEFINE_FILTER(filter_u16, uint16_t)
+DEFINE_FILTER(filter_s16, int16_t)
+DEFINE_FILTER(filter_u32, uint32_t)
+DEFINE_FILTER(filter_s32, int32_t)
+DEFINE_FILTER(filter_float, float)
+
+/* value j of a block is host value j ^ S8 (bytes) or j ^ (S16 >> 1) (halfwords) */
+static uint64_t swizzle_mask(uint64_t mask, unsigned int shift)
+{
+    if (shift == 0 && S8 != 0)
+    {
+        mask = ((mask >> 1) & UINT64_C(0x5555555555555555)) | ((mask & UINT64_C(0x5555555555555555)) << 1);
+        mask = ((mask >> 2) & UINT64_C(0x3333333333333333)) | ((mask & UINT64_C(0x3333333333333333)) << 2);
+    }
+    else if (shift == 1 && S16 != 0)
+    {
+        mask = ((mask >> 1) & UINT64_C(0x5555555555555555)) | ((mask & UINT64_C(0x5555555555555555)) << 1);
+    }
+    return mask;
+}
+
+static uint64_t filter_block(const uint8_t* cur, const uint8_t* prev, m64p_ram_search_op op, double value)
+{
+    /* going through a signed 64-bit integer makes negative values wrap */
+    int64_t ivalue = (int64_t)value;
+
+    switch (l_search.type)
+    {
+    case M64P_RAM_SEARCH_U8:  return filter_u8(cur, prev, op, (uint8_t)ivalue);
+    case M64P_RAM_SEARCH_S8:  return filter_s8((const int8_t*)cur, (const int8_t*)prev, op, (int8_t)ivalue);
+    case M64P_RAM_SEARCH_U16: return filter_u16((const uint16_t*)cur, (const uint16_t*)prev, op, (uint16_t)ivalue);
+    case M64P_RAM_SEARCH_S16: return filter_s16((const int16_t*)cur, (const int16_t*)prev, op, (int16_t)ivalue);
+    case M64P_RAM_SEARCH_U32: return filter_u32((const uint32_t*)cur, (const uint32_t*)prev, op, (uint32_t)ivalue);
+    case M64P_RAM_SEARCH_S32: return filter_s32((const int32_t*)cur, (const int32_t*)prev, op, (int32_t)ivalue);
+    default:
+        /* compare floats bit for bit to tell changes, so that NaNs don't always differ */
+        if (op == M64P_RAM_SEARCH_CHANGED || op == M64P_RAM_SEARCH_UNCHANGED)
+            return filter_u32((const uint32_t*)cur, (const uint32_t*)prev, op, 0);
+        return filter_float((const float*)cur, (const float*)prev, op, (float)value);
+    }
+}
+
+static unsigned int popcount64(uint64_t x)
+{
+    x = x - ((x >> 1) & UINT64_C(0x5555555555555555));
+    x = (x & UINT64_C(0x3333333333333333)) + ((x >> 2) & UINT64_C(0x3333333333333333));
+    x = (x + (x >> 4)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+    return (unsigned int)((x * UINT64_C(0x0101010101010101)) >> 56);
+}
+
+static double value_at(size_t i)
+{
+    const uint8_t* mem = (const uint8_t*)g_dev.ri.rdram.dram;
+    union { uint32_t u; float f; } v;
+
+    switch (l_search.type)
+    {
+    case M64P_RAM_SEARCH_U8:  return mem[i ^ S8];
+    case M64P_RAM_SEARCH_S8:  return (int8_t)mem[i ^ S8];
+    case M64P_RAM_SEARCH_U16: return *(const uint16_t*)(mem + ((i << 1) ^ S16));
+    case M64P_RAM_SEARCH_S16: return *(const int16_t*)(mem + ((i << 1) ^ S16));
+    case M64P_RAM_SEARCH_U32: return g_dev.ri.rdram.dram[i];
+    case M64P_RAM_SEARCH_S32: return (int32_t)g_dev.ri.rdram.dram[i];
+    default:
+        v.u = g_dev.ri.rdram.dram[i];
+        return v.f;
+    }
+}
+
+
+m64p_error ram_search_start(m64p_ram_search_type type)
+{
+    size_t size = g_dev.ri.rdram.dram_size;
+
+    if (type < M64P_RAM_SEARCH_U8 || type > M64P_RAM_SEARCH_FLOAT)
+        return M64ERR_INPUT_INVALID;
+    if (!g_EmulatorRunning || g_dev.ri.rdram.dram == NULL)
+        return M64ERR_INVALID_STATE;
+
+    ram_search_stop();
+
+    l_search.type = type;
+    l_search.shift = (type >= M64P_RAM_SEARCH_U32) ? 2 : (type >= M64P_RAM_SEARCH_U16) ? 1 : 0;
+    l_search.blocks = (size >> l_search.shift) / 64;
+    l_search.remaining = l_search.blocks * 64;
+    l_search.snapshot = malloc(size);
+    l_search.candidates = malloc(l_search.blocks * sizeof(uint64_t));
+
+    if (l_search.snapshot == NULL || l_search.candidates == NULL)
+    {
+        ram_search_stop();
+        return M64ERR_NO_MEMORY;
+    }
+
+    memcpy(l_search.snapshot, g_dev.ri.rdram.dram, size);
+    memset(l_search.candidates, 0xff, l_search.blocks * sizeof(uint64_t));
+
+    return M64ERR_SUCCESS;
+}
+
+void ram_search_stop(void)
+{
+    free(l_search.snapshot);
+    free(l_search.candidates);
+    memset(&l_search, 0, sizeof(l_search));
+}
+
+size_t ram_search_filter(m64p_ram_search_op op, double value)
+{
+    const uint8_t* cur = (const uint8_t*)g_dev.ri.rdram.dram;
+    const size_t block_size = (size_t)64 << l_search.shift;
+    const int relative = (op >= M64P_RAM_SEARCH_CHANGED);
+    size_t b;
+
+    if (l_search.candidates == NULL)
+        return 0;
+
+    l_search.remaining = 0;
+
+    for (b = 0; b < l_search.blocks; ++b)
+    {
+        const size_t offset = b * block_size;
+        uint64_t bits = l_search.candidates[b];
+
+        if (bits == 0)
+            continue;
+
+        /* most of RDRAM doesn't change between two filters */
+        if (relative && memcmp(cur + offset, l_search.snapshot + offset, block_size) == 0)
+        {
+            if (op != M64P_RAM_SEARCH_UNCHANGED)
+                bits = 0;
+        }
+        else
+        {
+            bits &= swizzle_mask(filter_block(cur + offset, l_search.snapshot + offset, op, value), l_search.shift);
+            /* dropped blocks are never looked at again */
+            if (bits != 0)
+                memcpy(l_search.snapshot + offset, cur + offset, block_size);
+        }
+
+        l_search.candidates[b] = bits;
+        l_search.remaining += popcount64(bits);
+    }
+
+    return l_search.remaining;
+}
+
+size_t ram_search_results(size_t first, m64p_ram_search_result* results, size_t max_results)
+{
+    size_t b, skipped = 0, count = 0;
+    unsigned int j;
+
+    if (l_search.candidates == NULL)
+        return 0;
+
+    for (b = 0; b < l_search.blocks && count < max_results; ++b)
+    {
+        uint64_t bits = l_search.candidates[b];
+        unsigned int n = popcount64(bits);
+
+        if (skipped + n <= first)
+        {
+            skipped += n;
+            continue;
+        }
+
+        for (j = 0; j < 64 && count < max_results; ++j)
+        {
+            size_t i = b * 64 + j;
+
+            if (((bits >> j) & 1) == 0 || skipped++ < first)
+                continue;
+
+            results[count].address = 0x80000000 | (uint32_t)(i << l_search.shift);
+            results[count].value = value_at(i);
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+int ram_search_cheat_codes(uint32_t address, double value, m64p_cheat_code* codes)
+{
+    union { uint32_t u; float f; } raw;
+
+    if (l_search.candidates == NULL)
+        return 0;
+
+    address &= 0x00ffffff;
+
+    switch (l_search.type)
+    {
+    case M64P_RAM_SEARCH_U8:
+    case M64P_RAM_SEARCH_S8:
+        codes[0].address = 0x80000000 | address;
+        codes[0].value = (uint8_t)(int64_t)value;
+        return 1;
+    case M64P_RAM_SEARCH_U16:
+    case M64P_RAM_SEARCH_S16:
+        codes[0].address = 0x81000000 | (address & ~1u);
+        codes[0].value = (uint16_t)(int64_t)value;
+        return 1;
+    case M64P_RAM_SEARCH_U32:
+    case M64P_RAM_SEARCH_S32:
+        raw.u = (uint32_t)(int64_t)value;
+        break;
+    default:
+        raw.f = (float)value;
+        break;
+    }
+
+    /* GameShark codes write 16 bits at most */
+    address &= ~3u;
+    codes[0].address = 0x81000000 | address;
+    codes[0].value = raw.u >> 16;
+    codes[1].address = 0x81000000 | (address + 2);
+    codes[1].value = raw.u & 0xffff;
+    return 2;
+}
@@ -0,0 +1,47 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - ram_search.h                                            *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_MAIN_RAM_SEARCH_H
+#define M64P_MAIN_RAM_SEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "api/m64p_types.h"
+
+/* Incremental search of RDRAM for values of one type: every aligned value
+ * starts as a candidate, and each filter drops the candidates failing it.
+ * Meant to be used while the emulator is paused, or from the frame callback. */
+
+m64p_error ram_search_start(m64p_ram_search_type type);
+void ram_search_stop(void);
+
+/* Returns the number of candidates left. Relative operations compare
+ * with the values seen by the previous filter (or the start). */
+size_t ram_search_filter(m64p_ram_search_op op, double value);
+
+size_t ram_search_results(size_t first, m64p_ram_search_result* results, size_t max_results);
+
+/* Fill the GameShark codes writing value at address with the type of the
+ * search. Returns the number of codes, at most 2, 0 if there is no search. */
+int ram_search_cheat_codes(uint32_t address, double value, m64p_cheat_code* codes);
+
+#endif
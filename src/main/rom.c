@@ -26,6 +26,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <SDL.h>
+#include <SDL_thread.h>
 
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
@@ -36,15 +38,25 @@
 #include "api/m64p_config.h"
 #include "api/m64p_types.h"
 #include "device/memory/memory.h"
+#include "device/si/cic.h"
 #include "main.h"
 #include "md5.h"
 #include "osal/preproc.h"
 #include "osd/osd.h"
 #include "rom.h"
 #include "util.h"
+#include "xxh64.h"
 
 #define CHUNKSIZE 1024*128 /* Read files 128KB at a time. */
 
+/* MD5s of previously loaded ROMs, keyed by their much cheaper XXH64 */
+#define ROM_HASH_CACHE_FILE "romhash.cache"
+#define ROM_HASH_CACHE_MAX 1024
+
+/* Range of the ROM covered by the boot checksum in the header */
+#define BOOT_CRC_START 0x1000
+#define BOOT_CRC_LENGTH 0x100000
+
 /* Amount of cpu cycles per vi scanline - empirically determined */
 enum { DEFAULT_COUNT_PER_SCANLINE = 1500 };
 /* Number of cpu cycles per instruction */
@@ -132,6 +144,203 @@ static void swap_copy_rom(void* dst, const void* src, size_t len, unsigned char*
     }
 }
 
+static uint32_t rom_word(const unsigned char* rom, size_t offset)
+{
+    uint32_t word;
+    memcpy(&word, rom + offset, sizeof(word));
+    return big32(word);
+}
+
+/* Unknown boot code falls back to CIC 6102 without a warning here, the
+ * PIF reports it when the game is started. */
+static enum cic_version rom_cic_version(const unsigned char* rom, size_t size)
+{
+    uint32_t ipl3[0xfc0/4];
+    enum cic_version version = CIC_X102;
+    size_t i;
+
+    if (size < 0x40 + 0xfc0)
+        return version;
+
+    /* the ROM is still big endian here, the CIC detection sums host words */
+    for (i = 0; i < 0xfc0/4; ++i)
+        ipl3[i] = rom_word(rom, 0x40 + i*4);
+    cic_version_from_ipl3(ipl3, &version);
+
+    return version;
+}
+
+/* Computes the CRC1/CRC2 pair the boot code checks against the header.
+ * Returns 0 if the ROM is too small to carry one. */
+static int compute_boot_crc(const unsigned char* rom, size_t size, enum cic_version cic, uint32_t crc[2])
+{
+    uint32_t seed, t1, t2, t3, t4, t5, t6;
+    size_t i;
+
+    if (size < BOOT_CRC_START + BOOT_CRC_LENGTH)
+        return 0;
+
+    switch (cic)
+    {
+    case CIC_X103: seed = UINT32_C(0xA3886759); break;
+    case CIC_X105: seed = UINT32_C(0xDF26F436); break;
+    case CIC_X106: seed = UINT32_C(0x1FEA617A); break;
+    default:       seed = UINT32_C(0xF8CA4DDC); break;
+    }
+
+    t1 = t2 = t3 = t4 = t5 = t6 = seed;
+
+    for (i = BOOT_CRC_START; i < BOOT_CRC_START + BOOT_CRC_LENGTH; i += 4)
+    {
+        uint32_t d = rom_word(rom, i);
+        uint32_t r = (d << (d & 0x1f)) | (d >> ((32 - (d & 0x1f)) & 0x1f));
+
+        if (t6 + d < t6)
+            ++t4;
+        t6 += d;
+        t3 ^= d;
+        t5 += r;
+        t2 ^= (t2 > d) ? r : (t6 ^ d);
+
+        if (cic == CIC_X105)
+            t1 += rom_word(rom, 0x40 + 0x710 + (i & 0xff)) ^ d;
+        else
+            t1 += t5 ^ d;
+    }
+
+    switch (cic)
+    {
+    case CIC_X103:
+        crc[0] = (t6 ^ t4) + t3;
+        crc[1] = (t5 ^ t2) + t1;
+        break;
+    case CIC_X106:
+        crc[0] = (t6 * t4) + t3;
+        crc[1] = (t5 * t2) + t1;
+        break;
+    default:
+        crc[0] = t6 ^ t4 ^ t3;
+        crc[1] = t5 ^ t2 ^ t1;
+        break;
+    }
+
+    return 1;
+}
+
+struct boot_crc_job
+{
+    const unsigned char* rom;
+    size_t size;
+    enum cic_version cic;
+    uint32_t crc[2];
+    int valid;
+};
+
+static int boot_crc_thread(void* opaque)
+{
+    struct boot_crc_job* job = (struct boot_crc_job*)opaque;
+    job->valid = compute_boot_crc(job->rom, job->size, job->cic, job->crc);
+    return 0;
+}
+
+static char* rom_hash_cache_path(void)
+{
+    const char* dir = ConfigGetUserCachePath();
+    if (dir == NULL)
+        return NULL;
+    return formatstr("%s%s", dir, ROM_HASH_CACHE_FILE);
+}
+
+/* Looks up the MD5 of a ROM by key and size. Returns 1 on a hit; on a miss
+ * *entries is set to the number of lines in the cache. */
+static int rom_hash_cache_lookup(uint64_t key, unsigned int size, md5_byte_t* digest, unsigned int* entries)
+{
+    char* path;
+    FILE* f;
+    char line[128];
+    int found = 0;
+
+    *entries = 0;
+    if ((path = rom_hash_cache_path()) == NULL)
+        return 0;
+    f = fopen(path, "r");
+    free(path);
+    if (f == NULL)
+        return 0;
+
+    while (!found && fgets(line, sizeof(line), f) != NULL)
+    {
+        uint64_t line_key;
+        unsigned int line_size;
+        char md5[33];
+
+        ++*entries;
+        if (sscanf(line, "%" SCNx64 " %u %32s", &line_key, &line_size, md5) == 3
+         && line_key == key && line_size == size
+         && parse_hex(md5, digest, 16))
+            found = 1;
+    }
+
+    fclose(f);
+    return found;
+}
+
+/* Adds a line to the cache, dropping the oldest ones past ROM_HASH_CACHE_MAX */
+static void rom_hash_cache_store(uint64_t key, unsigned int size, const char* md5, unsigned int entries)
+{
+    char* path;
+    FILE* f;
+    char line[128];
+
+    if ((path = rom_hash_cache_path()) == NULL)
+        return;
+
+    if (entries < ROM_HASH_CACHE_MAX)
+    {
+        f = fopen(path, "a");
+    }
+    else
+    {
+        /* keep the newest entries only */
+        char* kept = NULL;
+        size_t kept_size = 0;
+        unsigned int skip = entries - ROM_HASH_CACHE_MAX + 1;
+
+        f = fopen(path, "r");
+        if (f != NULL)
+        {
+            kept = malloc((size_t)ROM_HASH_CACHE_MAX * sizeof(line));
+            while (kept != NULL && fgets(line, sizeof(line), f) != NULL)
+            {
+                size_t len = strlen(line);
+                if (skip > 0)
+                    --skip;
+                else if (kept_size + len <= (size_t)ROM_HASH_CACHE_MAX * sizeof(line))
+                {
+                    memcpy(kept + kept_size, line, len);
+                    kept_size += len;
+                }
+            }
+            fclose(f);
+        }
+
+        f = fopen(path, "w");
+        if (f != NULL && kept != NULL)
+            fwrite(kept, 1, kept_size, f);
+        free(kept);
+    }
+
+    if (f == NULL)
+        DebugMessage(M64MSG_WARNING, "Couldn't write ROM hash cache %s", path);
+    else
+    {
+        fprintf(f, "%016" PRIX64 " %u %s\n", key, size, md5);
+        fclose(f);
+    }
+
+    free(path);
+}
+
 m64p_error open_rom(const unsigned char* romimage, unsigned int size)
 {
     md5_state_t state;
@@ -139,6 +348,10 @@ m64p_error open_rom(const unsigned char* romimage, unsigned int size)
     romdatabase_entry* entry;
     char buffer[256];
     unsigned char imagetype;
+    struct boot_crc_job crc_job;
+    SDL_Thread* crc_thread;
+    uint64_t hash_key;
+    unsigned int cache_entries;
     int i;
 
     /* check input requirements */
@@ -164,20 +377,56 @@ m64p_error open_rom(const unsigned char* romimage, unsigned int size)
 
     memcpy(&ROM_HEADER, g_rom, sizeof(m64p_rom_header));
 
-    /* Calculate MD5 hash  */
-    md5_init(&state);
-    md5_append(&state, (const md5_byte_t*)g_rom, g_rom_size);
-    md5_finish(&state, digest);
-    for ( i = 0; i < 16; ++i )
-        sprintf(buffer+i*2, "%02X", digest[i]);
-    buffer[32] = '\0';
+    /* Verify the boot checksum while the ROM gets hashed */
+    crc_job.rom = g_rom;
+    crc_job.size = g_rom_size;
+    crc_job.cic = rom_cic_version(g_rom, g_rom_size);
+    crc_job.valid = 0;
+#if SDL_VERSION_ATLEAST(2,0,0)
+    crc_thread = SDL_CreateThread(boot_crc_thread, "m64pbootcrc", &crc_job);
+#else
+    crc_thread = SDL_CreateThread(boot_crc_thread, &crc_job);
+#endif
+    if (crc_thread == NULL)
+        boot_crc_thread(&crc_job);
+
+    /* Calculate MD5 hash, unless this ROM was seen before */
+    hash_key = xxh64(g_rom, g_rom_size, 0);
+    if (rom_hash_cache_lookup(hash_key, g_rom_size, digest, &cache_entries))
+    {
+        DebugMessage(M64MSG_VERBOSE, "MD5 found in ROM hash cache");
+        for ( i = 0; i < 16; ++i )
+            sprintf(buffer+i*2, "%02X", digest[i]);
+        buffer[32] = '\0';
+    }
+    else
+    {
+        md5_init(&state);
+        md5_append(&state, (const md5_byte_t*)g_rom, g_rom_size);
+        md5_finish(&state, digest);
+        for ( i = 0; i < 16; ++i )
+            sprintf(buffer+i*2, "%02X", digest[i]);
+        buffer[32] = '\0';
+        rom_hash_cache_store(hash_key, g_rom_size, buffer, cache_entries);
+    }
     strcpy(ROM_SETTINGS.MD5, buffer);
 
+    if (crc_thread != NULL)
+        SDL_WaitThread(crc_thread, NULL);
+    if (!crc_job.valid)
+        DebugMessage(M64MSG_VERBOSE, "ROM too small for a boot checksum");
+    else if (crc_job.crc[0] != sl(ROM_HEADER.CRC1) || crc_job.crc[1] != sl(ROM_HEADER.CRC2))
+        DebugMessage(M64MSG_WARNING, "Boot checksum mismatch: header %08" PRIX32 " %08" PRIX32 ", computed %08" PRIX32 " %08" PRIX32,
+                     sl(ROM_HEADER.CRC1), sl(ROM_HEADER.CRC2), crc_job.crc[0], crc_job.crc[1]);
+    else
+        DebugMessage(M64MSG_VERBOSE, "Boot checksum verified");
+
     /* add some useful properties to ROM_PARAMS */
     ROM_PARAMS.systemtype = rom_country_code_to_system_type(ROM_HEADER.Country_code);
     ROM_PARAMS.countperop = DEFAULT_COUNT_PER_OP;
     ROM_PARAMS.vitiming = DEFAULT_ALTERNATE_VI_TIMING;
     ROM_PARAMS.countperscanline = DEFAULT_COUNT_PER_SCANLINE;
+    ROM_PARAMS.idleloopskip = 1;
     ROM_PARAMS.cheats = NULL;
 
     memcpy(ROM_PARAMS.headername, ROM_HEADER.Name, 20);
@@ -197,6 +446,7 @@ m64p_error open_rom(const unsigned char* romimage, unsigned int size)
         ROM_PARAMS.countperop = entry->countperop;
         ROM_PARAMS.vitiming = entry->alternate_vi_timing;
         ROM_PARAMS.countperscanline = entry->count_per_scanline;
+        ROM_PARAMS.idleloopskip = entry->idle_loop_skip;
         ROM_PARAMS.cheats = entry->cheats;
     }
     else
@@ -210,6 +460,7 @@ m64p_error open_rom(const unsigned char* romimage, unsigned int size)
         ROM_PARAMS.countperop = DEFAULT_COUNT_PER_OP;
         ROM_PARAMS.vitiming = DEFAULT_ALTERNATE_VI_TIMING;
         ROM_PARAMS.countperscanline = DEFAULT_COUNT_PER_SCANLINE;
+        ROM_PARAMS.idleloopskip = 1;
         ROM_PARAMS.cheats = NULL;
     }
 
@@ -352,6 +603,12 @@ static size_t romdatabase_resolve_round(void)
             entry->entry.set_flags |= ROMDATABASE_ENTRY_COUNTEROP;
         }
 
+        if (!isset_bitmask(entry->entry.set_flags, ROMDATABASE_ENTRY_IDLE_LOOP_SKIP) &&
+            isset_bitmask(ref->set_flags, ROMDATABASE_ENTRY_IDLE_LOOP_SKIP)) {
+            entry->entry.idle_loop_skip = ref->idle_loop_skip;
+            entry->entry.set_flags |= ROMDATABASE_ENTRY_IDLE_LOOP_SKIP;
+        }
+
         if (!isset_bitmask(entry->entry.set_flags, ROMDATABASE_ENTRY_CHEATS) &&
             isset_bitmask(ref->set_flags, ROMDATABASE_ENTRY_CHEATS)) {
             if (ref->cheats)
@@ -451,6 +708,7 @@ void romdatabase_open(void)
             search->entry.countperop = DEFAULT_COUNT_PER_OP;
             search->entry.alternate_vi_timing = DEFAULT_ALTERNATE_VI_TIMING;
             search->entry.count_per_scanline = DEFAULT_COUNT_PER_SCANLINE;
+            search->entry.idle_loop_skip = 1;
             search->entry.cheats = NULL;
             search->entry.set_flags = ROMDATABASE_ENTRY_NONE;
 
@@ -578,6 +836,18 @@ void romdatabase_open(void)
                     DebugMessage(M64MSG_WARNING, "ROM Database: Invalid CountPerOp on line %i", lineno);
                 }
             }
+            else if(!strcmp(l.name, "IdleLoopSkip"))
+            {
+                if(!strcmp(l.value, "Yes")) {
+                    search->entry.idle_loop_skip = 1;
+                    search->entry.set_flags |= ROMDATABASE_ENTRY_IDLE_LOOP_SKIP;
+                } else if(!strcmp(l.value, "No")) {
+                    search->entry.idle_loop_skip = 0;
+                    search->entry.set_flags |= ROMDATABASE_ENTRY_IDLE_LOOP_SKIP;
+                } else {
+                    DebugMessage(M64MSG_WARNING, "ROM Database: Invalid IdleLoopSkip string on line %i", lineno);
+                }
+            }
             else if(!strncmp(l.name, "Cheat", 5))
             {
                 size_t len1 = 0, len2 = 0;
@@ -54,6 +54,7 @@ typedef struct _rom_params
    unsigned char countperop;
    int vitiming;
    int countperscanline;
+   int idleloopskip;
 } rom_params;
 
 extern m64p_rom_header   ROM_HEADER;
@@ -127,6 +128,7 @@ typedef struct
    unsigned char alternate_vi_timing;
    int count_per_scanline;
    unsigned char countperop;
+   unsigned char idle_loop_skip; /* 0 - No, 1 - Yes, skip polling loops to the next interrupt. */
    uint32_t set_flags;
 } romdatabase_entry;
 
@@ -139,7 +141,8 @@ enum romdatabase_entry_set_flags {
     ROMDATABASE_ENTRY_PLAYERS = BIT(4),
     ROMDATABASE_ENTRY_RUMBLE = BIT(5),
     ROMDATABASE_ENTRY_COUNTEROP = BIT(6),
-    ROMDATABASE_ENTRY_CHEATS = BIT(7)
+    ROMDATABASE_ENTRY_CHEATS = BIT(7),
+    ROMDATABASE_ENTRY_IDLE_LOOP_SKIP = BIT(8)
 };
 
 typedef struct _romdatabase_search
@@ -49,6 +49,8 @@
 #include "device/rsp/rsp_core.h"
 #include "device/si/si_controller.h"
 #include "device/vi/vi_controller.h"
+#include "cheat.h"
+#include "lockstep.h"
 #include "main.h"
 #include "main/list.h"
 #include "osal/preproc.h"
@@ -71,10 +73,21 @@ static const char* savestate_magic = "M64+SAVE";
 static const int savestate_latest_version = 0x00010100;  /* 1.1 */
 static const unsigned char pj64_magic[4] = { 0xC8, 0xA6, 0xD8, 0x23 };
 
+/* Optional sections follow the using_tlb word of m64p savestates as a tag,
+   a 32-bit size and the data. Older versions stop reading before them. */
+static const char* cheat_section_tag = "CHTS";
+#define SECTION_HEADER_SIZE 8
+/* Cheat sections are a few KB, anything bigger is a corrupt file */
+#define SECTION_MAX_SIZE (16 * 1024 * 1024)
+
 static savestates_job job = savestates_job_nothing;
 static savestates_type type = savestates_type_unknown;
 static char *fname = NULL;
 
+/* State kept by savestates_type_m64p_memory jobs. */
+static char *memory_state = NULL;
+static size_t memory_state_size = 0;
+
 static unsigned int slot = 0;
 static int autoinc_save_slot = 0;
 
@@ -196,130 +209,16 @@ static void savestates_clear_job(void)
 #define PUTDATA(buff, type, value) \
     do { type x = value; PUTARRAY(&x, buff, type, 1); } while(0)
 
-int savestates_load_m64p(char *filepath)
+/* Restores the machine state from the body of a m64p savestate (everything
+   following the 44-byte header), its event queue and additional data. */
+static void savestates_load_m64p_data(unsigned int version, unsigned char *curr,
+                                      char *queue, unsigned char *additionalData)
 {
-    unsigned char header[44];
-    gzFile f;
-    unsigned int version;
     int i;
     uint32_t FCR31;
 
-    size_t savestateSize;
-    unsigned char *savestateData, *curr;
-    char queue[1024];
-    unsigned char additionalData[4];
-
     uint32_t* cp0_regs = r4300_cp0_regs();
 
-#ifdef USE_SDL
-    SDL_LockMutex(savestates_lock);
-#endif
-
-    f = gzopen(filepath, "rb");
-    if(f==NULL)
-    {
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not open state file: %s", filepath);
-#ifdef USE_SDL
-        SDL_UnlockMutex(savestates_lock);
-#endif
-        return 0;
-    }
-
-    /* Read and check Mupen64Plus magic number. */
-    if (gzread(f, header, 44) != 44)
-    {
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not read header from state file %s", filepath);
-        gzclose(f);
-#ifdef USE_SDL
-        SDL_UnlockMutex(savestates_lock);
-#endif
-        return 0;
-    }
-    curr = header;
-
-    if(strncmp((char *)curr, savestate_magic, 8)!=0)
-    {
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State file: %s is not a valid Mupen64plus savestate.", filepath);
-        gzclose(f);
-#ifdef USE_SDL
-        SDL_UnlockMutex(savestates_lock);
-#endif
-        return 0;
-    }
-    curr += 8;
-
-    version = *curr++;
-    version = (version << 8) | *curr++;
-    version = (version << 8) | *curr++;
-    version = (version << 8) | *curr++;
-    if((version >> 16) != (savestate_latest_version >> 16))
-    {
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State version (%08x) isn't compatible. Please update Mupen64Plus.", version);
-        gzclose(f);
-#ifdef USE_SDL
-        SDL_UnlockMutex(savestates_lock);
-#endif
-        return 0;
-    }
-
-    if(memcmp((char *)curr, ROM_SETTINGS.MD5, 32))
-    {
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State ROM MD5 does not match current ROM.");
-        gzclose(f);
-#ifdef USE_SDL
-        SDL_UnlockMutex(savestates_lock);
-#endif
-        return 0;
-    }
-    curr += 32;
-
-    /* Read the rest of the savestate */
-    savestateSize = 16788244;
-    savestateData = curr = (unsigned char *)malloc(savestateSize);
-    if (savestateData == NULL)
-    {
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to load state.");
-        gzclose(f);
-#ifdef USE_SDL
-        SDL_UnlockMutex(savestates_lock);
-#endif
-        return 0;
-    }
-    if (version == 0x00010000) /* original savestate version */
-    {
-        if (gzread(f, savestateData, savestateSize) != savestateSize ||
-            (gzread(f, queue, sizeof(queue)) % 4) != 0)
-        {
-            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not read Mupen64Plus savestate 1.0 data from %s", filepath);
-            free(savestateData);
-            gzclose(f);
-#ifdef USE_SDL
-            SDL_UnlockMutex(savestates_lock);
-#endif
-            return 0;
-        }
-    }
-    else // version >= 0x00010100  saves entire eventqueue plus 4-byte using_tlb flage
-    {
-        if (gzread(f, savestateData, savestateSize) != savestateSize ||
-            gzread(f, queue, sizeof(queue)) != sizeof(queue) ||
-            gzread(f, additionalData, sizeof(additionalData)) != sizeof(additionalData))
-        {
-            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not read Mupen64Plus savestate 1.1 data from %s", filepath);
-            free(savestateData);
-            gzclose(f);
-#ifdef USE_SDL
-            SDL_UnlockMutex(savestates_lock);
-#endif
-            return 0;
-        }
-    }
-    
-    gzclose(f);
-#ifdef USE_SDL
-    SDL_UnlockMutex(savestates_lock);
-#endif
-
     // Parse savestate
     g_dev.ri.rdram.regs[RDRAM_CONFIG_REG]       = GETDATA(curr, uint32_t);
     g_dev.ri.rdram.regs[RDRAM_DEVICE_ID_REG]    = GETDATA(curr, uint32_t);
@@ -509,12 +408,231 @@ int savestates_load_m64p(char *filepath)
 #endif
 
     *r4300_cp0_last_addr() = *r4300_pc();
+}
+
+static uint32_t savestates_section_size(const unsigned char *section)
+{
+    uint32_t size;
+    memcpy(&size, section + 4, sizeof(size));
+    return little32(size);
+}
+
+static void savestates_put_section_header(unsigned char *section, const char *tag, uint32_t size)
+{
+    memcpy(section, tag, 4);
+    size = little32(size);
+    memcpy(section + 4, &size, sizeof(size));
+}
+
+/* Restores the cheat engine from an optional cheat section, starting at its
+   header. States without one leave the cheats as they are. */
+static void savestates_load_cheat_section(const unsigned char *section, size_t size)
+{
+    uint32_t section_size;
+
+    if (size < SECTION_HEADER_SIZE || memcmp(section, cheat_section_tag, 4) != 0)
+        return;
+
+    section_size = savestates_section_size(section);
+    if (section_size > size - SECTION_HEADER_SIZE
+     || !cheat_load_state(section + SECTION_HEADER_SIZE, section_size))
+        DebugMessage(M64MSG_WARNING, "Ignoring malformed cheat state in savestate.");
+}
+
+int savestates_load_m64p(char *filepath)
+{
+    unsigned char header[44];
+    gzFile f;
+    unsigned int version;
+
+    size_t savestateSize;
+    unsigned char *savestateData, *curr;
+    char queue[1024];
+    unsigned char additionalData[4];
+    unsigned char *section = NULL;
+    size_t sectionSize = 0;
+
+#ifdef USE_SDL
+    SDL_LockMutex(savestates_lock);
+#endif
+
+    f = gzopen(filepath, "rb");
+    if(f==NULL)
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not open state file: %s", filepath);
+#ifdef USE_SDL
+        SDL_UnlockMutex(savestates_lock);
+#endif
+        return 0;
+    }
+
+    /* Read and check Mupen64Plus magic number. */
+    if (gzread(f, header, 44) != 44)
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not read header from state file %s", filepath);
+        gzclose(f);
+#ifdef USE_SDL
+        SDL_UnlockMutex(savestates_lock);
+#endif
+        return 0;
+    }
+    curr = header;
+
+    if(strncmp((char *)curr, savestate_magic, 8)!=0)
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State file: %s is not a valid Mupen64plus savestate.", filepath);
+        gzclose(f);
+#ifdef USE_SDL
+        SDL_UnlockMutex(savestates_lock);
+#endif
+        return 0;
+    }
+    curr += 8;
+
+    version = *curr++;
+    version = (version << 8) | *curr++;
+    version = (version << 8) | *curr++;
+    version = (version << 8) | *curr++;
+    if((version >> 16) != (savestate_latest_version >> 16))
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State version (%08x) isn't compatible. Please update Mupen64Plus.", version);
+        gzclose(f);
+#ifdef USE_SDL
+        SDL_UnlockMutex(savestates_lock);
+#endif
+        return 0;
+    }
 
+    if(memcmp((char *)curr, ROM_SETTINGS.MD5, 32))
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State ROM MD5 does not match current ROM.");
+        gzclose(f);
+#ifdef USE_SDL
+        SDL_UnlockMutex(savestates_lock);
+#endif
+        return 0;
+    }
+    curr += 32;
+
+    /* Read the rest of the savestate */
+    savestateSize = 16788244;
+    savestateData = (unsigned char *)malloc(savestateSize);
+    if (savestateData == NULL)
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to load state.");
+        gzclose(f);
+#ifdef USE_SDL
+        SDL_UnlockMutex(savestates_lock);
+#endif
+        return 0;
+    }
+    if (version == 0x00010000) /* original savestate version */
+    {
+        if (gzread(f, savestateData, savestateSize) != savestateSize ||
+            (gzread(f, queue, sizeof(queue)) % 4) != 0)
+        {
+            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not read Mupen64Plus savestate 1.0 data from %s", filepath);
+            free(savestateData);
+            gzclose(f);
+#ifdef USE_SDL
+            SDL_UnlockMutex(savestates_lock);
+#endif
+            return 0;
+        }
+    }
+    else // version >= 0x00010100  saves entire eventqueue plus 4-byte using_tlb flage
+    {
+        if (gzread(f, savestateData, savestateSize) != savestateSize ||
+            gzread(f, queue, sizeof(queue)) != sizeof(queue) ||
+            gzread(f, additionalData, sizeof(additionalData)) != sizeof(additionalData))
+        {
+            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not read Mupen64Plus savestate 1.1 data from %s", filepath);
+            free(savestateData);
+            gzclose(f);
+#ifdef USE_SDL
+            SDL_UnlockMutex(savestates_lock);
+#endif
+            return 0;
+        }
+
+        /* optional cheat section */
+        section = malloc(SECTION_HEADER_SIZE);
+        if (section != NULL && gzread(f, section, SECTION_HEADER_SIZE) == SECTION_HEADER_SIZE
+         && memcmp(section, cheat_section_tag, 4) == 0)
+        {
+            uint32_t size = savestates_section_size(section);
+            unsigned char *grown = NULL;
+
+            if (size <= SECTION_MAX_SIZE)
+                grown = realloc(section, SECTION_HEADER_SIZE + (size_t)size);
+            else
+                DebugMessage(M64MSG_WARNING, "Ignoring oversized cheat state in savestate.");
+            if (grown != NULL)
+            {
+                section = grown;
+                if (gzread(f, section + SECTION_HEADER_SIZE, size) == (int)size)
+                    sectionSize = SECTION_HEADER_SIZE + (size_t)size;
+            }
+        }
+    }
+    
+    gzclose(f);
+#ifdef USE_SDL
+    SDL_UnlockMutex(savestates_lock);
+#endif
+
+    savestates_load_m64p_data(version, savestateData, queue, additionalData);
+    savestates_load_cheat_section(section, sectionSize);
+
+    free(section);
     free(savestateData);
     main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State loaded from: %s", namefrompath(filepath));
     return 1;
 }
 
+static int savestates_load_m64p_memory(void)
+{
+    unsigned char *body;
+    char queue[1024];
+    unsigned char additionalData[4];
+
+    if (memory_state == NULL)
+    {
+        DebugMessage(M64MSG_WARNING, "No in-memory state to load.");
+        return 0;
+    }
+
+    /* Parsing byte swaps the buffer in place on big endian hosts, so it
+       works on a copy there; little endian hosts parse the state directly. */
+#ifdef M64P_BIG_ENDIAN
+    body = malloc(16788244);
+    if (body == NULL)
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to load state.");
+        return 0;
+    }
+    memcpy(body, memory_state + 44, 16788244);
+#else
+    body = (unsigned char *)memory_state + 44;
+#endif
+    memcpy(queue, memory_state + 44 + 16788244, sizeof(queue));
+    memcpy(additionalData, memory_state + 44 + 16788244 + sizeof(queue), sizeof(additionalData));
+
+    savestates_load_m64p_data(savestate_latest_version, body, queue, additionalData);
+
+#ifdef M64P_BIG_ENDIAN
+    free(body);
+#endif
+
+    if (memory_state_size > 44 + 16788244 + sizeof(queue) + sizeof(additionalData))
+    {
+        size_t offset = 44 + 16788244 + sizeof(queue) + sizeof(additionalData);
+        savestates_load_cheat_section((const unsigned char *)memory_state + offset,
+                                      memory_state_size - offset);
+    }
+    return 1;
+}
+
 static int savestates_load_pj64(char *filepath, void *handle,
                                 int (*read_func)(void *, void *, size_t))
 {
@@ -732,30 +850,8 @@ static int savestates_load_pj64(char *filepath, void *handle,
         MyEntryLo0 = GETDATA(curr, unsigned int);
         MyEntryLo1 = GETDATA(curr, unsigned int);
 
-        // This is copied from TLBWI instruction
-        g_dev.r4300.cp0.tlb.entries[i].g = (MyEntryLo0 & MyEntryLo1 & 1);
-        g_dev.r4300.cp0.tlb.entries[i].pfn_even = (MyEntryLo0 & 0x3FFFFFC0) >> 6;
-        g_dev.r4300.cp0.tlb.entries[i].pfn_odd = (MyEntryLo1 & 0x3FFFFFC0) >> 6;
-        g_dev.r4300.cp0.tlb.entries[i].c_even = (MyEntryLo0 & 0x38) >> 3;
-        g_dev.r4300.cp0.tlb.entries[i].c_odd = (MyEntryLo1 & 0x38) >> 3;
-        g_dev.r4300.cp0.tlb.entries[i].d_even = (MyEntryLo0 & 0x4) >> 2;
-        g_dev.r4300.cp0.tlb.entries[i].d_odd = (MyEntryLo1 & 0x4) >> 2;
-        g_dev.r4300.cp0.tlb.entries[i].v_even = (MyEntryLo0 & 0x2) >> 1;
-        g_dev.r4300.cp0.tlb.entries[i].v_odd = (MyEntryLo1 & 0x2) >> 1;
-        g_dev.r4300.cp0.tlb.entries[i].asid = (MyEntryHi & 0xFF);
-        g_dev.r4300.cp0.tlb.entries[i].vpn2 = (MyEntryHi & 0xFFFFE000) >> 13;
-        //g_dev.r4300.cp0.tlb.entries[i].r = (MyEntryHi & 0xC000000000000000LL) >> 62;
-        g_dev.r4300.cp0.tlb.entries[i].mask = (MyPageMask & 0x1FFE000) >> 13;
-           
-        g_dev.r4300.cp0.tlb.entries[i].start_even = g_dev.r4300.cp0.tlb.entries[i].vpn2 << 13;
-        g_dev.r4300.cp0.tlb.entries[i].end_even = g_dev.r4300.cp0.tlb.entries[i].start_even+
-          (g_dev.r4300.cp0.tlb.entries[i].mask << 12) + 0xFFF;
-        g_dev.r4300.cp0.tlb.entries[i].phys_even = g_dev.r4300.cp0.tlb.entries[i].pfn_even << 12;
-           
-        g_dev.r4300.cp0.tlb.entries[i].start_odd = g_dev.r4300.cp0.tlb.entries[i].end_even+1;
-        g_dev.r4300.cp0.tlb.entries[i].end_odd = g_dev.r4300.cp0.tlb.entries[i].start_odd+
-          (g_dev.r4300.cp0.tlb.entries[i].mask << 12) + 0xFFF;
-        g_dev.r4300.cp0.tlb.entries[i].phys_odd = g_dev.r4300.cp0.tlb.entries[i].pfn_odd << 12;
+        tlb_entry_from_cp0(&g_dev.r4300.cp0.tlb.entries[i],
+                           MyEntryLo0, MyEntryLo1, MyEntryHi, MyPageMask);
 
         tlb_map(&g_dev.r4300.cp0.tlb, i);
     }
@@ -890,7 +986,11 @@ int savestates_load(void)
     char *filepath = NULL;
     int ret = 0;
 
-    if (fname == NULL) // For slots, autodetect the savestate type
+    if (type == savestates_type_m64p_memory)
+    {
+        ret = savestates_load_m64p_memory();
+    }
+    else if (fname == NULL) // For slots, autodetect the savestate type
     {
         // try M64P type first
         type = savestates_type_m64p;
@@ -956,6 +1056,7 @@ int savestates_load(void)
 
     // deliver callback to indicate completion of state loading operation
     StateChanged(M64CORE_STATE_LOADCOMPLETE, ret);
+    lockstep_state_loaded(ret);
 
     savestates_clear_job();
 
@@ -1000,43 +1101,38 @@ static void savestates_save_m64p_work(struct work_struct *work)
 #endif
 }
 
-int savestates_save_m64p(char *filepath)
+/* Serializes the machine state into a malloc'd m64p savestate image,
+   header included. Returns NULL on allocation failure. */
+static char *savestates_save_m64p_data(size_t *size)
 {
     unsigned char outbuf[4];
     int i;
 
     char queue[1024];
 
-    struct savestate_work *save;
-    char *curr;
+    char *data, *curr;
 
-    uint32_t* cp0_regs = r4300_cp0_regs();
+    unsigned char *cheat_state;
+    size_t cheat_size = 0;
 
-    save = malloc(sizeof(*save));
-    if (!save) {
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to save state.");
-        return 0;
-    }
-
-    save->filepath = strdup(filepath);
-
-    if(autoinc_save_slot)
-        savestates_inc_slot();
+    uint32_t* cp0_regs = r4300_cp0_regs();
 
     save_eventqueue_infos(&g_dev.r4300.cp0, queue);
+    cheat_state = cheat_save_state(&cheat_size);
 
     // Allocate memory for the save state data
-    save->size = 16788288 + sizeof(queue) + 4;
-    save->data = curr = malloc(save->size);
-    if (save->data == NULL)
+    *size = 16788288 + sizeof(queue) + 4;
+    if (cheat_state != NULL)
+        *size += SECTION_HEADER_SIZE + cheat_size;
+    data = curr = malloc(*size);
+    if (data == NULL)
     {
-        free(save->filepath);
-        free(save);
         main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to save state.");
-        return 0;
+        free(cheat_state);
+        return NULL;
     }
 
-    memset(save->data, 0, save->size);
+    memset(data, 0, *size);
 
     // Write the save state data to memory
     PUTARRAY(savestate_magic, curr, unsigned char, 8);
@@ -1257,12 +1353,72 @@ int savestates_save_m64p(char *filepath)
     PUTDATA(curr, unsigned int, 0);
 #endif
 
+    if (cheat_state != NULL)
+    {
+        savestates_put_section_header((unsigned char *)curr, cheat_section_tag, (uint32_t)cheat_size);
+        curr += SECTION_HEADER_SIZE;
+        PUTARRAY(cheat_state, curr, unsigned char, cheat_size);
+        free(cheat_state);
+    }
+
+    return data;
+}
+
+int savestates_save_m64p(char *filepath)
+{
+    struct savestate_work *save;
+
+    save = malloc(sizeof(*save));
+    if (!save) {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to save state.");
+        return 0;
+    }
+
+    save->filepath = strdup(filepath);
+
+    if(autoinc_save_slot)
+        savestates_inc_slot();
+
+    save->data = savestates_save_m64p_data(&save->size);
+    if (save->data == NULL)
+    {
+        free(save->filepath);
+        free(save);
+        return 0;
+    }
+
     init_work(&save->work, savestates_save_m64p_work);
     queue_work(&save->work);
 
     return 1;
 }
 
+static int savestates_save_m64p_memory(void)
+{
+    size_t size;
+    char *data = savestates_save_m64p_data(&size);
+
+    if (data == NULL)
+        return 0;
+
+    free(memory_state);
+    memory_state = data;
+    memory_state_size = size;
+    return 1;
+}
+
+int savestates_has_memory_state(void)
+{
+    return memory_state != NULL;
+}
+
+void savestates_free_memory_state(void)
+{
+    free(memory_state);
+    memory_state = NULL;
+    memory_state_size = 0;
+}
+
 static int savestates_save_pj64(char *filepath, void *handle,
                                 int (*write_func)(void *, const void *, size_t))
 {
@@ -1501,6 +1657,15 @@ int savestates_save(void)
     char *filepath;
     int ret = 0;
 
+    /* In-memory states are silent: they are taken far too often to be
+       reported to the front-end. */
+    if (type == savestates_type_m64p_memory)
+    {
+        ret = savestates_save_m64p_memory();
+        savestates_clear_job();
+        return ret;
+    }
+
     /* Can only save PJ64 savestates on VI / COMPARE interrupt.
        Otherwise try again in a little while. */
     if ((type == savestates_type_pj64_zip ||
@@ -1550,4 +1715,5 @@ void savestates_deinit(void)
     SDL_DestroyMutex(savestates_lock);
 #endif
     savestates_clear_job();
+    savestates_free_memory_state();
 }
@@ -37,7 +37,8 @@ typedef enum _savestates_type
     savestates_type_unknown,
     savestates_type_m64p,
     savestates_type_pj64_zip,
-    savestates_type_pj64_unc
+    savestates_type_pj64_unc,
+    savestates_type_m64p_memory  /* single in-memory slot, no file involved */
 } savestates_type;
 
 savestates_job savestates_get_job(void);
@@ -51,6 +52,9 @@ int savestates_save(void);
 int savestates_save_m64p(char *filepath);
 int savestates_load_m64p(char *filepath);
 
+int savestates_has_memory_state(void);
+void savestates_free_memory_state(void);
+
 void savestates_select_slot(unsigned int s);
 unsigned int savestates_get_slot(void);
 void savestates_set_autoinc_slot(int b);
@@ -0,0 +1,160 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - speed_limiter.c                                         *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "speed_limiter.h"
+
+#include <SDL.h>
+#include <string.h>
+
+#include "async_audio_out.h"
+#include "backends/clock_backend.h"
+
+#ifndef WIN32
+#include <time.h>
+#endif
+
+/* frames later than this are given up on instead of being caught up */
+#define RESYNC_LATE_NS 50000000
+/* bounds of the spin margin */
+#define MIN_SPIN_NS 50000
+#define MAX_SPIN_NS 4000000
+/* largest period correction of audio pacing, in 1/1000 */
+#define AUDIO_MAX_SKEW 50
+
+static const uint64_t jitter_bounds_ns[SPEED_LIMITER_JITTER_BUCKETS - 1] =
+{
+    100000, 250000, 500000, 1000000, 2000000, 4000000, 8000000
+};
+
+static void sleep_ns(uint64_t ns)
+{
+#ifdef WIN32
+    SDL_Delay((Uint32)(ns / 1000000));
+#else
+    struct timespec ts;
+    ts.tv_sec = (time_t)(ns / 1000000000);
+    ts.tv_nsec = (long)(ns % 1000000000);
+    nanosleep(&ts, NULL);
+#endif
+}
+
+static void wait_until(struct speed_limiter* limiter, uint64_t deadline)
+{
+    uint64_t now = clock_get_monotonic_ns(limiter->clock);
+
+    if (deadline > now + limiter->spin_ns)
+    {
+        uint64_t wakeup = deadline - limiter->spin_ns;
+        uint64_t oversleep;
+
+        sleep_ns(wakeup - now);
+        now = clock_get_monotonic_ns(limiter->clock);
+
+        /* keep the margin around twice the usual oversleep */
+        oversleep = (now > wakeup) ? now - wakeup : 0;
+        limiter->spin_ns = (limiter->spin_ns * 7 + oversleep * 2) / 8;
+        if (limiter->spin_ns < MIN_SPIN_NS)
+            limiter->spin_ns = MIN_SPIN_NS;
+        else if (limiter->spin_ns > MAX_SPIN_NS)
+            limiter->spin_ns = MAX_SPIN_NS;
+    }
+
+    while (now < deadline)
+        now = clock_get_monotonic_ns(limiter->clock);
+}
+
+static uint64_t audio_paced_period(const struct speed_limiter* limiter, uint64_t period_ns)
+{
+    int target = (int)limiter->audio_target;
+    int skew = ((int)async_audio_out_pending(limiter->audio) - target) * AUDIO_MAX_SKEW / target;
+
+    if (skew > AUDIO_MAX_SKEW)
+        skew = AUDIO_MAX_SKEW;
+    else if (skew < -AUDIO_MAX_SKEW)
+        skew = -AUDIO_MAX_SKEW;
+
+    /* a fuller queue means audio is consumed slower than produced */
+    return (uint64_t)((int64_t)period_ns + (int64_t)period_ns * skew / 1000);
+}
+
+static void count_jitter(struct speed_limiter* limiter, uint64_t interval_ns, uint64_t period_ns)
+{
+    uint64_t deviation = (interval_ns > period_ns)
+        ? interval_ns - period_ns
+        : period_ns - interval_ns;
+    unsigned int i = 0;
+
+    while (i < SPEED_LIMITER_JITTER_BUCKETS - 1 && deviation >= jitter_bounds_ns[i])
+        ++i;
+
+    ++limiter->jitter[i];
+}
+
+
+void init_speed_limiter(struct speed_limiter* limiter,
+                        struct clock_backend* clock,
+                        const struct async_audio_out* audio,
+                        unsigned int audio_target)
+{
+    memset(limiter, 0, sizeof(*limiter));
+    limiter->clock = clock;
+    limiter->audio = (audio_target != 0) ? audio : NULL;
+    limiter->audio_target = audio_target;
+    limiter->spin_ns = 1000000;
+}
+
+void speed_limiter_resync(struct speed_limiter* limiter)
+{
+    limiter->synced = 0;
+}
+
+void speed_limiter_wait(struct speed_limiter* limiter, uint64_t period_ns, int enabled)
+{
+    uint64_t now = clock_get_monotonic_ns(limiter->clock);
+
+    if (!limiter->synced || !enabled)
+    {
+        limiter->deadline_ns = now;
+        limiter->last_frame_ns = now;
+        limiter->synced = enabled;
+        return;
+    }
+
+    if (limiter->audio != NULL)
+        period_ns = audio_paced_period(limiter, period_ns);
+
+    limiter->deadline_ns += period_ns;
+
+    if (now > limiter->deadline_ns + RESYNC_LATE_NS)
+    {
+        /* a frame this late is still counted, as the worst kind of jitter */
+        ++limiter->jitter[SPEED_LIMITER_JITTER_BUCKETS - 1];
+        limiter->deadline_ns = now;
+        limiter->last_frame_ns = now;
+        return;
+    }
+
+    wait_until(limiter, limiter->deadline_ns);
+
+    now = clock_get_monotonic_ns(limiter->clock);
+    count_jitter(limiter, now - limiter->last_frame_ns, period_ns);
+    limiter->last_frame_ns = now;
+}
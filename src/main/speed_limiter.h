@@ -0,0 +1,67 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - speed_limiter.h                                         *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_MAIN_SPEED_LIMITER_H
+#define M64P_MAIN_SPEED_LIMITER_H
+
+#include <stdint.h>
+
+struct clock_backend;
+struct async_audio_out;
+
+/* frame interval deviations are counted in buckets bounded by
+ * 0.1, 0.25, 0.5, 1, 2, 4 and 8 ms, the last one is for larger ones */
+#define SPEED_LIMITER_JITTER_BUCKETS 8
+
+/* Paces frames against a fixed timeline: frame n is released at
+ * start + n * period, so that late wakeups don't accumulate.
+ * Waits sleep until shortly before the deadline and spin the rest,
+ * the spin margin following the observed oversleep of the host. */
+struct speed_limiter
+{
+    struct clock_backend* clock;
+
+    /* when not NULL, the period is nudged to keep this many AI DMAs
+     * queued to the audio thread, so that frames follow the audio clock */
+    const struct async_audio_out* audio;
+    unsigned int audio_target;
+
+    uint64_t deadline_ns;
+    uint64_t last_frame_ns;
+    uint64_t spin_ns;
+    int synced;
+
+    unsigned int jitter[SPEED_LIMITER_JITTER_BUCKETS];
+};
+
+void init_speed_limiter(struct speed_limiter* limiter,
+                        struct clock_backend* clock,
+                        const struct async_audio_out* audio,
+                        unsigned int audio_target);
+
+/* Forget the timeline, e.g. after a pause. */
+void speed_limiter_resync(struct speed_limiter* limiter);
+
+/* Wait for the end of the current frame, lasting period_ns nanoseconds
+ * at the current speed. When not enabled, nothing is waited for. */
+void speed_limiter_wait(struct speed_limiter* limiter, uint64_t period_ns, int enabled);
+
+#endif
@@ -25,6 +25,10 @@
 #include "main/main.h"
 #include "plugin.h"
 #include "device/si/game_controller.h"
+#include "device/si/pif.h"
+
+static unsigned int l_snapshot_mask = 0;
+static uint32_t l_snapshot_keys[GAME_CONTROLLERS_COUNT];
 
 int egcvip_is_connected(void* opaque, enum pak_type* pak)
 {
@@ -58,10 +62,29 @@ uint32_t egcvip_get_input(void* opaque)
     BUTTONS keys = { 0 };
     int channel = *(int*)opaque;
 
+    if (egcvip_has_input_snapshot(channel))
+        return l_snapshot_keys[channel];
+
     if (input.getKeys)
         input.getKeys(channel, &keys);
 
     return keys.Value;
+}
+
+void egcvip_set_input_snapshot(unsigned int mask, const uint32_t* keys)
+{
+    size_t i;
 
+    for (i = 0; i < GAME_CONTROLLERS_COUNT; ++i)
+    {
+        if (mask & (1 << i))
+            l_snapshot_keys[i] = keys[i];
+    }
+
+    l_snapshot_mask = mask & ((1 << GAME_CONTROLLERS_COUNT) - 1);
 }
 
+int egcvip_has_input_snapshot(int channel)
+{
+    return (l_snapshot_mask >> channel) & 1;
+}
@@ -30,4 +30,10 @@ int egcvip_is_connected(void* opaque, enum pak_type* pak);
 
 uint32_t egcvip_get_input(void* opaque);
 
+/* Per-VI input snapshot: BUTTONS reads of the channels in mask are served
+ * from keys (one value per channel) without calling the input plugin,
+ * until the next snapshot. A zero mask gives control back to the plugin. */
+void egcvip_set_input_snapshot(unsigned int mask, const uint32_t* keys);
+int egcvip_has_input_snapshot(int channel);
+
 #endif
@@ -26,6 +26,7 @@
 #include "device/ai/ai_controller.h"
 #include "device/ri/ri_controller.h"
 #include "device/vi/vi_controller.h"
+#include "main/async_audio_out.h"
 #include "main/rom.h"
 #include "plugin/plugin.h"
 
@@ -61,3 +62,25 @@ void push_audio_samples_via_audio_plugin(void* user_data, const void* buffer, si
     ai->regs[AI_DRAM_ADDR_REG] = saved_ai_dram;
 }
 
+
+uint32_t g_threaded_audio_plugin_regs[AI_REGS_COUNT];
+
+void set_audio_format_via_threaded_audio_plugin(void* user_data, unsigned int frequency, unsigned int bits)
+{
+    /* called from the audio thread, so only touch the plugin registers */
+    struct ai_controller* ai = (struct ai_controller*)user_data;
+
+    g_threaded_audio_plugin_regs[AI_DACRATE_REG] = ai->vi->clock / frequency - 1;
+    g_threaded_audio_plugin_regs[AI_BITRATE_REG] = bits - 1;
+
+    audio.aiDacrateChanged(ROM_PARAMS.systemtype);
+}
+
+void push_audio_samples_via_threaded_audio_plugin(void* user_data, const void* buffer, size_t size)
+{
+    /* buffer points in the async audio ring, which the plugin sees as its RDRAM */
+    g_threaded_audio_plugin_regs[AI_DRAM_ADDR_REG] = (const uint8_t*)buffer - g_async_audio_ring;
+    g_threaded_audio_plugin_regs[AI_LEN_REG] = size;
+
+    audio.aiLenChanged();
+}
@@ -23,8 +23,18 @@
 #define M64P_PLUGIN_EMULATE_SPEAKER_VIA_AUDIO_PLUGIN_H
 
 #include <stddef.h>
+#include <stdint.h>
+
+#include "device/ai/ai_controller.h"
 
 void set_audio_format_via_audio_plugin(void* user_data, unsigned int frequency, unsigned int bits);
 void push_audio_samples_via_audio_plugin(void* user_data, const void* buffer, size_t size);
 
+/* AI registers seen by an audio plugin fed from the audio thread.
+ * Its RDRAM view is the async audio ring. */
+extern uint32_t g_threaded_audio_plugin_regs[AI_REGS_COUNT];
+
+void set_audio_format_via_threaded_audio_plugin(void* user_data, unsigned int frequency, unsigned int bits);
+void push_audio_samples_via_threaded_audio_plugin(void* user_data, const void* buffer, size_t size);
+
 #endif
@@ -25,10 +25,12 @@
 
 #include "api/callbacks.h"
 #include "api/m64p_common.h"
+#include "api/m64p_config.h"
 #include "api/m64p_plugin.h"
 #include "api/m64p_types.h"
 #include "device/ai/ai_controller.h"
 #include "device/memory/memory.h"
+#include "device/r4300/cp1.h"
 #include "device/r4300/r4300_core.h"
 #include "device/rdp/rdp_core.h"
 #include "device/rsp/rsp_core.h"
@@ -37,6 +39,8 @@
 #include "dummy_input.h"
 #include "dummy_rsp.h"
 #include "dummy_video.h"
+#include "emulate_speaker_via_audio_plugin.h"
+#include "main/async_audio_out.h"
 #include "main/main.h"
 #include "main/rom.h"
 #include "main/version.h"
@@ -117,6 +121,8 @@ static RSP_INFO rsp_info;
 static int l_RspAttached = 0;
 static int l_InputAttached = 0;
 static int l_AudioAttached = 0;
+static int l_AudioThreaded = 0;
+static int l_AudioCapabilities = 0;
 static int l_GfxAttached = 0;
 
 static unsigned int dummy;
@@ -147,6 +153,92 @@ static void backcompat_setRenderCallbackIntercept(void (*callback)(int))
     l_mainRenderCallback = callback;
 }
 
+/* Plugin calls made while emulating are wrapped so that the FCR31 rounding
+ * mode gets applied again afterwards: the plugin may have changed the host
+ * FPU control word or MXCSR. The real entry points are kept in the l_*_impl
+ * copies. */
+static gfx_plugin_functions l_gfx_impl;
+static audio_plugin_functions l_audio_impl;
+static input_plugin_functions l_input_impl;
+static rsp_plugin_functions l_rsp_impl;
+
+static void restore_rounding_mode(void)
+{
+    invalidate_host_rounding_mode();
+    apply_sse_rounding_mode();
+}
+
+#define FPU_GUARD(impl, field, params, args) \
+    static void guarded_##impl##_##field params \
+    { \
+        l_##impl##_impl.field args; \
+        restore_rounding_mode(); \
+    }
+
+FPU_GUARD(gfx, processDList, (void), ())
+FPU_GUARD(gfx, processRDPList, (void), ())
+FPU_GUARD(gfx, showCFB, (void), ())
+FPU_GUARD(gfx, updateScreen, (void), ())
+FPU_GUARD(gfx, viStatusChanged, (void), ())
+FPU_GUARD(gfx, viWidthChanged, (void), ())
+FPU_GUARD(gfx, fBRead, (unsigned int addr), (addr))
+FPU_GUARD(gfx, fBWrite, (unsigned int addr, unsigned int size), (addr, size))
+FPU_GUARD(gfx, fBGetFrameBufferInfo, (void* p), (p))
+FPU_GUARD(audio, aiDacrateChanged, (int system_type), (system_type))
+FPU_GUARD(audio, aiLenChanged, (void), ())
+FPU_GUARD(audio, processAList, (void), ())
+FPU_GUARD(input, controllerCommand, (int control, unsigned char* command), (control, command))
+FPU_GUARD(input, getKeys, (int control, BUTTONS* keys), (control, keys))
+FPU_GUARD(input, readController, (int control, unsigned char* command), (control, command))
+
+static unsigned int guarded_rsp_doRspCycles(unsigned int cycles)
+{
+    unsigned int ret = l_rsp_impl.doRspCycles(cycles);
+    restore_rounding_mode();
+    return ret;
+}
+
+/* optional entry points stay NULL */
+#define GUARD(impl, field) \
+    if (impl.field != NULL) impl.field = guarded_##impl##_##field
+
+static void guard_plugin_calls(m64p_plugin_type type)
+{
+    switch (type)
+    {
+    case M64PLUGIN_GFX:
+        l_gfx_impl = gfx;
+        GUARD(gfx, processDList);
+        GUARD(gfx, processRDPList);
+        GUARD(gfx, showCFB);
+        GUARD(gfx, updateScreen);
+        GUARD(gfx, viStatusChanged);
+        GUARD(gfx, viWidthChanged);
+        GUARD(gfx, fBRead);
+        GUARD(gfx, fBWrite);
+        GUARD(gfx, fBGetFrameBufferInfo);
+        break;
+    case M64PLUGIN_AUDIO:
+        l_audio_impl = audio;
+        GUARD(audio, aiDacrateChanged);
+        GUARD(audio, aiLenChanged);
+        GUARD(audio, processAList);
+        break;
+    case M64PLUGIN_INPUT:
+        l_input_impl = input;
+        GUARD(input, controllerCommand);
+        GUARD(input, getKeys);
+        GUARD(input, readController);
+        break;
+    case M64PLUGIN_RSP:
+        l_rsp_impl = rsp;
+        GUARD(rsp, doRspCycles);
+        break;
+    default:
+        break;
+    }
+}
+
 static void plugin_disconnect_gfx(void)
 {
     gfx = dummy_gfx;
@@ -267,6 +359,7 @@ static void plugin_disconnect_audio(void)
 {
     audio = dummy_audio;
     l_AudioAttached = 0;
+    l_AudioCapabilities = 0;
 }
 
 static m64p_error plugin_connect_audio(m64p_dynlib_handle plugin_handle)
@@ -276,6 +369,7 @@ static m64p_error plugin_connect_audio(m64p_dynlib_handle plugin_handle)
     {
         m64p_plugin_type PluginType;
         int PluginVersion, APIVersion;
+        int Capabilities = 0;
 
         if (l_AudioAttached)
             return M64ERR_INVALID_STATE;
@@ -301,7 +395,7 @@ static m64p_error plugin_connect_audio(m64p_dynlib_handle plugin_handle)
         }
 
         /* check the version info */
-        (*audio.getVersion)(&PluginType, &PluginVersion, &APIVersion, NULL, NULL);
+        (*audio.getVersion)(&PluginType, &PluginVersion, &APIVersion, NULL, &Capabilities);
         if (PluginType != M64PLUGIN_AUDIO || (APIVersion & 0xffff0000) != (AUDIO_API_VERSION & 0xffff0000))
         {
             DebugMessage(M64MSG_ERROR, "incompatible Audio plugin");
@@ -309,6 +403,7 @@ static m64p_error plugin_connect_audio(m64p_dynlib_handle plugin_handle)
             return M64ERR_INCOMPATIBLE;
         }
 
+        l_AudioCapabilities = Capabilities;
         l_AudioAttached = 1;
     }
     else
@@ -332,6 +427,33 @@ static m64p_error plugin_start_audio(void)
     audio_info.AI_BITRATE_REG = &(g_dev.ai.regs[AI_BITRATE_REG]);
     audio_info.CheckInterrupts = EmptyFunc;
 
+    /* a plugin fed from the audio thread gets its own view of samples and AI registers,
+     * so it never reads emulator state concurrently with the emulation thread.
+     * Its other functions keep being called from other threads, so the
+     * plugin has to say it copes with that. */
+    l_AudioThreaded = ConfigGetParamBool(g_CoreConfig, "AudioThread");
+    if (l_AudioThreaded && !(l_AudioCapabilities & M64P_AUDIO_CAPS_THREADED))
+    {
+        DebugMessage(M64MSG_WARNING, "Audio plugin does not support AudioThread, feeding it from the emulation thread");
+        l_AudioThreaded = 0;
+    }
+
+    /* the wrappers restoring the rounding mode must run on the emulation thread */
+    if (l_audio_impl.aiDacrateChanged != NULL)
+        audio.aiDacrateChanged = l_AudioThreaded ? l_audio_impl.aiDacrateChanged : guarded_audio_aiDacrateChanged;
+    if (l_audio_impl.aiLenChanged != NULL)
+        audio.aiLenChanged = l_AudioThreaded ? l_audio_impl.aiLenChanged : guarded_audio_aiLenChanged;
+
+    if (l_AudioThreaded)
+    {
+        audio_info.RDRAM = g_async_audio_ring;
+        audio_info.AI_DRAM_ADDR_REG = &g_threaded_audio_plugin_regs[AI_DRAM_ADDR_REG];
+        audio_info.AI_LEN_REG = &g_threaded_audio_plugin_regs[AI_LEN_REG];
+        audio_info.AI_CONTROL_REG = &g_threaded_audio_plugin_regs[AI_CONTROL_REG];
+        audio_info.AI_DACRATE_REG = &g_threaded_audio_plugin_regs[AI_DACRATE_REG];
+        audio_info.AI_BITRATE_REG = &g_threaded_audio_plugin_regs[AI_BITRATE_REG];
+    }
+
     /* call the audio plugin */
     if (!audio.initiateAudio(audio_info))
         return M64ERR_PLUGIN_FAIL;
@@ -502,27 +624,35 @@ static m64p_error plugin_start_rsp(void)
 /* global functions */
 m64p_error plugin_connect(m64p_plugin_type type, m64p_dynlib_handle plugin_handle)
 {
+    m64p_error rval;
+
     switch(type)
     {
         case M64PLUGIN_GFX:
             if (plugin_handle != NULL && (l_AudioAttached || l_InputAttached || l_RspAttached))
                 DebugMessage(M64MSG_WARNING, "Front-end bug: plugins are attached in wrong order.");
-            return plugin_connect_gfx(plugin_handle);
+            rval = plugin_connect_gfx(plugin_handle);
+            break;
         case M64PLUGIN_AUDIO:
             if (plugin_handle != NULL && (l_InputAttached || l_RspAttached))
                 DebugMessage(M64MSG_WARNING, "Front-end bug: plugins are attached in wrong order.");
-            return plugin_connect_audio(plugin_handle);
+            rval = plugin_connect_audio(plugin_handle);
+            break;
         case M64PLUGIN_INPUT:
             if (plugin_handle != NULL && (l_RspAttached))
                 DebugMessage(M64MSG_WARNING, "Front-end bug: plugins are attached in wrong order.");
-            return plugin_connect_input(plugin_handle);
+            rval = plugin_connect_input(plugin_handle);
+            break;
         case M64PLUGIN_RSP:
-            return plugin_connect_rsp(plugin_handle);
+            rval = plugin_connect_rsp(plugin_handle);
+            break;
         default:
             return M64ERR_INPUT_INVALID;
     }
 
-    return M64ERR_INTERNAL;
+    /* the dummy plugins left on failure are wrapped as well */
+    guard_plugin_calls(type);
+    return rval;
 }
 
 m64p_error plugin_start(m64p_plugin_type type)
@@ -544,6 +674,11 @@ m64p_error plugin_start(m64p_plugin_type type)
     return M64ERR_INTERNAL;
 }
 
+int plugin_audio_threaded(void)
+{
+    return l_AudioAttached && l_AudioThreaded;
+}
+
 m64p_error plugin_check(void)
 {
     if (!l_GfxAttached)
@@ -31,6 +31,9 @@ extern m64p_error plugin_connect(m64p_plugin_type, m64p_dynlib_handle plugin_han
 extern m64p_error plugin_start(m64p_plugin_type);
 extern m64p_error plugin_check(void);
 
+/* audio plugin was started to be fed from the audio thread */
+extern int plugin_audio_threaded(void);
+
 extern CONTROL Controls[4];
 
 /*** Version requirement information ***/
@@ -0,0 +1,379 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - core_bench.c                                            *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Headless benchmark of the core: runs a ROM from a savestate for a fixed
+ * number of VIs with the dummy plugins, optionally playing back an .m64
+ * input file, and prints one line of JSON with the results:
+ *   vis_per_second       VIs emulated per second of host time
+ *   ns_per_instruction   host time per guest instruction actually executed
+ *                        (Count cycles skipped over polling loops excluded)
+ *   compile_ms           time spent compiling guest code while measuring
+ *   max_rss_kb           memory high-water mark of the process
+ * Timing starts at the first VI after the savestate is loaded, so boot and
+ * state loading are not measured. Run one process per emulator mode so the
+ * memory high-water marks do not mix.
+ *
+ * The dummy input plugin only connects controller 1, so only the first
+ * controller of the .m64 file is played back, one input per VI.
+ *
+ * Build and run through the 'bench' target of projects/unix/Makefile.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#define M64P_CORE_PROTOTYPES 1
+#include "m64p_types.h"
+#include "m64p_common.h"
+#include "m64p_config.h"
+#include "m64p_debugger.h"
+#include "m64p_frontend.h"
+
+#define BENCH_FRONTEND_API_VERSION 0x020200
+#define BENCH_DEFAULT_VIS 3000
+#define M64_CONTROLLER_FLAGS_OFFSET 0x20
+
+static int l_Verbose = 0;
+static volatile int l_StateLoaded = 0;
+
+static unsigned int l_ViTarget = BENCH_DEFAULT_VIS;
+static unsigned int l_ViMeasured = 0;
+static int l_Done = 0;
+
+static uint32_t* l_Cp0Regs = NULL;
+static uint32_t l_LastCount = 0;
+static unsigned long long l_GuestCycles = 0;
+
+static double l_StartTime = 0.0;
+static double l_EndTime = 0.0;
+static m64p_run_stats l_StartStats;
+static m64p_run_stats l_EndStats;
+
+static uint32_t* l_Inputs = NULL;
+static size_t l_InputCount = 0;
+static size_t l_InputPos = 0;
+static unsigned int l_InputStride = 1;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *read_file(const char* path, size_t* size)
+{
+    FILE* f = fopen(path, "rb");
+    void* data = NULL;
+    long length;
+
+    if (f == NULL)
+        return NULL;
+
+    if (fseek(f, 0, SEEK_END) == 0 && (length = ftell(f)) > 0 && fseek(f, 0, SEEK_SET) == 0)
+    {
+        data = malloc(length);
+        if (data != NULL && fread(data, 1, length, f) != (size_t)length)
+        {
+            free(data);
+            data = NULL;
+        }
+        *size = length;
+    }
+
+    fclose(f);
+    return data;
+}
+
+static int load_m64(const char* path)
+{
+    size_t size = 0;
+    uint8_t* data = (uint8_t*)read_file(path, &size);
+    size_t header_size;
+    uint32_t version;
+    uint32_t flags;
+    unsigned int i;
+
+    if (data == NULL || size < 0x200 || memcmp(data, "M64\x1a", 4) != 0)
+    {
+        free(data);
+        return -1;
+    }
+
+    memcpy(&version, data + 4, sizeof(version));
+    header_size = (version == 3) ? 0x400 : 0x200;
+    if (size < header_size)
+    {
+        free(data);
+        return -1;
+    }
+
+    /* inputs are interleaved, one word per connected controller */
+    memcpy(&flags, data + M64_CONTROLLER_FLAGS_OFFSET, sizeof(flags));
+    l_InputStride = 0;
+    for (i = 0; i < 4; ++i)
+        l_InputStride += (flags >> i) & 1;
+    if (l_InputStride == 0)
+        l_InputStride = 1;
+
+    l_InputCount = (size - header_size) / sizeof(uint32_t);
+    l_Inputs = (uint32_t*)malloc(l_InputCount * sizeof(uint32_t));
+    if (l_Inputs == NULL)
+    {
+        free(data);
+        return -1;
+    }
+    memcpy(l_Inputs, data + header_size, l_InputCount * sizeof(uint32_t));
+
+    free(data);
+    return 0;
+}
+
+static void feed_input(void)
+{
+    uint32_t keys[4] = { 0, 0, 0, 0 };
+
+    if (l_Inputs == NULL)
+        return;
+
+    if (l_InputPos + l_InputStride <= l_InputCount)
+    {
+        keys[0] = l_Inputs[l_InputPos];
+        l_InputPos += l_InputStride;
+    }
+
+    CoreDoCommand(M64CMD_SET_INPUT_SNAPSHOT, 1, keys);
+}
+
+static void vi_callback(unsigned int vi)
+{
+    uint32_t count;
+
+    (void)vi;
+
+    if (!l_StateLoaded || l_Done)
+        return;
+
+    count = l_Cp0Regs[9]; /* CP0 Count */
+
+    if (l_ViMeasured == 0)
+    {
+        CoreDoCommand(M64CMD_GET_RUN_STATS, 0, &l_StartStats);
+        l_StartTime = now();
+    }
+    else
+    {
+        l_GuestCycles += (uint32_t)(count - l_LastCount);
+    }
+    l_LastCount = count;
+
+    if (l_ViMeasured++ == l_ViTarget)
+    {
+        l_EndTime = now();
+        CoreDoCommand(M64CMD_GET_RUN_STATS, 0, &l_EndStats);
+        l_Done = 1;
+        CoreDoCommand(M64CMD_STOP, 0, NULL);
+        return;
+    }
+
+    feed_input();
+}
+
+static void debug_callback(void* context, int level, const char* message)
+{
+    (void)context;
+
+    if (level <= M64MSG_WARNING || l_Verbose)
+        fprintf(stderr, "core: %s\n", message);
+}
+
+static void state_callback(void* context, m64p_core_param param, int value)
+{
+    (void)context;
+
+    if (param == M64CORE_STATE_LOADCOMPLETE && value)
+        l_StateLoaded = 1;
+}
+
+static void print_json_string(const char* s)
+{
+    putchar('"');
+    for (; *s != '\0'; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+            putchar('\\');
+        if ((unsigned char)*s >= 0x20)
+            putchar(*s);
+    }
+    putchar('"');
+}
+
+static void print_results(const char* rom_path, int emumode)
+{
+    struct rusage usage;
+    double seconds = l_EndTime - l_StartTime;
+    unsigned int count_per_op = (l_EndStats.count_per_op != 0) ? l_EndStats.count_per_op : 1;
+    unsigned long long skipped = l_EndStats.idle_skipped_cycles - l_StartStats.idle_skipped_cycles;
+    unsigned long long instructions = (l_GuestCycles > skipped) ? (l_GuestCycles - skipped) / count_per_op : 0;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("{\"rom\":");
+    print_json_string(rom_path);
+    printf(",\"emumode\":%d,\"vis\":%u,\"seconds\":%.6f,\"vis_per_second\":%.3f", emumode, l_ViTarget, seconds, l_ViTarget / seconds);
+    printf(",\"guest_cycles\":%llu,\"skipped_cycles\":%llu,\"guest_instructions\":%llu", l_GuestCycles, skipped, instructions);
+    printf(",\"ns_per_instruction\":%.4f", (instructions != 0) ? seconds * 1e9 / instructions : 0.0);
+    printf(",\"compile_ms\":%.3f", (l_EndStats.compile_ns - l_StartStats.compile_ns) * 1e-6);
+    if (l_EndStats.dynarec_cache_size != 0)
+        printf(",\"dynarec_misses\":%u,\"dynarec_evictions\":%u,\"dynarec_kept\":%u",
+               l_EndStats.dynarec_misses - l_StartStats.dynarec_misses,
+               l_EndStats.dynarec_evictions - l_StartStats.dynarec_evictions,
+               l_EndStats.dynarec_kept - l_StartStats.dynarec_kept);
+    printf(",\"max_rss_kb\":%ld}\n", usage.ru_maxrss);
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s --rom <file> --state <file> [options]\n"
+                    "  --m64 <file>       play back controller 1 of this .m64 file\n"
+                    "  --vis <n>          number of VIs to measure (default %d)\n"
+                    "  --emumode <n>      0 pure interpreter, 1 cached interpreter, 2 dynarec\n"
+                    "  --configdir <dir>  configuration directory (default: user's)\n"
+                    "  --datadir <dir>    directory of mupen64plus.ini\n"
+                    "  --verbose          print all core messages\n",
+                    name, BENCH_DEFAULT_VIS);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* rom_path = NULL;
+    const char* state_path = NULL;
+    const char* m64_path = NULL;
+    const char* config_dir = NULL;
+    const char* data_dir = NULL;
+    int emumode = 2;
+    int zero = 0;
+    m64p_handle core_section;
+    int core_api = 0;
+    void* rom;
+    size_t rom_size = 0;
+    int i;
+
+    for (i = 1; i < argc; ++i)
+    {
+        int has_value = (i + 1 < argc);
+
+        if (strcmp(argv[i], "--rom") == 0 && has_value)
+            rom_path = argv[++i];
+        else if (strcmp(argv[i], "--state") == 0 && has_value)
+            state_path = argv[++i];
+        else if (strcmp(argv[i], "--m64") == 0 && has_value)
+            m64_path = argv[++i];
+        else if (strcmp(argv[i], "--vis") == 0 && has_value)
+            l_ViTarget = (unsigned int)strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--emumode") == 0 && has_value)
+            emumode = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--configdir") == 0 && has_value)
+            config_dir = argv[++i];
+        else if (strcmp(argv[i], "--datadir") == 0 && has_value)
+            data_dir = argv[++i];
+        else if (strcmp(argv[i], "--verbose") == 0)
+            l_Verbose = 1;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (rom_path == NULL || state_path == NULL || l_ViTarget == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (m64_path != NULL && load_m64(m64_path) < 0)
+    {
+        fprintf(stderr, "Could not read input file %s\n", m64_path);
+        return 2;
+    }
+
+    rom = read_file(rom_path, &rom_size);
+    if (rom == NULL)
+    {
+        fprintf(stderr, "Could not read ROM file %s\n", rom_path);
+        return 2;
+    }
+
+    if (CoreStartup(BENCH_FRONTEND_API_VERSION, config_dir, data_dir, NULL, NULL,
+                    debug_callback, NULL, state_callback) != M64ERR_SUCCESS)
+    {
+        fprintf(stderr, "Could not start the core\n");
+        return 3;
+    }
+
+    /* the VI callback, input snapshots and run stats need a 2.2.0 core */
+    PluginGetVersion(NULL, NULL, &core_api, NULL, NULL);
+    if (core_api < BENCH_FRONTEND_API_VERSION)
+    {
+        fprintf(stderr, "The core's Front-end API version %d.%d.%d is too old\n",
+                (core_api >> 16) & 0xffff, (core_api >> 8) & 0xff, core_api & 0xff);
+        CoreShutdown();
+        return 3;
+    }
+
+    /* settings are only changed in memory, the configuration file is never saved */
+    ConfigOpenSection("Core", &core_section);
+    ConfigSetParameter(core_section, "R4300Emulator", M64TYPE_INT, &emumode);
+    ConfigSetParameter(core_section, "OnScreenDisplay", M64TYPE_BOOL, &zero);
+
+    if (CoreDoCommand(M64CMD_ROM_OPEN, (int)rom_size, rom) != M64ERR_SUCCESS)
+    {
+        fprintf(stderr, "Could not open ROM %s\n", rom_path);
+        CoreShutdown();
+        return 3;
+    }
+    free(rom);
+
+    l_Cp0Regs = (uint32_t*)DebugGetCPUDataPtr(M64P_CPU_REG_COP0);
+
+    CoreDoCommand(M64CMD_CORE_STATE_SET, M64CORE_SPEED_LIMITER, &zero);
+    CoreDoCommand(M64CMD_SET_VI_CALLBACK, 0, (void*)vi_callback);
+    CoreDoCommand(M64CMD_STATE_LOAD, 0, (void*)state_path);
+    CoreDoCommand(M64CMD_EXECUTE, 0, NULL);
+
+    CoreDoCommand(M64CMD_ROM_CLOSE, 0, NULL);
+    CoreShutdown();
+    free(l_Inputs);
+
+    if (!l_Done)
+    {
+        fprintf(stderr, "Emulation stopped after %u of %u VIs\n", l_ViMeasured, l_ViTarget);
+        return 4;
+    }
+
+    print_results(rom_path, emumode);
+    return 0;
+}
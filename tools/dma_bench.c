@@ -0,0 +1,124 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - dma_bench.c                                             *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Micro-benchmark of the RDRAM DMA copy kernel against the byte loop
+ * it replaces, over the transfer sizes seen in practice
+ * (SP DMA rows of 8 bytes up to PI loads of a few MB).
+ *
+ * Build from the tools directory with:
+ *   gcc -O3 -I../src -o dma_bench dma_bench.c ../src/device/memory/dma_copy.c
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "device/memory/dma_copy.h"
+
+#define BUFFER_SIZE (8 * 1024 * 1024)
+
+static uint8_t* src;
+static uint8_t* dst;
+static uint8_t* ref;
+
+static void byte_copy(uint8_t* d, uint32_t d_addr, const uint8_t* s, uint32_t s_addr, size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length; ++i)
+        d[(d_addr+i)^3] = s[(s_addr+i)^3];
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double bench(void (*copy)(uint8_t*, uint32_t, const uint8_t*, uint32_t, size_t),
+                    uint32_t d_addr, uint32_t s_addr, size_t length)
+{
+    size_t iterations = (64 * 1024 * 1024) / length + 1;
+    size_t i;
+    double start;
+
+    start = now();
+    for (i = 0; i < iterations; ++i)
+        copy(dst, d_addr, src, s_addr, length);
+
+    /* MB/s */
+    return ((double)length * iterations) / (now() - start) / (1024.0 * 1024.0);
+}
+
+int main(void)
+{
+    static const size_t sizes[] = { 8, 64, 256, 1024, 4096, 16384, 65536, 1024 * 1024, 4 * 1024 * 1024 };
+    static const uint32_t offsets[][2] = { { 0, 0 }, { 2, 2 }, { 0, 2 }, { 1, 0 } };
+    size_t i, j;
+
+    src = malloc(BUFFER_SIZE + 16);
+    dst = malloc(BUFFER_SIZE + 16);
+    ref = malloc(BUFFER_SIZE + 16);
+
+    if (src == NULL || dst == NULL || ref == NULL)
+        return 1;
+
+    for (i = 0; i < BUFFER_SIZE + 16; ++i)
+        src[i] = (uint8_t)rand();
+
+    printf("size,dst_offset,src_offset,byte_loop_MBps,dma_copy_MBps\n");
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+    {
+        for (j = 0; j < sizeof(offsets) / sizeof(offsets[0]); ++j)
+        {
+            uint32_t d_addr = offsets[j][0];
+            uint32_t s_addr = offsets[j][1];
+            double byte_rate, dma_rate;
+
+            /* check result before timing */
+            memset(dst, 0, BUFFER_SIZE + 16);
+            memset(ref, 0, BUFFER_SIZE + 16);
+            dma_copy(dst, d_addr, src, s_addr, sizes[i]);
+            byte_copy(ref, d_addr, src, s_addr, sizes[i]);
+            if (memcmp(dst, ref, BUFFER_SIZE + 16) != 0)
+            {
+                fprintf(stderr, "mismatch: size=%u dst=%u src=%u\n",
+                        (unsigned int)sizes[i], d_addr, s_addr);
+                return 1;
+            }
+
+            byte_rate = bench(byte_copy, d_addr, s_addr, sizes[i]);
+            dma_rate = bench(dma_copy, d_addr, s_addr, sizes[i]);
+
+            printf("%u,%u,%u,%.1f,%.1f\n", (unsigned int)sizes[i], d_addr, s_addr, byte_rate, dma_rate);
+        }
+    }
+
+    free(src);
+    free(dst);
+    free(ref);
+
+    return 0;
+}
@@ -0,0 +1,165 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - fpu_rounding_test.c                                     *
+ *   Mupen64Plus homepage: http://code.google.com/p/mupen64plus/           *
+ *   Copyright (C) 2016 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Checks that every FCR31 rounding mode is honoured by the COP1 code of
+ * each emulator mode, both right after FCR31 is set (as by CTC1 or a
+ * savestate load) and after a plugin call has left the host FPU in another
+ * rounding mode and plugin.c has restored it.
+ *
+ * The interpreters round through set_rounding() in fpu.h; the x86-64
+ * dynarec rounds through MXCSR, which is checked with the same SSE2 scalar
+ * operations the generated code uses.
+ *
+ * Build from the tools directory with:
+ *   gcc -O2 -I../src -o fpu_rounding_test fpu_rounding_test.c ../src/device/r4300/cp1.c -lm
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "device/device.h"
+#include "device/r4300/cp1.h"
+#include "device/r4300/fpu.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define HAVE_SSE_DYNAREC 1
+#endif
+
+struct device g_dev;
+
+static const char* const mode_names[] = { "nearest", "trunc", "up", "down" };
+static const char* const emumode_names[] = { "pure interpreter", "cached interpreter", "dynarec" };
+
+/* x / 3 rounded to float with FCR31 mode, computed without the host FPU
+ * rounding mode: the float neighbours of the exact quotient, then the
+ * choice the mode makes between them. */
+static float expected_div3(float x, int mode)
+{
+    double q = (double)x / 3.0;
+    float lo = (float)q;
+    float hi;
+
+    if ((double)lo > q)
+        lo = nextafterf(lo, -INFINITY);
+    hi = nextafterf(lo, INFINITY);
+
+    switch (mode)
+    {
+    case 0: return (q - lo < hi - q) ? lo : hi;
+    case 1: return (x >= 0) ? lo : hi;
+    case 2: return hi;
+    default: return lo;
+    }
+}
+
+static float run_div3(float x, unsigned int emumode)
+{
+    const float three = 3.0f;
+    float result;
+
+#ifdef HAVE_SSE_DYNAREC
+    if (emumode == EMUMODE_DYNAREC)
+        return _mm_cvtss_f32(_mm_div_ss(_mm_set_ss(x), _mm_set_ss(three)));
+#endif
+
+    div_s(&x, &three, &result);
+    return result;
+}
+
+/* what a plugin is free to do to the host FPU between two COP1 ops */
+static void plugin_call(int mode)
+{
+    static const int host_modes[] = { FE_TONEAREST, FE_TOWARDZERO, FE_UPWARD, FE_DOWNWARD };
+    fesetround(host_modes[(mode + 2) & 3]);
+}
+
+/* the tail of every wrapped plugin call in plugin.c */
+static void plugin_return(void)
+{
+    invalidate_host_rounding_mode();
+    apply_sse_rounding_mode();
+}
+
+static int check(unsigned int emumode, int mode, const char* when)
+{
+    static const float inputs[] = { 1.0f, -1.0f, 2.0f, -7.0f };
+    int failures = 0;
+    size_t i;
+
+    for (i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i)
+    {
+        float got = run_div3(inputs[i], emumode);
+        float want = expected_div3(inputs[i], mode);
+
+        if (got != want)
+        {
+            fprintf(stderr, "FAIL %s, %s, %s: %g / 3 = %.9g, expected %.9g\n",
+                    emumode_names[emumode], mode_names[mode], when,
+                    inputs[i], got, want);
+            ++failures;
+        }
+    }
+
+    return failures;
+}
+
+int main(void)
+{
+    unsigned int emumode;
+    int mode;
+    int failures = 0;
+
+    poweron_cp1(&g_dev.r4300.cp1);
+
+    for (emumode = EMUMODE_PURE_INTERPRETER; emumode <= EMUMODE_DYNAREC; ++emumode)
+    {
+#ifndef HAVE_SSE_DYNAREC
+        if (emumode == EMUMODE_DYNAREC)
+        {
+            printf("skipping %s: not an x86-64 host\n", emumode_names[emumode]);
+            continue;
+        }
+#endif
+        for (mode = 0; mode < 4; ++mode)
+        {
+            *r4300_cp1_fcr31() = (uint32_t)mode;
+            update_x86_rounding_mode(*r4300_cp1_fcr31());
+            failures += check(emumode, mode, "after FCR31 write");
+
+            plugin_call(mode);
+            plugin_return();
+            failures += check(emumode, mode, "after plugin call");
+        }
+    }
+
+    fesetround(FE_TONEAREST);
+
+    if (failures != 0)
+    {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+
+    printf("all rounding modes ok\n");
+    return 0;
+}